@@ -0,0 +1,519 @@
+#include "alignment.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::size_t kByteLanes = 32; ///< 8-bit scores per AVX2 vector.
+constexpr std::size_t kWordLanes = 16; ///< 16-bit scores per AVX2 vector.
+constexpr std::int64_t kWordLimit = 32000; ///< The largest score magnitude trusted to 16-bit lanes.
+
+/**
+ * @brief Builds the table from a character to its two-bit code.
+ * @return The table: A=0, C=1, G=2, T and U=3.
+ */
+constexpr std::array<std::uint8_t, 256> letterTable() {
+    std::array<std::uint8_t, 256> table{};
+    table['C'] = 1;
+    table['G'] = 2;
+    table['T'] = 3;
+    table['U'] = 3;
+    return table;
+}
+
+constexpr std::array<std::uint8_t, 256> kLetters = letterTable(); ///< Two-bit code of every letter.
+
+/**
+ * @struct StripedInput
+ * @brief What a striped kernel needs: a profile laid out for its lane width and a target.
+ */
+struct StripedInput {
+    const void* profile; ///< Per code and segment, one vector of scores.
+    std::size_t segments; ///< The segment length.
+    std::size_t querySize; ///< The number of query bases.
+    const std::uint8_t* target; ///< The target's two-bit codes.
+    std::size_t targetSize; ///< The number of target bases.
+    const AlignmentScoring* scoring; ///< The scores.
+};
+
+/**
+ * @brief Scalar kernel: Gotoh's recurrences one cell at a time in 64-bit scores.
+ * @param query The query's two-bit codes.
+ * @param querySize The number of query bases.
+ * @param target The target's two-bit codes.
+ * @param targetSize The number of target bases.
+ * @param scoring The scores.
+ * @param global True for a global alignment, false for a local one.
+ * @return The score and, for a local alignment, where it ends.
+ */
+AlignmentResult alignScalar(const std::uint8_t* query, std::size_t querySize, const std::uint8_t* target,
+                            std::size_t targetSize, const AlignmentScoring& scoring, bool global) {
+    const std::int64_t open = scoring.gapOpen;
+    const std::int64_t extend = scoring.gapExtend;
+    const std::int64_t negative = std::numeric_limits<std::int64_t>::min() / 4;
+    // h[i] and e[i] hold column j - 1 until row i of column j replaces them
+    std::vector<std::int64_t> h(querySize + 1, 0);
+    std::vector<std::int64_t> e(querySize + 1, negative);
+    if (global) {
+        for (std::size_t i = 1; i <= querySize; ++i) {
+            h[i] = -(open + static_cast<std::int64_t>(i - 1) * extend);
+        }
+    }
+    AlignmentResult result{0, 0, 0};
+    for (std::size_t j = 1; j <= targetSize; ++j) {
+        std::int64_t diagonal = h[0];
+        h[0] = global ? -(open + static_cast<std::int64_t>(j - 1) * extend) : 0;
+        std::int64_t f = negative;
+        const std::uint8_t base = target[j - 1];
+        for (std::size_t i = 1; i <= querySize; ++i) {
+            e[i] = std::max(e[i] - extend, h[i] - open);
+            f = std::max(f - extend, h[i - 1] - open);
+            std::int64_t cell = diagonal + (query[i - 1] == base ? scoring.match : -scoring.mismatch);
+            cell = std::max({cell, e[i], f});
+            if (!global) {
+                cell = std::max<std::int64_t>(cell, 0);
+                if (cell > result.score) {
+                    result = AlignmentResult{cell, i - 1, j - 1};
+                }
+            }
+            diagonal = h[i];
+            h[i] = cell;
+        }
+    }
+    if (global) {
+        result.score = h[querySize];
+    }
+    return result;
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @brief Moves every byte one lane up across the whole vector, shifting in 0.
+ * @param v The vector.
+ * @return The shifted vector.
+ */
+__attribute__((target("avx2")))
+inline __m256i shiftBytes(__m256i v) {
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 15);
+}
+
+/**
+ * @brief Moves every word one lane up across the whole vector, shifting in 0.
+ * @param v The vector.
+ * @return The shifted vector.
+ */
+__attribute__((target("avx2")))
+inline __m256i shiftWords(__m256i v) {
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 14);
+}
+
+/**
+ * @brief Getter for the largest of 32 unsigned bytes.
+ * @param v The vector.
+ * @return The largest byte.
+ */
+__attribute__((target("avx2")))
+inline int maxByte(__m256i v) {
+    __m128i m = _mm_max_epu8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+    return _mm_extract_epi8(m, 0);
+}
+
+/**
+ * @brief Getter for the largest of 16 signed words.
+ * @param v The vector.
+ * @return The largest word.
+ */
+__attribute__((target("avx2")))
+inline int maxWord(__m256i v) {
+    __m128i m = _mm_max_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 8));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epi16(m, _mm_srli_si128(m, 2));
+    return static_cast<std::int16_t>(_mm_extract_epi16(m, 0));
+}
+
+/**
+ * @brief Loads segment s of a striped array.
+ * @param base The array.
+ * @param s The segment.
+ * @return The vector.
+ */
+__attribute__((target("avx2")))
+inline __m256i loadSegment(const void* base, std::size_t s) {
+    return _mm256_loadu_si256(static_cast<const __m256i*>(base) + s);
+}
+
+/**
+ * @brief Stores segment s of a striped array.
+ * @param base The array.
+ * @param s The segment.
+ * @param v The vector.
+ */
+__attribute__((target("avx2")))
+inline void storeSegment(void* base, std::size_t s, __m256i v) {
+    _mm256_storeu_si256(static_cast<__m256i*>(base) + s, v);
+}
+
+/**
+ * @brief Finds the first query base of a striped column holding a score.
+ * @param column The column, segments vectors of lanes scores.
+ * @param segments The segment length.
+ * @param score The score.
+ * @return The query index.
+ */
+template <typename Score, std::size_t lanes>
+std::size_t stripedIndexOf(const Score* column, std::size_t segments, int score) {
+    std::size_t index = std::numeric_limits<std::size_t>::max();
+    for (std::size_t s = 0; s < segments; ++s) {
+        for (std::size_t lane = 0; lane < lanes; ++lane) {
+            if (column[s * lanes + lane] == score) {
+                index = std::min(index, lane * segments + s);
+            }
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief Local kernel in 32 lanes of unsigned saturating bytes; scores carry a bias so they stay non-negative.
+ * @param input The biased byte profile and the target.
+ * @param result Receives the score and ends.
+ * @return False when the score grew too high for bytes.
+ */
+__attribute__((target("avx2")))
+bool localBytes(const StripedInput& input, AlignmentResult& result) {
+    const std::size_t segments = input.segments;
+    const auto* profile = static_cast<const std::uint8_t*>(input.profile);
+    const __m256i gapOpen = _mm256_set1_epi8(static_cast<char>(input.scoring->gapOpen));
+    const __m256i gapExtend = _mm256_set1_epi8(static_cast<char>(input.scoring->gapExtend));
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(input.scoring->mismatch));
+    const __m256i zero = _mm256_setzero_si256();
+    // A cell plus the largest profile entry must stay below 255
+    const int limit = 255 - input.scoring->mismatch - input.scoring->match;
+    const std::size_t stride = segments * kByteLanes;
+    std::vector<std::uint8_t> buffer(4 * stride, 0);
+    std::uint8_t* store = buffer.data();
+    std::uint8_t* load = store + stride;
+    std::uint8_t* gaps = load + stride;
+    std::uint8_t* best = gaps + stride;
+    int bestScore = 0;
+    std::size_t bestColumn = 0;
+    for (std::size_t j = 0; j < input.targetSize; ++j) {
+        const std::uint8_t* scores = profile + input.target[j] * stride;
+        __m256i f = zero;
+        __m256i columnMax = zero;
+        __m256i h = shiftBytes(loadSegment(store, segments - 1));
+        std::swap(store, load);
+        for (std::size_t s = 0; s < segments; ++s) {
+            h = _mm256_subs_epu8(_mm256_adds_epu8(h, loadSegment(scores, s)), bias);
+            __m256i e = loadSegment(gaps, s);
+            h = _mm256_max_epu8(_mm256_max_epu8(h, e), f);
+            columnMax = _mm256_max_epu8(columnMax, h);
+            storeSegment(store, s, h);
+            __m256i opened = _mm256_subs_epu8(h, gapOpen);
+            storeSegment(gaps, s, _mm256_max_epu8(_mm256_subs_epu8(e, gapExtend), opened));
+            f = _mm256_max_epu8(_mm256_subs_epu8(f, gapExtend), opened);
+            h = loadSegment(load, s);
+        }
+        // Vertical gaps leaving the end of one lane's segment continue at the start of the next lane's
+        f = shiftBytes(f);
+        for (std::size_t s = 0;;) {
+            h = loadSegment(store, s);
+            __m256i above = _mm256_subs_epu8(f, _mm256_subs_epu8(h, gapOpen));
+            if (_mm256_testz_si256(above, above)) {
+                break;
+            }
+            h = _mm256_max_epu8(h, f);
+            storeSegment(store, s, h);
+            storeSegment(gaps, s, _mm256_max_epu8(loadSegment(gaps, s), _mm256_subs_epu8(h, gapOpen)));
+            f = _mm256_subs_epu8(f, gapExtend);
+            if (++s == segments) {
+                s = 0;
+                f = shiftBytes(f);
+            }
+        }
+        int column = maxByte(columnMax);
+        if (column > bestScore) {
+            if (column > limit) {
+                return false;
+            }
+            bestScore = column;
+            bestColumn = j;
+            std::memcpy(best, store, stride);
+        }
+    }
+    result = AlignmentResult{bestScore, 0, 0};
+    if (bestScore > 0) {
+        result.queryEnd = stripedIndexOf<std::uint8_t, kByteLanes>(best, segments, bestScore);
+        result.targetEnd = bestColumn;
+    }
+    return true;
+}
+
+/**
+ * @brief Local kernel in 16 lanes of signed saturating words.
+ * @param input The word profile and the target.
+ * @param result Receives the score and ends.
+ * @return False when the score grew too high for words.
+ */
+__attribute__((target("avx2")))
+bool localWords(const StripedInput& input, AlignmentResult& result) {
+    const std::size_t segments = input.segments;
+    const auto* profile = static_cast<const std::int16_t*>(input.profile);
+    const __m256i gapOpen = _mm256_set1_epi16(static_cast<short>(input.scoring->gapOpen));
+    const __m256i gapExtend = _mm256_set1_epi16(static_cast<short>(input.scoring->gapExtend));
+    const __m256i zero = _mm256_setzero_si256();
+    // Vertical gaps start below -inf so the lazy pass cannot loop on the 0 a shift brings in
+    const short negative = std::numeric_limits<std::int16_t>::min();
+    const int limit = std::numeric_limits<std::int16_t>::max() - input.scoring->match;
+    const std::size_t stride = segments * kWordLanes;
+    std::vector<std::int16_t> buffer(4 * stride, 0);
+    std::int16_t* store = buffer.data();
+    std::int16_t* load = store + stride;
+    std::int16_t* gaps = load + stride;
+    std::int16_t* best = gaps + stride;
+    int bestScore = 0;
+    std::size_t bestColumn = 0;
+    for (std::size_t j = 0; j < input.targetSize; ++j) {
+        const std::int16_t* scores = profile + input.target[j] * stride;
+        __m256i f = _mm256_set1_epi16(negative);
+        __m256i columnMax = zero;
+        __m256i h = shiftWords(loadSegment(store, segments - 1));
+        std::swap(store, load);
+        for (std::size_t s = 0; s < segments; ++s) {
+            h = _mm256_max_epi16(_mm256_adds_epi16(h, loadSegment(scores, s)), zero);
+            __m256i e = loadSegment(gaps, s);
+            h = _mm256_max_epi16(_mm256_max_epi16(h, e), f);
+            columnMax = _mm256_max_epi16(columnMax, h);
+            storeSegment(store, s, h);
+            __m256i opened = _mm256_subs_epi16(h, gapOpen);
+            storeSegment(gaps, s, _mm256_max_epi16(_mm256_subs_epi16(e, gapExtend), opened));
+            f = _mm256_max_epi16(_mm256_subs_epi16(f, gapExtend), opened);
+            h = loadSegment(load, s);
+        }
+        f = _mm256_insert_epi16(shiftWords(f), negative, 0);
+        for (std::size_t s = 0;;) {
+            h = loadSegment(store, s);
+            if (!_mm256_movemask_epi8(_mm256_cmpgt_epi16(f, _mm256_subs_epi16(h, gapOpen)))) {
+                break;
+            }
+            h = _mm256_max_epi16(h, f);
+            storeSegment(store, s, h);
+            storeSegment(gaps, s, _mm256_max_epi16(loadSegment(gaps, s), _mm256_subs_epi16(h, gapOpen)));
+            f = _mm256_subs_epi16(f, gapExtend);
+            if (++s == segments) {
+                s = 0;
+                f = _mm256_insert_epi16(shiftWords(f), negative, 0);
+            }
+        }
+        int column = maxWord(columnMax);
+        if (column > bestScore) {
+            if (column > limit) {
+                return false;
+            }
+            bestScore = column;
+            bestColumn = j;
+            std::memcpy(best, store, stride * sizeof(std::int16_t));
+        }
+    }
+    result = AlignmentResult{bestScore, 0, 0};
+    if (bestScore > 0) {
+        result.queryEnd = stripedIndexOf<std::int16_t, kWordLanes>(best, segments, bestScore);
+        result.targetEnd = bestColumn;
+    }
+    return true;
+}
+
+/**
+ * @brief Global kernel in 16 lanes of signed saturating words; the caller checks that the lengths bound every score within them.
+ * @param input The word profile and the target.
+ * @param result Receives the score.
+ * @return True.
+ */
+__attribute__((target("avx2")))
+bool globalWords(const StripedInput& input, AlignmentResult& result) {
+    const std::size_t segments = input.segments;
+    const auto* profile = static_cast<const std::int16_t*>(input.profile);
+    const int open = input.scoring->gapOpen;
+    const int extend = input.scoring->gapExtend;
+    const __m256i gapOpen = _mm256_set1_epi16(static_cast<short>(open));
+    const __m256i gapExtend = _mm256_set1_epi16(static_cast<short>(extend));
+    const short negative = std::numeric_limits<std::int16_t>::min();
+    const std::size_t stride = segments * kWordLanes;
+    std::vector<std::int16_t> buffer(3 * stride, negative);
+    std::int16_t* store = buffer.data();
+    std::int16_t* load = store + stride;
+    std::int16_t* gaps = load + stride;
+    // Column 0 is a gap down the query
+    for (std::size_t s = 0; s < segments; ++s) {
+        for (std::size_t lane = 0; lane < kWordLanes; ++lane) {
+            store[s * kWordLanes + lane] = static_cast<std::int16_t>(-(open + static_cast<int>(lane * segments + s) * extend));
+        }
+    }
+    for (std::size_t j = 0; j < input.targetSize; ++j) {
+        const std::int16_t* scores = profile + input.target[j] * stride;
+        // Row 0 is a gap along the target
+        int corner = j == 0 ? 0 : -(open + static_cast<int>(j - 1) * extend);
+        int top = -(open + static_cast<int>(j) * extend);
+        __m256i f = _mm256_insert_epi16(_mm256_set1_epi16(negative), static_cast<short>(top - open), 0);
+        __m256i h = _mm256_insert_epi16(shiftWords(loadSegment(store, segments - 1)), static_cast<short>(corner), 0);
+        std::swap(store, load);
+        for (std::size_t s = 0; s < segments; ++s) {
+            h = _mm256_adds_epi16(h, loadSegment(scores, s));
+            __m256i e = loadSegment(gaps, s);
+            h = _mm256_max_epi16(_mm256_max_epi16(h, e), f);
+            storeSegment(store, s, h);
+            __m256i opened = _mm256_subs_epi16(h, gapOpen);
+            storeSegment(gaps, s, _mm256_max_epi16(_mm256_subs_epi16(e, gapExtend), opened));
+            f = _mm256_max_epi16(_mm256_subs_epi16(f, gapExtend), opened);
+            h = loadSegment(load, s);
+        }
+        f = _mm256_insert_epi16(shiftWords(f), negative, 0);
+        for (std::size_t s = 0;;) {
+            h = loadSegment(store, s);
+            if (!_mm256_movemask_epi8(_mm256_cmpgt_epi16(f, _mm256_subs_epi16(h, gapOpen)))) {
+                break;
+            }
+            h = _mm256_max_epi16(h, f);
+            storeSegment(store, s, h);
+            storeSegment(gaps, s, _mm256_max_epi16(loadSegment(gaps, s), _mm256_subs_epi16(h, gapOpen)));
+            f = _mm256_subs_epi16(f, gapExtend);
+            if (++s == segments) {
+                s = 0;
+                f = _mm256_insert_epi16(shiftWords(f), negative, 0);
+            }
+        }
+    }
+    std::size_t last = input.querySize - 1;
+    result = AlignmentResult{store[last % segments * kWordLanes + last / segments], 0, 0};
+    return true;
+}
+
+#endif
+
+/**
+ * @struct Kernel
+ * @brief The striped alignment kernels and their name; null kernels leave everything to the scalar code.
+ */
+struct Kernel {
+    bool (*localBytes)(const StripedInput&, AlignmentResult&); ///< Local alignment in 8-bit lanes.
+    bool (*localWords)(const StripedInput&, AlignmentResult&); ///< Local alignment in 16-bit lanes.
+    bool (*globalWords)(const StripedInput&, AlignmentResult&); ///< Global alignment in 16-bit lanes.
+    const char* name; ///< The name reported by alignmentKernel().
+};
+
+/**
+ * @brief Picks the widest kernels the CPU supports, once.
+ * @return The kernels.
+ */
+const Kernel& selectKernel() {
+    static const Kernel kernel = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel{localBytes, localWords, globalWords, "avx2"};
+        }
+#endif
+        return Kernel{nullptr, nullptr, nullptr, "scalar"};
+    }();
+    return kernel;
+}
+
+} // namespace
+
+/**
+ * @brief Builds the striped score profiles of a query.
+ * @param query The query's two-bit codes.
+ * @param scoring The scores.
+ */
+QueryProfile::QueryProfile(std::vector<std::uint8_t> query, const AlignmentScoring& scoring)
+    : query(std::move(query)), scoring(scoring), byteSegments((this->query.size() + kByteLanes - 1) / kByteLanes),
+      wordSegments((this->query.size() + kWordLanes - 1) / kWordLanes),
+      byteProfile(4 * byteSegments * kByteLanes), wordProfile(4 * wordSegments * kWordLanes) {
+    const std::size_t size = this->query.size();
+    for (std::uint8_t code = 0; code < 4; ++code) {
+        // Lane k of segment s holds query base k * segments + s; lanes past the end score 0
+        for (std::size_t s = 0; s < byteSegments; ++s) {
+            for (std::size_t lane = 0; lane < kByteLanes; ++lane) {
+                std::size_t i = lane * byteSegments + s;
+                int score = i >= size ? 0 : this->query[i] == code ? scoring.match : -scoring.mismatch;
+                byteProfile[(code * byteSegments + s) * kByteLanes + lane] = static_cast<std::uint8_t>(score + scoring.mismatch);
+            }
+        }
+        for (std::size_t s = 0; s < wordSegments; ++s) {
+            for (std::size_t lane = 0; lane < kWordLanes; ++lane) {
+                std::size_t i = lane * wordSegments + s;
+                int score = i >= size ? 0 : this->query[i] == code ? scoring.match : -scoring.mismatch;
+                wordProfile[(code * wordSegments + s) * kWordLanes + lane] = static_cast<std::int16_t>(score);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Aligns the query against a target.
+ * @param target The target's two-bit codes.
+ * @param size The number of target bases.
+ * @param global True for a global alignment, false for a local one.
+ * @return The score, and for a local alignment scoring above 0 where it ends; the first end found wins ties.
+ */
+AlignmentResult QueryProfile::align(const std::uint8_t* target, std::size_t size, bool global) const {
+    AlignmentResult result{0, 0, 0};
+    if (query.empty() || size == 0) {
+        std::size_t gap = query.size() + size;
+        if (global && gap > 0) {
+            result.score = -(scoring.gapOpen + static_cast<std::int64_t>(gap - 1) * scoring.gapExtend);
+        }
+        return result;
+    }
+    const Kernel& kernel = selectKernel();
+    StripedInput words{wordProfile.data(), wordSegments, query.size(), target, size, &scoring};
+    if (!global && kernel.localBytes) {
+        StripedInput bytes{byteProfile.data(), byteSegments, query.size(), target, size, &scoring};
+        if (kernel.localBytes(bytes, result) || kernel.localWords(words, result)) {
+            return result;
+        }
+    }
+    if (global && kernel.globalWords) {
+        // Every cell, padding rows included, lies within a gap down, a gap across and one step per base
+        std::int64_t step = std::max({scoring.match, scoring.mismatch, scoring.gapExtend});
+        std::int64_t bound = 3 * static_cast<std::int64_t>(scoring.gapOpen) +
+                             static_cast<std::int64_t>(query.size() + size + kWordLanes) * step;
+        if (bound <= kWordLimit && kernel.globalWords(words, result)) {
+            return result;
+        }
+    }
+    return alignScalar(query.data(), query.size(), target, size, scoring, global);
+}
+
+/**
+ * @brief Converts letters to two-bit codes.
+ * @param letters The letters, uppercase A, C, G, T or U.
+ * @param size The number of letters.
+ * @param codes Receives size codes: A=0, C=1, G=2, T and U=3.
+ */
+void encodeBases(const char* letters, std::size_t size, std::uint8_t* codes) {
+    for (std::size_t i = 0; i < size; ++i) {
+        codes[i] = kLetters[static_cast<unsigned char>(letters[i])];
+    }
+}
+
+/**
+ * @brief Getter for the name of the alignment kernel picked for this CPU.
+ * @return "avx2" or "scalar".
+ */
+const char* alignmentKernel() {
+    return selectKernel().name;
+}
@@ -0,0 +1,87 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct AlignmentScoring
+ * @brief The scores of an alignment; a gap of length L costs gapOpen + (L - 1) * gapExtend.
+ */
+struct AlignmentScoring {
+    int match = 2; ///< Added for two equal bases.
+    int mismatch = 3; ///< Subtracted for two different bases.
+    int gapOpen = 5; ///< Subtracted for the first base of a gap.
+    int gapExtend = 2; ///< Subtracted for every further base of a gap.
+};
+
+/**
+ * @struct AlignmentResult
+ * @brief The score of an alignment and, for a local one, where it ends.
+ */
+struct AlignmentResult {
+    std::int64_t score; ///< The best score.
+    std::size_t queryEnd; ///< The last query base of the best local alignment.
+    std::size_t targetEnd; ///< The last target base of the best local alignment.
+};
+
+/**
+ * @class QueryProfile
+ * @brief A query prepared for aligning against any number of targets.
+ *
+ * Alignment is Smith-Waterman for local and Needleman-Wunsch for global,
+ * both with affine gaps, computed with Farrar's striped method: the query is
+ * split into as many interleaved segments as a vector has lanes, so the cells
+ * of one target column that do not depend on each other fill a vector, and
+ * vertical gaps crossing segments are fixed up by a lazy pass that usually
+ * ends at once. Local alignment first runs 32 lanes of saturating 8-bit
+ * scores; if the score gets too high for them it runs again with 16 lanes of
+ * 16-bit scores, and then with the scalar 64-bit code. Global alignment runs
+ * 16-bit lanes when the lengths bound every score within them and the scalar
+ * code otherwise. Without AVX2 everything runs the scalar code.
+ *
+ * Bases are compared by their two-bit codes, so 'T' and 'U' are equal.
+ */
+class QueryProfile {
+public:
+    /**
+     * @brief Builds the striped score profiles of a query.
+     * @param query The query's two-bit codes.
+     * @param scoring The scores.
+     */
+    QueryProfile(std::vector<std::uint8_t> query, const AlignmentScoring& scoring);
+
+    /**
+     * @brief Aligns the query against a target.
+     * @param target The target's two-bit codes.
+     * @param size The number of target bases.
+     * @param global True for a global alignment, false for a local one.
+     * @return The score, and for a local alignment scoring above 0 where it ends; the first end found wins ties.
+     */
+    AlignmentResult align(const std::uint8_t* target, std::size_t size, bool global) const;
+
+private:
+    std::vector<std::uint8_t> query; ///< The query's two-bit codes.
+    AlignmentScoring scoring; ///< The scores.
+    std::size_t byteSegments; ///< The segment length with 32 lanes.
+    std::size_t wordSegments; ///< The segment length with 16 lanes.
+    std::vector<std::uint8_t> byteProfile; ///< Per code and segment, 32 scores biased by the mismatch score.
+    std::vector<std::int16_t> wordProfile; ///< Per code and segment, 16 scores.
+};
+
+/**
+ * @brief Converts letters to two-bit codes.
+ * @param letters The letters, uppercase A, C, G, T or U.
+ * @param size The number of letters.
+ * @param codes Receives size codes: A=0, C=1, G=2, T and U=3.
+ */
+void encodeBases(const char* letters, std::size_t size, std::uint8_t* codes);
+
+/**
+ * @brief Getter for the name of the alignment kernel picked for this CPU.
+ * @return "avx2" or "scalar".
+ */
+const char* alignmentKernel();
+
+#endif // ALIGNMENT_H
@@ -0,0 +1,439 @@
+#include "alignment.h"
+#include "command_output.h"
+#include "command_processor.h"
+#include "command_program.h"
+#include "fragment_list.h"
+#include "pattern_search.h"
+#include "reverse_complement.h"
+#include "sequence_validator.h"
+#include "thread_pool.h"
+#include "translation.h"
+#include "workload_generator.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t kMaxIterations = 100000; ///< The most runs one measurement takes.
+constexpr std::size_t kKmerMaxLength = 10000000; ///< The longest sequence indexed; longer indexes outgrow memory.
+constexpr std::size_t kAlignQuery = 100; ///< The bases of the query aligned against each length.
+constexpr int kBenchSlots = 8; ///< The positions the micro benchmarks use.
+
+/**
+ * @struct BenchOptions
+ * @brief What dna_bench runs and where it writes.
+ */
+struct BenchOptions {
+    std::size_t maxLength = 100000000; ///< The longest sequence timed; lengths go up from 10 by factors of 10.
+    double minSeconds = 0.1; ///< The time one measurement runs for at least, unless it reaches kMaxIterations.
+    std::string outputPath; ///< The JSON file, or empty for standard output.
+    std::string workDirectory = "."; ///< Where the snapshot and FASTA files of the file operations are written.
+    int threadCount = 1; ///< Threads for searches, alignments and the generated script.
+    bool micro = true; ///< Time each operation on its own.
+    bool macro = true; ///< Time a generated script.
+    bool generateOnly = false; ///< Print the generated script and stop.
+    WorkloadOptions workload; ///< The generated script.
+};
+
+/**
+ * @struct Measurement
+ * @brief The timings of one operation at one sequence length.
+ */
+struct Measurement {
+    const char* operation; ///< The operation.
+    std::size_t length; ///< The sequence length.
+    std::size_t iterations; ///< The number of timed runs.
+    double meanNanoseconds; ///< The mean time of a run.
+    double minNanoseconds; ///< The fastest run.
+};
+
+/**
+ * @struct MacroResult
+ * @brief The timings of a generated script.
+ */
+struct MacroResult {
+    std::size_t scriptBytes; ///< The size of the script.
+    double compileSeconds; ///< The time to compile it.
+    double runSeconds; ///< The time to run it.
+};
+
+/**
+ * @brief Drops what the commands printed, reporting any diagnostics.
+ * @param capture The capture of the calling thread.
+ * @param operation The operation that printed it, named in the report.
+ * @return False if there were diagnostics, which means the benchmark itself is wrong.
+ */
+bool discardOutput(OutputCapture& capture, const char* operation) {
+    std::string output;
+    std::string errors;
+    capture.take(output, errors);
+    if (!errors.empty()) {
+        std::cerr << operation << " reported: " << errors;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Times an operation over and over, each run after its own untimed setup.
+ * @param capture The capture swallowing the output.
+ * @param minSeconds The time to run for at least.
+ * @param operation The name of the operation.
+ * @param length The sequence length.
+ * @param setup Prepares one run.
+ * @param run The timed run.
+ * @param results Receives the measurement.
+ * @return False if the operation reported an error.
+ */
+template <typename Setup, typename Run>
+bool measure(OutputCapture& capture, double minSeconds, const char* operation, std::size_t length, Setup setup, Run run,
+             std::vector<Measurement>& results) {
+    std::size_t iterations = 0;
+    double total = 0.0;
+    double fastest = std::numeric_limits<double>::max();
+    do {
+        setup();
+        Clock::time_point start = Clock::now();
+        run();
+        double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (!discardOutput(capture, operation)) {
+            return false;
+        }
+        total += elapsed;
+        fastest = std::min(fastest, elapsed);
+        ++iterations;
+    } while (total < minSeconds * 1e9 && iterations < kMaxIterations);
+    results.push_back(Measurement{operation, length, iterations, total / static_cast<double>(iterations), fastest});
+    std::cerr << operation << " " << length << ": " << static_cast<std::uint64_t>(total / static_cast<double>(iterations))
+              << " ns\n";
+    return true;
+}
+
+/**
+ * @brief Times every FragmentList operation on sequences of one length.
+ * @param options The options.
+ * @param length The sequence length.
+ * @param results Receives the measurements.
+ * @return False if an operation reported an error.
+ */
+bool benchLength(const BenchOptions& options, std::size_t length, std::vector<Measurement>& results) {
+    std::mt19937_64 random(length);
+    std::string text(length, 'A');
+    for (char& base : text) {
+        base = "ACGT"[random() & 3];
+    }
+    const std::string snapshot = options.workDirectory + "/dna_bench.snapshot";
+    const std::string fasta = options.workDirectory + "/dna_bench.fasta";
+    const int half = static_cast<int>(length / 2);
+    const int third = static_cast<int>(length / 3);
+    const std::string pattern = "ACGTTGCAACGT";
+    const std::string kmer = "ACGTTGCAACGTTGC";
+    const auto none = [] {};
+
+    FragmentList list(kBenchSlots);
+    std::unique_ptr<ThreadPool> pool;
+    if (options.threadCount > 1) {
+        pool = std::make_unique<ThreadPool>(options.threadCount);
+    }
+    list.setThreadPool(pool.get());
+    OutputCapture capture;
+    auto step = [&](const char* operation, auto setup, auto run) {
+        return measure(capture, options.minSeconds, operation, length, setup, run, results);
+    };
+
+    // Slot 0 holds the sequence, 1 and 2 take copies to edit, 5 its transcript and 6 an alignment query
+    bool ok = step("insert", none, [&] { list.insert(0, SequenceType::DNA, text); }) &&
+              step("print", none, [&] { list.print(0); }) &&
+              step("stats", none, [&] { list.printStats(0); }) &&
+              step("shares", none, [&] { list.printSharing(0); }) &&
+              step("copy", none, [&] { list.copy(0, 1); }) &&
+              step("remove", [&] { list.copy(0, 1); }, [&] { list.remove(1); }) &&
+              step("clip", [&] { list.copy(0, 1); }, [&] { list.clip(1, half); }) &&
+              step("swap", [&] { list.copy(0, 1); list.copy(0, 2); }, [&] { list.swap(1, half, 2, third); }) &&
+              step("transcribe", [&] { list.copy(0, 1); }, [&] { list.transcribe(1); }) &&
+              step("find", none, [&] { list.find(0, false, pattern, 0); }) &&
+              step("find_errors", none, [&] { list.find(0, false, pattern, 2); });
+    if (!ok) {
+        return false;
+    }
+
+    list.copy(0, 5);
+    list.transcribe(5);
+    list.insert(6, SequenceType::DNA, std::string_view(text).substr(0, std::min(length, kAlignQuery)));
+    ok = step("translate", none, [&] { list.translate(5, true, 1, false, 0); }) &&
+         step("align", none, [&] { list.align(6, 0, false, false); }) &&
+         step("export", none, [&] { list.exportFasta(0, 1, fasta); }) &&
+         step("load", none, [&] { list.load(7, SequenceType::DNA, fasta, 1); }) &&
+         step("save", none, [&] { list.save(snapshot); }) &&
+         step("restore", none, [&] { list.restore(snapshot); });
+    std::remove(fasta.c_str());
+    if (!ok) {
+        std::remove(snapshot.c_str());
+        return false;
+    }
+
+    // Index the sequence alone; removing slots that are already empty is not an error here
+    for (int pos = 1; pos < kBenchSlots; ++pos) {
+        list.remove(pos);
+    }
+    std::string output;
+    std::string errors;
+    capture.take(output, errors);
+    if (length <= kKmerMaxLength) {
+        ok = step("kmer", [&] { list.setKmerLength(0); }, [&] { list.setKmerLength(15); }) &&
+             step("lookup", none, [&] { list.lookup(kmer); });
+    }
+    list.setKmerLength(0);
+    std::remove(snapshot.c_str());
+    return ok;
+}
+
+/**
+ * @brief Generates a script and times compiling and running it.
+ * @param options The options.
+ * @param result Receives the timings.
+ */
+void benchScript(const BenchOptions& options, MacroResult& result) {
+    std::string script = WorkloadGenerator(options.workload).generate();
+    FragmentList list(options.workload.slotCount);
+    CommandProcessor processor(options.workload.slotCount, list);
+    processor.setThreadCount(options.threadCount);
+    OutputCapture capture;
+
+    CommandProgram program;
+    Clock::time_point start = Clock::now();
+    processor.compile(script, program);
+    Clock::time_point compiled = Clock::now();
+    processor.run(program);
+    Clock::time_point finished = Clock::now();
+
+    std::string output;
+    std::string errors;
+    capture.take(output, errors);
+    result.scriptBytes = script.size();
+    result.compileSeconds = std::chrono::duration<double>(compiled - start).count();
+    result.runSeconds = std::chrono::duration<double>(finished - compiled).count();
+}
+
+/**
+ * @brief Formats a number with a fixed number of decimals.
+ * @param value The number.
+ * @param decimals The decimals.
+ * @return The text.
+ */
+std::string fixed(double value, int decimals) {
+    char text[64];
+    std::snprintf(text, sizeof(text), "%.*f", decimals, value);
+    return text;
+}
+
+/**
+ * @brief Writes the results as JSON.
+ * @param out The stream.
+ * @param options The options.
+ * @param micro The operation timings.
+ * @param macro The script timings, if the script ran.
+ */
+void writeJson(std::ostream& out, const BenchOptions& options, const std::vector<Measurement>& micro,
+               const MacroResult* macro) {
+    out << "{\n";
+    out << "  \"version\": 1,\n";
+    out << "  \"threads\": " << options.threadCount << ",\n";
+    out << "  \"kernels\": {\"validation\": \"" << validationKernel() << "\", \"transcription\": \"" << transcribeKernel()
+        << "\", \"search\": \"" << searchKernel() << "\", \"translation\": \"" << translationKernel()
+        << "\", \"alignment\": \"" << alignmentKernel() << "\"},\n";
+    out << "  \"micro\": [";
+    for (std::size_t i = 0; i < micro.size(); ++i) {
+        const Measurement& m = micro[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"operation\": \"" << m.operation << "\", \"length\": " << m.length
+            << ", \"iterations\": " << m.iterations << ", \"meanNanoseconds\": " << fixed(m.meanNanoseconds, 1)
+            << ", \"minNanoseconds\": " << fixed(m.minNanoseconds, 1) << ", \"basesPerSecond\": "
+            << fixed(static_cast<double>(m.length) * 1e9 / m.meanNanoseconds, 0) << "}";
+    }
+    out << (micro.empty() ? "],\n" : "\n  ],\n");
+    out << "  \"macro\": ";
+    if (macro == nullptr) {
+        out << "null\n";
+    } else {
+        const WorkloadOptions& workload = options.workload;
+        static const char* const kDistributions[] = {"fixed", "uniform", "log"};
+        out << "{\"seed\": " << workload.seed << ", \"commands\": " << workload.commandCount << ", \"slots\": "
+            << workload.slotCount << ", \"distribution\": \"" << kDistributions[static_cast<int>(workload.distribution)]
+            << "\", \"minLength\": " << workload.minLength << ", \"maxLength\": " << workload.maxLength << ", \"mix\": {";
+        for (std::size_t i = 0; i < workload.mix.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << "\"" << WorkloadGenerator::operationName(static_cast<WorkloadOperation>(i))
+                << "\": " << workload.mix[i];
+        }
+        out << "}, \"scriptBytes\": " << macro->scriptBytes << ", \"compileSeconds\": " << fixed(macro->compileSeconds, 6)
+            << ", \"runSeconds\": " << fixed(macro->runSeconds, 6) << ", \"commandsPerSecond\": "
+            << fixed(workload.commandCount / std::max(macro->runSeconds, 1e-9), 0) << "}\n";
+    }
+    out << "}\n";
+}
+
+/**
+ * @brief Reads an unsigned option value.
+ * @param text The value.
+ * @param value Receives it.
+ * @return False if the text is not a whole number.
+ */
+bool parseNumber(const char* text, std::uint64_t& value) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || text[0] == '-') {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Main function for the benchmark program.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return 0 if the benchmarks ran, 1 otherwise.
+ */
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "hl:r:o:w:t:u:gs:n:m:d:a:b:x:")) != -1) {
+        std::uint64_t number = 0;
+        bool numeric = std::string("lrtsnmab").find(static_cast<char>(opt)) != std::string::npos;
+        if (numeric && !parseNumber(optarg, number)) {
+            std::cerr << "Invalid number for -" << static_cast<char>(opt) << ": " << optarg << '\n';
+            return 1;
+        }
+        switch (opt) {
+            case 'h':
+                std::cout << "Usage: dna_bench [-h] [-l #] [-r #] [-o <json file>] [-w <directory>] [-t #] [-u suite] [-g]\n"
+                             "                 [-s #] [-n #] [-m #] [-d distribution] [-a #] [-b #] [-x mix]\n"
+                             "Options:\n"
+                             "  -h   Show this text and exit.\n"
+                             "  -l   Longest sequence timed; lengths go from 10 up by factors of 10.\n"
+                             "       The default is 100000000\n"
+                             "  -r   Milliseconds each measurement runs for at least. The default is 100\n"
+                             "  -o   File the JSON results are written to. The default is standard output\n"
+                             "  -w   Directory for the snapshot and FASTA files timed. The default is .\n"
+                             "  -t   Threads for searches, alignments and the script. The default is 1\n"
+                             "  -u   'micro' times each operation, 'macro' a generated script, 'all' both.\n"
+                             "       The default is 'all'\n"
+                             "  -g   Print the generated script instead of timing anything.\n"
+                             "Generated script:\n"
+                             "  -s   Seed. The default is 1\n"
+                             "  -n   Number of commands. The default is 1000\n"
+                             "  -m   Number of positions used. The default is 8\n"
+                             "  -d   Sequence lengths: 'fixed' at the longest, 'uniform', or 'log' with every\n"
+                             "       power of ten equally likely. The default is 'log'\n"
+                             "  -a   Shortest sequence. The default is 10\n"
+                             "  -b   Longest sequence. The default is 100000\n"
+                             "  -x   Operation weights as name=weight pairs, e.g. 'insert=5,find=1', from insert,\n"
+                             "       remove, print, clip, copy, swap, transcribe, stats, find, translate and align\n";
+                return 0;
+            case 'l':
+                options.maxLength = static_cast<std::size_t>(number);
+                break;
+            case 'r':
+                options.minSeconds = static_cast<double>(number) / 1000.0;
+                break;
+            case 'o':
+                options.outputPath = optarg;
+                break;
+            case 'w':
+                options.workDirectory = optarg;
+                break;
+            case 't':
+                options.threadCount = static_cast<int>(std::max<std::uint64_t>(std::min<std::uint64_t>(number, 1024), 1));
+                break;
+            case 'u': {
+                std::string suite = optarg;
+                if (suite != "micro" && suite != "macro" && suite != "all") {
+                    std::cerr << "Unknown suite: " << suite << '\n';
+                    return 1;
+                }
+                options.micro = suite != "macro";
+                options.macro = suite != "micro";
+                break;
+            }
+            case 'g':
+                options.generateOnly = true;
+                break;
+            case 's':
+                options.workload.seed = number;
+                break;
+            case 'n':
+                options.workload.commandCount = static_cast<int>(std::min<std::uint64_t>(number, 100000000));
+                break;
+            case 'm':
+                options.workload.slotCount = static_cast<int>(std::max<std::uint64_t>(std::min<std::uint64_t>(number, 1000000), 1));
+                break;
+            case 'd':
+                if (!WorkloadGenerator::parseDistribution(optarg, options.workload.distribution)) {
+                    std::cerr << "Unknown distribution: " << optarg << '\n';
+                    return 1;
+                }
+                break;
+            case 'a':
+                options.workload.minLength = static_cast<std::size_t>(number);
+                break;
+            case 'b':
+                options.workload.maxLength = static_cast<std::size_t>(number);
+                break;
+            case 'x':
+                if (!WorkloadGenerator::parseMix(optarg, options.workload.mix)) {
+                    std::cerr << "Invalid operation mix: " << optarg << '\n';
+                    return 1;
+                }
+                break;
+            default:
+                std::cerr << "Invalid option\n";
+                return 1;
+        }
+    }
+
+    if (options.generateOnly) {
+        std::cout << WorkloadGenerator(options.workload).generate();
+        return 0;
+    }
+
+    std::vector<Measurement> micro;
+    if (options.micro) {
+        for (std::size_t length = 10; length <= options.maxLength; length *= 10) {
+            if (!benchLength(options, length, micro)) {
+                return 1;
+            }
+        }
+    }
+    MacroResult macro{};
+    if (options.macro) {
+        benchScript(options, macro);
+    }
+
+    if (options.outputPath.empty()) {
+        writeJson(std::cout, options, micro, options.macro ? &macro : nullptr);
+        return 0;
+    }
+    std::ofstream out(options.outputPath);
+    writeJson(out, options, micro, options.macro ? &macro : nullptr);
+    if (!out) {
+        std::cerr << "Failed to write " << options.outputPath << '\n';
+        return 1;
+    }
+    return 0;
+}
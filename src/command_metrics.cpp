@@ -0,0 +1,219 @@
+#include "command_metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+/// The command names, in CommandType order.
+constexpr const char* kCommandNames[] = {"INSERT", "REMOVE", "PRINT", "CLIP", "COPY", "SWAP", "TRANSCRIBE",
+                                         "SHARES", "LOAD", "EXPORT", "SAVE", "RESTORE", "MEMORY", "KMER",
+                                         "LOOKUP", "FIND", "STATS", "TRANSLATE", "SCORING", "ALIGN", "METRICS",
+                                         "UNKNOWN", "INVALID"};
+static_assert(sizeof(kCommandNames) / sizeof(kCommandNames[0]) == static_cast<std::size_t>(CommandType::INVALID) + 1,
+              "Every opcode needs a name");
+
+/**
+ * @brief Formats a duration in microseconds.
+ * @param nanoseconds The duration.
+ * @return The text, such as "12.5 us".
+ */
+std::string microseconds(double nanoseconds) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f us", nanoseconds / 1000.0);
+    return text;
+}
+
+} // namespace
+
+/**
+ * @brief Count a duration
+ *
+ * @param nanoseconds The duration
+ */
+void LatencyHistogram::record(std::uint64_t nanoseconds) {
+    buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(nanoseconds, std::memory_order_relaxed);
+    std::uint64_t longest = max.load(std::memory_order_relaxed);
+    while (nanoseconds > longest && !max.compare_exchange_weak(longest, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief Getter for the duration a fraction of the recorded durations do not exceed
+ *
+ * The walk stops at the bucket holding the ceil(quantile * count)th
+ * duration; the reported value is never above the longest recorded.
+ *
+ * @param quantile The fraction, from 0 to 1
+ * @return The highest duration of the bucket holding it, or 0 if nothing was recorded
+ */
+std::uint64_t LatencyHistogram::percentile(double quantile) const {
+    std::uint64_t recorded = getCount();
+    if (recorded == 0) {
+        return 0;
+    }
+    quantile = std::min(std::max(quantile, 0.0), 1.0);
+    auto rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(quantile * static_cast<double>(recorded) + 0.999999), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(highestOf(bucket), getMax());
+        }
+    }
+    return getMax();
+}
+
+/**
+ * @brief Getter for the number of recorded durations
+ *
+ * @return The count
+ */
+std::uint64_t LatencyHistogram::getCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Getter for the sum of the recorded durations
+ *
+ * @return The sum in nanoseconds
+ */
+std::uint64_t LatencyHistogram::getTotal() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Getter for the longest recorded duration
+ *
+ * @return The duration in nanoseconds
+ */
+std::uint64_t LatencyHistogram::getMax() const {
+    return max.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Find the bucket of a duration
+ *
+ * Durations below 2^(kSubBits + 1) are their own bucket. Above that the
+ * duration is shifted right until its top bit is bit kSubBits; the shift
+ * picks the power of two and the kSubBits bits below the top one the
+ * bucket within it.
+ *
+ * @param nanoseconds The duration
+ * @return The bucket index
+ */
+std::size_t LatencyHistogram::bucketOf(std::uint64_t nanoseconds) {
+    constexpr std::uint64_t half = std::uint64_t(1) << kSubBits;
+    if (nanoseconds < 2 * half) {
+        return static_cast<std::size_t>(nanoseconds);
+    }
+    int shift = 63 - __builtin_clzll(nanoseconds) - kSubBits;
+    if (shift > kMaxShift) {
+        return kBuckets - 1;
+    }
+    return static_cast<std::size_t>(shift + 1) * half + static_cast<std::size_t>((nanoseconds >> shift) - half);
+}
+
+/**
+ * @brief Getter for the highest duration a bucket holds
+ *
+ * @param bucket The bucket index
+ * @return The duration in nanoseconds
+ */
+std::uint64_t LatencyHistogram::highestOf(std::size_t bucket) {
+    constexpr std::size_t half = std::size_t(1) << kSubBits;
+    if (bucket < 2 * half) {
+        return bucket;
+    }
+    std::size_t shift = bucket / half - 1;
+    std::uint64_t mantissa = bucket % half + half;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * @brief Turn recording on or off
+ *
+ * @param enabled True to record
+ */
+void CommandMetrics::setEnabled(bool enabled) {
+    this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Record one executed command
+ *
+ * @param type The command
+ * @param nanoseconds How long it ran
+ * @param bytes The bytes it read and printed
+ * @param failed True if it printed a diagnostic
+ */
+void CommandMetrics::record(CommandType type, std::uint64_t nanoseconds, std::uint64_t bytes, bool failed) {
+    Counters& command = counters[static_cast<std::size_t>(type)];
+    if (failed) {
+        command.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    command.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    command.latency.record(nanoseconds);
+}
+
+/**
+ * @brief Write a line of totals and a line for every command recorded at least once
+ *
+ * Commands recorded while writing may be counted in some columns and not
+ * yet in others.
+ *
+ * @param out The stream
+ */
+void CommandMetrics::write(std::ostream& out) const {
+    std::uint64_t calls = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t nanoseconds = 0;
+    for (const Counters& command : counters) {
+        calls += command.latency.getCount();
+        errors += command.errors.load(std::memory_order_relaxed);
+        bytes += command.bytes.load(std::memory_order_relaxed);
+        nanoseconds += command.latency.getTotal();
+    }
+    out << "Commands: " << calls << ", Errors: " << errors << ", Bytes: " << bytes
+        << ", Time: " << microseconds(static_cast<double>(nanoseconds)) << "\n";
+
+    for (std::size_t type = 0; type < counters.size(); ++type) {
+        const Counters& command = counters[type];
+        std::uint64_t count = command.latency.getCount();
+        if (count == 0) {
+            continue;
+        }
+        const LatencyHistogram& latency = command.latency;
+        out << "Command: " << kCommandNames[type] << ", Calls: " << count
+            << ", Errors: " << command.errors.load(std::memory_order_relaxed)
+            << ", Bytes: " << command.bytes.load(std::memory_order_relaxed)
+            << ", Mean: " << microseconds(static_cast<double>(latency.getTotal()) / static_cast<double>(count))
+            << ", P50: " << microseconds(static_cast<double>(latency.percentile(0.5)))
+            << ", P90: " << microseconds(static_cast<double>(latency.percentile(0.9)))
+            << ", P99: " << microseconds(static_cast<double>(latency.percentile(0.99)))
+            << ", Max: " << microseconds(static_cast<double>(latency.getMax())) << "\n";
+    }
+}
+
+/**
+ * @brief Getter for the metrics of the commands this process runs
+ *
+ * @return The metrics
+ */
+CommandMetrics& commandMetrics() {
+    static CommandMetrics metrics;
+    return metrics;
+}
+
+/**
+ * @brief Getter for the name of a command
+ *
+ * @param type The command
+ * @return The uppercase name
+ */
+const char* commandName(CommandType type) {
+    return kCommandNames[static_cast<std::size_t>(type)];
+}
@@ -0,0 +1,145 @@
+#ifndef COMMAND_METRICS_H
+#define COMMAND_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "command_program.h"
+
+/**
+ * @class LatencyHistogram
+ * @brief Counts durations in log-linear buckets, in the manner of an HDR histogram.
+ *
+ * Durations below 64 ns have a bucket each; above that every power of two is
+ * split into 32 buckets, so any reported value is within about 3% of the
+ * durations it stands for. Recording is a relaxed atomic increment, so
+ * several threads may record at once.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 5; ///< Each power of two is split into 2^kSubBits buckets.
+    static constexpr int kMaxShift = 40; ///< Durations from 2^(kMaxShift + kSubBits + 1) ns, about 20 hours, share the last bucket.
+    static constexpr std::size_t kBuckets = (kMaxShift + 2) << kSubBits; ///< The number of buckets.
+
+    /**
+     * @brief Counts a duration.
+     * @param nanoseconds The duration.
+     */
+    void record(std::uint64_t nanoseconds);
+
+    /**
+     * @brief Getter for the duration a fraction of the recorded durations do not exceed.
+     * @param quantile The fraction, from 0 to 1.
+     * @return The highest duration of the bucket holding it, or 0 if nothing was recorded.
+     */
+    std::uint64_t percentile(double quantile) const;
+
+    /**
+     * @brief Getter for the number of recorded durations.
+     * @return The count.
+     */
+    std::uint64_t getCount() const;
+
+    /**
+     * @brief Getter for the sum of the recorded durations.
+     * @return The sum in nanoseconds.
+     */
+    std::uint64_t getTotal() const;
+
+    /**
+     * @brief Getter for the longest recorded duration.
+     * @return The duration in nanoseconds.
+     */
+    std::uint64_t getMax() const;
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets{}; ///< The count of each bucket.
+    std::atomic<std::uint64_t> count{0}; ///< The number of durations.
+    std::atomic<std::uint64_t> total{0}; ///< Their sum.
+    std::atomic<std::uint64_t> max{0}; ///< The longest.
+
+    /**
+     * @brief Finds the bucket of a duration.
+     * @param nanoseconds The duration.
+     * @return The bucket index.
+     */
+    static std::size_t bucketOf(std::uint64_t nanoseconds);
+
+    /**
+     * @brief Getter for the highest duration a bucket holds.
+     * @param bucket The bucket index.
+     * @return The duration in nanoseconds.
+     */
+    static std::uint64_t highestOf(std::size_t bucket);
+};
+
+/**
+ * @class CommandMetrics
+ * @brief Per-command call, error and byte counters with a latency histogram for each CommandType.
+ *
+ * Disabled by default, in which case executing a command costs one relaxed
+ * load more than without metrics. Bytes are those of the command's payload
+ * plus the results it printed.
+ */
+class CommandMetrics {
+public:
+    /**
+     * @brief Turns recording on or off.
+     * @param enabled True to record.
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Getter for whether commands are recorded.
+     * @return True if recording.
+     */
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Records one executed command.
+     * @param type The command.
+     * @param nanoseconds How long it ran.
+     * @param bytes The bytes it read and printed.
+     * @param failed True if it printed a diagnostic.
+     */
+    void record(CommandType type, std::uint64_t nanoseconds, std::uint64_t bytes, bool failed);
+
+    /**
+     * @brief Writes a line of totals and a line for every command recorded at least once.
+     * @param out The stream.
+     */
+    void write(std::ostream& out) const;
+
+private:
+    /**
+     * @struct Counters
+     * @brief What is recorded for one command.
+     */
+    struct Counters {
+        std::atomic<std::uint64_t> errors{0}; ///< The calls that printed a diagnostic.
+        std::atomic<std::uint64_t> bytes{0}; ///< The bytes read and printed.
+        LatencyHistogram latency; ///< The durations, and with them the number of calls.
+    };
+
+    std::atomic<bool> enabled{false}; ///< Whether commands are recorded.
+    std::array<Counters, static_cast<std::size_t>(CommandType::INVALID) + 1> counters; ///< Per command.
+};
+
+/**
+ * @brief Getter for the metrics of the commands this process runs.
+ * @return The metrics.
+ */
+CommandMetrics& commandMetrics();
+
+/**
+ * @brief Getter for the name of a command.
+ * @param type The command.
+ * @return The uppercase name.
+ */
+const char* commandName(CommandType type);
+
+#endif // COMMAND_METRICS_H
@@ -0,0 +1,157 @@
+#include "command_output.h"
+#include <algorithm>
+#include <streambuf>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @class SinkBuffer
+ * @brief Stream buffer that passes everything written straight to an output sink.
+ *
+ * Flushing the stream, as std::endl does, is left to the sink's policy.
+ */
+class SinkBuffer : public std::streambuf {
+public:
+    /**
+     * @brief Constructs a stream buffer for one descriptor of a sink.
+     * @param sink The sink.
+     * @param fd The file descriptor.
+     */
+    SinkBuffer(OutputSink& sink, int fd)
+        : sink(sink), fd(fd) {}
+
+    /**
+     * @brief Getter for the bytes written through this buffer.
+     * @return The count.
+     */
+    std::uint64_t getWritten() const {
+        return written;
+    }
+
+protected:
+    std::streamsize xsputn(const char* data, std::streamsize size) override {
+        sink.write(fd, data, static_cast<std::size_t>(size));
+        written += static_cast<std::uint64_t>(size);
+        return size;
+    }
+
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char letter = traits_type::to_char_type(c);
+            sink.write(fd, &letter, 1);
+            ++written;
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    OutputSink& sink; ///< The sink.
+    int fd; ///< The file descriptor.
+    std::uint64_t written = 0; ///< The bytes written, read only by the thread that writes.
+};
+
+/**
+ * @struct SinkStreams
+ * @brief The sink shared by standard output and standard error, and streams over it.
+ */
+struct SinkStreams {
+    OutputSink sink; ///< Declared first so it is flushed after the streams go.
+    SinkBuffer outputBuffer{sink, STDOUT_FILENO}; ///< Writes to standard output.
+    SinkBuffer errorBuffer{sink, STDERR_FILENO}; ///< Writes to standard error.
+    std::ostream output{&outputBuffer}; ///< The results stream.
+    std::ostream errors{&errorBuffer}; ///< The diagnostics stream.
+};
+
+/**
+ * @brief Getter for the process wide sink streams, built on first use.
+ * @return The sink streams.
+ */
+SinkStreams& sinkStreams() {
+    static SinkStreams streams;
+    return streams;
+}
+
+thread_local std::ostream* threadOutput = nullptr; ///< The capture stream for results, if any.
+thread_local std::ostream* threadErrors = nullptr; ///< The capture stream for diagnostics, if any.
+
+} // namespace
+
+/**
+ * @brief Getter for the stream command results are printed to.
+ * @return The calling thread's capture stream, or the output sink's standard output when not capturing.
+ */
+std::ostream& commandOutput() {
+    return threadOutput ? *threadOutput : sinkStreams().output;
+}
+
+/**
+ * @brief Getter for the stream command diagnostics are printed to.
+ * @return The calling thread's capture stream, or the output sink's standard error when not capturing.
+ */
+std::ostream& commandErrors() {
+    return threadErrors ? *threadErrors : sinkStreams().errors;
+}
+
+/**
+ * @brief Getter for how many bytes the calling thread has printed so far.
+ * @param output Receives the bytes printed to commandOutput().
+ * @param errors Receives the bytes printed to commandErrors().
+ */
+void printedBytes(std::uint64_t& output, std::uint64_t& errors) {
+    if (threadOutput) {
+        // A capture's position is the length of what it holds
+        output = static_cast<std::uint64_t>(std::max<std::streamoff>(threadOutput->tellp(), 0));
+        errors = static_cast<std::uint64_t>(std::max<std::streamoff>(threadErrors->tellp(), 0));
+        return;
+    }
+    output = sinkStreams().outputBuffer.getWritten();
+    errors = sinkStreams().errorBuffer.getWritten();
+}
+
+/**
+ * @brief Configures the sink behind commandOutput() and commandErrors().
+ * @param background True to write full buffers on a background thread.
+ * @param errorPolicy When diagnostics are written.
+ */
+void configureOutput(bool background, FlushPolicy errorPolicy) {
+    OutputSink& sink = sinkStreams().sink;
+    sink.setErrorPolicy(errorPolicy);
+    sink.setBackground(background);
+}
+
+/**
+ * @brief Writes out everything printed so far.
+ */
+void flushOutput() {
+    sinkStreams().sink.flush();
+}
+
+/**
+ * @brief Starts capturing on the calling thread.
+ */
+OutputCapture::OutputCapture()
+    : previousOutput(threadOutput), previousErrors(threadErrors) {
+    threadOutput = &output;
+    threadErrors = &errors;
+}
+
+/**
+ * @brief Stops capturing and restores the previous streams.
+ */
+OutputCapture::~OutputCapture() {
+    threadOutput = previousOutput;
+    threadErrors = previousErrors;
+}
+
+/**
+ * @brief Moves out what was printed since the last take.
+ * @param output Receives the results.
+ * @param errors Receives the diagnostics.
+ */
+void OutputCapture::take(std::string& output, std::string& errors) {
+    output = this->output.str();
+    errors = this->errors.str();
+    this->output.str(std::string());
+    this->errors.str(std::string());
+}
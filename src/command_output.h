@@ -0,0 +1,81 @@
+#ifndef COMMAND_OUTPUT_H
+#define COMMAND_OUTPUT_H
+
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include "output_sink.h"
+
+/**
+ * @brief Getter for the stream command results are printed to.
+ * @return The calling thread's capture stream, or the output sink's standard output when not capturing.
+ */
+std::ostream& commandOutput();
+
+/**
+ * @brief Getter for the stream command diagnostics are printed to.
+ * @return The calling thread's capture stream, or the output sink's standard error when not capturing.
+ */
+std::ostream& commandErrors();
+
+/**
+ * @brief Getter for how many bytes the calling thread has printed so far.
+ *
+ * Only the difference between two calls is meaningful: a capture's counts
+ * start again when it is taken.
+ *
+ * @param output Receives the bytes printed to commandOutput().
+ * @param errors Receives the bytes printed to commandErrors().
+ */
+void printedBytes(std::uint64_t& output, std::uint64_t& errors);
+
+/**
+ * @brief Configures the sink behind commandOutput() and commandErrors().
+ * @param background True to write full buffers on a background thread.
+ * @param errorPolicy When diagnostics are written.
+ */
+void configureOutput(bool background, FlushPolicy errorPolicy);
+
+/**
+ * @brief Writes out everything printed so far.
+ */
+void flushOutput();
+
+/**
+ * @class OutputCapture
+ * @brief Redirects the calling thread's command output into buffers while it lives.
+ *
+ * Commands run on worker threads print into their own buffers, which are
+ * then written out in command order.
+ */
+class OutputCapture {
+public:
+    /**
+     * @brief Starts capturing on the calling thread.
+     */
+    OutputCapture();
+
+    /**
+     * @brief Stops capturing and restores the previous streams.
+     */
+    ~OutputCapture();
+
+    OutputCapture(const OutputCapture&) = delete;
+    OutputCapture& operator=(const OutputCapture&) = delete;
+
+    /**
+     * @brief Moves out what was printed since the last take.
+     * @param output Receives the results.
+     * @param errors Receives the diagnostics.
+     */
+    void take(std::string& output, std::string& errors);
+
+private:
+    std::ostringstream output; ///< The captured results.
+    std::ostringstream errors; ///< The captured diagnostics.
+    std::ostream* previousOutput; ///< The stream results went to before.
+    std::ostream* previousErrors; ///< The stream diagnostics went to before.
+};
+
+#endif // COMMAND_OUTPUT_H
@@ -6,12 +6,100 @@
  */ 
 #include "command_processor.h"
 #include "fragment_list.h"
-#include <sstream>
+#include "command_output.h"
+#include "command_metrics.h"
+#include "memory_pool.h"
 #include <iostream>
-#include <iterator>
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
 #include <map>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Checks for the characters std::istream treats as word separators.
+ * @param c The character.
+ * @return True if c separates words.
+ */
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * @brief Copies a short word into a buffer in uppercase.
+ * @param word The word.
+ * @param buffer The buffer; longer words are cut to its size.
+ * @return A view of the uppercase word in the buffer.
+ */
+template <std::size_t N>
+std::string_view toUpper(std::string_view word, std::array<char, N>& buffer) {
+    std::size_t size = std::min(word.size(), N);
+    for (std::size_t i = 0; i < size; ++i) {
+        buffer[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(word[i])));
+    }
+    return std::string_view(buffer.data(), size);
+}
+
+/**
+ * @brief Parses an integer parameter, allowing a leading '+'.
+ * @param word The parameter.
+ * @param value Receives the integer.
+ * @return True if the parameter starts with an integer.
+ */
+bool parseInteger(std::string_view word, int& value) {
+    if (!word.empty() && word[0] == '+') {
+        word.remove_prefix(1);
+    }
+    std::from_chars_result result = std::from_chars(word.data(), word.data() + word.size(), value);
+    return result.ec == std::errc();
+}
+
+/**
+ * @brief Parses the optional count of a LOAD or EXPORT command.
+ * @param word The parameter: a positive number, or ALL in any case.
+ * @param count Receives the count, -1 for ALL.
+ * @return True if the parameter is a valid count.
+ */
+bool parseCount(std::string_view word, int& count) {
+    std::array<char, 4> buffer;
+    if (word.size() == 3 && toUpper(word, buffer) == "ALL") {
+        count = -1;
+        return true;
+    }
+    return parseInteger(word, count) && count > 0;
+}
+
+/**
+ * @brief Checks whether a parsed line is a comment.
+ * @param tokens The parsed line.
+ * @return True if its first word starts with '#'.
+ */
+bool isComment(const CommandTokens& tokens) {
+    return !tokens.name.empty() && tokens.name[0] == '#';
+}
+
+/**
+ * @brief Builds the instruction reporting a bad command.
+ * @param error Why the command is bad.
+ * @param word The offending word, empty if none.
+ * @param source The text the word views.
+ * @return The INVALID instruction.
+ */
+Instruction invalidInstruction(CommandError error, std::string_view word, std::string_view source) {
+    Instruction instruction{};
+    instruction.opcode = CommandType::INVALID;
+    instruction.operandCount = 1;
+    instruction.operands[0] = static_cast<std::int32_t>(error);
+    instruction.payloadOffset = word.empty() ? 0 : static_cast<std::uint64_t>(word.data() - source.data());
+    instruction.payloadLength = word.size();
+    return instruction;
+}
+
+} // namespace
 
 /**
  * @brief Constructs a new Command Processor object.
@@ -19,8 +107,8 @@
  * @param fragmentList The fragment list object.
  */
 CommandProcessor::CommandProcessor(int fragmentsCount, FragmentList& fragmentList)  
-  : fragmentsCount(fragmentsCount), 
-    fragmentList(fragmentList),
+  : fragmentList(fragmentList),
+    fragmentsCount(fragmentsCount),
     commandMap({
         {"INSERT", CommandType::INSERT},
         {"REMOVE", CommandType::REMOVE},
@@ -28,7 +116,21 @@ CommandProcessor::CommandProcessor(int fragmentsCount, FragmentList& fragmentLis
         {"CLIP", CommandType::CLIP},
         {"COPY", CommandType::COPY},
         {"SWAP", CommandType::SWAP},
-        {"TRANSCRIBE", CommandType::TRANSCRIBE}
+        {"TRANSCRIBE", CommandType::TRANSCRIBE},
+        {"SHARES", CommandType::SHARES},
+        {"LOAD", CommandType::LOAD},
+        {"EXPORT", CommandType::EXPORT},
+        {"SAVE", CommandType::SAVE},
+        {"RESTORE", CommandType::RESTORE},
+        {"MEMORY", CommandType::MEMORY},
+        {"KMER", CommandType::KMER},
+        {"LOOKUP", CommandType::LOOKUP},
+        {"FIND", CommandType::FIND},
+        {"STATS", CommandType::STATS},
+        {"TRANSLATE", CommandType::TRANSLATE},
+        {"SCORING", CommandType::SCORING},
+        {"ALIGN", CommandType::ALIGN},
+        {"METRICS", CommandType::METRICS}
     }),
     sequenceTypeMap({ 
         {"DNA", SequenceType::DNA},
@@ -39,101 +141,700 @@ CommandProcessor::CommandProcessor(int fragmentsCount, FragmentList& fragmentLis
 
 /**
  * @brief Processes a command.
- * @param command The command to process.
+ * @param command The command to process, viewed in place; nothing is copied.
  */
-void CommandProcessor::processCommand(const std::string& command) { 
+void CommandProcessor::processCommand(std::string_view command) { 
     // Log the command
-    //logger.log(LogLevel::INFO, "Processing command: " + command);
+    if (logger) {
+        logger->log(LogLevel::DEBUG, "Processing command: ", command);
+    }
     // Ignore empty lines
     if (command.empty()) {
         return;
     }
-    // Convert the command to uppercase for case insensitivity
-    std::string uppercaseCommand = command;
-    std::transform(uppercaseCommand.begin(), uppercaseCommand.end(), uppercaseCommand.begin(), ::toupper);
 
-    // Parse the command and its parameters
-    std::string commandName;
-    std::vector<std::string> parameters;
-    
-    parseCommand(uppercaseCommand, commandName, parameters);
-    // Execute the command
-    executeCommand(commandName, parameters);
-    
+    // Parse the command and its parameters as views into the command text;
+    // the command name is matched case-insensitively and sequences are
+    // validated and packed in either case
+    CommandTokens tokens;
+    parseCommand(command, tokens);
+    // Ignore comments
+    if (isComment(tokens)) {
+        return;
+    }
+    // Compile and execute the command
+    Instruction instruction = compileCommand(tokens, command);
+    executeInstruction(instruction, command.substr(instruction.payloadOffset, instruction.payloadLength));
+    if (journal) {
+        journal->commit();
+    }
+}
+
+/**
+ * @brief Compiles a command script into a program without executing it.
+ * @param script The script, one command per line; it must outlive the program.
+ * @param program Receives one instruction per line that is neither empty nor a comment.
+ */
+void CommandProcessor::compile(std::string_view script, CommandProgram& program) {
+    program.setSource(script);
+    std::string_view rest = script;
+    while (!rest.empty()) {
+        std::size_t end = rest.find('\n');
+        std::string_view line = rest.substr(0, end);
+        if (!line.empty()) {
+            CommandTokens tokens;
+            parseCommand(line, tokens);
+            if (!isComment(tokens)) {
+                program.append(compileCommand(tokens, script));
+            }
+        }
+        if (end == std::string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(end + 1);
+    }
 }
 
 /**
- * @brief Parses a command.
+ * @brief Executes a compiled program.
+ * @param program The program.
+ */
+void CommandProcessor::run(const CommandProgram& program) {
+    // Journaled commands are committed a window at a time, so a long program
+    // never holds unsynced records for long and still reaches its checkpoints
+    CommandScheduler::Settler settle;
+    if (journal) {
+        settle = [this] { journal->commit(); };
+    }
+    if (shards) {
+        shards->run(program.getInstructions(), [this, &program](const Instruction& instruction) {
+            executeInstruction(instruction, program.getPayload(instruction));
+        }, nullptr, settle);
+    } else if (scheduler) {
+        scheduler->run(program.getInstructions(), [this, &program](const Instruction& instruction) {
+            executeInstruction(instruction, program.getPayload(instruction));
+        }, nullptr, settle);
+    } else {
+        const std::vector<Instruction>& instructions = program.getInstructions();
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            executeInstruction(instructions[i], program.getPayload(instructions[i]));
+            if (settle && (i + 1) % kCommitWindow == 0) {
+                settle();
+            }
+        }
+    }
+    if (journal) {
+        journal->commit();
+    }
+}
+
+/**
+ * @brief Executes a compiled program, handing each instruction's output to a callback instead of printing it.
+ * @param program The program.
+ * @param collect Receives the index, results and diagnostics of each instruction, in program order.
+ */
+void CommandProcessor::run(const CommandProgram& program, const CommandScheduler::Collector& collect) {
+    CommandScheduler::Settler settle;
+    if (journal) {
+        settle = [this] { journal->commit(); };
+    }
+    if (shards) {
+        shards->run(program.getInstructions(), [this, &program](const Instruction& instruction) {
+            executeInstruction(instruction, program.getPayload(instruction));
+        }, collect, settle);
+    } else if (scheduler) {
+        scheduler->run(program.getInstructions(), [this, &program](const Instruction& instruction) {
+            executeInstruction(instruction, program.getPayload(instruction));
+        }, collect, settle);
+    } else {
+        OutputCapture capture;
+        std::string output;
+        std::string errors;
+        const std::vector<Instruction>& instructions = program.getInstructions();
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            executeInstruction(instructions[i], program.getPayload(instructions[i]));
+            capture.take(output, errors);
+            collect(i, output, errors);
+            if (settle && (i + 1) % kCommitWindow == 0) {
+                settle();
+            }
+        }
+    }
+    // Collected responses are only sent after this, so they acknowledge durable commands
+    if (journal) {
+        journal->commit();
+    }
+}
+
+/**
+ * @brief Sets how many threads run compiled programs and searches.
+ * @param threadCount The number of threads; 1 runs commands one after another on the calling thread.
+ */
+void CommandProcessor::setThreadCount(int threadCount) {
+    if (threadCount > 1) {
+        scheduler = std::make_unique<CommandScheduler>(threadCount);
+    } else {
+        scheduler.reset();
+    }
+    // Searches share the scheduler's workers; shard threads already own the cores
+    fragmentList.setThreadPool(scheduler && !shards ? &scheduler->getPool() : nullptr);
+}
+
+/**
+ * @brief Partitions the positions between shard threads, which then run compiled programs in place of the scheduler.
+ * @param shardCount The number of shards; 1 goes back to the scheduler or the calling thread.
+ */
+void CommandProcessor::setShardCount(int shardCount) {
+    if (shardCount > 1) {
+        shards = std::make_unique<CommandShards>(shardCount);
+    } else {
+        shards.reset();
+    }
+    fragmentList.setShardCount(shardCount);
+    fragmentList.setThreadPool(scheduler && !shards ? &scheduler->getPool() : nullptr);
+}
+
+/**
+ * @brief Sets the logger commands are logged to.
+ * @param logger The logger, owned by the caller, or null to log nothing.
+ */
+void CommandProcessor::setLogger(Logger* logger) {
+    this->logger = logger;
+}
+
+/**
+ * @brief Splits a command into words without copying it.
  * @param command The command to parse.
- * @param commandName The parsed command name.
- * @param parameters The parsed parameters.
- */
-void CommandProcessor::parseCommand(const std::string& command, std::string& commandName, std::vector<std::string>& parameters) {
-    std::istringstream iss(command); // Convert the command to a stream
-    std::vector<std::string> words((std::istream_iterator<std::string>(iss)), std::istream_iterator<std::string>()); // Split the command into words
-
-    if (!words.empty()) { // If there are words in the command
-        commandName = words[0]; // The first word is the command name
-        parameters.assign(words.begin() + 1, words.end()); // The rest of the words are parameters
-        
-        commandName.erase(commandName.begin(), std::find_if(commandName.begin(), commandName.end(), [](unsigned char ch) { // Remove leading whitespace
-            return !std::isspace(ch); // Find the first character that is not whitespace
-        }));
-        commandName.erase(std::find_if(commandName.rbegin(), commandName.rend(), [](unsigned char ch) { // Remove trailing whitespace
-            return !std::isspace(ch); // Find the first character that is not whitespace
-        }).base(), commandName.end()); // Remove the characters from the first non-whitespace character to the end of the string
-
-        for (auto& parameter : parameters) { // For each parameter
-            parameter.erase(parameter.begin(), std::find_if(parameter.begin(), parameter.end(), [](unsigned char ch) { // Remove leading whitespace
-                return !std::isspace(ch); // Find the first character that is not whitespace
-            }));
-            parameter.erase(std::find_if(parameter.rbegin(), parameter.rend(), [](unsigned char ch) { // Remove trailing whitespace
-                return !std::isspace(ch); // Find the first character that is not whitespace
-            }).base(), parameter.end()); // Remove the characters from the first non-whitespace character to the end of the string
-        }
-    }
-}
-
-/**
- * @brief Executes a command.
- * @param commandName The name of the command to execute.
- * @param parameters The parameters of the command.
- */
-void CommandProcessor::executeCommand(const std::string& commandName, const std::vector<std::string>& parameters) {
-    if (commandName == "INSERT") {
-        int pos = std::stoi(parameters[0]);
-        SequenceType type = sequenceTypeMap[parameters[1]];
-        std::string sequence = parameters[2];
-        fragmentList.insert(pos, type, sequence);
-    } else if (commandName == "REMOVE") {
-        int pos = std::stoi(parameters[0]);
-        fragmentList.remove(pos);
-    } else if (commandName == "PRINT") {
-        if (!parameters.empty()) {
-            int pos = std::stoi(parameters[0]);
-            fragmentList.print(pos);
-        } else {
-            fragmentList.print();
-        }
-    } else if (commandName == "CLIP") {
-        int pos = std::stoi(parameters[0]);
-        int start = std::stoi(parameters[1]);
-        fragmentList.clip(pos, start);
-    } else if (commandName == "COPY") {
-        int pos = std::stoi(parameters[0]);
-        int pos2 = std::stoi(parameters[1]);
-        fragmentList.copy(pos, pos2);
-    } else if (commandName == "SWAP") {
-        int pos = std::stoi(parameters[0]);
-        int start = std::stoi(parameters[1]);
-        int pos2 = std::stoi(parameters[2]);
-        int start2 = std::stoi(parameters[3]);
-        fragmentList.swap(pos, start, pos2, start2);
-    } else if (commandName == "TRANSCRIBE") {
-        int pos = std::stoi(parameters[0]);
-        fragmentList.transcribe(pos);
+ * @param tokens The parsed command name and parameters.
+ */
+void CommandProcessor::parseCommand(std::string_view command, CommandTokens& tokens) {
+    std::size_t pos = 0;
+    std::size_t words = 0;
+    while (pos < command.size()) {
+        while (pos < command.size() && isSpace(command[pos])) { // Skip whitespace
+            ++pos;
+        }
+        std::size_t start = pos;
+        while (pos < command.size() && !isSpace(command[pos])) { // Find the end of the word
+            ++pos;
+        }
+        if (pos == start) {
+            break;
+        }
+        std::string_view word = command.substr(start, pos - start);
+        if (words == 0) { // The first word is the command name
+            tokens.name = word;
+        } else if (tokens.parameterCount < CommandTokens::kMaxParameters) { // The rest of the words are parameters
+            tokens.parameters[tokens.parameterCount++] = word;
+        }
+        ++words;
+    }
+}
+
+/**
+ * @brief Compiles a parsed command into an instruction.
+ * @param tokens The command name and parameters.
+ * @param source The text the tokens view, which payload offsets are relative to.
+ * @return The instruction; bad commands compile to UNKNOWN or INVALID.
+ */
+Instruction CommandProcessor::compileCommand(const CommandTokens& tokens, std::string_view source) {
+    Instruction instruction{};
+    std::array<char, 16> nameBuffer;
+    auto command = commandMap.find(toUpper(tokens.name, nameBuffer));
+    if (command == commandMap.end()) {
+        instruction.opcode = CommandType::UNKNOWN;
+        instruction.payloadOffset = tokens.name.empty() ? 0 : static_cast<std::uint64_t>(tokens.name.data() - source.data());
+        instruction.payloadLength = tokens.name.size();
+        return instruction;
+    }
+    instruction.opcode = command->second;
+
+    switch (instruction.opcode) {
+        case CommandType::INSERT: {
+            if (tokens.parameterCount < 3) {
+                return invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+            }
+            if (!readIntegers(tokens, 1, source, instruction)) {
+                return instruction;
+            }
+            std::array<char, 16> typeBuffer;
+            auto type = sequenceTypeMap.find(toUpper(tokens.parameters[1], typeBuffer));
+            if (type == sequenceTypeMap.end()) {
+                return invalidInstruction(CommandError::UNKNOWN_TYPE, tokens.parameters[1], source);
+            }
+            instruction.operands[instruction.operandCount++] = static_cast<std::int32_t>(type->second);
+            instruction.payloadOffset = static_cast<std::uint64_t>(tokens.parameters[2].data() - source.data());
+            instruction.payloadLength = tokens.parameters[2].size();
+            break;
+        }
+        case CommandType::LOAD: {
+            // load pos type file [count|all]
+            if (tokens.parameterCount < 3) {
+                return invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+            }
+            if (!readIntegers(tokens, 1, source, instruction)) {
+                return instruction;
+            }
+            std::array<char, 16> typeBuffer;
+            auto type = sequenceTypeMap.find(toUpper(tokens.parameters[1], typeBuffer));
+            if (type == sequenceTypeMap.end()) {
+                return invalidInstruction(CommandError::UNKNOWN_TYPE, tokens.parameters[1], source);
+            }
+            int count = 1;
+            if (tokens.parameterCount > 3 && !parseCount(tokens.parameters[3], count)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[3], source);
+            }
+            instruction.operands[instruction.operandCount++] = static_cast<std::int32_t>(type->second);
+            instruction.operands[instruction.operandCount++] = count;
+            instruction.payloadOffset = static_cast<std::uint64_t>(tokens.parameters[2].data() - source.data());
+            instruction.payloadLength = tokens.parameters[2].size();
+            break;
+        }
+        case CommandType::EXPORT: {
+            // export pos file [count|all]
+            if (tokens.parameterCount < 2) {
+                return invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+            }
+            if (!readIntegers(tokens, 1, source, instruction)) {
+                return instruction;
+            }
+            int count = 1;
+            if (tokens.parameterCount > 2 && !parseCount(tokens.parameters[2], count)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[2], source);
+            }
+            instruction.operands[instruction.operandCount++] = count;
+            instruction.payloadOffset = static_cast<std::uint64_t>(tokens.parameters[1].data() - source.data());
+            instruction.payloadLength = tokens.parameters[1].size();
+            break;
+        }
+        case CommandType::SAVE:
+        case CommandType::RESTORE:
+        case CommandType::LOOKUP: {
+            // save file, restore file, lookup kmer
+            if (tokens.parameterCount < 1) {
+                return invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+            }
+            instruction.payloadOffset = static_cast<std::uint64_t>(tokens.parameters[0].data() - source.data());
+            instruction.payloadLength = tokens.parameters[0].size();
+            break;
+        }
+        case CommandType::FIND: {
+            // find pos|all pattern [maxErrors]
+            if (tokens.parameterCount < 2) {
+                return invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+            }
+            std::array<char, 4> allBuffer;
+            bool all = tokens.parameters[0].size() == 3 && toUpper(tokens.parameters[0], allBuffer) == "ALL";
+            int pos = 0;
+            if (!all && !parseInteger(tokens.parameters[0], pos)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[0], source);
+            }
+            int maxErrors = 0;
+            if (tokens.parameterCount > 2 && !parseInteger(tokens.parameters[2], maxErrors)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[2], source);
+            }
+            instruction.operands[instruction.operandCount++] = pos;
+            instruction.operands[instruction.operandCount++] = maxErrors;
+            instruction.operands[instruction.operandCount++] = all ? 1 : 0;
+            instruction.payloadOffset = static_cast<std::uint64_t>(tokens.parameters[1].data() - source.data());
+            instruction.payloadLength = tokens.parameters[1].size();
+            break;
+        }
+        case CommandType::TRANSLATE: {
+            // translate pos [frame|all] [dest]
+            if (!readIntegers(tokens, 1, source, instruction)) {
+                return instruction;
+            }
+            std::array<char, 4> allBuffer;
+            bool all = tokens.parameterCount > 1 && tokens.parameters[1].size() == 3 &&
+                       toUpper(tokens.parameters[1], allBuffer) == "ALL";
+            int frame = 1;
+            if (tokens.parameterCount > 1 && !all && !parseInteger(tokens.parameters[1], frame)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[1], source);
+            }
+            int dest = 0;
+            if (tokens.parameterCount > 2 && !parseInteger(tokens.parameters[2], dest)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[2], source);
+            }
+            instruction.operands[instruction.operandCount++] = frame;
+            instruction.operands[instruction.operandCount++] = all ? 1 : 0;
+            if (tokens.parameterCount > 2) {
+                instruction.operands[instruction.operandCount++] = dest;
+            }
+            break;
+        }
+        case CommandType::ALIGN: {
+            // align pos1 pos2|all [local|global]
+            if (!readIntegers(tokens, 1, source, instruction)) {
+                return instruction;
+            }
+            if (tokens.parameterCount < 2) {
+                return invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+            }
+            std::array<char, 4> allBuffer;
+            bool all = tokens.parameters[1].size() == 3 && toUpper(tokens.parameters[1], allBuffer) == "ALL";
+            int pos2 = 0;
+            if (!all && !parseInteger(tokens.parameters[1], pos2)) {
+                return invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[1], source);
+            }
+            bool global = false;
+            if (tokens.parameterCount > 2) {
+                std::array<char, 8> modeBuffer;
+                std::string_view mode = toUpper(tokens.parameters[2], modeBuffer);
+                if (mode != "LOCAL" && mode != "GLOBAL") {
+                    return invalidInstruction(CommandError::UNKNOWN_MODE, tokens.parameters[2], source);
+                }
+                global = mode == "GLOBAL";
+            }
+            instruction.operands[instruction.operandCount++] = pos2;
+            instruction.operands[instruction.operandCount++] = all ? 1 : 0;
+            instruction.operands[instruction.operandCount++] = global ? 1 : 0;
+            break;
+        }
+        case CommandType::PRINT:
+        case CommandType::SHARES:
+        case CommandType::STATS:
+            // The position is optional
+            readIntegers(tokens, std::min<std::size_t>(tokens.parameterCount, 1), source, instruction);
+            break;
+        case CommandType::REMOVE:
+        case CommandType::TRANSCRIBE:
+        case CommandType::KMER:
+            readIntegers(tokens, 1, source, instruction);
+            break;
+        case CommandType::CLIP:
+        case CommandType::COPY:
+            readIntegers(tokens, 2, source, instruction);
+            break;
+        case CommandType::SWAP:
+        case CommandType::SCORING:
+            readIntegers(tokens, 4, source, instruction);
+            break;
+        default:
+            break;
+    }
+    return instruction;
+}
+
+/**
+ * @brief Reads the leading integer parameters of a command into instruction operands.
+ * @param tokens The command name and parameters.
+ * @param count The number of integers to read.
+ * @param source The text the tokens view.
+ * @param instruction Receives the operands, or becomes INVALID.
+ * @return True if there were enough parameters and all were integers.
+ */
+bool CommandProcessor::readIntegers(const CommandTokens& tokens, std::size_t count, std::string_view source, Instruction& instruction) {
+    if (tokens.parameterCount < count) {
+        instruction = invalidInstruction(CommandError::MISSING_PARAMETERS, {}, source);
+        return false;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        int value = 0;
+        if (!parseInteger(tokens.parameters[i], value)) {
+            instruction = invalidInstruction(CommandError::INVALID_NUMBER, tokens.parameters[i], source);
+            return false;
+        }
+        instruction.operands[instruction.operandCount++] = value;
+    }
+    return true;
+}
+
+/**
+ * @brief Recovers the list from a journal and journals every later command that changes it.
+ * @param journal The journal, owned by the caller and outliving the processor's use of it.
+ * @return False if the journal could not be recovered; nothing is journaled then.
+ */
+bool CommandProcessor::openJournal(Journal& journal) {
+    bool opened = false;
+    std::string output;
+    std::string errors;
+    {
+        // The replayed commands' output was seen when they first ran
+        OutputCapture capture;
+        opened = journal.open([this](const Instruction& instruction, std::string_view payload) {
+            executeInstruction(instruction, payload);
+        });
+        capture.take(output, errors);
+    }
+    if (!opened) {
+        commandErrors() << errors;
+        return false;
+    }
+    this->journal = &journal;
+    return true;
+}
+
+/**
+ * @brief Executes one instruction through the opcode jump table, recording it if metrics are enabled and journaling it.
+ * @param instruction The instruction.
+ * @param payload The payload of the instruction.
+ */
+void CommandProcessor::executeInstruction(const Instruction& instruction, std::string_view payload) {
+    using Handler = void (CommandProcessor::*)(const Instruction&, std::string_view);
+    static constexpr Handler handlers[] = {
+        &CommandProcessor::executeInsert,       // INSERT
+        &CommandProcessor::executeRemove,       // REMOVE
+        &CommandProcessor::executePrint,        // PRINT
+        &CommandProcessor::executeClip,         // CLIP
+        &CommandProcessor::executeCopy,         // COPY
+        &CommandProcessor::executeSwap,         // SWAP
+        &CommandProcessor::executeTranscribe,   // TRANSCRIBE
+        &CommandProcessor::executeShares,       // SHARES
+        &CommandProcessor::executeLoad,         // LOAD
+        &CommandProcessor::executeExport,       // EXPORT
+        &CommandProcessor::executeSave,         // SAVE
+        &CommandProcessor::executeRestore,      // RESTORE
+        &CommandProcessor::executeMemory,       // MEMORY
+        &CommandProcessor::executeKmer,         // KMER
+        &CommandProcessor::executeLookup,       // LOOKUP
+        &CommandProcessor::executeFind,         // FIND
+        &CommandProcessor::executeStats,        // STATS
+        &CommandProcessor::executeTranslate,    // TRANSLATE
+        &CommandProcessor::executeScoring,      // SCORING
+        &CommandProcessor::executeAlign,        // ALIGN
+        &CommandProcessor::executeMetrics,      // METRICS
+        &CommandProcessor::executeUnknown,      // UNKNOWN
+        &CommandProcessor::executeInvalid       // INVALID
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<std::size_t>(CommandType::INVALID) + 1,
+                  "Every opcode needs a handler");
+    Handler handler = handlers[static_cast<std::size_t>(instruction.opcode)];
+    if (logger) {
+        logger->log(LogLevel::DEBUG, "Executing ", commandName(instruction.opcode));
+    }
+    if (!commandMetrics().isEnabled()) {
+        (this->*handler)(instruction, payload);
+    } else {
+        // What the handler printed tells its output bytes and whether it failed
+        std::uint64_t outputBefore = 0;
+        std::uint64_t errorsBefore = 0;
+        printedBytes(outputBefore, errorsBefore);
+        auto start = std::chrono::steady_clock::now();
+        (this->*handler)(instruction, payload);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::uint64_t outputAfter = 0;
+        std::uint64_t errorsAfter = 0;
+        printedBytes(outputAfter, errorsAfter);
+
+        bool failed = errorsAfter != errorsBefore || instruction.opcode == CommandType::UNKNOWN;
+        commandMetrics().record(instruction.opcode,
+                                static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+                                payload.size() + (outputAfter - outputBefore), failed);
+    }
+    // Failed commands are journaled too, as replaying them fails the same way
+    if (journal && Journal::isJournaled(instruction)) {
+        journal->append(instruction, payload);
+    }
+}
+
+/**
+ * @brief Executes INSERT: operands are the position and the sequence type, the payload the sequence.
+ */
+void CommandProcessor::executeInsert(const Instruction& instruction, std::string_view payload) {
+    fragmentList.insert(instruction.operands[0], static_cast<SequenceType>(instruction.operands[1]), payload);
+}
+
+/**
+ * @brief Executes REMOVE: the operand is the position.
+ */
+void CommandProcessor::executeRemove(const Instruction& instruction, std::string_view) {
+    fragmentList.remove(instruction.operands[0]);
+}
+
+/**
+ * @brief Executes PRINT: the optional operand is the position.
+ */
+void CommandProcessor::executePrint(const Instruction& instruction, std::string_view) {
+    if (instruction.operandCount != 0) {
+        fragmentList.print(instruction.operands[0]);
+    } else {
+        fragmentList.print();
+    }
+}
+
+/**
+ * @brief Executes CLIP: operands are the position and the start.
+ */
+void CommandProcessor::executeClip(const Instruction& instruction, std::string_view) {
+    fragmentList.clip(instruction.operands[0], instruction.operands[1]);
+}
+
+/**
+ * @brief Executes COPY: operands are the source and destination positions.
+ */
+void CommandProcessor::executeCopy(const Instruction& instruction, std::string_view) {
+    fragmentList.copy(instruction.operands[0], instruction.operands[1]);
+}
+
+/**
+ * @brief Executes SWAP: operands are both positions, each followed by its start.
+ */
+void CommandProcessor::executeSwap(const Instruction& instruction, std::string_view) {
+    fragmentList.swap(instruction.operands[0], instruction.operands[1], instruction.operands[2], instruction.operands[3]);
+}
+
+/**
+ * @brief Executes TRANSCRIBE: the operand is the position.
+ */
+void CommandProcessor::executeTranscribe(const Instruction& instruction, std::string_view) {
+    fragmentList.transcribe(instruction.operands[0]);
+}
+
+/**
+ * @brief Executes SHARES: the optional operand is the position.
+ */
+void CommandProcessor::executeShares(const Instruction& instruction, std::string_view) {
+    if (instruction.operandCount != 0) {
+        fragmentList.printSharing(instruction.operands[0]);
+    } else {
+        fragmentList.printSharing();
+    }
+}
+
+/**
+ * @brief Executes LOAD: operands are the position, the sequence type and the record count, the payload the file.
+ */
+void CommandProcessor::executeLoad(const Instruction& instruction, std::string_view payload) {
+    fragmentList.load(instruction.operands[0], static_cast<SequenceType>(instruction.operands[1]),
+                      std::string(payload), instruction.operands[2]);
+}
+
+/**
+ * @brief Executes EXPORT: operands are the position and the position count, the payload the file.
+ */
+void CommandProcessor::executeExport(const Instruction& instruction, std::string_view payload) {
+    fragmentList.exportFasta(instruction.operands[0], instruction.operands[1], std::string(payload));
+}
+
+/**
+ * @brief Executes SAVE: the payload is the snapshot file.
+ */
+void CommandProcessor::executeSave(const Instruction&, std::string_view payload) {
+    fragmentList.save(std::string(payload));
+}
+
+/**
+ * @brief Executes RESTORE: the payload is the snapshot file.
+ */
+void CommandProcessor::executeRestore(const Instruction&, std::string_view payload) {
+    fragmentList.restore(std::string(payload));
+}
+
+/**
+ * @brief Executes MEMORY: prints the live, peak and reserved bytes and the fragmentation of each pool.
+ */
+void CommandProcessor::executeMemory(const Instruction&, std::string_view) {
+    const std::pair<const char*, MemoryPool&> pools[] = {
+        {"Fragment pool", fragmentPool()},
+        {"Sequence arena", sequenceArena()}
+    };
+    for (const auto& pool : pools) {
+        MemoryStatistics statistics = pool.second.getStatistics();
+        char fragmentation[16];
+        std::snprintf(fragmentation, sizeof(fragmentation), "%.1f", statistics.getFragmentation());
+        commandOutput() << pool.first << ": live " << statistics.liveBytes << " bytes, peak " << statistics.peakBytes
+                        << " bytes, reserved " << statistics.reservedBytes << " bytes, fragmentation " << fragmentation << "%\n";
+    }
+}
+
+/**
+ * @brief Executes KMER: the operand is the k-mer length, 0 to disable the index.
+ */
+void CommandProcessor::executeKmer(const Instruction& instruction, std::string_view) {
+    fragmentList.setKmerLength(instruction.operands[0]);
+}
+
+/**
+ * @brief Executes LOOKUP: the payload is the k-mer.
+ */
+void CommandProcessor::executeLookup(const Instruction&, std::string_view payload) {
+    fragmentList.lookup(payload);
+}
+
+/**
+ * @brief Executes FIND: operands are the position, the error limit and whether to search every position, the payload the pattern.
+ */
+void CommandProcessor::executeFind(const Instruction& instruction, std::string_view payload) {
+    fragmentList.find(instruction.operands[0], instruction.operands[2] != 0, payload, instruction.operands[1]);
+}
+
+/**
+ * @brief Executes STATS: the optional operand is the position.
+ */
+void CommandProcessor::executeStats(const Instruction& instruction, std::string_view) {
+    if (instruction.operandCount != 0) {
+        fragmentList.printStats(instruction.operands[0]);
     } else {
-        //logger.log(LogLevel::ERROR, "Unknown command: " + commandName);
-        std::cout << "Unknown command: " + commandName << std::endl;
+        fragmentList.printStats();
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Executes TRANSLATE: operands are the position, the frame, whether to translate all six frames and, if given, where to store the proteins.
+ */
+void CommandProcessor::executeTranslate(const Instruction& instruction, std::string_view) {
+    fragmentList.translate(instruction.operands[0], instruction.operands[2] != 0, instruction.operands[1],
+                           instruction.operandCount > 3, instruction.operands[3]);
+}
+
+/**
+ * @brief Executes SCORING: operands are the match, mismatch, gap open and gap extend scores.
+ */
+void CommandProcessor::executeScoring(const Instruction& instruction, std::string_view) {
+    fragmentList.setScoring(instruction.operands[0], instruction.operands[1], instruction.operands[2],
+                            instruction.operands[3]);
+}
+
+/**
+ * @brief Executes ALIGN: operands are the query and target positions, whether to align against every position and whether to align globally.
+ */
+void CommandProcessor::executeAlign(const Instruction& instruction, std::string_view) {
+    fragmentList.align(instruction.operands[0], instruction.operands[1], instruction.operands[2] != 0,
+                       instruction.operands[3] != 0);
+}
+
+/**
+ * @brief Executes METRICS: prints the calls, errors, bytes and latency percentiles of each command run so far.
+ */
+void CommandProcessor::executeMetrics(const Instruction&, std::string_view) {
+    if (!commandMetrics().isEnabled()) {
+        commandErrors() << "Metrics are disabled. Run with -M to enable them.\n";
+        return;
+    }
+    commandMetrics().write(commandOutput());
+}
+
+/**
+ * @brief Reports an unknown command: the payload is the command name as written.
+ */
+void CommandProcessor::executeUnknown(const Instruction&, std::string_view payload) {
+    if (logger) {
+        logger->log(LogLevel::ERROR, "Unknown command: ", payload);
+    }
+    commandOutput() << "Unknown command: ";
+    for (char c : payload) {
+        commandOutput().put(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+    }
+    commandOutput() << std::endl;
+}
+
+/**
+ * @brief Reports a command with bad parameters: the operand is the CommandError.
+ */
+void CommandProcessor::executeInvalid(const Instruction& instruction, std::string_view payload) {
+    switch (static_cast<CommandError>(instruction.operands[0])) {
+        case CommandError::MISSING_PARAMETERS:
+            commandErrors() << "Missing parameters for the command.\n";
+            break;
+        case CommandError::INVALID_NUMBER:
+            commandErrors() << "Invalid number: " << payload << "\n";
+            break;
+        case CommandError::UNKNOWN_TYPE:
+            commandErrors() << "Unknown sequence type: " << payload << "\n";
+            break;
+        case CommandError::UNKNOWN_MODE:
+            commandErrors() << "Unknown alignment mode: " << payload << ". It must be local or global.\n";
+            break;
+    }
+}
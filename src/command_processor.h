@@ -1,24 +1,29 @@
 #ifndef COMMAND_PROCESSOR_H
 #define COMMAND_PROCESSOR_H
 
-//#include "logger.h"
+#include "logger.h"
 #include "fragment_list.h"
+#include "journal.h"
+#include "command_program.h"
+#include "command_scheduler.h"
+#include "command_shards.h"
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <memory>
 
 /**
- * @enum CommandType
- * @brief Enum class for the type of a command used.
+ * @struct CommandTokens
+ * @brief The words of one command, viewing the command text in place.
 */
-enum class CommandType {
-    INSERT,         
-    REMOVE,         
-    PRINT,
-    CLIP,
-    COPY,
-    SWAP,
-    TRANSCRIBE
+struct CommandTokens {
+    static constexpr std::size_t kMaxParameters = 8; ///< Further words are ignored.
+
+    std::string_view name; ///< The command name, as written.
+    std::array<std::string_view, kMaxParameters> parameters; ///< The parameters, as written.
+    std::size_t parameterCount = 0; ///< The number of parameters.
 };
 
 /**
@@ -30,32 +35,133 @@ public:
     /**
      * @brief Constructs a new Command Processor object.
      * @param fragmentsCount The number of fragments, default is 8.
-     * @param logger The logger object.
+     * @param fragmentList The list the commands act on.
     */
     CommandProcessor(int fragmentsCount, FragmentList& fragmentList);
     /**
      * @brief Processes a command.
-     * @param command The command to process.
+     * @param command The command to process, viewed in place; nothing is copied.
+    */
+    void processCommand(std::string_view command);
+
+    /**
+     * @brief Compiles a command script into a program without executing it.
+     * @param script The script, one command per line; it must outlive the program.
+     * @param program Receives one instruction per non-empty line.
+    */
+    void compile(std::string_view script, CommandProgram& program);
+
+    /**
+     * @brief Executes a compiled program.
+     * @param program The program.
+    */
+    void run(const CommandProgram& program);
+
+    /**
+     * @brief Executes a compiled program, handing each instruction's output to a callback instead of printing it.
+     * @param program The program.
+     * @param collect Receives the index, results and diagnostics of each instruction, in program order.
+    */
+    void run(const CommandProgram& program, const CommandScheduler::Collector& collect);
+
+    /**
+     * @brief Sets how many threads run compiled programs and searches.
+     * @param threadCount The number of threads; 1 runs commands one after another on the calling thread.
+    */
+    void setThreadCount(int threadCount);
+
+    /**
+     * @brief Partitions the positions between shard threads, which then run compiled programs in place of the scheduler.
+     * @param shardCount The number of shards; 1 goes back to the scheduler or the calling thread.
     */
-    void processCommand(const std::string& command);
+    void setShardCount(int shardCount);
+
+    /**
+     * @brief Sets the logger commands are logged to.
+     * @param logger The logger, owned by the caller, or null to log nothing.
+    */
+    void setLogger(Logger* logger);
+
+    /**
+     * @brief Recovers the list from a journal and journals every later command that changes it.
+     *
+     * Commands replayed from the journal print nothing. Programs commit the
+     * journal after every window of commands and once they finish, so their
+     * commands are durable when run() returns.
+     * @param journal The journal, owned by the caller and outliving the processor's use of it.
+     * @return False if the journal could not be recovered; nothing is journaled then.
+    */
+    bool openJournal(Journal& journal);
 
 private:
-    FragmentList fragmentList; 
+    static constexpr std::size_t kCommitWindow = 1024; ///< The commands run one after another between journal commits.
+
+    FragmentList& fragmentList; ///< The list the commands act on, owned by the caller.
 
     int fragmentsCount; ///< The number of fragments.
 
-    std::map<std::string, CommandType> commandMap; ///< Map of command names to command types.
-    std::map<std::string, SequenceType> sequenceTypeMap; ///< Map of sequence types to sequence type enum values.
+    std::map<std::string, CommandType, std::less<>> commandMap; ///< Map of command names to command types.
+    std::map<std::string, SequenceType, std::less<>> sequenceTypeMap; ///< Map of sequence types to sequence type enum values.
+    std::unique_ptr<CommandScheduler> scheduler; ///< Runs programs in parallel, null when single threaded.
+    std::unique_ptr<CommandShards> shards; ///< Runs programs one thread per shard of the positions, null unless sharded.
+    Logger* logger = nullptr; ///< Where commands are logged, owned by the caller; null to log nothing.
+    Journal* journal = nullptr; ///< Where changing commands are journaled, owned by the caller; null to journal nothing.
     
     /**
-     * @brief Parses a command.
+     * @brief Splits a command into words without copying it.
      * @param command The command being parsed.
-     * @param commandName The parsed command name.
-     * @param parameters The parsed parameters.
+     * @param tokens The parsed command name and parameters.
+    */
+    void parseCommand(std::string_view command, CommandTokens& tokens);
+
+    /**
+     * @brief Compiles a parsed command into an instruction.
+     * @param tokens The command name and parameters.
+     * @param source The text the tokens view, which payload offsets are relative to.
+     * @return The instruction; bad commands compile to UNKNOWN or INVALID.
+    */
+    Instruction compileCommand(const CommandTokens& tokens, std::string_view source);
+
+    /**
+     * @brief Reads the leading integer parameters of a command into instruction operands.
+     * @param tokens The command name and parameters.
+     * @param count The number of integers to read.
+     * @param source The text the tokens view.
+     * @param instruction Receives the operands, or becomes INVALID.
+     * @return True if there were enough parameters and all were integers.
+    */
+    bool readIntegers(const CommandTokens& tokens, std::size_t count, std::string_view source, Instruction& instruction);
+
+    /**
+     * @brief Executes one instruction through the opcode jump table, recording it if metrics are enabled and journaling it.
+     * @param instruction The instruction.
+     * @param payload The payload of the instruction.
     */
-    void parseCommand(const std::string& command, std::string& commandName, std::vector<std::string>& parameters);
+    void executeInstruction(const Instruction& instruction, std::string_view payload);
 
-    void executeCommand(const std::string& commandName, const std::vector<std::string>& parameters);
+    void executeInsert(const Instruction& instruction, std::string_view payload); ///< Executes INSERT.
+    void executeRemove(const Instruction& instruction, std::string_view payload); ///< Executes REMOVE.
+    void executePrint(const Instruction& instruction, std::string_view payload); ///< Executes PRINT.
+    void executeClip(const Instruction& instruction, std::string_view payload); ///< Executes CLIP.
+    void executeCopy(const Instruction& instruction, std::string_view payload); ///< Executes COPY.
+    void executeSwap(const Instruction& instruction, std::string_view payload); ///< Executes SWAP.
+    void executeTranscribe(const Instruction& instruction, std::string_view payload); ///< Executes TRANSCRIBE.
+    void executeShares(const Instruction& instruction, std::string_view payload); ///< Executes SHARES.
+    void executeLoad(const Instruction& instruction, std::string_view payload); ///< Executes LOAD.
+    void executeExport(const Instruction& instruction, std::string_view payload); ///< Executes EXPORT.
+    void executeSave(const Instruction& instruction, std::string_view payload); ///< Executes SAVE.
+    void executeRestore(const Instruction& instruction, std::string_view payload); ///< Executes RESTORE.
+    void executeMemory(const Instruction& instruction, std::string_view payload); ///< Executes MEMORY.
+    void executeKmer(const Instruction& instruction, std::string_view payload); ///< Executes KMER.
+    void executeLookup(const Instruction& instruction, std::string_view payload); ///< Executes LOOKUP.
+    void executeFind(const Instruction& instruction, std::string_view payload); ///< Executes FIND.
+    void executeStats(const Instruction& instruction, std::string_view payload); ///< Executes STATS.
+    void executeTranslate(const Instruction& instruction, std::string_view payload); ///< Executes TRANSLATE.
+    void executeScoring(const Instruction& instruction, std::string_view payload); ///< Executes SCORING.
+    void executeAlign(const Instruction& instruction, std::string_view payload); ///< Executes ALIGN.
+    void executeMetrics(const Instruction& instruction, std::string_view payload); ///< Executes METRICS.
+    void executeUnknown(const Instruction& instruction, std::string_view payload); ///< Reports an unknown command.
+    void executeInvalid(const Instruction& instruction, std::string_view payload); ///< Reports bad parameters.
 
 };
 #endif // COMMAND_PROCESSOR_H
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "command_program.h"
+#include "mapped_file.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<Instruction>::value, "Instructions are written to disk as raw bytes");
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'N', 'A', 'P', 'R', 'O', 'G', '\0'}; ///< Identifies a cache file.
+
+/**
+ * @struct ProgramHeader
+ * @brief The start of a cache file; instructions and then payload text follow.
+ */
+struct ProgramHeader {
+    char magic[8]; ///< kMagic.
+    std::uint32_t version; ///< kProgramVersion.
+    std::uint32_t instructionSize; ///< sizeof(Instruction) when written.
+    std::uint64_t instructionCount; ///< The number of instructions.
+    std::uint64_t payloadSize; ///< The number of payload bytes.
+    std::uint64_t sourceSize; ///< The size of the script compiled.
+    std::int64_t sourceModified; ///< The modification time of the script compiled, in nanoseconds.
+    std::uint64_t sourceInode; ///< The inode of the script compiled.
+};
+
+} // namespace
+
+/**
+ * @brief Constructs an empty program.
+ */
+CommandProgram::CommandProgram()
+    : sourceSize(0), sourceModified(0), sourceInode(0) {}
+
+/**
+ * @brief Destroys the program, unmapping a loaded cache.
+ */
+CommandProgram::~CommandProgram() = default;
+
+/**
+ * @brief Sets the text that payload offsets point into.
+ * @param text The script text; it must outlive the program.
+ */
+void CommandProgram::setSource(std::string_view text) {
+    source = text;
+}
+
+/**
+ * @brief Appends an instruction.
+ * @param instruction The instruction.
+ */
+void CommandProgram::append(const Instruction& instruction) {
+    instructions.push_back(instruction);
+}
+
+/**
+ * @brief Getter for the instructions.
+ * @return The instructions, in execution order.
+ */
+const std::vector<Instruction>& CommandProgram::getInstructions() const {
+    return instructions;
+}
+
+/**
+ * @brief Getter for the payload of an instruction.
+ * @param instruction An instruction of this program.
+ * @return The payload text.
+ */
+std::string_view CommandProgram::getPayload(const Instruction& instruction) const {
+    return source.substr(instruction.payloadOffset, instruction.payloadLength);
+}
+
+/**
+ * @brief Records which script the program was compiled from.
+ * @param size The size of the script file in bytes.
+ * @param modified The modification time of the script file, in nanoseconds.
+ * @param inode The inode of the script file, which changes when an editor replaces it.
+ */
+void CommandProgram::setSourceStamp(std::uint64_t size, std::int64_t modified, std::uint64_t inode) {
+    sourceSize = size;
+    sourceModified = modified;
+    sourceInode = inode;
+}
+
+/**
+ * @brief Checks whether the program was compiled from a given script.
+ * @param size The size of the script file in bytes.
+ * @param modified The modification time of the script file, in nanoseconds.
+ * @param inode The inode of the script file.
+ * @return True if all three match the recorded stamp.
+ */
+bool CommandProgram::matchesSource(std::uint64_t size, std::int64_t modified, std::uint64_t inode) const {
+    return sourceSize == size && sourceModified == modified && sourceInode == inode;
+}
+
+/**
+ * @brief Writes the program to a cache file, keeping only the referenced payloads.
+ * @param path The path of the cache file.
+ * @return True if the file was written.
+ */
+bool CommandProgram::save(const std::string& path) const {
+    // Gather the payloads so comments and whitespace of the script are dropped
+    std::vector<Instruction> packed(instructions);
+    std::uint64_t payloadSize = 0;
+    for (Instruction& instruction : packed) {
+        instruction.payloadOffset = payloadSize;
+        payloadSize += instruction.payloadLength;
+    }
+
+    ProgramHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kProgramVersion;
+    header.instructionSize = sizeof(Instruction);
+    header.instructionCount = packed.size();
+    header.payloadSize = payloadSize;
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified;
+    header.sourceInode = sourceInode;
+
+    // Written next to the cache and renamed over it, so a crash or another
+    // run never leaves a torn cache for the next run to load
+    std::string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(packed.data()), packed.size() * sizeof(Instruction));
+    for (const Instruction& instruction : instructions) {
+        std::string_view payload = getPayload(instruction);
+        file.write(payload.data(), payload.size());
+    }
+    file.close();
+    if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces the program with one read from a cache file.
+ * @param path The path of the cache file.
+ * @return True if the file held a valid program of this version.
+ */
+bool CommandProgram::load(const std::string& path) {
+    std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>(path);
+    std::string_view data = file->data();
+    ProgramHeader header;
+    if (!file->isOpen() || data.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kProgramVersion ||
+        header.instructionSize != sizeof(Instruction) ||
+        header.instructionCount > (data.size() - sizeof(header)) / sizeof(Instruction) ||
+        header.payloadSize != data.size() - sizeof(header) - header.instructionCount * sizeof(Instruction)) {
+        return false;
+    }
+
+    std::vector<Instruction> loaded(header.instructionCount);
+    std::memcpy(loaded.data(), data.data() + sizeof(header), loaded.size() * sizeof(Instruction));
+    for (const Instruction& instruction : loaded) {
+        if (instruction.opcode > CommandType::INVALID || instruction.operandCount > 4 ||
+            instruction.payloadOffset > header.payloadSize ||
+            instruction.payloadLength > header.payloadSize - instruction.payloadOffset) {
+            return false;
+        }
+    }
+
+    instructions = std::move(loaded);
+    source = data.substr(sizeof(header) + header.instructionCount * sizeof(Instruction));
+    cache = std::move(file);
+    sourceSize = header.sourceSize;
+    sourceModified = header.sourceModified;
+    sourceInode = header.sourceInode;
+    return true;
+}
@@ -0,0 +1,155 @@
+#ifndef COMMAND_PROGRAM_H
+#define COMMAND_PROGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MappedFile;
+
+/// Bumped whenever the opcodes or the Instruction layout change; cached programs and journals of other versions are rejected.
+constexpr std::uint32_t kProgramVersion = 10;
+
+/**
+ * @enum CommandType
+ * @brief Enum class for the type of a command used, doubling as the opcode of a compiled command.
+*/
+enum class CommandType : std::uint8_t {
+    INSERT,
+    REMOVE,
+    PRINT,
+    CLIP,
+    COPY,
+    SWAP,
+    TRANSCRIBE,
+    SHARES,
+    LOAD,       ///< Operands: position, sequence type, record count (-1 for all); payload: the file.
+    EXPORT,     ///< Operands: position, position count (-1 for all); payload: the file.
+    SAVE,       ///< Payload: the snapshot file.
+    RESTORE,    ///< Payload: the snapshot file.
+    MEMORY,     ///< Prints the allocator statistics.
+    KMER,       ///< Operand: the k-mer length, 0 to disable the index.
+    LOOKUP,     ///< Payload: the k-mer.
+    FIND,       ///< Operands: position, error limit, 1 to search every position; payload: the pattern.
+    STATS,      ///< Optional operand: the position.
+    TRANSLATE,  ///< Operands: position, frame, 1 for all six frames, and the first position to store at if given.
+    SCORING,    ///< Operands: match, mismatch, gap open and gap extend scores.
+    ALIGN,      ///< Operands: query position, target position, 1 to align against every position, 1 for global.
+    METRICS,    ///< Prints the per-command metrics.
+    UNKNOWN,    ///< A command name that is not recognised; reported when executed.
+    INVALID     ///< A command with bad parameters; reported when executed.
+};
+
+/**
+ * @enum CommandError
+ * @brief Why a command compiled to CommandType::INVALID.
+*/
+enum class CommandError : std::int32_t {
+    MISSING_PARAMETERS, ///< Fewer parameters than the command needs.
+    INVALID_NUMBER,     ///< A parameter that should be an integer is not; the payload is the word.
+    UNKNOWN_TYPE,       ///< An insert names an unknown sequence type; the payload is the word.
+    UNKNOWN_MODE        ///< An align names an unknown alignment mode; the payload is the word.
+};
+
+/**
+ * @struct Instruction
+ * @brief One compiled command: an opcode, its integer operands and a payload reference.
+ *
+ * The layout is written to disk as is, so it only holds fixed-size fields.
+*/
+struct Instruction {
+    CommandType opcode; ///< What to execute.
+    std::uint8_t operandCount; ///< The number of operands used.
+    std::int32_t operands[4]; ///< The integer operands, an error code for INVALID.
+    std::uint64_t payloadOffset; ///< The start of the payload in the program's payload text.
+    std::uint64_t payloadLength; ///< The length of the payload: a sequence, or the offending word.
+};
+
+/**
+ * @class CommandProgram
+ * @brief A compiled command script that can be cached on disk and replayed.
+ *
+ * Payloads are views: into the script text for a freshly compiled program,
+ * or into the mapped cache file for a loaded one.
+*/
+class CommandProgram {
+public:
+    /**
+     * @brief Constructs an empty program.
+    */
+    CommandProgram();
+
+    /**
+     * @brief Destroys the program, unmapping a loaded cache.
+    */
+    ~CommandProgram();
+
+    /**
+     * @brief Sets the text that payload offsets point into.
+     * @param text The script text; it must outlive the program.
+    */
+    void setSource(std::string_view text);
+
+    /**
+     * @brief Appends an instruction.
+     * @param instruction The instruction.
+    */
+    void append(const Instruction& instruction);
+
+    /**
+     * @brief Getter for the instructions.
+     * @return The instructions, in execution order.
+    */
+    const std::vector<Instruction>& getInstructions() const;
+
+    /**
+     * @brief Getter for the payload of an instruction.
+     * @param instruction An instruction of this program.
+     * @return The payload text.
+    */
+    std::string_view getPayload(const Instruction& instruction) const;
+
+    /**
+     * @brief Records which script the program was compiled from.
+     * @param size The size of the script file in bytes.
+     * @param modified The modification time of the script file, in nanoseconds.
+     * @param inode The inode of the script file, which changes when an editor replaces it.
+    */
+    void setSourceStamp(std::uint64_t size, std::int64_t modified, std::uint64_t inode);
+
+    /**
+     * @brief Checks whether the program was compiled from a given script.
+     * @param size The size of the script file in bytes.
+     * @param modified The modification time of the script file, in nanoseconds.
+     * @param inode The inode of the script file.
+     * @return True if all three match the recorded stamp.
+    */
+    bool matchesSource(std::uint64_t size, std::int64_t modified, std::uint64_t inode) const;
+
+    /**
+     * @brief Writes the program to a cache file, keeping only the referenced payloads.
+     * @param path The path of the cache file.
+     * @return True if the file was written.
+    */
+    bool save(const std::string& path) const;
+
+    /**
+     * @brief Replaces the program with one read from a cache file.
+     * @param path The path of the cache file.
+     * @return True if the file held a valid program of this version.
+    */
+    bool load(const std::string& path);
+
+private:
+    std::vector<Instruction> instructions; ///< The compiled commands.
+    std::string_view source; ///< The text payload offsets point into.
+    std::unique_ptr<MappedFile> cache; ///< The mapped cache file of a loaded program.
+    std::uint64_t sourceSize; ///< The size of the script the program came from.
+    std::int64_t sourceModified; ///< The modification time of the script the program came from, in nanoseconds.
+    std::uint64_t sourceInode; ///< The inode of the script the program came from.
+};
+
+#endif // COMMAND_PROGRAM_H
@@ -0,0 +1,238 @@
+#include "command_scheduler.h"
+#include "command_output.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+/**
+ * @struct Task
+ * @brief One scheduled instruction.
+ */
+struct Task {
+    const Instruction* instruction = nullptr; ///< The instruction.
+    std::atomic<int> waiting{0}; ///< The number of unfinished tasks it depends on.
+    std::vector<std::size_t> successors; ///< The tasks that depend on it.
+    std::string output; ///< The results it printed.
+    std::string errors; ///< The diagnostics it printed.
+};
+
+/**
+ * @struct SlotState
+ * @brief The tasks of a window that last used a slot.
+ */
+struct SlotState {
+    std::size_t writer = SIZE_MAX; ///< The last task writing the slot, if any.
+    std::vector<std::size_t> readers; ///< The tasks reading the slot since then.
+};
+
+/**
+ * @brief Makes one task wait for another.
+ * @param tasks The tasks of the window.
+ * @param from The earlier task.
+ * @param to The later task.
+ */
+void addEdge(Task* tasks, std::size_t from, std::size_t to) {
+    std::vector<std::size_t>& successors = tasks[from].successors;
+    if (successors.empty() || successors.back() != to) {
+        successors.push_back(to);
+        tasks[to].waiting++;
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Works out which slots an instruction touches.
+ * @param instruction The instruction.
+ * @return The slots and how they are used.
+ */
+SlotAccess slotAccessOf(const Instruction& instruction) {
+    SlotAccess access;
+    auto touch = [&access](int slot, bool write) {
+        access.slots[access.count] = slot;
+        access.writes[access.count] = write;
+        ++access.count;
+    };
+    switch (instruction.opcode) {
+        case CommandType::INSERT:
+        case CommandType::REMOVE:
+        case CommandType::CLIP:
+        case CommandType::TRANSCRIBE:
+            touch(instruction.operands[0], true);
+            break;
+        case CommandType::PRINT:
+        case CommandType::STATS:
+            if (instruction.operandCount != 0) {
+                touch(instruction.operands[0], false);
+            } else {
+                access.everySlot = true;
+            }
+            break;
+        case CommandType::COPY:
+            touch(instruction.operands[0], false);
+            touch(instruction.operands[1], true);
+            break;
+        case CommandType::SWAP:
+            touch(instruction.operands[0], true);
+            touch(instruction.operands[2], true);
+            break;
+        case CommandType::TRANSLATE:
+            if (instruction.operandCount > 3) {
+                // Storing covers a range of positions
+                access.everySlot = true;
+            } else {
+                touch(instruction.operands[0], false);
+            }
+            break;
+        case CommandType::FIND:
+            if (instruction.operands[2] == 0) {
+                touch(instruction.operands[0], false);
+            } else {
+                access.everySlot = true;
+            }
+            break;
+        case CommandType::ALIGN:
+            if (instruction.operands[2] == 0) {
+                touch(instruction.operands[0], false);
+                touch(instruction.operands[1], false);
+            } else {
+                access.everySlot = true;
+            }
+            break;
+        case CommandType::SCORING:
+            // Every later alignment reads the scores
+            access.everySlot = true;
+            break;
+        case CommandType::SHARES:
+        case CommandType::MEMORY:
+        case CommandType::METRICS:
+        case CommandType::KMER:
+        case CommandType::LOOKUP:
+            // Sharing counts, allocator and command statistics and the k-mer index depend on every earlier command
+            access.everySlot = true;
+            break;
+        case CommandType::LOAD:
+        case CommandType::EXPORT:
+        case CommandType::SAVE:
+        case CommandType::RESTORE:
+            // They cover ranges of slots, and commands may share files
+            access.everySlot = true;
+            break;
+        default:
+            // Reported without touching the list
+            break;
+    }
+    return access;
+}
+
+/**
+ * @brief Starts the thread pool.
+ * @param threadCount The number of worker threads.
+ */
+CommandScheduler::CommandScheduler(int threadCount)
+    : pool(threadCount) {}
+
+/**
+ * @brief Getter for the thread pool, which commands may share out their own work on.
+ * @return The pool.
+ */
+ThreadPool& CommandScheduler::getPool() {
+    return pool;
+}
+
+/**
+ * @brief Executes instructions, printing their output in order.
+ * @param instructions The instructions, in program order.
+ * @param execute Executes one instruction; called from the worker threads.
+ * @param collect If set, receives each instruction's results and diagnostics in order instead of printing them.
+ * @param settle If set, runs after each window finishes, before its output is written.
+ */
+void CommandScheduler::run(const std::vector<Instruction>& instructions, const Executor& execute, const Collector& collect,
+                           const Settler& settle) {
+    for (std::size_t start = 0; start < instructions.size(); start += kWindow) {
+        std::size_t count = std::min(kWindow, instructions.size() - start);
+        std::unique_ptr<Task[]> tasks(new Task[count]);
+
+        // Link each task to the earlier ones it conflicts with
+        std::unordered_map<int, SlotState> slots;
+        std::size_t barrier = SIZE_MAX;
+        for (std::size_t i = 0; i < count; ++i) {
+            tasks[i].instruction = &instructions[start + i];
+            SlotAccess access = slotAccessOf(*tasks[i].instruction);
+            if (access.everySlot) {
+                std::size_t first = barrier == SIZE_MAX ? 0 : barrier;
+                for (std::size_t j = first; j < i; ++j) {
+                    addEdge(tasks.get(), j, i);
+                }
+                barrier = i;
+                slots.clear();
+                continue;
+            }
+            if (barrier != SIZE_MAX) {
+                addEdge(tasks.get(), barrier, i);
+            }
+            for (int k = 0; k < access.count; ++k) {
+                SlotState& slot = slots[access.slots[k]];
+                if (slot.writer != SIZE_MAX && slot.writer != i) {
+                    addEdge(tasks.get(), slot.writer, i);
+                }
+                if (access.writes[k]) {
+                    for (std::size_t reader : slot.readers) {
+                        if (reader != i) {
+                            addEdge(tasks.get(), reader, i);
+                        }
+                    }
+                    slot.readers.clear();
+                    slot.writer = i;
+                } else if (slot.writer != i) {
+                    slot.readers.push_back(i);
+                }
+            }
+        }
+
+        // Each task releases its successors when it finishes
+        std::function<void(std::size_t)> runTask = [&](std::size_t i) {
+            thread_local OutputCapture capture;
+            Task& task = tasks[i];
+            execute(*task.instruction);
+            capture.take(task.output, task.errors);
+            for (std::size_t next : task.successors) {
+                if (--tasks[next].waiting == 0) {
+                    pool.submit([&runTask, next] { runTask(next); });
+                }
+            }
+        };
+        // Find every root before starting any, as running tasks release others
+        std::vector<std::size_t> roots;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (tasks[i].waiting == 0) {
+                roots.push_back(i);
+            }
+        }
+        for (std::size_t i : roots) {
+            pool.submit([&runTask, i] { runTask(i); });
+        }
+        pool.wait();
+        if (settle) {
+            settle();
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            if (collect) {
+                collect(start + i, tasks[i].output, tasks[i].errors);
+                continue;
+            }
+            if (!tasks[i].output.empty()) {
+                commandOutput() << tasks[i].output;
+            }
+            if (!tasks[i].errors.empty()) {
+                commandErrors() << tasks[i].errors;
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef COMMAND_SCHEDULER_H
+#define COMMAND_SCHEDULER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "command_program.h"
+#include "thread_pool.h"
+
+/**
+ * @struct SlotAccess
+ * @brief The slots one instruction reads and writes.
+ */
+struct SlotAccess {
+    int slots[2]; ///< The positions touched.
+    bool writes[2]; ///< Whether each position is written.
+    int count = 0; ///< The number of positions touched.
+    bool everySlot = false; ///< True if the instruction may use any slot, which makes it a barrier.
+};
+
+/**
+ * @brief Works out which slots an instruction touches.
+ * @param instruction The instruction.
+ * @return The slots and how they are used.
+ */
+SlotAccess slotAccessOf(const Instruction& instruction);
+
+/**
+ * @class CommandScheduler
+ * @brief Runs compiled commands on a thread pool, in parallel where they touch different slots.
+ *
+ * Commands are taken a window at a time. Within a window each command waits
+ * only for the earlier commands that write a slot it reads or writes, or read
+ * a slot it writes; commands that may use any slot wait for all earlier ones,
+ * and all later ones wait for them.
+ * What each command prints is captured and written out in command order, so
+ * the output is the same as running the commands one after another.
+ */
+class CommandScheduler {
+public:
+    using Executor = std::function<void(const Instruction&)>; ///< Executes one instruction.
+    /// Receives what one instruction printed, given its index; the strings may be moved from.
+    using Collector = std::function<void(std::size_t, std::string&, std::string&)>;
+    using Settler = std::function<void()>; ///< Runs between windows, while no instruction runs.
+
+    /**
+     * @brief Starts the thread pool.
+     * @param threadCount The number of worker threads.
+     */
+    explicit CommandScheduler(int threadCount);
+
+    /**
+     * @brief Executes instructions, printing their output in order.
+     * @param instructions The instructions, in program order.
+     * @param execute Executes one instruction; called from the worker threads.
+     * @param collect If set, receives each instruction's results and diagnostics in order instead of printing them.
+     * @param settle If set, runs after each window finishes, before its output is written.
+     */
+    void run(const std::vector<Instruction>& instructions, const Executor& execute, const Collector& collect = nullptr,
+             const Settler& settle = nullptr);
+
+    /**
+     * @brief Getter for the thread pool, which commands may share out their own work on.
+     * @return The pool.
+     */
+    ThreadPool& getPool();
+
+private:
+    static constexpr std::size_t kWindow = 1024; ///< The number of commands scheduled together.
+
+    ThreadPool pool; ///< The worker threads.
+};
+
+#endif // COMMAND_SCHEDULER_H
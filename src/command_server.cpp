@@ -0,0 +1,349 @@
+#include "command_server.h"
+#include "command_output.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <utility>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+volatile std::sig_atomic_t interrupted = 0; ///< Set by SIGINT or SIGTERM.
+
+/**
+ * @brief Asks the server to stop once its current round is done.
+ */
+void onInterrupt(int) {
+    interrupted = 1;
+}
+
+/**
+ * @brief Checks for a line holding nothing but whitespace, or a comment.
+ * @param line The line.
+ * @return True if it has no command, as it compiles to nothing.
+ */
+bool isBlank(std::string_view line) {
+    for (char c : line) {
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f') {
+            return c == '#';
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for the CommandServer class
+ *
+ * @param processor Runs the commands
+ * @param socketPath The socket to listen on, or "-" to serve standard input alone
+ * @param logger Where connections are logged, or null
+ */
+CommandServer::CommandServer(CommandProcessor& processor, std::string socketPath, Logger* logger)
+    : processor(processor), socketPath(std::move(socketPath)), logger(logger), buffer(kReadBytes) {}
+
+/**
+ * @brief Close every connection and remove the socket
+ */
+CommandServer::~CommandServer() {
+    for (Client& client : clients) {
+        close(client);
+    }
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+/**
+ * @brief Serve until interrupted, or until standard input ends when there is no socket
+ *
+ * Each round waits for any connection to become readable or writable,
+ * reads what arrived, runs every complete line as one program and writes
+ * the responses. A client with many unsent responses is not read from
+ * until it catches up, so a client that never reads cannot make the server
+ * buffer without bound.
+ *
+ * @return False if the socket could not be set up
+ */
+bool CommandServer::run() {
+    if (socketPath != "-" && !listen()) {
+        return false;
+    }
+    struct sigaction action{};
+    action.sa_handler = onInterrupt;
+    sigemptyset(&action.sa_mask);
+    // Without SA_RESTART, poll() returns early to notice the signal
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Client console;
+    console.input = STDIN_FILENO;
+    console.output = STDOUT_FILENO;
+    clients.push_back(std::move(console));
+    if (logger) {
+        logger->log(LogLevel::INFO, "Serving on ", socketPath == "-" ? "standard input" : socketPath);
+    }
+
+    std::vector<pollfd> polled;
+    while (!interrupted && (listener >= 0 || !clients.empty())) {
+        // Each client takes two entries, for reading and for writing
+        polled.clear();
+        for (const Client& client : clients) {
+            bool reading = !client.ended && client.pending.size() - client.written < kMaxPendingBytes;
+            bool writing = client.written < client.pending.size();
+            polled.push_back({reading ? client.input : -1, POLLIN, 0});
+            polled.push_back({writing ? client.output : -1, POLLOUT, 0});
+        }
+        if (listener >= 0) {
+            polled.push_back({listener, POLLIN, 0});
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            commandErrors() << "Failed to wait for clients: " << std::strerror(errno) << '\n';
+            break;
+        }
+
+        for (std::size_t i = 0; i < clients.size(); ++i) {
+            if (polled[2 * i].revents != 0) {
+                receive(clients[i]);
+            }
+        }
+        runRound();
+        for (std::size_t i = 0; i < clients.size();) {
+            if (clients[i].overlong) {
+                // Answered after the lines before it; the client is closed once this is sent
+                clients[i].pending += "Line too long.\nERROR\n";
+                clients[i].overlong = false;
+            }
+            if (!send(clients[i])) {
+                clients[i].failed = true;
+            }
+            if (finished(clients[i])) {
+                close(clients[i]);
+                clients.erase(clients.begin() + static_cast<std::ptrdiff_t>(i));
+            } else {
+                ++i;
+            }
+        }
+        if (listener >= 0 && polled.back().revents != 0) {
+            accept();
+        }
+    }
+    if (logger) {
+        logger->log(LogLevel::INFO, "Server stopped");
+    }
+    return true;
+}
+
+/**
+ * @brief Create and bind the listening socket
+ *
+ * A socket file left by a server that is gone is replaced; one that still
+ * accepts connections, or a path that is not a socket, is an error.
+ *
+ * @return False if it could not be set up
+ */
+bool CommandServer::listen() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        commandErrors() << "Socket path too long: " << socketPath << '\n';
+        return false;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        commandErrors() << "Failed to create socket: " << std::strerror(errno) << '\n';
+        return false;
+    }
+    struct stat status{};
+    if (::stat(socketPath.c_str(), &status) == 0) {
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = !S_ISSOCK(status.st_mode) ||
+                    (probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (live) {
+            commandErrors() << "Socket path already in use: " << socketPath << '\n';
+            ::close(fd);
+            return false;
+        }
+        ::unlink(socketPath.c_str());
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        commandErrors() << "Failed to listen on " << socketPath << ": " << std::strerror(errno) << '\n';
+        ::close(fd);
+        return false;
+    }
+    listener = fd;
+    return true;
+}
+
+/**
+ * @brief Accept every waiting connection
+ */
+void CommandServer::accept() {
+    while (true) {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        Client client;
+        client.input = fd;
+        client.output = fd;
+        client.socket = true;
+        clients.push_back(std::move(client));
+        if (logger) {
+            logger->log(LogLevel::DEBUG, "Client connected on descriptor ", fd);
+        }
+    }
+}
+
+/**
+ * @brief Read what a client has sent
+ *
+ * One read per round, so a client sending without pause cannot starve the
+ * others. Text after the last line break waits for the rest of its line,
+ * unless the client has ended. A line growing past kMaxLineBytes is dropped
+ * and nothing more is read from the client; its complete lines still run.
+ *
+ * @param client The client
+ */
+void CommandServer::receive(Client& client) {
+    ssize_t count = client.socket ? ::recv(client.input, buffer.data(), buffer.size(), MSG_DONTWAIT)
+                                  : ::read(client.input, buffer.data(), buffer.size());
+    if (count > 0) {
+        client.received.append(buffer.data(), static_cast<std::size_t>(count));
+        std::size_t end = client.received.rfind('\n');
+        std::size_t start = end == std::string::npos ? 0 : end + 1;
+        if (client.received.size() - start > kMaxLineBytes) {
+            client.received.erase(start);
+            client.ended = true;
+            client.overlong = true;
+            if (logger) {
+                logger->log(LogLevel::WARNING, "Dropping client on descriptor ", client.input,
+                            ": line longer than ", kMaxLineBytes, " bytes");
+            }
+        }
+        return;
+    }
+    if (count < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    client.ended = true;
+    client.failed = count < 0;
+    if (!client.received.empty() && client.received.back() != '\n') {
+        client.received.push_back('\n');
+    }
+}
+
+/**
+ * @brief Run the complete lines of every client as one program and queue the responses
+ *
+ * Lines keep their order within a client; the program runs them client by
+ * client, and the scheduler orders commands of different clients only where
+ * they use the same slots.
+ */
+void CommandServer::runRound() {
+    std::string script;
+    std::vector<std::size_t> owners; ///< The client of each line.
+    for (std::size_t i = 0; i < clients.size(); ++i) {
+        Client& client = clients[i];
+        std::size_t end = client.received.rfind('\n');
+        if (end == std::string::npos) {
+            continue;
+        }
+        std::string_view lines(client.received.data(), end + 1);
+        while (!lines.empty()) {
+            std::size_t next = lines.find('\n');
+            std::string_view line = lines.substr(0, next);
+            lines.remove_prefix(next + 1);
+            // Blank lines and comments get no response, as they compile to nothing
+            if (!isBlank(line)) {
+                script.append(line);
+                script.push_back('\n');
+                owners.push_back(i);
+            }
+        }
+        client.received.erase(0, end + 1);
+    }
+    if (owners.empty()) {
+        return;
+    }
+
+    CommandProgram program;
+    processor.compile(script, program);
+    const std::vector<Instruction>& instructions = program.getInstructions();
+    processor.run(program, [&](std::size_t index, std::string& output, std::string& errors) {
+        Client& client = clients[owners[index]];
+        client.pending += output;
+        client.pending += errors;
+        bool failed = !errors.empty() || instructions[index].opcode == CommandType::UNKNOWN;
+        client.pending += failed ? "ERROR\n" : "OK\n";
+    });
+}
+
+/**
+ * @brief Write as much of a client's responses as it takes without blocking
+ *
+ * Standard output is written in full, as it may not be a socket.
+ *
+ * @param client The client
+ * @return False if the connection failed
+ */
+bool CommandServer::send(Client& client) {
+    while (client.written < client.pending.size()) {
+        const char* data = client.pending.data() + client.written;
+        std::size_t size = client.pending.size() - client.written;
+        ssize_t count = client.socket ? ::send(client.output, data, size, MSG_DONTWAIT | MSG_NOSIGNAL)
+                                      : ::write(client.output, data, size);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.written += static_cast<std::size_t>(count);
+    }
+    client.pending.clear();
+    client.written = 0;
+    return true;
+}
+
+/**
+ * @brief Check whether a client is done: ended and every response written, or failed
+ *
+ * @param client The client
+ * @return True if it can be closed
+ */
+bool CommandServer::finished(const Client& client) {
+    return client.failed || (client.ended && client.received.empty() && client.written == client.pending.size());
+}
+
+/**
+ * @brief Close a client's descriptors, other than standard input and output
+ *
+ * @param client The client
+ */
+void CommandServer::close(Client& client) {
+    if (client.socket) {
+        ::close(client.input);
+        if (logger) {
+            logger->log(LogLevel::DEBUG, "Client disconnected on descriptor ", client.input);
+        }
+    }
+}
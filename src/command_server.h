@@ -0,0 +1,117 @@
+#ifndef COMMAND_SERVER_H
+#define COMMAND_SERVER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "command_processor.h"
+#include "logger.h"
+
+/**
+ * @class CommandServer
+ * @brief Keeps a FragmentList resident and runs commands sent over a Unix domain socket and standard input.
+ *
+ * Clients send commands one per line and may send many before reading any
+ * response. Each round the server gathers every complete line from every
+ * client into one program and runs it, so with several threads commands on
+ * different slots run in parallel, prints and stats of the same slot run
+ * side by side, and writes to a slot run in order. Each command's response
+ * is its output and diagnostics followed by an "OK" or "ERROR" line; a
+ * client's responses are written together once the round is done.
+ */
+class CommandServer {
+public:
+    /**
+     * @brief Constructor for the CommandServer class.
+     * @param processor Runs the commands.
+     * @param socketPath The socket to listen on, or "-" to serve standard input alone.
+     * @param logger Where connections are logged, or null.
+     */
+    CommandServer(CommandProcessor& processor, std::string socketPath, Logger* logger);
+
+    /**
+     * @brief Closes every connection and removes the socket.
+     */
+    ~CommandServer();
+
+    CommandServer(const CommandServer&) = delete;
+    CommandServer& operator=(const CommandServer&) = delete;
+
+    /**
+     * @brief Serves until interrupted, or until standard input ends when there is no socket.
+     * @return False if the socket could not be set up.
+     */
+    bool run();
+
+private:
+    static constexpr std::size_t kReadBytes = 1 << 20; ///< The most read from one client in a round.
+    static constexpr std::size_t kMaxPendingBytes = 16 << 20; ///< A client with more unsent responses is not read from.
+    static constexpr std::size_t kMaxLineBytes = 64 << 20; ///< A client sending a longer line is answered ERROR and dropped.
+
+    /**
+     * @struct Client
+     * @brief One connection, or standard input and output.
+     */
+    struct Client {
+        int input = -1; ///< The descriptor commands are read from.
+        int output = -1; ///< The descriptor responses are written to.
+        bool socket = false; ///< True for a socket connection.
+        bool ended = false; ///< Set once the client sent end of file.
+        bool failed = false; ///< Set once reading or writing failed.
+        bool overlong = false; ///< Set once a line grew past kMaxLineBytes, until the ERROR is queued.
+        std::string received; ///< Text read and not yet run.
+        std::string pending; ///< Responses not yet written.
+        std::size_t written = 0; ///< The bytes of pending already written.
+    };
+
+    CommandProcessor& processor; ///< Runs the commands.
+    std::string socketPath; ///< The socket path, or "-".
+    Logger* logger; ///< Where connections are logged, or null.
+    int listener = -1; ///< The listening socket, or -1.
+    std::vector<Client> clients; ///< The open connections.
+    std::vector<char> buffer; ///< Receives what one client sent.
+
+    /**
+     * @brief Creates and binds the listening socket.
+     * @return False if it could not be set up.
+     */
+    bool listen();
+
+    /**
+     * @brief Accepts every waiting connection.
+     */
+    void accept();
+
+    /**
+     * @brief Reads what a client has sent.
+     * @param client The client.
+     */
+    void receive(Client& client);
+
+    /**
+     * @brief Runs the complete lines of every client as one program and queues the responses.
+     */
+    void runRound();
+
+    /**
+     * @brief Writes as much of a client's responses as it takes without blocking.
+     * @param client The client.
+     * @return False if the connection failed.
+     */
+    bool send(Client& client);
+
+    /**
+     * @brief Checks whether a client is done: ended and every response written, or failed.
+     * @param client The client.
+     * @return True if it can be closed.
+     */
+    static bool finished(const Client& client);
+
+    /**
+     * @brief Closes a client's descriptors, other than standard input and output.
+     * @param client The client.
+     */
+    void close(Client& client);
+};
+
+#endif // COMMAND_SERVER_H
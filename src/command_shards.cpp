@@ -0,0 +1,181 @@
+#include "command_shards.h"
+#include "command_output.h"
+#include "fragment_slots.h"
+#include <algorithm>
+
+/**
+ * @brief Starts one thread per shard.
+ * @param shardCount The number of shards.
+ */
+CommandShards::CommandShards(int shardCount) {
+    std::size_t count = static_cast<std::size_t>(std::max(shardCount, 1));
+    for (std::size_t i = 0; i < count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    for (auto& shard : shards) {
+        shard->thread = std::thread(&CommandShards::work, this, std::ref(*shard));
+    }
+}
+
+/**
+ * @brief Stops and joins the shard threads.
+ */
+CommandShards::~CommandShards() {
+    stopping.store(true);
+    for (auto& shard : shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+        }
+        shard->wake.notify_one();
+    }
+    for (auto& shard : shards) {
+        shard->thread.join();
+    }
+}
+
+/**
+ * @brief Executes instructions, printing their output in order.
+ * @param instructions The instructions, in program order.
+ * @param execute Executes one instruction; called from the shard threads.
+ * @param collect If set, receives each instruction's results and diagnostics in order instead of printing them.
+ * @param settle If set, runs after each window finishes, before its output is written.
+ */
+void CommandShards::run(const std::vector<Instruction>& instructions, const CommandScheduler::Executor& execute,
+                        const CommandScheduler::Collector& collect, const CommandScheduler::Settler& settle) {
+    this->execute = &execute;
+    for (std::size_t start = 0; start < instructions.size(); start += kWindow) {
+        std::size_t count = std::min(kWindow, instructions.size() - start);
+        std::unique_ptr<Task[]> tasks(new Task[count]);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            Task& task = tasks[i];
+            task.instruction = &instructions[start + i];
+            SlotAccess access = slotAccessOf(*task.instruction);
+            if (access.everySlot || access.count == 0) {
+                // Commands on no position only report errors; the others need every shard stopped
+                if (access.everySlot) {
+                    waitIdle();
+                }
+                OutputCapture capture;
+                execute(*task.instruction);
+                capture.take(task.output, task.errors);
+                continue;
+            }
+            // Bad positions are reported by whichever shard gets them
+            Shard* first = shards[FragmentSlots::shardOf(static_cast<std::size_t>(access.slots[0]), shards.size())].get();
+            Shard* second = access.count == 2
+                ? shards[FragmentSlots::shardOf(static_cast<std::size_t>(access.slots[1]), shards.size())].get()
+                : first;
+            task.parties = first == second ? 1 : 2;
+            pending.fetch_add(static_cast<std::size_t>(task.parties), std::memory_order_relaxed);
+            push(*first, &task);
+            if (second != first) {
+                push(*second, &task);
+            }
+        }
+        waitIdle();
+        if (settle) {
+            settle();
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            if (collect) {
+                collect(start + i, tasks[i].output, tasks[i].errors);
+                continue;
+            }
+            if (!tasks[i].output.empty()) {
+                commandOutput() << tasks[i].output;
+            }
+            if (!tasks[i].errors.empty()) {
+                commandErrors() << tasks[i].errors;
+            }
+        }
+    }
+    this->execute = nullptr;
+}
+
+/**
+ * @brief Runs a shard's queue until the shards stop.
+ *
+ * An empty queue is polled a while before the thread sleeps, so a steady
+ * stream of commands never waits for a wake-up.
+ *
+ * @param shard The shard.
+ */
+void CommandShards::work(Shard& shard) {
+    Task* task = nullptr;
+    while (true) {
+        int spins = 0;
+        while (!shard.queue.tryPop(task)) {
+            if (++spins < kSpins) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.sleeping.store(true, std::memory_order_relaxed);
+            // Pairs with the fence in push(): either it sees sleeping, or this sees its task
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            shard.wake.wait(lock, [&] { return !shard.queue.empty() || stopping.load(); });
+            shard.sleeping.store(false, std::memory_order_relaxed);
+            if (shard.queue.empty()) {
+                return;
+            }
+            spins = 0;
+        }
+        runTask(*task);
+    }
+}
+
+/**
+ * @brief Runs a task on a shard thread, or waits while the other shard it is queued to runs it.
+ *
+ * A task on two shards runs once both have reached it, so neither shard is
+ * running anything else on its positions. Both shards take their tasks in
+ * program order, so a shard only ever waits for an earlier task and the
+ * waits cannot form a cycle.
+ *
+ * @param task The task.
+ */
+void CommandShards::runTask(Task& task) {
+    if (task.parties == 2 && task.arrived.fetch_add(1, std::memory_order_acq_rel) == 0) {
+        while (!task.done.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    } else {
+        thread_local OutputCapture capture;
+        (*execute)(*task.instruction);
+        capture.take(task.output, task.errors);
+        task.done.store(true, std::memory_order_release);
+    }
+    // Each shard finishes its entry only once it no longer touches the task
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idle.notify_one();
+    }
+}
+
+/**
+ * @brief Queues a task to a shard and wakes its thread if it sleeps.
+ * @param shard The shard.
+ * @param task The task.
+ */
+void CommandShards::push(Shard& shard, Task* task) {
+    while (!shard.queue.tryPush(task)) {
+        std::this_thread::yield();
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (shard.sleeping.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+        }
+        shard.wake.notify_one();
+    }
+}
+
+/**
+ * @brief Blocks until every queued task has finished.
+ */
+void CommandShards::waitIdle() {
+    std::unique_lock<std::mutex> lock(idleMutex);
+    idle.wait(lock, [&] { return pending.load(std::memory_order_acquire) == 0; });
+}
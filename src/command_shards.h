@@ -0,0 +1,118 @@
+#ifndef COMMAND_SHARDS_H
+#define COMMAND_SHARDS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "command_program.h"
+#include "command_scheduler.h"
+#include "spsc_queue.h"
+
+/**
+ * @class CommandShards
+ * @brief Runs compiled commands on one thread per shard of the positions, routed over single-producer queues.
+ *
+ * Each position belongs to the shard FragmentSlots::shardOf() gives it, and
+ * a command is queued to the shard of the positions it uses. A shard's thread
+ * runs its queue in order, so commands on a position run in program order
+ * without any dependency tracking, and positions of different shards never
+ * share a thread or a lock. A copy or swap between two shards is queued to
+ * both: the first to reach it waits, and the second runs it while both
+ * shards are stopped. Commands that may use any position wait for every
+ * shard to drain and run on the calling thread.
+ * What each command prints is captured and written out in command order, so
+ * the output is the same as running the commands one after another.
+ */
+class CommandShards {
+public:
+    /**
+     * @brief Starts one thread per shard.
+     * @param shardCount The number of shards.
+     */
+    explicit CommandShards(int shardCount);
+
+    /**
+     * @brief Stops and joins the shard threads.
+     */
+    ~CommandShards();
+
+    CommandShards(const CommandShards&) = delete;
+    CommandShards& operator=(const CommandShards&) = delete;
+
+    /**
+     * @brief Executes instructions, printing their output in order.
+     * @param instructions The instructions, in program order.
+     * @param execute Executes one instruction; called from the shard threads.
+     * @param collect If set, receives each instruction's results and diagnostics in order instead of printing them.
+     * @param settle If set, runs after each window finishes, before its output is written.
+     */
+    void run(const std::vector<Instruction>& instructions, const CommandScheduler::Executor& execute,
+             const CommandScheduler::Collector& collect = nullptr, const CommandScheduler::Settler& settle = nullptr);
+
+private:
+    static constexpr std::size_t kWindow = 1024; ///< The number of commands routed before their output is written.
+    static constexpr int kSpins = 256; ///< The empty polls before a shard thread sleeps.
+
+    /**
+     * @struct Task
+     * @brief One routed instruction.
+     */
+    struct Task {
+        const Instruction* instruction = nullptr; ///< The instruction.
+        int parties = 1; ///< The number of shards it is queued to.
+        std::atomic<int> arrived{0}; ///< The shards that have reached it.
+        std::atomic<bool> done{false}; ///< Set once it has run.
+        std::string output; ///< The results it printed.
+        std::string errors; ///< The diagnostics it printed.
+    };
+
+    /**
+     * @struct Shard
+     * @brief The queue and thread of one shard.
+     */
+    struct Shard {
+        SpscQueue<Task*> queue{kWindow}; ///< The tasks routed to the shard, in program order.
+        std::atomic<bool> sleeping{false}; ///< Set while the thread waits for tasks.
+        std::mutex mutex; ///< Guards sleeping and waking.
+        std::condition_variable wake; ///< Signalled when a task is queued to a sleeping thread or the shards stop.
+        std::thread thread; ///< Runs the queue.
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards; ///< The shards.
+    const CommandScheduler::Executor* execute = nullptr; ///< Executes instructions during run().
+    std::atomic<std::size_t> pending{0}; ///< The queued task entries not yet finished.
+    std::mutex idleMutex; ///< Guards waiting for the shards to drain.
+    std::condition_variable idle; ///< Signalled when the last pending entry finishes.
+    std::atomic<bool> stopping{false}; ///< Set when the shards are destroyed.
+
+    /**
+     * @brief Runs a shard's queue until the shards stop.
+     * @param shard The shard.
+     */
+    void work(Shard& shard);
+
+    /**
+     * @brief Runs a task on a shard thread, or waits while the other shard it is queued to runs it.
+     * @param task The task.
+     */
+    void runTask(Task& task);
+
+    /**
+     * @brief Queues a task to a shard and wakes its thread if it sleeps.
+     * @param shard The shard.
+     * @param task The task.
+     */
+    void push(Shard& shard, Task* task);
+
+    /**
+     * @brief Blocks until every queued task has finished.
+     */
+    void waitIdle();
+};
+
+#endif // COMMAND_SHARDS_H
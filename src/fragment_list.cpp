@@ -5,18 +5,243 @@
  * ID: 0005623258
  */ 
 #include "fragment_list.h"
+#include "command_output.h"
+#include "mapped_file.h"
+#include "memory_pool.h"
+#include "pattern_search.h"
+#include "sequence_reader.h"
+#include "sequence_validator.h"
+#include "translation.h"
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <stdexcept> 
+#include <string>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kSnapshotMagic[8] = {'D', 'N', 'A', 'S', 'N', 'A', 'P', '\0'}; ///< Identifies a snapshot file.
+constexpr std::uint32_t kSnapshotVersion = 5; ///< Bumped whenever the layout changes.
+constexpr std::uint8_t kUracil = 1; ///< Slot flag: code 3 reads as 'U'.
+constexpr std::uint8_t kAlternate = 2; ///< Slot flag: the alternate plane follows the words.
+constexpr std::uint8_t kRemoved = 4; ///< Slot flag: the position was removed and holds no sequence.
+
+/**
+ * @struct SnapshotHeader
+ * @brief The start of a snapshot file; the slot table and then the packed words follow.
+ */
+struct SnapshotHeader {
+    char magic[8]; ///< kSnapshotMagic.
+    std::uint32_t version; ///< kSnapshotVersion.
+    std::uint32_t slotCount; ///< The number of positions holding a sequence or removed.
+};
+
+/**
+ * @struct SnapshotSlot
+ * @brief One position holding a sequence, or removed. Positions sharing a fragment share its words.
+ */
+struct SnapshotSlot {
+    std::uint32_t position; ///< The position.
+    std::uint8_t type; ///< The SequenceType.
+    std::uint8_t flags; ///< kUracil and kAlternate.
+    std::uint8_t reserved[2]; ///< Zero.
+    std::uint64_t length; ///< The number of bases.
+    std::uint64_t offset; ///< Where the words, or a protein's amino acids, start in the file, 8-byte aligned.
+    std::uint64_t counts[5]; ///< The number of 'A's, 'C's, 'G's, 'T's and 'U's, summing to length.
+};
+
+/**
+ * @brief Number of 64-bit words holding a bit count.
+ * @param bits The number of bits.
+ * @return The number of words.
+ */
+std::uint64_t snapshotWords(std::uint64_t bits) {
+    return bits / 64 + (bits % 64 != 0);
+}
+
+/**
+ * @brief Builds a fragment in the fragment pool.
+ * @param args The SequenceFragment constructor arguments.
+ * @return The fragment, with its reference count in the same block.
+ */
+template <typename... Args>
+std::shared_ptr<SequenceFragment> makeFragment(Args&&... args) {
+    return std::allocate_shared<SequenceFragment>(PoolAllocator<SequenceFragment, fragmentPool>(), std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Prints a fragment's position, type and sequence as one line in a single write.
+ * @param out The stream.
+ * @param pos Position of the sequence
+ * @param fragment The fragment
+ */
+void writeFragment(std::ostream& out, int pos, const SequenceFragment& fragment) {
+    thread_local std::string line;
+    line.assign("Position: ");
+    line.append(std::to_string(pos));
+    line.append(fragment.getType() == SequenceType::DNA ? ", Type: DNA, Sequence: "
+              : fragment.getType() == SequenceType::RNA ? ", Type: RNA, Sequence: "
+              : fragment.getType() == SequenceType::PROTEIN ? ", Type: PROTEIN, Sequence: " : ", Type: Sequence: ");
+    if (fragment.getType() == SequenceType::PROTEIN) {
+        line.append(fragment.getResidues());
+        line.push_back('\n');
+    } else {
+        std::size_t prefix = line.size();
+        line.resize(prefix + fragment.getLength() + 1);
+        fragment.unpack(0, fragment.getLength(), &line[prefix]);
+        line.back() = '\n';
+    }
+    out.write(line.data(), static_cast<std::streamsize>(line.size()));
+}
+
+/**
+ * @brief Prints a length, base counts and GC content as the rest of a line.
+ * @param out The stream.
+ * @param counts The base counts.
+ */
+void writeCounts(std::ostream& out, const BaseCounts& counts) {
+    std::size_t length = counts.total();
+    double gc = length == 0 ? 0.0 : 100.0 * static_cast<double>(counts.g + counts.c) / static_cast<double>(length);
+    char percent[16];
+    std::snprintf(percent, sizeof(percent), "%.1f", gc);
+    out << "Length: " << length << ", A: " << counts.a << ", C: " << counts.c << ", G: " << counts.g
+        << ", T: " << counts.t << ", U: " << counts.u << ", GC: " << percent << "%\n";
+}
+
+/**
+ * @brief Writes a fragment as a FASTA record with 60 bases per line.
+ * @param out The stream.
+ * @param pos Position of the sequence, used as the record name
+ * @param fragment The fragment
+ */
+void writeFastaRecord(std::ostream& out, int pos, const SequenceFragment& fragment) {
+    constexpr std::size_t kLineLength = 60;
+    constexpr std::size_t kLinesPerBlock = 1024;
+    out << '>' << pos << ' ' << (fragment.getType() == SequenceType::DNA ? "DNA"
+                                 : fragment.getType() == SequenceType::RNA ? "RNA" : "PROTEIN") << '\n';
+    if (fragment.getType() == SequenceType::PROTEIN) {
+        const std::string& residues = fragment.getResidues();
+        for (std::size_t line = 0; line < residues.size(); line += kLineLength) {
+            out.write(residues.data() + line, static_cast<std::streamsize>(std::min(kLineLength, residues.size() - line)));
+            out.put('\n');
+        }
+        return;
+    }
+
+    // Unpack a block of lines at a time so long sequences are never unpacked whole
+    std::string bases(kLineLength * kLinesPerBlock, 'A');
+    std::string block;
+    for (std::size_t start = 0; start < fragment.getLength(); start += bases.size()) {
+        std::size_t count = std::min(bases.size(), fragment.getLength() - start);
+        fragment.unpack(start, count, &bases[0]);
+        block.clear();
+        for (std::size_t line = 0; line < count; line += kLineLength) {
+            block.append(bases, line, std::min(kLineLength, count - line));
+            block.push_back('\n');
+        }
+        out.write(block.data(), static_cast<std::streamsize>(block.size()));
+    }
+}
+
+constexpr std::size_t kSearchChunk = 1 << 20; ///< The bases whose matches one search task reports.
+constexpr std::size_t kTranslateChunk = 3 << 16; ///< The codons translated per unpacked block.
+constexpr std::size_t kEncodeChunk = 1 << 16; ///< The bases unpacked per block when coding a sequence for alignment.
+
+/**
+ * @struct SearchChunk
+ * @brief A stretch of one sequence searched as a single task.
+ */
+struct SearchChunk {
+    int pos; ///< The position of the sequence.
+    std::size_t first; ///< The first base a match may end at.
+    std::size_t last; ///< One past the last base a match may end at.
+};
+
+/**
+ * @struct SearchMatch
+ * @brief A match found by a search, standing for a run of adjacent ends within the error limit.
+ */
+struct SearchMatch {
+    int pos; ///< The position of the sequence.
+    std::size_t firstEnd; ///< The first end of the run.
+    std::size_t lastEnd; ///< The last end of the run.
+    std::size_t start; ///< The first base of the best match of the run.
+    std::size_t end; ///< The last base of the best match of the run.
+    int errors; ///< The edit distance of the best match.
+};
+
+/**
+ * @brief Searches one chunk of a sequence.
+ * @param matcher The pattern.
+ * @param fragment The sequence.
+ * @param chunk The chunk.
+ * @param matches Receives the matches in increasing order; with errors allowed, adjacent ends are one match.
+ */
+void searchChunk(const PatternMatcher& matcher, const SequenceFragment& fragment, const SearchChunk& chunk,
+                 std::vector<SearchMatch>& matches) {
+    thread_local std::vector<char> text;
+    thread_local std::vector<PatternHit> hits;
+    std::size_t read = chunk.first - std::min(chunk.first, matcher.getContext());
+    std::size_t size = chunk.last - read;
+    text.resize(size);
+    fragment.unpack(read, size, text.data());
+    hits.clear();
+    matcher.scan(text.data(), size, chunk.first - read, hits);
+
+    for (const PatternHit& hit : hits) {
+        if (matcher.getMaxErrors() > 0 && !matches.empty() && matches.back().lastEnd + 1 == read + hit.last) {
+            SearchMatch& run = matches.back();
+            run.lastEnd = read + hit.last;
+            if (hit.errors < run.errors) {
+                run.end = read + hit.last;
+                run.errors = hit.errors;
+            }
+            continue;
+        }
+        matches.push_back(SearchMatch{chunk.pos, read + hit.last, read + hit.last, 0, read + hit.last, hit.errors});
+    }
+    for (SearchMatch& match : matches) {
+        match.start = read + matcher.findStart(text.data(), match.end - read);
+    }
+}
+
+/**
+ * @brief Converts a sequence to the two-bit codes alignment reads, a block at a time.
+ * @param fragment The sequence.
+ * @param codes Receives one code per base.
+ */
+void encodeFragment(const SequenceFragment& fragment, std::vector<std::uint8_t>& codes) {
+    thread_local std::vector<char> bases;
+    codes.resize(fragment.getLength());
+    for (std::size_t first = 0; first < fragment.getLength(); first += kEncodeChunk) {
+        std::size_t count = std::min(kEncodeChunk, fragment.getLength() - first);
+        bases.resize(count);
+        fragment.unpack(first, count, bases.data());
+        encodeBases(bases.data(), count, codes.data() + first);
+    }
+}
+
+} // namespace
 
 /**
  * @brief Construct a new Fragment List:: Fragment List object
  * 
+ * No slot storage is allocated until a position is used.
+ * 
  * @param size Size of the fragment list
  */
 FragmentList::FragmentList(int size)
-    : fragments(size) {}
+    : fragments(static_cast<std::size_t>(std::max(size, 0))) {}
 
 
 /**
@@ -26,27 +251,25 @@ FragmentList::FragmentList(int size)
  * @param type Type of the sequence (DNA or RNA)
  * @param sequence The sequence string
  */
-void FragmentList::insert(int pos, SequenceType type, const std::string& sequence) {
+void FragmentList::insert(int pos, SequenceType type, std::string_view sequence) {
     // Check that the position is within the valid range
-    if (pos < 0 || pos >= fragments.size()) {
-        std::cerr << "The position out of range.\n";
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
         return;
     }
 
-    // Check that the sequence contains only appropriate letters for its type
-    for (char c : sequence) {
-        if (type == SequenceType::DNA && c != 'A' && c != 'C' && c != 'G' && c != 'T') {
-            std::cerr << "Invalid sequence. The sequence \"" << sequence << "\" contains invalid characters for the DNA sequence.\n";
-            return;
-        }
-        if (type == SequenceType::RNA && c != 'A' && c != 'C' && c != 'G' && c != 'U') {
-            std::cerr << "Invalid sequence. The sequence \"" << sequence << "\" contains invalid characters for the RNA sequence.\n";
-            return;
-        }
+    // Check that the sequence contains only appropriate letters for its type, in either case
+    std::size_t offset = findInvalidBase(sequence.data(), sequence.size(), type);
+    if (offset != sequence.size()) {
+        commandErrors() << "Invalid sequence. The character '" << sequence[offset] << "' at offset " << offset
+                  << " is not valid for the " << (type == SequenceType::DNA ? "DNA" : "RNA") << " sequence.\n";
+        return;
     }
 
     // If there is already a sequence at pos, the new sequence replaces the old one
-    fragments[pos] = std::make_shared<SequenceFragment>(type, sequence);
+    unindexSlot(pos);
+    fragments.set(pos, makeFragment(type, sequence));
+    indexSlot(pos);
 }
 
 /**
@@ -56,41 +279,32 @@ void FragmentList::insert(int pos, SequenceType type, const std::string& sequenc
  */
 void FragmentList::remove(int pos) {
     // Check that the position is within the valid range
-    if (pos < 0 || pos >= fragments.size()) {
-        std::cerr << "The position out of range.\n";
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
         return;
     }
 
-    // Check if there is a sequence at pos
-    if (fragments[pos] == nullptr) {
-        std::cerr << "There is no sequence at this position.\n";
+    // Check if there is a sequence at pos; removing it twice is allowed
+    if (fragments.get(pos) == nullptr && !fragments.isRemoved(pos)) {
+        commandErrors() << "There is no sequence at this position.\n";
         return;
     }
 
-    // Remove the sequence at pos and set the sequence type to EMPTY
-    fragments[pos] = std::make_shared<SequenceFragment>(SequenceType::EMPTY, "");
+    // Free the sequence and mark pos as removed, without allocating an empty fragment
+    unindexSlot(pos);
+    fragments.remove(pos);
 }
 
 /**
  * @brief Print all sequences
  */
 void FragmentList::print() {
-    for (int i = 0; i < fragments.size(); ++i) {
-        if (fragments[i] != nullptr && fragments[i]->getType() != SequenceType::EMPTY) {
-            std::cout << "Position: " << i << ", Type: ";
-            switch (fragments[i]->getType()) {
-                case SequenceType::DNA:
-                    std::cout << "DNA, ";
-                    break;
-                case SequenceType::RNA:
-                    std::cout << "RNA, ";
-                    break;
-                default:
-                    break;
-            }
-            std::cout << "Sequence: " << fragments[i]->getSequence() << "\n";
+    // One write per fragment, unpacked straight into the line; empty slots are never visited
+    fragments.forEach([](std::size_t i, const std::shared_ptr<SequenceFragment>& fragment) {
+        if (fragment->getType() != SequenceType::EMPTY) {
+            writeFragment(commandOutput(), static_cast<int>(i), *fragment);
         }
-    }
+    });
 }
 
 /**
@@ -100,30 +314,19 @@ void FragmentList::print() {
  */
 void FragmentList::print(int pos) {
     // Check that the position is within the valid range
-    if (pos < 0 || pos >= fragments.size()) {
-        std::cerr << "The position out of range.\n";
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
         return;
     }
 
     // Check if there is a sequence at pos
-    if (fragments[pos] == nullptr || fragments[pos]->getType() == SequenceType::EMPTY) {
-        std::cerr << "There is no sequence at this position.\n";
+    if (fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+        commandErrors() << "There is no sequence at this position.\n";
         return;
     }
 
     // Print the sequence and its type
-    std::cout << "Position: " << pos << ", Type: ";
-    switch (fragments[pos]->getType()) {
-        case SequenceType::DNA:
-            std::cout << "DNA, ";
-            break;
-        case SequenceType::RNA:
-            std::cout << "RNA, ";
-            break;
-        default:
-            break;
-    }
-    std::cout << "Sequence: " << fragments[pos]->getSequence() << "\n";
+    writeFragment(commandOutput(), pos, *fragments.get(pos));
 }
 
 /**
@@ -134,26 +337,39 @@ void FragmentList::print(int pos) {
  */
 void FragmentList::clip(int pos, int start) {
     // Check that the position is within the valid range
-    if (pos < 0 || pos >= fragments.size()) {
-        std::cerr << "The position out of range.\n";
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
         return;
     }
 
     // Check if there is a sequence at pos
-    if (fragments[pos] == nullptr || fragments[pos]->getType() == SequenceType::EMPTY) {
-        std::cerr << "There is no sequence at this position.\n";
+    if (fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+        commandErrors() << "There is no sequence at this position.\n";
+        return;
+    }
+
+    // Check that the sequence is made of bases
+    if (fragments.get(pos)->getType() == SequenceType::PROTEIN) {
+        commandErrors() << "The sequence at this position is a protein.\n";
         return;
     }
 
     // Check that start is within the valid range
-    if (start < 0 || start >= fragments[pos]->getSequence().size()) {
-        std::cerr << "The start position out of range.\n";
+    if (start < 0 || static_cast<std::size_t>(start) >= fragments.get(pos)->getLength()) {
+        commandErrors() << "The start position out of range.\n";
         return;
     }
 
-    // Replace the sequence at pos with the clipped version of the sequence
-    std::string clippedSequence = fragments[pos]->getSequence().substr(start);
-    fragments[pos]->setSequence(clippedSequence);
+    // Split the rope at start and keep the right part; no bases are copied.
+    // Only the k-mers starting in and the bases of the dropped prefix are counted out
+    SequenceFragment& fragment = detach(pos);
+    if (kmerIndex) {
+        kmerIndex->remove(pos, fragment, 0, start);
+    }
+    BaseCounts counts = fragment.getCounts();
+    counts -= fragment.countBases(0, start);
+    fragment.setCounts(counts);
+    fragment.erasePrefix(start);
 }
 
 /**
@@ -164,21 +380,24 @@ void FragmentList::clip(int pos, int start) {
  */
 void FragmentList::copy(int pos1, int pos2) {
     // Check that the positions are within the valid range
-    if (pos1 < 0 || pos1 >= fragments.size() || pos2 < 0 || pos2 >= fragments.size()) {
-        std::cerr << "The position out of range.\n";
+    if (!inRange(pos1) || !inRange(pos2)) {
+        commandErrors() << "The position out of range.\n";
         return;
     }
 
     // Check if there is a sequence at pos1
-    if (fragments[pos1] == nullptr || fragments[pos1]->getType() == SequenceType::EMPTY) {
-        std::cerr << "There is no sequence at the source position.\n";
+    if (fragments.get(pos1) == nullptr || fragments.get(pos1)->getType() == SequenceType::EMPTY) {
+        commandErrors() << "There is no sequence at the source position.\n";
         return;
     }
 
-    // Copy the sequence from pos1 to pos2
-    SequenceType type = fragments[pos1]->getType();
-    std::string sequence = fragments[pos1]->getSequence();
-    fragments[pos2] = std::make_shared<SequenceFragment>(type, sequence);
+    // Share the source fragment; whichever slot is mutated first detaches
+    if (fragments.get(pos2) == fragments.get(pos1)) {
+        return;
+    }
+    unindexSlot(pos2);
+    fragments.set(pos2, fragments.get(pos1));
+    indexSlot(pos2);
 }
 
 /**
@@ -191,36 +410,85 @@ void FragmentList::copy(int pos1, int pos2) {
  */
 void FragmentList::swap(int pos1, int start1, int pos2, int start2) {
     // Check that the positions are within the valid range
-    if (pos1 < 0 || pos1 >= fragments.size() || pos2 < 0 || pos2 >= fragments.size()) {
-        std::cerr << "The position out of range.\n";
+    if (!inRange(pos1) || !inRange(pos2)) {
+        commandErrors() << "The position out of range.\n";
         return;
     }
 
     // Check if there are sequences at pos1 and pos2
-    if (fragments[pos1] == nullptr || fragments[pos1]->getType() == SequenceType::EMPTY ||
-        fragments[pos2] == nullptr || fragments[pos2]->getType() == SequenceType::EMPTY) {
-        std::cerr << "One or both positions do not contain a sequence.\n";
+    if (fragments.get(pos1) == nullptr || fragments.get(pos1)->getType() == SequenceType::EMPTY ||
+        fragments.get(pos2) == nullptr || fragments.get(pos2)->getType() == SequenceType::EMPTY) {
+        commandErrors() << "One or both positions do not contain a sequence.\n";
         return;
     }
 
     // Check that the sequences are of the same type
-    if (fragments[pos1]->getType() != fragments[pos2]->getType()) {
-        std::cerr << "Sequences are not of the same type.\n";
+    if (fragments.get(pos1)->getType() != fragments.get(pos2)->getType()) {
+        commandErrors() << "Sequences are not of the same type.\n";
+        return;
+    }
+
+    // Check that the sequences are made of bases
+    if (fragments.get(pos1)->getType() == SequenceType::PROTEIN) {
+        commandErrors() << "Proteins cannot be swapped.\n";
         return;
     }
 
     // Check that the start positions are within the valid range
-    if (start1 < 0 || start1 > fragments[pos1]->getSequence().size() ||
-        start2 < 0 || start2 > fragments[pos2]->getSequence().size()) {
-        std::cerr << "Start position out of range.\n";
+    if (start1 < 0 || static_cast<std::size_t>(start1) > fragments.get(pos1)->getLength() ||
+        start2 < 0 || static_cast<std::size_t>(start2) > fragments.get(pos2)->getLength()) {
+        commandErrors() << "Start position out of range.\n";
         return;
     }
 
-    // Swap the tails of the sequences
-    std::string tail1 = fragments[pos1]->getSequence().substr(start1);
-    std::string tail2 = fragments[pos2]->getSequence().substr(start2);
-    fragments[pos1]->setSequence(fragments[pos1]->getSequence().substr(0, start1) + tail2);
-    fragments[pos2]->setSequence(fragments[pos2]->getSequence().substr(0, start2) + tail1);
+    // Swap the tails of the sequences by splitting and rejoining their ropes
+    SequenceFragment& fragment1 = detach(pos1);
+    SequenceFragment& fragment2 = detach(pos2);
+    if (fragment1.isTranscribed() != fragment2.isTranscribed()) {
+        // A tail only moves as it is stored between fragments stored the same way round
+        fragment1.materialize();
+        fragment2.materialize();
+    }
+    std::size_t from1 = 0;
+    std::size_t from2 = 0;
+    if (kmerIndex) {
+        // Only the k-mers of the tails and those running into them change
+        std::size_t reach = static_cast<std::size_t>(kmerIndex->getLength() - 1);
+        if (pos1 != pos2) {
+            from1 = static_cast<std::size_t>(start1) - std::min<std::size_t>(start1, reach);
+            from2 = static_cast<std::size_t>(start2) - std::min<std::size_t>(start2, reach);
+            kmerIndex->remove(pos2, fragment2, from2);
+        }
+        kmerIndex->remove(pos1, fragment1, from1);
+    }
+    // Only the exchanged tails are counted
+    BaseCounts counts1;
+    BaseCounts counts2;
+    if (pos1 != pos2) {
+        counts1 = fragment1.countBases(start1, fragment1.getLength() - start1);
+        counts2 = fragment2.countBases(start2, fragment2.getLength() - start2);
+    }
+    SequenceRope tail1 = fragment1.tail(start1);
+    SequenceRope tail2 = fragment2.tail(start2);
+    fragment1.truncate(start1);
+    fragment1.append(tail2);
+    fragment2.truncate(start2);
+    fragment2.append(tail1);
+    if (pos1 != pos2) {
+        BaseCounts counts = fragment1.getCounts();
+        fragment1.setCounts((counts -= counts1) += counts2);
+        counts = fragment2.getCounts();
+        fragment2.setCounts((counts -= counts2) += counts1);
+    } else {
+        // Swapping within one sequence can drop or repeat bases, so it is recounted
+        fragment1.setCounts(fragment1.countBases(0, fragment1.getLength()));
+    }
+    if (kmerIndex) {
+        if (pos1 != pos2) {
+            kmerIndex->add(pos2, fragment2, from2);
+        }
+        kmerIndex->add(pos1, fragment1, from1);
+    }
 }
 
 /**
@@ -230,32 +498,895 @@ void FragmentList::swap(int pos1, int start1, int pos2, int start2) {
  */
 void FragmentList::transcribe(int pos) {
     // Check that the position is valid
-    if (pos < 0 || pos >= fragments.size() || fragments[pos] == nullptr || fragments[pos]->getType() == SequenceType::EMPTY) {
-        std::cerr << " Position does not contain a sequence.\n";
+    if (!inRange(pos) || fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+        commandErrors() << " Position does not contain a sequence.\n";
         return;
     }
 
     // Check that the sequence is DNA
-    if (fragments[pos]->getType() != SequenceType::DNA) {
-        std::cerr << " Sequence is not DNA.\n";
+    if (fragments.get(pos)->getType() != SequenceType::DNA) {
+        commandErrors() << " Sequence is not DNA.\n";
         return;
     }
 
-    // Change the sequence type to RNA
-    fragments[pos]->setType(SequenceType::RNA);
+    // Change the sequence type to RNA and read it back reversed and complemented:
+    // A becomes T, C becomes G, G becomes C and T becomes U.
+    // No bases are touched until something needs them in the new order
+    detach(pos).transcribe();
 
-    // Complement and reverse the sequence
-    std::string sequence = fragments[pos]->getSequence();
-    for (char& c : sequence) {
-        switch (c) {
-            case 'A': c = 'T'; break;
-            case 'C': c = 'G'; break;
-            case 'G': c = 'C'; break;
-            case 'T': c = 'U'; break;
+    // The indexed k-mers still hold, read back through the transcription
+    if (kmerIndex) {
+        kmerIndex->markTranscribed(pos);
+    }
+}
+
+/**
+ * @brief Load FASTA or FASTQ records from a file into consecutive positions
+ * 
+ * Records are streamed from the file and packed as they are read, so the
+ * file is never held in memory.
+ * 
+ * @param pos Position of the first record
+ * @param type Type of the sequences (DNA or RNA)
+ * @param path Path of the file
+ * @param count Number of records to load, or -1 for every record
+ */
+void FragmentList::load(int pos, SequenceType type, const std::string& path, int count) {
+    // Check that the position is within the valid range
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
+        return;
+    }
+
+    SequenceReader reader(path);
+    if (!reader.isOpen()) {
+        commandErrors() << "Failed to open file: " << path << "\n";
+        return;
+    }
+
+    int loaded = 0;
+    while (count < 0 || loaded < count) {
+        PackedSequence sequence;
+        SequenceReader::Status status = reader.next(type, sequence);
+        if (status == SequenceReader::Status::END) {
+            break;
+        }
+        if (status == SequenceReader::Status::MALFORMED) {
+            commandErrors() << "The file is not valid FASTA or FASTQ: " << path << "\n";
+            return;
+        }
+
+        // Each record takes the next position, even one that fails to validate
+        int target = pos + loaded++;
+        if (static_cast<std::size_t>(target) >= fragments.size()) {
+            commandErrors() << "The position out of range.\n";
+            return;
+        }
+        if (status == SequenceReader::Status::INVALID) {
+            commandErrors() << "Invalid sequence in record '" << reader.getName() << "'. The character '"
+                            << reader.getInvalidCharacter() << "' at offset " << reader.getInvalidOffset()
+                            << " is not valid for the " << (type == SequenceType::DNA ? "DNA" : "RNA") << " sequence.\n";
+            continue;
+        }
+        unindexSlot(target);
+        fragments.set(target, makeFragment(type, SequenceRope(std::move(sequence))));
+        indexSlot(target);
+    }
+
+    if (count > 0 && loaded < count) {
+        commandErrors() << "The file holds fewer records than requested.\n";
+    }
+}
+
+/**
+ * @brief Write the sequences at consecutive positions to a FASTA file
+ * 
+ * Each record is named after its position and type. Empty positions are skipped.
+ * 
+ * @param pos First position
+ * @param count Number of positions, or -1 for every position from pos on
+ * @param path Path of the file
+ */
+void FragmentList::exportFasta(int pos, int count, const std::string& path) {
+    // Check that the position is within the valid range
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
+        return;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        commandErrors() << "Failed to open file: " << path << "\n";
+        return;
+    }
+
+    std::size_t last = count < 0 ? fragments.size() : std::min<std::size_t>(fragments.size(), static_cast<std::size_t>(pos) + count);
+    int written = 0;
+    fragments.forEach([&](std::size_t i, const std::shared_ptr<SequenceFragment>& fragment) {
+        if (i >= static_cast<std::size_t>(pos) && i < last && fragment->getType() != SequenceType::EMPTY) {
+            writeFastaRecord(file, static_cast<int>(i), *fragment);
+            ++written;
+        }
+    });
+
+    if (written == 0) {
+        commandErrors() << "There is no sequence at this position.\n";
+    }
+    if (!file.flush()) {
+        commandErrors() << "Failed to write file: " << path << "\n";
+    }
+}
+
+/**
+ * @brief Write every position to a binary snapshot file
+ * 
+ * The file holds a header, a table with the position, type, length and
+ * offset of every slot holding a sequence, then the packed words of each
+ * fragment once, however many slots share it. It is written next to the target and renamed over it, so a
+ * snapshot that is mapped by an earlier restore is never changed underneath.
+ * 
+ * @param path Path of the file
+ */
+void FragmentList::save(const std::string& path) {
+    std::string error;
+    if (!writeSnapshot(path, captureSlots(), false, error)) {
+        commandErrors() << error;
+    }
+}
+
+/**
+ * @brief Take every occupied slot's fragment, sharing it with the slot
+ * 
+ * A fragment shared this way is copied by the next edit of its slot, as
+ * for a copied slot, so the captured fragments keep their contents.
+ * Removed positions are captured too, as removing one again is not an
+ * error, and a restored list must behave the same.
+ * 
+ * @return The position and fragment of every occupied slot, and every removed one with a null fragment, in position order
+ */
+FragmentList::SlotCapture FragmentList::captureSlots() {
+    std::vector<std::size_t> removed = fragments.removedPositions();
+    SlotCapture captured;
+    captured.reserve(fragments.occupiedCount() + removed.size());
+    auto next = removed.begin();
+    fragments.forEach([&](std::size_t pos, const std::shared_ptr<SequenceFragment>& fragment) {
+        for (; next != removed.end() && *next < pos; ++next) {
+            captured.emplace_back(*next, nullptr);
+        }
+        captured.emplace_back(pos, fragment);
+    });
+    for (; next != removed.end(); ++next) {
+        captured.emplace_back(*next, nullptr);
+    }
+    return captured;
+}
+
+/**
+ * @brief Write captured slots to a binary snapshot file
+ * 
+ * Only the captured fragments are read, so this may run on any thread
+ * while the list is edited.
+ * 
+ * @param path Path of the file
+ * @param slotsToWrite The slots, from captureSlots()
+ * @param durable True to flush the file to disk before it is renamed into place
+ * @param error Receives the diagnostic on failure
+ * @return True if the snapshot was written
+ */
+bool FragmentList::writeSnapshot(const std::string& path, const SlotCapture& slotsToWrite, bool durable,
+                                 std::string& error) {
+    std::string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        error = "Failed to open file: " + path + "\n";
+        return false;
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+    header.version = kSnapshotVersion;
+    header.slotCount = static_cast<std::uint32_t>(slotsToWrite.size());
+    std::vector<SnapshotSlot> slots(slotsToWrite.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(SnapshotSlot));
+
+    // Flatten one fragment at a time; the table is filled in as words are written
+    std::unordered_map<const SequenceFragment*, std::size_t> written;
+    std::uint64_t offset = sizeof(header) + slots.size() * sizeof(SnapshotSlot);
+    std::size_t index = 0;
+    for (const auto& [pos, fragment] : slotsToWrite) {
+        SnapshotSlot& slot = slots[index];
+        auto shared = written.find(fragment.get());
+        if (fragment == nullptr) {
+            // A removed position owns no words
+            slot.type = static_cast<std::uint8_t>(SequenceType::EMPTY);
+            slot.flags = kRemoved;
+            slot.offset = offset;
+        } else if (shared != written.end()) {
+            slot = slots[shared->second];
+        } else if (fragment->getType() == SequenceType::PROTEIN) {
+            // Amino acids are written as letters, padded to whole words
+            written.emplace(fragment.get(), index);
+            const std::string& residues = fragment->getResidues();
+            std::uint64_t words = snapshotWords(8 * residues.size());
+            slot.type = static_cast<std::uint8_t>(SequenceType::PROTEIN);
+            slot.length = residues.size();
+            slot.offset = offset;
+            file.write(residues.data(), static_cast<std::streamsize>(residues.size()));
+            file.write("\0\0\0\0\0\0\0", static_cast<std::streamsize>(8 * words - residues.size()));
+            offset += words * sizeof(std::uint64_t);
+        } else {
+            written.emplace(fragment.get(), index);
+            PackedSequence sequence = fragment->flatten();
+            slot.type = static_cast<std::uint8_t>(fragment->getType());
+            slot.flags = (sequence.isUracil() ? kUracil : 0) | (sequence.alternateCount() != 0 ? kAlternate : 0);
+            slot.length = sequence.size();
+            slot.offset = offset;
+            const BaseCounts& counts = fragment->getCounts();
+            slot.counts[0] = counts.a;
+            slot.counts[1] = counts.c;
+            slot.counts[2] = counts.g;
+            slot.counts[3] = counts.t;
+            slot.counts[4] = counts.u;
+            file.write(reinterpret_cast<const char*>(sequence.wordData()), sequence.wordCount() * sizeof(std::uint64_t));
+            file.write(reinterpret_cast<const char*>(sequence.alternateData()), sequence.alternateCount() * sizeof(std::uint64_t));
+            offset += (sequence.wordCount() + sequence.alternateCount()) * sizeof(std::uint64_t);
         }
+        slot.position = static_cast<std::uint32_t>(pos);
+        ++index;
     }
-    std::reverse(sequence.begin(), sequence.end());
+    file.seekp(sizeof(header));
+    file.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(SnapshotSlot));
+    file.close();
 
-    // Update the sequence
-    fragments[pos]->setSequence(sequence);
-}
\ No newline at end of file
+    bool synced = true;
+    if (durable && file) {
+        int fd = ::open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+        synced = fd >= 0 && ::fdatasync(fd) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    if (!file || !synced || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        error = "Failed to write file: " + path + "\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Replace every position with those of a snapshot file
+ * 
+ * Only the slot table is read: each fragment borrows its words from the
+ * mapping, which stays alive while any sequence references it, and copies
+ * them only when it is edited. Slots that shared a fragment share it again,
+ * and removed positions are marked removed again.
+ * 
+ * @param path Path of the file
+ * @return True if the snapshot was restored
+ */
+bool FragmentList::restore(const std::string& path) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+    if (!file->isOpen()) {
+        commandErrors() << "Failed to open file: " << path << "\n";
+        return false;
+    }
+
+    // Check the whole table before touching the list
+    std::string_view data = file->data();
+    SnapshotHeader header;
+    bool valid = data.size() >= sizeof(header) && reinterpret_cast<std::uintptr_t>(data.data()) % 8 == 0;
+    if (valid) {
+        std::memcpy(&header, data.data(), sizeof(header));
+        valid = std::memcmp(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0 &&
+                header.version == kSnapshotVersion &&
+                header.slotCount <= (data.size() - sizeof(header)) / sizeof(SnapshotSlot);
+    }
+    std::vector<SnapshotSlot> slots;
+    if (valid && header.slotCount != 0) {
+        slots.resize(header.slotCount);
+        std::memcpy(slots.data(), data.data() + sizeof(header), slots.size() * sizeof(SnapshotSlot));
+    }
+    for (std::size_t i = 0; valid && i < slots.size(); ++i) {
+        const SnapshotSlot& slot = slots[i];
+        bool protein = slot.type == static_cast<std::uint8_t>(SequenceType::PROTEIN);
+        std::uint64_t words = protein ? snapshotWords(8 * std::min<std::uint64_t>(slot.length, data.size()))
+                                      : snapshotWords(2 * slot.length) + (slot.flags & kAlternate ? snapshotWords(slot.length) : 0);
+        std::uint64_t counted = 0;
+        for (std::uint64_t count : slot.counts) {
+            counted += std::min(count, slot.length + 1);
+        }
+        valid = slot.type <= static_cast<std::uint8_t>(SequenceType::EMPTY) && slot.offset % 8 == 0 &&
+                (!(slot.flags & kRemoved) || slot.length == 0) &&
+                slot.length <= data.size() && slot.offset <= data.size() &&
+                words <= (data.size() - slot.offset) / sizeof(std::uint64_t) && counted == (protein ? 0 : slot.length);
+        if (valid && slot.position >= fragments.size()) {
+            commandErrors() << "The snapshot holds more positions than the fragment list.\n";
+            return false;
+        }
+    }
+    if (!valid) {
+        commandErrors() << "The file is not a valid snapshot: " << path << "\n";
+        return false;
+    }
+
+    fragments.clear();
+    std::unordered_map<std::uint64_t, std::shared_ptr<SequenceFragment>> restored;
+    for (const SnapshotSlot& slot : slots) {
+        SequenceType type = static_cast<SequenceType>(slot.type);
+        if (slot.flags & kRemoved) {
+            fragments.remove(slot.position);
+            continue;
+        }
+        if (slot.length == 0) {
+            // Empty fragments own no words, so their offsets are not unique
+            fragments.set(slot.position, makeFragment(type, SequenceRope()));
+            continue;
+        }
+        std::shared_ptr<SequenceFragment>& fragment = restored[slot.offset];
+        if (fragment == nullptr && type == SequenceType::PROTEIN) {
+            // Amino acids are copied out; they are small next to the sequences they come from
+            fragment = makeFragment(std::string(data.data() + slot.offset, slot.length));
+        } else if (fragment == nullptr) {
+            const std::uint64_t* words = reinterpret_cast<const std::uint64_t*>(data.data() + slot.offset);
+            const std::uint64_t* alternate = slot.flags & kAlternate ? words + snapshotWords(2 * slot.length) : nullptr;
+            PackedSequence sequence(words, alternate, slot.length, (slot.flags & kUracil) != 0, file);
+            BaseCounts counts;
+            counts.a = slot.counts[0];
+            counts.c = slot.counts[1];
+            counts.g = slot.counts[2];
+            counts.t = slot.counts[3];
+            counts.u = slot.counts[4];
+            fragment = makeFragment(type, SequenceRope(std::move(sequence)), counts);
+        }
+        fragments.set(slot.position, fragment);
+    }
+
+    if (kmerIndex) {
+        kmerIndex->clear();
+        fragments.forEach([this](std::size_t pos, const std::shared_ptr<SequenceFragment>&) {
+            indexSlot(static_cast<int>(pos));
+        });
+    }
+    return true;
+}
+
+/**
+ * @brief Print how many slots share the fragment at a given position
+ * 
+ * @param pos Position of the sequence
+ */
+void FragmentList::printSharing(int pos) {
+    // Check that the position is within the valid range
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
+        return;
+    }
+
+    // Check if there is a sequence at pos
+    if (fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+        commandErrors() << "There is no sequence at this position.\n";
+        return;
+    }
+
+    commandOutput() << "Position: " << pos << ", Shared by: " << sharingCount(pos) << "\n";
+}
+
+/**
+ * @brief Print the sharing count of every sequence and the bases sharing saves
+ */
+void FragmentList::printSharing() {
+    std::set<const SequenceFragment*> stored;
+    std::size_t referencedBases = 0;
+    std::size_t storedBases = 0;
+    fragments.forEach([&](std::size_t i, const std::shared_ptr<SequenceFragment>& fragment) {
+        if (fragment->getType() != SequenceType::EMPTY) {
+            commandOutput() << "Position: " << i << ", Shared by: " << fragment.use_count() << "\n";
+            referencedBases += fragment->getLength();
+            if (stored.insert(fragment.get()).second) {
+                storedBases += fragment->getLength();
+            }
+        }
+    });
+    commandOutput() << "Bases referenced: " << referencedBases << ", Bases stored: " << storedBases << "\n";
+}
+
+/**
+ * @brief Get the number of slots sharing the fragment at a given position
+ * 
+ * @param pos Position of the sequence
+ * @return The number of slots, including pos, or 0 if pos holds no fragment
+ */
+int FragmentList::sharingCount(int pos) const {
+    if (!inRange(pos) || fragments.get(pos) == nullptr) {
+        return 0;
+    }
+    return static_cast<int>(fragments.get(pos).use_count());
+}
+
+/**
+ * @brief Print the length, base counts and GC content of a sequence at a given position
+ * 
+ * The counts are kept by the fragment as it is edited, so no base is read.
+ * 
+ * @param pos Position of the sequence
+ */
+void FragmentList::printStats(int pos) {
+    // Check that the position is within the valid range
+    if (!inRange(pos)) {
+        commandErrors() << "The position out of range.\n";
+        return;
+    }
+
+    // Check if there is a sequence at pos
+    if (fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+        commandErrors() << "There is no sequence at this position.\n";
+        return;
+    }
+
+    // Check that the sequence is made of bases
+    if (fragments.get(pos)->getType() == SequenceType::PROTEIN) {
+        commandErrors() << "The sequence at this position is a protein.\n";
+        return;
+    }
+
+    commandOutput() << "Position: " << pos << ", ";
+    writeCounts(commandOutput(), fragments.get(pos)->getCounts());
+}
+
+/**
+ * @brief Print the length, base counts and GC content of every sequence together
+ * 
+ * Sums the counts kept by each fragment, so the cost grows with the number
+ * of positions in use rather than the number of bases.
+ */
+void FragmentList::printStats() {
+    BaseCounts total;
+    std::size_t count = 0;
+    fragments.forEach([&](std::size_t, const std::shared_ptr<SequenceFragment>& fragment) {
+        if (fragment->getType() != SequenceType::EMPTY && fragment->getType() != SequenceType::PROTEIN) {
+            total += fragment->getCounts();
+            ++count;
+        }
+    });
+    commandOutput() << "Positions: " << count << ", ";
+    writeCounts(commandOutput(), total);
+}
+
+/**
+ * @brief Enable, rebuild or disable the k-mer index
+ * 
+ * Enabling the index reads every sequence once; after that each edit only
+ * files the k-mers it changes.
+ * 
+ * @param length K-mer length, or 0 to disable the index
+ */
+void FragmentList::setKmerLength(int length) {
+    if (length == 0) {
+        kmerIndex.reset();
+        return;
+    }
+    if (length < 0 || length > KmerIndex::kMaxLength) {
+        commandErrors() << "The k-mer length must be between 1 and " << KmerIndex::kMaxLength << ".\n";
+        return;
+    }
+    kmerIndex = std::make_unique<KmerIndex>(length);
+    fragments.forEach([this](std::size_t pos, const std::shared_ptr<SequenceFragment>&) {
+        indexSlot(static_cast<int>(pos));
+    });
+}
+
+/**
+ * @brief Print the positions whose sequences hold a k-mer
+ * 
+ * @param kmer The k-mer; 'T' and 'U' are different letters
+ */
+void FragmentList::lookup(std::string_view kmer) {
+    // Check that the index is enabled
+    if (!kmerIndex) {
+        commandErrors() << "The k-mer index is not enabled.\n";
+        return;
+    }
+
+    // Check that the k-mer is valid for the index
+    std::uint64_t code = 0;
+    if (!kmerIndex->encode(kmer, code)) {
+        commandErrors() << "Invalid k-mer: " << kmer << ". It must be " << kmerIndex->getLength()
+                        << " bases drawn from A, C, G, T and U.\n";
+        return;
+    }
+
+    std::vector<KmerPosting> found = kmerIndex->lookup(code);
+    commandOutput() << "K-mer: ";
+    for (char c : kmer) {
+        commandOutput().put(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+    }
+    commandOutput() << ", Positions: " << found.size() << "\n";
+    for (const KmerPosting& posting : found) {
+        commandOutput() << "Position: " << posting.position << ", Occurrences: " << posting.count << "\n";
+    }
+}
+
+/**
+ * @brief Print where a pattern occurs in one sequence or in all of them
+ * 
+ * Sequences are split into chunks searched on the calling thread and idle workers of the search pool;
+ * the matches are printed afterwards, in order, from the calling thread. With
+ * errors allowed, a run of adjacent ends within the limit is one match: the
+ * end with the fewest errors, and the shortest match ending there.
+ * 
+ * @param pos Position of the sequence, ignored when all is set
+ * @param all Whether to search every sequence
+ * @param pattern The pattern; 'T' and 'U' differ
+ * @param maxErrors The largest edit distance of a match
+ */
+void FragmentList::find(int pos, bool all, std::string_view pattern, int maxErrors) {
+    if (!all) {
+        // Check that the position is within the valid range
+        if (!inRange(pos)) {
+            commandErrors() << "The position out of range.\n";
+            return;
+        }
+
+        // Check if there is a sequence at pos
+        if (fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+            commandErrors() << "There is no sequence at this position.\n";
+            return;
+        }
+
+        // Check that the sequence is made of bases
+        if (fragments.get(pos)->getType() == SequenceType::PROTEIN) {
+            commandErrors() << "The sequence at this position is a protein.\n";
+            return;
+        }
+    }
+
+    // Check that the pattern and the error limit are valid
+    if (!PatternMatcher::isValid(pattern)) {
+        commandErrors() << "Invalid pattern: " << pattern << ". It must be 1 to " << PatternMatcher::kMaxLength
+                        << " bases drawn from A, C, G, T and U.\n";
+        return;
+    }
+    if (maxErrors < 0 || static_cast<std::size_t>(maxErrors) >= pattern.size()) {
+        commandErrors() << "The number of errors must be at least 0 and less than the pattern length.\n";
+        return;
+    }
+
+    PatternMatcher matcher(pattern, maxErrors);
+    std::vector<std::shared_ptr<SequenceFragment>> targets;
+    std::vector<SearchChunk> chunks;
+    auto addTarget = [&](int target, const std::shared_ptr<SequenceFragment>& fragment) {
+        if (fragment->getType() == SequenceType::EMPTY || fragment->getType() == SequenceType::PROTEIN) {
+            return;
+        }
+        for (std::size_t first = 0; first < fragment->getLength(); first += kSearchChunk) {
+            chunks.push_back(SearchChunk{target, first, std::min(fragment->getLength(), first + kSearchChunk)});
+            targets.push_back(fragment);
+        }
+    };
+    if (all) {
+        fragments.forEach([&](std::size_t i, const std::shared_ptr<SequenceFragment>& fragment) {
+            addTarget(static_cast<int>(i), fragment);
+        });
+    } else {
+        addTarget(pos, fragments.get(pos));
+    }
+
+    std::vector<std::vector<SearchMatch>> found(chunks.size());
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        for (std::size_t i = next++; i < chunks.size(); i = next++) {
+            searchChunk(matcher, *targets[i], chunks[i], found[i]);
+        }
+    };
+    if (searchPool && chunks.size() > 1) {
+        searchPool->parallel(std::min(chunks.size(), static_cast<std::size_t>(searchPool->size())) - 1, work);
+    } else {
+        work();
+    }
+
+    // Join the runs cut by chunk boundaries
+    std::vector<SearchMatch> matches;
+    for (const std::vector<SearchMatch>& chunk : found) {
+        for (const SearchMatch& match : chunk) {
+            if (maxErrors > 0 && !matches.empty() && matches.back().pos == match.pos
+                && matches.back().lastEnd + 1 == match.firstEnd) {
+                SearchMatch& run = matches.back();
+                run.lastEnd = match.lastEnd;
+                if (match.errors < run.errors) {
+                    run.start = match.start;
+                    run.end = match.end;
+                    run.errors = match.errors;
+                }
+                continue;
+            }
+            matches.push_back(match);
+        }
+    }
+
+    commandOutput() << "Pattern: ";
+    for (char c : pattern) {
+        commandOutput().put(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+    }
+    commandOutput() << ", Matches: " << matches.size() << "\n";
+    for (const SearchMatch& match : matches) {
+        commandOutput() << "Position: " << match.pos << ", Offset: " << match.start << ", Length: "
+                        << match.end - match.start + 1 << ", Errors: " << match.errors << "\n";
+    }
+}
+
+/**
+ * @brief Set the thread pool searches and alignments share their work on
+ * 
+ * @param pool The pool, owned by the caller, or null to run them on the calling thread
+ */
+void FragmentList::setThreadPool(ThreadPool* pool) {
+    searchPool = pool;
+}
+
+/**
+ * @brief Partition the positions between shards
+ * 
+ * Commands on positions of different shards then never contend for the
+ * slot table; only the k-mer index, when enabled, is still shared.
+ * 
+ * @param shardCount Number of shards
+ */
+void FragmentList::setShardCount(int shardCount) {
+    fragments.setShardCount(static_cast<std::size_t>(std::max(shardCount, 1)));
+}
+
+/**
+ * @brief Translate an RNA sequence into protein
+ * 
+ * A single pass over the sequence, a block at a time, translates the codon
+ * starting at every base on both strands; each reading frame then takes
+ * every third amino acid. Stop codons read as '*' and translation carries on
+ * past them; bases left over after the last whole codon are dropped.
+ * 
+ * @param pos Position of the sequence
+ * @param all Whether to translate all six frames
+ * @param frame 1 to 3 for the sequence, -1 to -3 for its reverse complement, when not all
+ * @param store Whether to place the proteins in the list rather than print them
+ * @param dest First position receiving a protein, in the order +1, +2, +3, -1, -2, -3
+ */
+void FragmentList::translate(int pos, bool all, int frame, bool store, int dest) {
+    // Check that the position is valid
+    if (!inRange(pos) || fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+        commandErrors() << " Position does not contain a sequence.\n";
+        return;
+    }
+
+    // Check that the sequence is RNA
+    if (fragments.get(pos)->getType() != SequenceType::RNA) {
+        commandErrors() << " Sequence is not RNA.\n";
+        return;
+    }
+
+    // Check the frame and the positions receiving the proteins
+    if (!all && (frame < -3 || frame == 0 || frame > 3)) {
+        commandErrors() << "The frame must be 1, 2, 3, -1, -2, -3 or all.\n";
+        return;
+    }
+    int frames = all ? 6 : 1;
+    if (store && (dest < 0 || static_cast<std::size_t>(dest) + frames > fragments.size())) {
+        commandErrors() << "The position out of range.\n";
+        return;
+    }
+
+    // Frames 0 to 2 read the sequence from base 0 to 2, frames 3 to 5 its reverse complement
+    bool wanted[6];
+    for (int i = 0; i < 6; ++i) {
+        wanted[i] = all || (frame > 0 ? i == frame - 1 : i == 2 - frame);
+    }
+    const SequenceFragment& fragment = *fragments.get(pos);
+    std::size_t length = fragment.getLength();
+    std::size_t codons = length < 3 ? 0 : length - 2;
+    std::string proteins[6];
+    for (int i = 0; i < 6; ++i) {
+        std::size_t skip = static_cast<std::size_t>(i % 3);
+        if (wanted[i] && length > skip) {
+            proteins[i].resize((length - skip) / 3);
+        }
+    }
+
+    thread_local std::vector<char> bases;
+    thread_local std::vector<char> forward;
+    thread_local std::vector<char> reverse;
+    for (std::size_t first = 0; first < codons; first += kTranslateChunk) {
+        std::size_t count = std::min(kTranslateChunk, codons - first);
+        bases.resize(count + 2);
+        forward.resize(count);
+        reverse.resize(count);
+        fragment.unpack(first, count + 2, bases.data());
+        translateCodons(bases.data(), count, forward.data(), reverse.data());
+
+        for (std::size_t i = 0; i < 3; ++i) {
+            // The codon starting at base b is amino acid b / 3 of frame b % 3, and
+            // its reverse complement amino acid j / 3 of reverse frame j % 3, j = length - 3 - b
+            if (wanted[i]) {
+                for (std::size_t k = (i + 3 - first % 3) % 3; k < count; k += 3) {
+                    proteins[i][(first + k) / 3] = forward[k];
+                }
+            }
+            if (wanted[3 + i]) {
+                for (std::size_t k = (length + 6 - i - first % 3) % 3; k < count; k += 3) {
+                    proteins[3 + i][(length - 3 - first - k) / 3] = reverse[k];
+                }
+            }
+        }
+    }
+
+    static const char* const kFrameNames[6] = {"+1", "+2", "+3", "-1", "-2", "-3"};
+    for (int i = 0; i < 6; ++i) {
+        if (!wanted[i]) {
+            continue;
+        }
+        if (store) {
+            unindexSlot(dest);
+            fragments.set(dest, makeFragment(std::move(proteins[i])));
+            ++dest;
+        } else {
+            commandOutput() << "Position: " << pos << ", Frame: " << kFrameNames[i] << ", Protein: " << proteins[i] << "\n";
+        }
+    }
+}
+
+/**
+ * @brief Set the scores alignments use
+ * 
+ * The bounds keep every score of a single step within the 8-bit lanes of
+ * the alignment kernels; a gap must cost something to extend.
+ * 
+ * @param match Score added for equal bases
+ * @param mismatch Score subtracted for different bases
+ * @param gapOpen Score subtracted for the first base of a gap
+ * @param gapExtend Score subtracted for every further base of a gap
+ */
+void FragmentList::setScoring(int match, int mismatch, int gapOpen, int gapExtend) {
+    if (match < 1 || match > 127 || mismatch < 0 || mismatch > 127 || gapExtend < 1 || gapOpen < gapExtend
+        || gapOpen > 127) {
+        commandErrors() << "The scores must satisfy 1 <= match <= 127, 0 <= mismatch <= 127 and "
+                           "1 <= gap extend <= gap open <= 127.\n";
+        return;
+    }
+    scoring = AlignmentScoring{match, mismatch, gapOpen, gapExtend};
+}
+
+/**
+ * @brief Print the score of aligning one sequence against another or against all of them
+ * 
+ * The query is prepared once; with all, the targets are aligned on the
+ * calling thread and idle workers of the search pool and printed afterwards,
+ * in order, from the calling thread. A local alignment scoring above 0 also prints the last base it
+ * covers in the query and in the target.
+ * 
+ * @param pos1 Position of the query
+ * @param pos2 Position of the target, ignored when all is set
+ * @param all Whether to align against every sequence
+ * @param global Whether to align end to end rather than locally
+ */
+void FragmentList::align(int pos1, int pos2, bool all, bool global) {
+    for (int pos : {pos1, pos2}) {
+        // Check that the position is within the valid range
+        if (!inRange(pos)) {
+            commandErrors() << "The position out of range.\n";
+            return;
+        }
+
+        // Check if there is a sequence at pos
+        if (fragments.get(pos) == nullptr || fragments.get(pos)->getType() == SequenceType::EMPTY) {
+            commandErrors() << "There is no sequence at this position.\n";
+            return;
+        }
+
+        // Check that the sequence is made of bases
+        if (fragments.get(pos)->getType() == SequenceType::PROTEIN) {
+            commandErrors() << "The sequence at this position is a protein.\n";
+            return;
+        }
+
+        if (all) {
+            break;
+        }
+    }
+
+    std::vector<std::uint8_t> codes;
+    encodeFragment(*fragments.get(pos1), codes);
+    QueryProfile query(std::move(codes), scoring);
+    std::vector<int> positions;
+    std::vector<std::shared_ptr<SequenceFragment>> targets;
+    if (all) {
+        fragments.forEach([&](std::size_t i, const std::shared_ptr<SequenceFragment>& fragment) {
+            if (fragment->getType() != SequenceType::EMPTY && fragment->getType() != SequenceType::PROTEIN) {
+                positions.push_back(static_cast<int>(i));
+                targets.push_back(fragment);
+            }
+        });
+    } else {
+        positions.push_back(pos2);
+        targets.push_back(fragments.get(pos2));
+    }
+
+    std::vector<AlignmentResult> results(targets.size());
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        thread_local std::vector<std::uint8_t> target;
+        for (std::size_t i = next++; i < targets.size(); i = next++) {
+            encodeFragment(*targets[i], target);
+            results[i] = query.align(target.data(), target.size(), global);
+        }
+    };
+    if (searchPool && targets.size() > 1) {
+        searchPool->parallel(std::min(targets.size(), static_cast<std::size_t>(searchPool->size())) - 1, work);
+    } else {
+        work();
+    }
+
+    commandOutput() << "Query: " << pos1 << ", Mode: " << (global ? "global" : "local") << ", Targets: "
+                    << targets.size() << "\n";
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        commandOutput() << "Position: " << positions[i] << ", Score: " << results[i].score;
+        if (!global && results[i].score > 0) {
+            commandOutput() << ", Query end: " << results[i].queryEnd << ", Target end: " << results[i].targetEnd;
+        }
+        commandOutput() << "\n";
+    }
+}
+
+/**
+ * @brief Check that a position is within the list
+ * 
+ * Positions are ints at the command boundary while the list counts in
+ * size_t, so the sign is checked before the one cast to size_t.
+ * 
+ * @param pos Position to check
+ * @return True if 0 <= pos < the number of positions
+ */
+bool FragmentList::inRange(int pos) const {
+    return pos >= 0 && static_cast<std::size_t>(pos) < fragments.size();
+}
+
+/**
+ * @brief Give a slot its own fragment before it is mutated
+ * 
+ * The new fragment shares the rope of the old one, so detaching is O(1);
+ * the edit that follows only rebuilds the rope nodes it touches.
+ * 
+ * @param pos Position of the sequence
+ * @return The fragment now owned by pos alone
+ */
+SequenceFragment& FragmentList::detach(int pos) {
+    if (fragments.get(pos).use_count() > 1) {
+        fragments.set(pos, makeFragment(*fragments.get(pos)));
+    } else {
+        // A slot sharing this fragment may have been detached on another
+        // thread just now; order its reads of the fragment before our edits
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *fragments.get(pos);
+}
+
+/**
+ * @brief Add every k-mer of the sequence at a position to the k-mer index
+ * 
+ * @param pos Position of the sequence
+ */
+void FragmentList::indexSlot(int pos) {
+    if (kmerIndex && fragments.get(pos) != nullptr) {
+        kmerIndex->add(pos, *fragments.get(pos));
+    }
+}
+
+/**
+ * @brief Remove every k-mer of the sequence at a position from the k-mer index
+ * 
+ * @param pos Position of the sequence
+ */
+void FragmentList::unindexSlot(int pos) {
+    if (kmerIndex && fragments.get(pos) != nullptr) {
+        kmerIndex->remove(pos, *fragments.get(pos));
+        kmerIndex->forget(pos);
+    }
+}
@@ -3,7 +3,14 @@
 
 #include <vector>
 #include <memory> 
+#include <string>
+#include <string_view>
+#include <utility>
+#include "alignment.h"
+#include "fragment_slots.h"
+#include "kmer_index.h"
 #include "sequence_fragment.h"
+#include "thread_pool.h"
 
 /**
  * @class FragmentList
@@ -21,9 +28,9 @@ public:
      * @brief Inserts a sequence at a specific position in the fragment list.
      * @param pos The position to insert the sequence at.
      * @param type The type of the sequence.
-     * @param sequence The sequence string.
+     * @param sequence The sequence, viewed in place and packed without an intermediate copy.
      */
-    void insert(int pos, SequenceType type, const std::string& sequence);
+    void insert(int pos, SequenceType type, std::string_view sequence);
 
     /**
      * @brief Removes a sequence at a specific position in the fragment list.
@@ -71,8 +78,183 @@ public:
      */
     void transcribe(int pos);
 
+    /**
+     * @brief Loads FASTA or FASTQ records from a file into consecutive positions.
+     * @param pos The position of the first record.
+     * @param type The type of the sequences.
+     * @param path The path of the file.
+     * @param count The number of records to load, or -1 for every record.
+     */
+    void load(int pos, SequenceType type, const std::string& path, int count);
+
+    /**
+     * @brief Writes the sequences at consecutive positions to a FASTA file.
+     * @param pos The first position.
+     * @param count The number of positions, or -1 for every position from pos on.
+     * @param path The path of the file.
+     */
+    void exportFasta(int pos, int count, const std::string& path);
+
+    /**
+     * @brief Writes every position to a binary snapshot file.
+     * @param path The path of the file.
+     */
+    void save(const std::string& path);
+
+    /// The position and fragment of each occupied slot, or a null fragment for a removed one, as captured for a snapshot.
+    using SlotCapture = std::vector<std::pair<std::size_t, std::shared_ptr<SequenceFragment>>>;
+
+    /**
+     * @brief Shares every occupied slot's fragment, so a snapshot can be written while the list is edited.
+     *
+     * Must not run alongside commands; later edits copy a captured fragment first.
+     * @return The position and fragment of every occupied slot, and every removed one with a null fragment, in position order.
+     */
+    SlotCapture captureSlots();
+
+    /**
+     * @brief Writes captured slots to a binary snapshot file, as save() does; safe on any thread.
+     * @param path The path of the file.
+     * @param slotsToWrite The slots, from captureSlots().
+     * @param durable True to flush the file to disk before it is renamed into place.
+     * @param error Receives the diagnostic on failure.
+     * @return True if the snapshot was written.
+     */
+    static bool writeSnapshot(const std::string& path, const SlotCapture& slotsToWrite, bool durable, std::string& error);
+
+    /**
+     * @brief Replaces every position with those of a snapshot file.
+     *
+     * The file is mapped and the sequences reference it in place, so restoring
+     * reads only the slot table; bases are paged in when first used.
+     * @param path The path of the file.
+     * @return True if the snapshot was restored.
+     */
+    bool restore(const std::string& path);
+
+    /**
+     * @brief Prints how many slots share the sequence at a specific position.
+     * @param pos The position of the sequence.
+     */
+    void printSharing(int pos);
+
+    /**
+     * @brief Prints the sharing count of every sequence and the bases sharing saves.
+     */
+    void printSharing();
+
+    /**
+     * @brief Gets the number of slots sharing the sequence at a specific position.
+     * @param pos The position of the sequence.
+     * @return The number of slots including pos, or 0 if pos holds no sequence.
+     */
+    int sharingCount(int pos) const;
+
+    /**
+     * @brief Prints the length, base counts and GC content of the sequence at a specific position.
+     * @param pos The position of the sequence.
+     */
+    void printStats(int pos);
+
+    /**
+     * @brief Prints the length, base counts and GC content of every sequence together.
+     */
+    void printStats();
+
+    /**
+     * @brief Enables, rebuilds or disables the k-mer index.
+     * @param length The k-mer length, from 1 to KmerIndex::kMaxLength, or 0 to disable the index.
+     */
+    void setKmerLength(int length);
+
+    /**
+     * @brief Prints the positions whose sequences hold a k-mer.
+     * @param kmer The k-mer, as long as the index's k-mers.
+     */
+    void lookup(std::string_view kmer);
+
+    /**
+     * @brief Prints where a pattern occurs in one sequence or in all of them.
+     * @param pos The position of the sequence; ignored when all is set.
+     * @param all True to search every sequence.
+     * @param pattern The pattern, 1 to PatternMatcher::kMaxLength bases.
+     * @param maxErrors The largest edit distance of a match, below the pattern length.
+     */
+    void find(int pos, bool all, std::string_view pattern, int maxErrors);
+
+    /**
+     * @brief Sets the thread pool searches and alignments share their work on.
+     * @param pool The pool, owned by the caller, or null to run them on the calling thread.
+     */
+    void setThreadPool(ThreadPool* pool);
+
+    /**
+     * @brief Partitions the positions between shards, each edited by one thread without sharing a lock.
+     *
+     * Must not run alongside commands.
+     * @param shardCount The number of shards, at least 1; FragmentSlots::shardOf() gives each position's shard.
+     */
+    void setShardCount(int shardCount);
+
+    /**
+     * @brief Translates an RNA sequence into protein in one or all six reading frames.
+     * @param pos The position of the sequence.
+     * @param all True to translate all six reading frames.
+     * @param frame The reading frame when not all: 1 to 3 on the sequence, -1 to -3 on its reverse complement.
+     * @param store True to place the proteins at consecutive positions from dest instead of printing them.
+     * @param dest The first position receiving a protein when storing.
+     */
+    void translate(int pos, bool all, int frame, bool store, int dest);
+
+    /**
+     * @brief Sets the scores alignments use.
+     * @param match The score added for equal bases, 1 to 127.
+     * @param mismatch The score subtracted for different bases, 0 to 127.
+     * @param gapOpen The score subtracted for the first base of a gap, gapExtend to 127.
+     * @param gapExtend The score subtracted for every further base of a gap, at least 1.
+     */
+    void setScoring(int match, int mismatch, int gapOpen, int gapExtend);
+
+    /**
+     * @brief Prints the score of aligning the sequence at one position against another or against every sequence.
+     * @param pos1 The position of the query.
+     * @param pos2 The position of the target; ignored when all is set.
+     * @param all True to align the query against every sequence.
+     * @param global True for global alignment, false for local.
+     */
+    void align(int pos1, int pos2, bool all, bool global);
+
 private:
-    std::vector<std::shared_ptr<SequenceFragment>> fragments; ///< The list of sequence fragments.
+    FragmentSlots fragments; ///< The sequence fragments, shared between slots by copy; pages are allocated as slots are used.
+    std::unique_ptr<KmerIndex> kmerIndex; ///< The k-mer index, null unless enabled; every edit keeps it up to date.
+    ThreadPool* searchPool = nullptr; ///< The pool searches are split over, owned by the caller; null to run them inline.
+    AlignmentScoring scoring; ///< The scores alignments use.
+
+    /**
+     * @brief Checks that a position is within the list.
+     * @param pos The position.
+     * @return True if 0 <= pos < the number of positions.
+     */
+    bool inRange(int pos) const;
+
+    /**
+     * @brief Gives a slot its own fragment before it is mutated.
+     * @param pos The position of the sequence.
+     * @return The fragment now owned by pos alone.
+     */
+    SequenceFragment& detach(int pos);
+
+    /**
+     * @brief Adds every k-mer of the sequence at a position to the k-mer index, if enabled.
+     * @param pos The position.
+     */
+    void indexSlot(int pos);
+
+    /**
+     * @brief Removes every k-mer of the sequence at a position from the k-mer index, if enabled.
+     * @param pos The position.
+     */
+    void unindexSlot(int pos);
 };
 
 #endif // FRAGMENT_LIST_H
\ No newline at end of file
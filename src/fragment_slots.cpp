@@ -0,0 +1,219 @@
+#include "fragment_slots.h"
+#include <algorithm>
+
+/**
+ * @brief Constructs a table with every slot empty.
+ * @param capacity The number of addressable positions.
+ */
+FragmentSlots::FragmentSlots(std::size_t capacity)
+    : capacity(capacity), pages(new std::atomic<Page*>[(capacity + kPageSize - 1) / kPageSize]) {
+    for (std::size_t i = 0; i < (capacity + kPageSize - 1) / kPageSize; ++i) {
+        pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+    shards.push_back(std::make_unique<Shard>());
+}
+
+/**
+ * @brief Frees every page.
+ */
+FragmentSlots::~FragmentSlots() {
+    clear();
+}
+
+/**
+ * @brief Getter for the number of addressable positions.
+ * @return The capacity given at construction.
+ */
+std::size_t FragmentSlots::size() const {
+    return capacity;
+}
+
+/**
+ * @brief Getter for the number of positions holding a fragment.
+ * @return The size of the occupied indices together.
+ */
+std::size_t FragmentSlots::occupiedCount() const {
+    std::size_t count = 0;
+    for (const auto& shard : shards) {
+        count += shard->occupied.size();
+    }
+    return count;
+}
+
+/**
+ * @brief Splits the occupied index between shards; must not run alongside anything else.
+ * @param count The number of shards, at least 1.
+ */
+void FragmentSlots::setShardCount(std::size_t count) {
+    std::vector<std::uint32_t> positions(sortOccupied());
+    shards.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    for (std::uint32_t pos : positions) {
+        Shard& shard = shardFor(pos);
+        slot(pos).index = static_cast<std::uint32_t>(shard.occupied.size());
+        shard.occupied.push_back(pos);
+    }
+}
+
+/**
+ * @brief Getter for the fragment at a position.
+ * @param pos The position, below size().
+ * @return The fragment, or null if the position holds none.
+ */
+const std::shared_ptr<SequenceFragment>& FragmentSlots::get(std::size_t pos) const {
+    static const std::shared_ptr<SequenceFragment> none;
+    const Slot* found = find(pos);
+    return found != nullptr ? found->fragment : none;
+}
+
+/**
+ * @brief Stores a fragment at a position, replacing any fragment there.
+ * @param pos The position, below size().
+ * @param fragment The fragment, not null.
+ */
+void FragmentSlots::set(std::size_t pos, std::shared_ptr<SequenceFragment> fragment) {
+    Slot& target = slot(pos);
+    if (target.fragment == nullptr) {
+        // Only a newly occupied position touches its shard's index
+        Shard& shard = shardFor(pos);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        target.index = static_cast<std::uint32_t>(shard.occupied.size());
+        shard.sorted = shard.sorted && (shard.occupied.empty() || shard.occupied.back() < pos);
+        shard.occupied.push_back(static_cast<std::uint32_t>(pos));
+    }
+    target.fragment = std::move(fragment);
+    target.removed = false;
+}
+
+/**
+ * @brief Drops the fragment at a position and marks the position as removed.
+ * @param pos The position, below size().
+ */
+void FragmentSlots::remove(std::size_t pos) {
+    Slot& target = slot(pos);
+    if (target.fragment != nullptr) {
+        // Move the last position into the hole so the index stays dense
+        Shard& shard = shardFor(pos);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::uint32_t last = shard.occupied.back();
+        shard.occupied[target.index] = last;
+        slot(last).index = target.index;
+        shard.occupied.pop_back();
+        shard.sorted = shard.sorted && target.index == shard.occupied.size();
+    }
+    target.fragment.reset();
+    target.removed = true;
+}
+
+/**
+ * @brief Checks whether the last change to a position was a removal.
+ * @param pos The position, below size().
+ * @return True if the position was removed and not set since.
+ */
+bool FragmentSlots::isRemoved(std::size_t pos) const {
+    const Slot* found = find(pos);
+    return found != nullptr && found->removed;
+}
+
+/**
+ * @brief Getter for the positions whose last change was a removal; must not run alongside anything else.
+ * @return The positions in increasing order; only pages that were allocated are scanned.
+ */
+std::vector<std::size_t> FragmentSlots::removedPositions() const {
+    std::vector<std::size_t> removed;
+    for (std::size_t i = 0; i < (capacity + kPageSize - 1) / kPageSize; ++i) {
+        const Page* page = pages[i].load(std::memory_order_acquire);
+        if (page == nullptr) {
+            continue;
+        }
+        for (std::size_t j = 0; j < kPageSize; ++j) {
+            if (page->slots[j].removed) {
+                removed.push_back(i * kPageSize + j);
+            }
+        }
+    }
+    return removed;
+}
+
+/**
+ * @brief Empties every position and frees every page.
+ */
+void FragmentSlots::clear() {
+    for (std::size_t i = 0; i < (capacity + kPageSize - 1) / kPageSize; ++i) {
+        delete pages[i].exchange(nullptr, std::memory_order_relaxed);
+    }
+    for (auto& shard : shards) {
+        shard->occupied.clear();
+        shard->sorted = true;
+    }
+    merged.clear();
+}
+
+/**
+ * @brief Getter for the slot at a position, allocating its page if needed.
+ * @param pos The position.
+ * @return The slot.
+ */
+FragmentSlots::Slot& FragmentSlots::slot(std::size_t pos) {
+    std::atomic<Page*>& entry = pages[pos / kPageSize];
+    Page* page = entry.load(std::memory_order_acquire);
+    if (page == nullptr) {
+        // Threads setting slots of the same page race to allocate it; one wins
+        Page* created = new Page();
+        if (entry.compare_exchange_strong(page, created, std::memory_order_acq_rel)) {
+            page = created;
+        } else {
+            delete created;
+        }
+    }
+    return page->slots[pos % kPageSize];
+}
+
+/**
+ * @brief Getter for the slot at a position without allocating.
+ * @param pos The position.
+ * @return The slot, or null if its page was never allocated.
+ */
+const FragmentSlots::Slot* FragmentSlots::find(std::size_t pos) const {
+    const Page* page = pages[pos / kPageSize].load(std::memory_order_acquire);
+    return page != nullptr ? &page->slots[pos % kPageSize] : nullptr;
+}
+
+/**
+ * @brief Getter for the shard of a position.
+ * @param pos The position.
+ * @return The shard.
+ */
+FragmentSlots::Shard& FragmentSlots::shardFor(std::size_t pos) {
+    return *shards[shardOf(pos, shards.size())];
+}
+
+/**
+ * @brief Sorts each shard's occupied index and renumbers the slots' places in it.
+ * @return Every occupied position in increasing order.
+ */
+const std::vector<std::uint32_t>& FragmentSlots::sortOccupied() {
+    for (auto& shard : shards) {
+        if (shard->sorted) {
+            continue;
+        }
+        std::sort(shard->occupied.begin(), shard->occupied.end());
+        for (std::size_t i = 0; i < shard->occupied.size(); ++i) {
+            slot(shard->occupied[i]).index = static_cast<std::uint32_t>(i);
+        }
+        shard->sorted = true;
+    }
+    if (shards.size() == 1) {
+        return shards.front()->occupied;
+    }
+    // Merge the sorted shards one at a time
+    merged.clear();
+    for (const auto& shard : shards) {
+        std::size_t middle = merged.size();
+        merged.insert(merged.end(), shard->occupied.begin(), shard->occupied.end());
+        std::inplace_merge(merged.begin(), merged.begin() + static_cast<std::ptrdiff_t>(middle), merged.end());
+    }
+    return merged;
+}
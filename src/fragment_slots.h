@@ -0,0 +1,184 @@
+#ifndef FRAGMENT_SLOTS_H
+#define FRAGMENT_SLOTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "sequence_fragment.h"
+
+/**
+ * @class FragmentSlots
+ * @brief Sparse table of fragment slots that only pays for the slots in use.
+ *
+ * Slots live in fixed-size pages allocated the first time one of their slots
+ * is set, so a table of tens of millions of mostly empty positions costs one
+ * pointer per page up front. The positions holding a fragment are also kept
+ * in a dense index, so visiting them does not scan the empty ones.
+ *
+ * Different slots may be set and removed from different threads at once;
+ * forEach() and clear() must not run alongside anything else. Runs of
+ * kShardRun slots can be dealt out to shards in turn, each with its own
+ * occupied index, so threads that each own a shard never share a lock.
+ */
+class FragmentSlots {
+public:
+    static constexpr std::size_t kPageSize = 256; ///< The number of slots in a page.
+    static constexpr std::size_t kShardRun = 8; ///< The consecutive slots of one shard, spanning whole cache lines.
+
+    /**
+     * @brief Constructs a table with every slot empty.
+     * @param capacity The number of addressable positions.
+     */
+    explicit FragmentSlots(std::size_t capacity);
+
+    /**
+     * @brief Frees every page.
+     */
+    ~FragmentSlots();
+
+    FragmentSlots(const FragmentSlots&) = delete;
+    FragmentSlots& operator=(const FragmentSlots&) = delete;
+
+    /**
+     * @brief Getter for the number of addressable positions.
+     * @return The capacity given at construction.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Getter for the number of positions holding a fragment.
+     * @return The size of the occupied indices together.
+     */
+    std::size_t occupiedCount() const;
+
+    /**
+     * @brief Splits the occupied index between shards; must not run alongside anything else.
+     * @param count The number of shards, at least 1.
+     */
+    void setShardCount(std::size_t count);
+
+    /**
+     * @brief Getter for the shard a position belongs to.
+     * @param pos The position.
+     * @param count The number of shards.
+     * @return The shard, below count; runs of kShardRun slots go to the shards in turn.
+     */
+    static std::size_t shardOf(std::size_t pos, std::size_t count) {
+        return (pos / kShardRun) % count;
+    }
+
+    /**
+     * @brief Getter for the fragment at a position.
+     * @param pos The position, below size().
+     * @return The fragment, or null if the position holds none.
+     */
+    const std::shared_ptr<SequenceFragment>& get(std::size_t pos) const;
+
+    /**
+     * @brief Stores a fragment at a position, replacing any fragment there.
+     * @param pos The position, below size().
+     * @param fragment The fragment, not null.
+     */
+    void set(std::size_t pos, std::shared_ptr<SequenceFragment> fragment);
+
+    /**
+     * @brief Drops the fragment at a position and marks the position as removed.
+     * @param pos The position, below size().
+     */
+    void remove(std::size_t pos);
+
+    /**
+     * @brief Checks whether the last change to a position was a removal.
+     * @param pos The position, below size().
+     * @return True if the position was removed and not set since.
+     */
+    bool isRemoved(std::size_t pos) const;
+
+    /**
+     * @brief Getter for the positions whose last change was a removal; must not run alongside anything else.
+     * @return The positions in increasing order; only pages that were allocated are scanned.
+     */
+    std::vector<std::size_t> removedPositions() const;
+
+    /**
+     * @brief Empties every position and frees every page.
+     */
+    void clear();
+
+    /**
+     * @brief Visits the positions holding a fragment in increasing order.
+     * @param visit Called with each position and its fragment.
+     */
+    template <typename Visitor>
+    void forEach(Visitor visit) {
+        for (std::uint32_t pos : sortOccupied()) {
+            visit(static_cast<std::size_t>(pos), slot(pos).fragment);
+        }
+    }
+
+private:
+    /**
+     * @struct Slot
+     * @brief One position of a page.
+     */
+    struct Slot {
+        std::shared_ptr<SequenceFragment> fragment; ///< The fragment, null if there is none.
+        std::uint32_t index = 0; ///< Where the position is in the occupied index, while it has a fragment.
+        bool removed = false; ///< True if the position was removed and not set since.
+    };
+
+    /**
+     * @struct Page
+     * @brief A run of kPageSize consecutive slots, cache line aligned so shard runs do not share lines.
+     */
+    struct alignas(64) Page {
+        Slot slots[kPageSize]; ///< The slots.
+    };
+
+    /**
+     * @struct Shard
+     * @brief The occupied index of the pages of one shard, on a cache line of its own.
+     */
+    struct alignas(64) Shard {
+        std::vector<std::uint32_t> occupied; ///< The positions holding a fragment.
+        bool sorted = true; ///< True while occupied is in increasing order.
+        std::mutex mutex; ///< Guards the occupied index.
+    };
+
+    std::size_t capacity; ///< The number of addressable positions.
+    std::unique_ptr<std::atomic<Page*>[]> pages; ///< One entry per page, null until a slot of it is set.
+    std::vector<std::unique_ptr<Shard>> shards; ///< The occupied index of each shard.
+    std::vector<std::uint32_t> merged; ///< Every shard's positions in increasing order, rebuilt by forEach().
+
+    /**
+     * @brief Getter for the slot at a position, allocating its page if needed.
+     * @param pos The position.
+     * @return The slot.
+     */
+    Slot& slot(std::size_t pos);
+
+    /**
+     * @brief Getter for the slot at a position without allocating.
+     * @param pos The position.
+     * @return The slot, or null if its page was never allocated.
+     */
+    const Slot* find(std::size_t pos) const;
+
+    /**
+     * @brief Getter for the shard of a position.
+     * @param pos The position.
+     * @return The shard.
+     */
+    Shard& shardFor(std::size_t pos);
+
+    /**
+     * @brief Sorts each shard's occupied index and renumbers the slots' places in it.
+     * @return Every occupied position in increasing order.
+     */
+    const std::vector<std::uint32_t>& sortOccupied();
+};
+
+#endif // FRAGMENT_SLOTS_H
@@ -0,0 +1,512 @@
+#include "journal.h"
+#include "command_output.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'N', 'A', 'J', 'R', 'N', 'L', '\0'}; ///< Identifies a log file.
+
+/**
+ * @struct LogHeader
+ * @brief The start of a log file; records follow.
+ */
+struct LogHeader {
+    char magic[8]; ///< kMagic.
+    std::uint32_t version; ///< kProgramVersion.
+    std::uint32_t instructionSize; ///< sizeof(Instruction) when written.
+};
+
+/**
+ * @struct RecordHeader
+ * @brief The start of a record; the payload follows.
+ */
+struct RecordHeader {
+    std::uint32_t checksum; ///< CRC-32 of the rest of the header and the payload.
+    std::uint32_t payloadLength; ///< The bytes of payload.
+    Instruction instruction; ///< The command, with its payload offset zero.
+};
+
+/**
+ * @brief Continues a CRC-32 (the zlib polynomial) over more bytes.
+ * @param crc The CRC of the bytes before, 0 to start.
+ * @param data The bytes.
+ * @param size The number of bytes.
+ * @return The CRC of all the bytes.
+ */
+std::uint32_t crc32(std::uint32_t crc, const void* data, std::size_t size) {
+    static const std::array<std::uint32_t, 256> table = [] {
+        std::array<std::uint32_t, 256> entries{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Computes the checksum of a record.
+ * @param header The record header; its checksum field is not covered.
+ * @param payload The payload.
+ * @return The checksum.
+ */
+std::uint32_t recordChecksum(const RecordHeader& header, std::string_view payload) {
+    std::uint32_t crc = crc32(0, reinterpret_cast<const char*>(&header) + sizeof(header.checksum),
+                              sizeof(header) - sizeof(header.checksum));
+    return crc32(crc, payload.data(), payload.size());
+}
+
+/**
+ * @brief Splits a path into its directory and file name.
+ * @param path The path.
+ * @return The directory, "." if there is none, and the file name.
+ */
+std::pair<std::string, std::string> splitPath(const std::string& path) {
+    std::size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return {".", path};
+    }
+    return {slash == 0 ? "/" : path.substr(0, slash), path.substr(slash + 1)};
+}
+
+/**
+ * @brief Flushes a directory, so files created, renamed or removed in it stay that way after a crash.
+ * @param directory The directory.
+ * @return True if it was flushed.
+ */
+bool syncDirectory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+/**
+ * @brief Reads the number after a prefix, as in "name.wal.12".
+ * @param name The file name.
+ * @param prefix The prefix.
+ * @param number Receives the number.
+ * @return False if the name is the prefix and anything but digits.
+ */
+bool parseNumber(std::string_view name, std::string_view prefix, std::uint64_t& number) {
+    if (name.size() <= prefix.size() || name.substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    number = 0;
+    for (char c : name.substr(prefix.size())) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        number = number * 10 + static_cast<std::uint64_t>(c - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for the Journal class
+ *
+ * @param path The path the journal's files are named after
+ * @param fragmentList The list the journaled commands act on
+ * @param logger Where checkpoints are logged, or null
+ */
+Journal::Journal(std::string path, FragmentList& fragmentList, Logger* logger)
+    : path(std::move(path)), fragmentList(fragmentList), logger(logger), lastCheckpoint(std::chrono::steady_clock::now()) {}
+
+/**
+ * @brief Commit what is buffered and wait for a checkpoint being written
+ */
+Journal::~Journal() {
+    if (fd >= 0) {
+        commit();
+    }
+    if (checkpointer.joinable()) {
+        checkpointer.join();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+/**
+ * @brief Recover the journal's state into the list and open the log for appending
+ *
+ * The newest checkpoint is restored and every log numbered from it on is
+ * replayed in order. A record cut short by a crash, or failing its
+ * checksum, ends the newest log and is cut off; anywhere else it is an
+ * error. Files older than the checkpoint are left by a crash during
+ * cleanup and are deleted.
+ *
+ * @param replay Executes each command logged after the checkpoint
+ * @return False if the files could not be read or written
+ */
+bool Journal::open(const Replayer& replay) {
+    auto [directory, name] = splitPath(path);
+    std::set<std::uint64_t> checkpoints;
+    std::set<std::uint64_t> logs;
+    if (DIR* entries = ::opendir(directory.c_str())) {
+        while (dirent* entry = ::readdir(entries)) {
+            std::uint64_t number = 0;
+            if (parseNumber(entry->d_name, name + ".ckpt.", number)) {
+                checkpoints.insert(number);
+            } else if (parseNumber(entry->d_name, name + ".wal.", number)) {
+                logs.insert(number);
+            }
+        }
+        ::closedir(entries);
+    } else {
+        commandErrors() << "Failed to open journal directory: " << directory << '\n';
+        return false;
+    }
+
+    if (checkpoints.empty()) {
+        if (!logs.empty()) {
+            commandErrors() << "Journal logs without a checkpoint: " << path << '\n';
+            return false;
+        }
+        // A new journal starts from the list as it is
+        std::string error;
+        if (!FragmentList::writeSnapshot(checkpointPath(0), fragmentList.captureSlots(), true, error) ||
+            !syncDirectory(directory)) {
+            commandErrors() << (error.empty() ? "Failed to write file: " + checkpointPath(0) + "\n" : error);
+            return false;
+        }
+        return openLog(0);
+    }
+
+    std::uint64_t checkpoint = *checkpoints.rbegin();
+    if (!fragmentList.restore(checkpointPath(checkpoint))) {
+        return false;
+    }
+    std::uint64_t newest = checkpoint;
+    for (auto it = logs.lower_bound(checkpoint); it != logs.end(); ++it) {
+        if (!replayLog(*it, std::next(it) == logs.end(), replay)) {
+            return false;
+        }
+        newest = *it;
+    }
+    oldest = std::min(*checkpoints.begin(), logs.empty() ? checkpoint : *logs.begin());
+    removeBefore(checkpoint);
+    if (logger) {
+        logger->log(LogLevel::INFO, "Recovered journal from checkpoint ", checkpoint, " and logs up to ", newest);
+    }
+    return openLog(newest);
+}
+
+/**
+ * @brief Buffer a record of a command that ran; safe from any thread
+ *
+ * Commands on the same position run one after another, so their records
+ * are buffered in the order they ran.
+ *
+ * @param instruction The command
+ * @param payload Its payload
+ */
+void Journal::append(const Instruction& instruction, std::string_view payload) {
+    RecordHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.payloadLength = static_cast<std::uint32_t>(payload.size());
+    header.instruction.opcode = instruction.opcode;
+    header.instruction.operandCount = instruction.operandCount;
+    std::memcpy(header.instruction.operands, instruction.operands, sizeof(instruction.operands));
+    header.instruction.payloadLength = payload.size();
+    header.checksum = recordChecksum(header, payload);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.append(payload);
+    logBytes += sizeof(header) + payload.size();
+    // Replaying these reads other files, which may change; a checkpoint ends that need
+    if (instruction.opcode == CommandType::LOAD || instruction.opcode == CommandType::RESTORE) {
+        checkpointWanted = true;
+    }
+    if (buffer.size() >= kWriteBytes) {
+        writeBuffered();
+    }
+}
+
+/**
+ * @brief Make every buffered record durable with one fdatasync, then start a checkpoint if one is due
+ *
+ * A checkpoint is due after a load or restore, once the log reaches
+ * kCheckpointBytes, or once it has records and kCheckpointInterval has
+ * passed since the last one. Only one checkpoint is written at a time.
+ */
+void Journal::commit() {
+    bool due = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writeBuffered();
+        if (unsynced && ::fdatasync(fd) != 0) {
+            failed = true;
+        }
+        unsynced = false;
+        if (failed) {
+            commandErrors() << "Failed to write journal: " << logPath(generation) << '\n';
+            if (logger) {
+                logger->log(LogLevel::ERROR, "Failed to write journal: ", logPath(generation));
+            }
+            failed = false;
+        }
+        // The checkpointer leaves its failure here, to be reported with the commands' diagnostics
+        if (!checkpointError.empty()) {
+            commandErrors() << checkpointError;
+            checkpointError.clear();
+        }
+        due = checkpointWanted || logBytes >= kCheckpointBytes ||
+              (logBytes != 0 && std::chrono::steady_clock::now() - lastCheckpoint >= kCheckpointInterval);
+    }
+    if (due && !checkpointing.load(std::memory_order_acquire)) {
+        startCheckpoint();
+    }
+}
+
+/**
+ * @brief Check whether a command is journaled
+ *
+ * Translations are journaled when they store proteins.
+ *
+ * @param instruction The command
+ * @return True if it may change a position
+ */
+bool Journal::isJournaled(const Instruction& instruction) {
+    switch (instruction.opcode) {
+        case CommandType::INSERT:
+        case CommandType::REMOVE:
+        case CommandType::CLIP:
+        case CommandType::COPY:
+        case CommandType::SWAP:
+        case CommandType::TRANSCRIBE:
+        case CommandType::LOAD:
+        case CommandType::RESTORE:
+            return true;
+        case CommandType::TRANSLATE:
+            return instruction.operandCount > 3;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Getter for the name of a checkpoint
+ *
+ * @param number Its number
+ * @return The path
+ */
+std::string Journal::checkpointPath(std::uint64_t number) const {
+    return path + ".ckpt." + std::to_string(number);
+}
+
+/**
+ * @brief Getter for the name of a log
+ *
+ * @param number Its number
+ * @return The path
+ */
+std::string Journal::logPath(std::uint64_t number) const {
+    return path + ".wal." + std::to_string(number);
+}
+
+/**
+ * @brief Replay the records of a log, cutting off a torn tail
+ *
+ * @param number The log's number
+ * @param last True for the newest log, the only one that may end torn
+ * @param replay Executes each command
+ * @return False if the log is unreadable, or damaged before its end
+ */
+bool Journal::replayLog(std::uint64_t number, bool last, const Replayer& replay) {
+    std::string name = logPath(number);
+    struct stat status{};
+    if (::stat(name.c_str(), &status) != 0) {
+        commandErrors() << "Failed to open file: " << name << '\n';
+        return false;
+    }
+    std::size_t good = 0;
+    std::size_t size = static_cast<std::size_t>(status.st_size);
+    if (size >= sizeof(LogHeader)) {
+        MappedFile file(name);
+        if (!file.isOpen()) {
+            commandErrors() << "Failed to open file: " << name << '\n';
+            return false;
+        }
+        std::string_view data = file.data();
+        LogHeader header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kProgramVersion ||
+            header.instructionSize != sizeof(Instruction)) {
+            commandErrors() << "Not a journal of this version: " << name << '\n';
+            return false;
+        }
+        good = sizeof(header);
+        while (data.size() - good >= sizeof(RecordHeader)) {
+            RecordHeader record;
+            std::memcpy(&record, data.data() + good, sizeof(record));
+            if (record.payloadLength > data.size() - good - sizeof(record)) {
+                break;
+            }
+            std::string_view payload = data.substr(good + sizeof(record), record.payloadLength);
+            if (record.checksum != recordChecksum(record, payload) ||
+                record.instruction.opcode > CommandType::INVALID) {
+                break;
+            }
+            replay(record.instruction, payload);
+            good += sizeof(record) + record.payloadLength;
+        }
+    }
+    if (good == size) {
+        return true;
+    }
+    if (!last) {
+        commandErrors() << "Journal damaged: " << name << '\n';
+        return false;
+    }
+    // The records after a crash were never committed; openLog() rewrites a torn header
+    if (::truncate(name.c_str(), static_cast<off_t>(good)) != 0) {
+        commandErrors() << "Failed to write file: " << name << '\n';
+        return false;
+    }
+    if (logger) {
+        logger->log(LogLevel::WARNING, "Cut ", size - good, " bytes of uncommitted records from ", name);
+    }
+    return true;
+}
+
+/**
+ * @brief Make a log the one appended to, creating it if needed
+ *
+ * @param number The log's number
+ * @return False if it could not be opened
+ */
+bool Journal::openLog(std::uint64_t number) {
+    std::string name = logPath(number);
+    int file = ::open(name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat status{};
+    if (file < 0 || ::fstat(file, &status) != 0) {
+        commandErrors() << "Failed to open file: " << name << '\n';
+        if (file >= 0) {
+            ::close(file);
+        }
+        return false;
+    }
+    auto size = static_cast<std::size_t>(status.st_size);
+    if (size < sizeof(LogHeader)) {
+        LogHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kProgramVersion;
+        header.instructionSize = sizeof(Instruction);
+        bool written = ::ftruncate(file, 0) == 0 &&
+                       ::write(file, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) &&
+                       ::fdatasync(file) == 0 && syncDirectory(splitPath(path).first);
+        if (!written) {
+            commandErrors() << "Failed to write file: " << name << '\n';
+            ::close(file);
+            return false;
+        }
+        size = sizeof(header);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = file;
+    generation = number;
+    logBytes = size - sizeof(LogHeader);
+    return true;
+}
+
+/**
+ * @brief Write buffered records to the log; the mutex must be held
+ */
+void Journal::writeBuffered() {
+    std::size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t count = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = true;
+            break;
+        }
+        written += static_cast<std::size_t>(count);
+    }
+    unsynced = unsynced || written != 0;
+    buffer.clear();
+}
+
+/**
+ * @brief Start a new log and write the positions as its checkpoint on the background thread
+ *
+ * The capture shares the fragments, so commands keep running while the
+ * checkpoint is written; the first edit of a captured slot copies it.
+ */
+void Journal::startCheckpoint() {
+    if (checkpointer.joinable()) {
+        checkpointer.join();
+    }
+    std::uint64_t number = generation + 1;
+    if (!openLog(number)) {
+        return;
+    }
+    FragmentList::SlotCapture captured = fragmentList.captureSlots();
+    checkpointWanted = false;
+    lastCheckpoint = std::chrono::steady_clock::now();
+    checkpointing.store(true, std::memory_order_release);
+    checkpointer = std::thread([this, number, captured = std::move(captured)]() mutable {
+        std::string error;
+        bool written = FragmentList::writeSnapshot(checkpointPath(number), captured, true, error) &&
+                       syncDirectory(splitPath(path).first);
+        captured.clear();
+        if (written) {
+            removeBefore(number);
+            if (logger) {
+                logger->log(LogLevel::INFO, "Wrote checkpoint ", number);
+            }
+        } else {
+            if (logger) {
+                logger->log(LogLevel::ERROR, "Failed to write checkpoint ", number, ": ", error);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            checkpointError = "Failed to write checkpoint: " + checkpointPath(number) + "\n";
+        }
+        checkpointing.store(false, std::memory_order_release);
+    });
+}
+
+/**
+ * @brief Delete the checkpoints and logs numbered below a checkpoint on disk
+ *
+ * @param number The checkpoint's number
+ */
+void Journal::removeBefore(std::uint64_t number) {
+    for (std::uint64_t i = oldest; i < number; ++i) {
+        ::unlink(checkpointPath(i).c_str());
+        ::unlink(logPath(i).c_str());
+    }
+    oldest = std::max(oldest, number);
+    syncDirectory(splitPath(path).first);
+}
@@ -0,0 +1,150 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "command_program.h"
+#include "fragment_list.h"
+#include "logger.h"
+
+/**
+ * @class Journal
+ * @brief A write-ahead journal of the commands that change positions, for sessions that survive a crash.
+ *
+ * The journal is a checkpoint, a snapshot named path.ckpt.N, followed by
+ * logs path.wal.N, path.wal.N+1 and so on, holding one checksummed record
+ * per command run since. Records are buffered as commands run and made
+ * durable together by commit(), with one fdatasync for the whole batch.
+ * After enough log, a commit starts a new log, captures the positions and
+ * writes them as the next checkpoint on a background thread; once it is on
+ * disk the older checkpoint and logs are deleted.
+ */
+class Journal {
+public:
+    using Replayer = std::function<void(const Instruction&, std::string_view)>; ///< Executes a recovered command.
+
+    /**
+     * @brief Constructor for the Journal class.
+     * @param path The path the journal's files are named after.
+     * @param fragmentList The list the journaled commands act on.
+     * @param logger Where checkpoints are logged, or null.
+     */
+    Journal(std::string path, FragmentList& fragmentList, Logger* logger);
+
+    /**
+     * @brief Commits what is buffered and waits for a checkpoint being written.
+     */
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /**
+     * @brief Recovers the journal's state into the list and opens the log for appending.
+     *
+     * Without journal files, the list as it stands is written as the first checkpoint.
+     * @param replay Executes each command logged after the checkpoint.
+     * @return False if the files could not be read or written.
+     */
+    bool open(const Replayer& replay);
+
+    /**
+     * @brief Buffers a record of a command that ran; safe from any thread.
+     * @param instruction The command.
+     * @param payload Its payload.
+     */
+    void append(const Instruction& instruction, std::string_view payload);
+
+    /**
+     * @brief Makes every buffered record durable with one fdatasync, then starts a checkpoint if one is due.
+     *
+     * Must not run alongside commands.
+     */
+    void commit();
+
+    /**
+     * @brief Checks whether a command is journaled.
+     * @param instruction The command.
+     * @return True if it may change a position.
+     */
+    static bool isJournaled(const Instruction& instruction);
+
+private:
+    static constexpr std::size_t kWriteBytes = 1 << 20; ///< Buffered records are written once they reach this size.
+    static constexpr std::uint64_t kCheckpointBytes = 64 << 20; ///< A log this long is checkpointed.
+    static constexpr std::chrono::seconds kCheckpointInterval{60}; ///< A log with records is checkpointed after this long.
+
+    std::string path; ///< The path the files are named after.
+    FragmentList& fragmentList; ///< The list the commands act on.
+    Logger* logger; ///< Where checkpoints are logged, or null.
+    int fd = -1; ///< The log being appended to.
+    std::uint64_t generation = 0; ///< The number of that log.
+    std::uint64_t oldest = 0; ///< The lowest numbered file that may still exist.
+    std::uint64_t logBytes = 0; ///< The records in that log, durable or not.
+    bool checkpointWanted = false; ///< Set by commands whose effect depends on other files.
+    std::chrono::steady_clock::time_point lastCheckpoint; ///< When the last checkpoint started.
+
+    std::mutex mutex; ///< Guards the buffer, fd and the counts.
+    std::string buffer; ///< Records not yet written.
+    bool unsynced = false; ///< Set once records are written, until they are flushed.
+    bool failed = false; ///< Set once a write failed, until reported.
+    std::string checkpointError; ///< Why the checkpointer failed, until commit() reports it.
+
+    std::thread checkpointer; ///< Writes the latest checkpoint.
+    std::atomic<bool> checkpointing{false}; ///< True while the checkpointer runs.
+
+    /**
+     * @brief Getter for the name of a checkpoint.
+     * @param number Its number.
+     * @return The path.
+     */
+    std::string checkpointPath(std::uint64_t number) const;
+
+    /**
+     * @brief Getter for the name of a log.
+     * @param number Its number.
+     * @return The path.
+     */
+    std::string logPath(std::uint64_t number) const;
+
+    /**
+     * @brief Replays the records of a log, cutting off a torn tail.
+     * @param number The log's number.
+     * @param last True for the newest log, the only one that may end torn.
+     * @param replay Executes each command.
+     * @return False if the log is unreadable, or damaged before its end.
+     */
+    bool replayLog(std::uint64_t number, bool last, const Replayer& replay);
+
+    /**
+     * @brief Makes a log the one appended to, creating it if needed.
+     * @param number The log's number.
+     * @return False if it could not be opened.
+     */
+    bool openLog(std::uint64_t number);
+
+    /**
+     * @brief Writes buffered records to the log; the mutex must be held.
+     */
+    void writeBuffered();
+
+    /**
+     * @brief Starts a new log and writes the positions as its checkpoint on the background thread.
+     */
+    void startCheckpoint();
+
+    /**
+     * @brief Deletes the checkpoints and logs numbered below a checkpoint on disk.
+     * @param number The checkpoint's number.
+     */
+    void removeBefore(std::uint64_t number);
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,371 @@
+#include "kmer_index.h"
+#include <algorithm>
+#include <array>
+#include <string>
+
+namespace {
+
+constexpr std::size_t kBlockSize = 1 << 16; ///< The k-mers coded per unpacked block.
+constexpr std::size_t kInitialEntries = 1024; ///< The size of the table before anything is added.
+constexpr unsigned kLetterBits = 3; ///< The bits coding one letter.
+
+/// The letter each letter was before transcription, which maps A, C, G, T and U to T, G, C, U and A.
+constexpr std::uint64_t kUntranscribed[5] = {4, 2, 1, 0, 3};
+
+/**
+ * @brief Table from a character to its letter code.
+ * @return The table: A=0, C=1, G=2, T=3, U=4 in either case, -1 for anything else.
+ */
+const std::array<std::int8_t, 256>& letterCodes() {
+    static const std::array<std::int8_t, 256> table = [] {
+        std::array<std::int8_t, 256> codes;
+        codes.fill(-1);
+        codes['A'] = codes['a'] = 0;
+        codes['C'] = codes['c'] = 1;
+        codes['G'] = codes['g'] = 2;
+        codes['T'] = codes['t'] = 3;
+        codes['U'] = codes['u'] = 4;
+        return codes;
+    }();
+    return table;
+}
+
+/**
+ * @brief Adds to or subtracts from the count of a position in a posting list.
+ * @param list The posting list, in increasing order of position.
+ * @param pos The position.
+ * @param add True to count one more occurrence, false to count one fewer.
+ */
+void adjust(std::vector<KmerPosting>& list, int pos, bool add) {
+    auto found = std::lower_bound(list.begin(), list.end(), pos,
+                                  [](const KmerPosting& posting, int value) { return posting.position < value; });
+    if (add) {
+        if (found != list.end() && found->position == pos) {
+            ++found->count;
+        } else {
+            list.insert(found, KmerPosting{pos, 1});
+        }
+    } else if (found != list.end() && found->position == pos && --found->count == 0) {
+        list.erase(found);
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Constructs an empty index.
+ * @param length The k-mer length, from 1 to kMaxLength.
+ */
+KmerIndex::KmerIndex(int length)
+    : length(length), table(kInitialEntries, Entry{kEmpty, KmerPosting{0, 0}, 0}), used(0) {}
+
+/**
+ * @brief Getter for the k-mer length.
+ * @return The length.
+ */
+int KmerIndex::getLength() const {
+    return length;
+}
+
+/**
+ * @brief Adds the k-mers starting in a range of a position's sequence.
+ * @param pos The position.
+ * @param fragment The sequence at the position.
+ * @param first The index of the first k-mer.
+ * @param last One past the index of the last k-mer; k-mers running past the end are skipped.
+ */
+void KmerIndex::add(int pos, const SequenceFragment& fragment, std::size_t first, std::size_t last) {
+    update(pos, fragment, first, last, true);
+}
+
+/**
+ * @brief Removes the k-mers starting in a range of a position's sequence.
+ * @param pos The position.
+ * @param fragment The sequence at the position, as it was when they were added.
+ * @param first The index of the first k-mer.
+ * @param last One past the index of the last k-mer; k-mers running past the end are skipped.
+ */
+void KmerIndex::remove(int pos, const SequenceFragment& fragment, std::size_t first, std::size_t last) {
+    update(pos, fragment, first, last, false);
+}
+
+/**
+ * @brief Records that a position's sequence was transcribed, without touching its k-mers.
+ * @param pos The position.
+ */
+void KmerIndex::markTranscribed(int pos) {
+    std::lock_guard<std::mutex> lock(mutex);
+    transcribed.insert(pos);
+}
+
+/**
+ * @brief Forgets whether a position was transcribed once it holds no k-mers.
+ * @param pos The position.
+ */
+void KmerIndex::forget(int pos) {
+    std::lock_guard<std::mutex> lock(mutex);
+    transcribed.erase(pos);
+}
+
+/**
+ * @brief Codes a k-mer.
+ * @param kmer The bases, any case, drawn from A, C, G, T and U.
+ * @param code Receives the code.
+ * @return True if the k-mer has the index's length and only valid bases.
+ */
+bool KmerIndex::encode(std::string_view kmer, std::uint64_t& code) const {
+    if (kmer.size() != static_cast<std::size_t>(length)) {
+        return false;
+    }
+    const std::array<std::int8_t, 256>& codes = letterCodes();
+    code = 0;
+    for (char c : kmer) {
+        std::int8_t letter = codes[static_cast<unsigned char>(c)];
+        if (letter < 0) {
+            return false;
+        }
+        code = (code << kLetterBits) | static_cast<std::uint64_t>(letter);
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the positions holding a k-mer.
+ * @param code The code of the k-mer.
+ * @return The positions in increasing order, each with its count.
+ */
+std::vector<KmerPosting> KmerIndex::lookup(std::uint64_t code) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<KmerPosting> found;
+
+    // Transcribed positions are filed under the k-mer that transcribes to this one
+    std::uint64_t original = untranscribe(code);
+    for (bool isTranscribed : {false, true}) {
+        const Entry& entry = table[find(isTranscribed ? original : code)];
+        if (entry.code == kEmpty) {
+            continue;
+        }
+        auto keep = [&](const KmerPosting& posting) {
+            if ((transcribed.count(posting.position) != 0) == isTranscribed) {
+                found.push_back(posting);
+            }
+        };
+        keep(entry.posting);
+        if (entry.overflow != 0) {
+            for (const KmerPosting& posting : overflows[entry.overflow - 1]) {
+                keep(posting);
+            }
+        }
+    }
+    std::sort(found.begin(), found.end(),
+              [](const KmerPosting& a, const KmerPosting& b) { return a.position < b.position; });
+    return found;
+}
+
+/**
+ * @brief Removes every k-mer and transcription mark.
+ */
+void KmerIndex::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    table.assign(kInitialEntries, Entry{kEmpty, KmerPosting{0, 0}, 0});
+    used = 0;
+    overflows.clear();
+    freeOverflows.clear();
+    transcribed.clear();
+}
+
+/**
+ * @brief Adds or removes the k-mers starting in a range of a position's sequence.
+ * @param pos The position.
+ * @param fragment The sequence at the position.
+ * @param first The index of the first k-mer.
+ * @param last One past the index of the last k-mer.
+ * @param add True to add the k-mers, false to remove them.
+ */
+void KmerIndex::update(int pos, const SequenceFragment& fragment, std::size_t first, std::size_t last, bool add) {
+    std::size_t k = static_cast<std::size_t>(length);
+    if (fragment.getLength() < k) {
+        return;
+    }
+    last = std::min(last, fragment.getLength() - k + 1);
+    if (first >= last) {
+        return;
+    }
+    bool isTranscribed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isTranscribed = transcribed.count(pos) != 0;
+    }
+
+    // Unpack and code a block at a time, so long ranges are never unpacked
+    // whole and the lock is only held while a block is filed
+    const std::array<std::int8_t, 256>& codes = letterCodes();
+    std::uint64_t mask = (std::uint64_t{1} << (kLetterBits * k)) - 1;
+    unsigned shift = static_cast<unsigned>(kLetterBits * (k - 1));
+    thread_local std::string bases;
+    thread_local std::vector<std::uint64_t> block;
+    for (std::size_t start = first; start < last; start += kBlockSize) {
+        std::size_t count = std::min(kBlockSize, last - start);
+        bases.resize(count + k - 1);
+        fragment.unpack(start, bases.size(), &bases[0]);
+        block.clear();
+        std::uint64_t forward = 0;
+        std::uint64_t original = 0;
+        for (std::size_t i = 0; i < bases.size(); ++i) {
+            std::uint64_t letter = static_cast<std::uint64_t>(codes[static_cast<unsigned char>(bases[i])]);
+            forward = ((forward << kLetterBits) | letter) & mask;
+            original = (original >> kLetterBits) | (kUntranscribed[letter] << shift);
+            if (i + 1 >= k) {
+                block.push_back(isTranscribed ? original : forward);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (add) {
+            reserve(used + block.size());
+        }
+        for (std::uint64_t code : block) {
+            if (add) {
+                insert(code, pos);
+            } else {
+                erase(code, pos);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Getter for the home entry of a k-mer.
+ * @param code The code of the k-mer.
+ * @return The index of the entry the k-mer's probe starts at.
+ */
+std::size_t KmerIndex::home(std::uint64_t code) const {
+    // Fibonacci hashing spreads the low letters, which neighbouring k-mers share, over the table
+    return static_cast<std::size_t>((code * 0x9e3779b97f4a7c15ULL) >> 32) & (table.size() - 1);
+}
+
+/**
+ * @brief Getter for the entry of a k-mer.
+ * @param code The code of the k-mer.
+ * @return The index of its entry, or of the unused entry where it would go.
+ */
+std::size_t KmerIndex::find(std::uint64_t code) const {
+    std::size_t index = home(code);
+    while (table[index].code != kEmpty && table[index].code != code) {
+        index = (index + 1) & (table.size() - 1);
+    }
+    return index;
+}
+
+/**
+ * @brief Counts one more occurrence of a k-mer at a position.
+ * @param code The code of the k-mer.
+ * @param pos The position.
+ */
+void KmerIndex::insert(std::uint64_t code, int pos) {
+    reserve(used + 1);
+    Entry& entry = table[find(code)];
+    if (entry.code == kEmpty) {
+        entry = Entry{code, KmerPosting{pos, 1}, 0};
+        ++used;
+    } else if (entry.posting.position == pos) {
+        ++entry.posting.count;
+    } else {
+        if (entry.overflow == 0) {
+            if (freeOverflows.empty()) {
+                overflows.emplace_back();
+                freeOverflows.push_back(static_cast<std::uint32_t>(overflows.size() - 1));
+            }
+            entry.overflow = freeOverflows.back() + 1;
+            freeOverflows.pop_back();
+        }
+        adjust(overflows[entry.overflow - 1], pos, true);
+    }
+}
+
+/**
+ * @brief Counts one fewer occurrence of a k-mer at a position.
+ * @param code The code of the k-mer.
+ * @param pos The position.
+ */
+void KmerIndex::erase(std::uint64_t code, int pos) {
+    std::size_t index = find(code);
+    Entry& entry = table[index];
+    if (entry.code == kEmpty) {
+        return;
+    }
+    if (entry.posting.position == pos) {
+        if (--entry.posting.count != 0) {
+            return;
+        }
+        if (entry.overflow == 0) {
+            vacate(index);
+            return;
+        }
+        // Promote the last further position into the entry
+        std::vector<KmerPosting>& list = overflows[entry.overflow - 1];
+        entry.posting = list.back();
+        list.pop_back();
+    } else if (entry.overflow != 0) {
+        adjust(overflows[entry.overflow - 1], pos, false);
+    }
+    if (entry.overflow != 0 && overflows[entry.overflow - 1].empty()) {
+        freeOverflows.push_back(entry.overflow - 1);
+        entry.overflow = 0;
+    }
+}
+
+/**
+ * @brief Frees an entry, moving later entries of its probe run back so no probe breaks.
+ * @param index The index of the entry.
+ */
+void KmerIndex::vacate(std::size_t index) {
+    std::size_t mask = table.size() - 1;
+    for (std::size_t next = (index + 1) & mask; table[next].code != kEmpty; next = (next + 1) & mask) {
+        // An entry can fill the hole unless its home lies after the hole
+        std::size_t start = home(table[next].code);
+        if (((next - start) & mask) >= ((next - index) & mask)) {
+            table[index] = table[next];
+            index = next;
+        }
+    }
+    table[index].code = kEmpty;
+    table[index].overflow = 0;
+    --used;
+}
+
+/**
+ * @brief Grows the table so it holds a number of k-mers at most three quarters full.
+ * @param count The number of k-mers.
+ */
+void KmerIndex::reserve(std::size_t count) {
+    if (count * 4 <= table.size() * 3) {
+        return;
+    }
+    std::size_t size = table.size();
+    while (count * 4 > size * 3) {
+        size *= 2;
+    }
+    std::vector<Entry> old(size, Entry{kEmpty, KmerPosting{0, 0}, 0});
+    old.swap(table);
+    for (const Entry& entry : old) {
+        if (entry.code != kEmpty) {
+            table[find(entry.code)] = entry;
+        }
+    }
+}
+
+/**
+ * @brief Getter for the k-mer that transcribes to a given one.
+ * @param code The code of the transcribed k-mer.
+ * @return The code of the k-mer before transcription.
+ */
+std::uint64_t KmerIndex::untranscribe(std::uint64_t code) const {
+    // Map each letter back and reverse their order
+    std::uint64_t original = 0;
+    for (int i = 0; i < length; ++i) {
+        original = (original << kLetterBits) | kUntranscribed[code & 7];
+        code >>= kLetterBits;
+    }
+    return original;
+}
@@ -0,0 +1,183 @@
+#ifndef KMER_INDEX_H
+#define KMER_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "sequence_fragment.h"
+
+/**
+ * @struct KmerPosting
+ * @brief One position holding a k-mer.
+ */
+struct KmerPosting {
+    int position; ///< The position.
+    std::uint32_t count; ///< How many times the k-mer occurs in its sequence.
+};
+
+/**
+ * @class KmerIndex
+ * @brief Inverted index from every k-mer to the positions whose sequences hold it.
+ *
+ * K-mers are coded three bits per letter, first letter in the high bits, so
+ * 'T' and 'U' are told apart and a lookup matches bases as they print.
+ * Callers keep the index up to date by adding and removing the k-mers that
+ * start in the range of bases an edit changes, which for a clip or swap is
+ * only the bases that leave or join a position and the k - 1 before the cut.
+ *
+ * Transcription reverses a sequence and maps each letter to another one to
+ * one, so a transcribed position is only marked instead of being reindexed:
+ * its k-mers stay filed under what they were before transcription, and
+ * lookups of that position map the query back the same way.
+ *
+ * Updates of different positions may run on different threads at once.
+ */
+class KmerIndex {
+public:
+    static constexpr int kMaxLength = 21; ///< The longest k-mer a 64-bit code holds.
+
+    /**
+     * @brief Constructs an empty index.
+     * @param length The k-mer length, from 1 to kMaxLength.
+     */
+    explicit KmerIndex(int length);
+
+    /**
+     * @brief Getter for the k-mer length.
+     * @return The length.
+     */
+    int getLength() const;
+
+    /**
+     * @brief Adds the k-mers starting in a range of a position's sequence.
+     * @param pos The position.
+     * @param fragment The sequence at the position.
+     * @param first The index of the first k-mer.
+     * @param last One past the index of the last k-mer; k-mers running past the end are skipped.
+     */
+    void add(int pos, const SequenceFragment& fragment, std::size_t first = 0, std::size_t last = PackedSequence::npos);
+
+    /**
+     * @brief Removes the k-mers starting in a range of a position's sequence.
+     * @param pos The position.
+     * @param fragment The sequence at the position, as it was when they were added.
+     * @param first The index of the first k-mer.
+     * @param last One past the index of the last k-mer; k-mers running past the end are skipped.
+     */
+    void remove(int pos, const SequenceFragment& fragment, std::size_t first = 0, std::size_t last = PackedSequence::npos);
+
+    /**
+     * @brief Records that a position's sequence was transcribed, without touching its k-mers.
+     * @param pos The position.
+     */
+    void markTranscribed(int pos);
+
+    /**
+     * @brief Forgets whether a position was transcribed once it holds no k-mers.
+     * @param pos The position.
+     */
+    void forget(int pos);
+
+    /**
+     * @brief Codes a k-mer.
+     * @param kmer The bases, any case, drawn from A, C, G, T and U.
+     * @param code Receives the code.
+     * @return True if the k-mer has the index's length and only valid bases.
+     */
+    bool encode(std::string_view kmer, std::uint64_t& code) const;
+
+    /**
+     * @brief Finds the positions holding a k-mer.
+     * @param code The code of the k-mer.
+     * @return The positions in increasing order, each with its count.
+     */
+    std::vector<KmerPosting> lookup(std::uint64_t code) const;
+
+    /**
+     * @brief Removes every k-mer and transcription mark.
+     */
+    void clear();
+
+private:
+    /**
+     * @struct Entry
+     * @brief One k-mer of the open addressing table, with its first position inline.
+     */
+    struct Entry {
+        std::uint64_t code; ///< The k-mer, kEmpty if the entry is unused.
+        KmerPosting posting; ///< The first position holding the k-mer.
+        std::uint32_t overflow; ///< One more than the index of the further positions in overflows, 0 if there are none.
+    };
+
+    static constexpr std::uint64_t kEmpty = ~std::uint64_t{0}; ///< Marks an unused entry; no k-mer code has every bit set.
+
+    int length; ///< The k-mer length.
+    std::vector<Entry> table; ///< Linear probing table of the k-mers, a power of two in size.
+    std::size_t used; ///< The number of entries holding a k-mer.
+    std::vector<std::vector<KmerPosting>> overflows; ///< The further positions of k-mers held by several, in increasing order.
+    std::vector<std::uint32_t> freeOverflows; ///< The overflow lists not in use.
+    std::unordered_set<int> transcribed; ///< The positions filed under their k-mers before transcription.
+    mutable std::mutex mutex; ///< Guards the table, the overflows and transcribed.
+
+    /**
+     * @brief Adds or removes the k-mers starting in a range of a position's sequence.
+     * @param pos The position.
+     * @param fragment The sequence at the position.
+     * @param first The index of the first k-mer.
+     * @param last One past the index of the last k-mer.
+     * @param add True to add the k-mers, false to remove them.
+     */
+    void update(int pos, const SequenceFragment& fragment, std::size_t first, std::size_t last, bool add);
+
+    /**
+     * @brief Getter for the home entry of a k-mer.
+     * @param code The code of the k-mer.
+     * @return The index of the entry the k-mer's probe starts at.
+     */
+    std::size_t home(std::uint64_t code) const;
+
+    /**
+     * @brief Getter for the entry of a k-mer.
+     * @param code The code of the k-mer.
+     * @return The index of its entry, or of the unused entry where it would go.
+     */
+    std::size_t find(std::uint64_t code) const;
+
+    /**
+     * @brief Counts one more occurrence of a k-mer at a position.
+     * @param code The code of the k-mer.
+     * @param pos The position.
+     */
+    void insert(std::uint64_t code, int pos);
+
+    /**
+     * @brief Counts one fewer occurrence of a k-mer at a position.
+     * @param code The code of the k-mer.
+     * @param pos The position.
+     */
+    void erase(std::uint64_t code, int pos);
+
+    /**
+     * @brief Frees an entry, moving later entries of its probe run back so no probe breaks.
+     * @param index The index of the entry.
+     */
+    void vacate(std::size_t index);
+
+    /**
+     * @brief Grows the table so it holds a number of k-mers at most three quarters full.
+     * @param count The number of k-mers.
+     */
+    void reserve(std::size_t count);
+
+    /**
+     * @brief Getter for the k-mer that transcribes to a given one.
+     * @param code The code of the transcribed k-mer.
+     * @return The code of the k-mer before transcription.
+     */
+    std::uint64_t untranscribe(std::uint64_t code) const;
+};
+
+#endif // KMER_INDEX_H
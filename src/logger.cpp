@@ -0,0 +1,226 @@
+#include "logger.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kFlushBytes = 64 * 1024; ///< Formatted text is written once it reaches this size, or when the queue is empty.
+constexpr auto kIdleSleep = std::chrono::milliseconds(1); ///< How long the background thread sleeps when the queue is empty.
+
+} // namespace
+
+/**
+ * @brief Constructs a new Logger object
+ *
+ * @param level The log level
+ * @param filename The name of the log file, appended to
+ * @param overflow What logging does when the queue is full
+ * @param capacity The number of messages the queue holds, rounded up to a power of two
+ */
+Logger::Logger(LogLevel level, const std::string& filename, LogOverflow overflow, std::size_t capacity)
+    : level(level), overflow(overflow), fd(::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) {
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open log file");
+    }
+    std::size_t rounded = 2;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    mask = rounded - 1;
+    slots = std::make_unique<Slot[]>(rounded);
+    for (std::size_t i = 0; i < rounded; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    flusher = std::thread(&Logger::flushLoop, this);
+}
+
+/**
+ * @brief Write out every queued message and close the log file
+ */
+Logger::~Logger() {
+    stopping.store(true, std::memory_order_release);
+    flusher.join();
+    ::close(fd);
+}
+
+/**
+ * @brief Claim the next free slot
+ *
+ * A bounded multi-producer queue after Vyukov: each slot's sequence says
+ * which turn of the ring may fill it next, so a thread claims a slot with
+ * one compare-and-swap on the tail and never waits for another producer.
+ * A slot the background thread has not read yet means the queue is full.
+ *
+ * @return The slot, or null if the queue is full and the policy is to drop
+ */
+Logger::Slot* Logger::acquire() {
+    std::size_t position = tail.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[position & mask];
+        std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+        if (difference == 0) {
+            if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                return &slot;
+            }
+        } else if (difference < 0) {
+            if (overflow == LogOverflow::DROP) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                droppedTotal.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            std::this_thread::yield();
+            position = tail.load(std::memory_order_relaxed);
+        } else {
+            // Another thread claimed it first
+            position = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Hand a filled slot to the background thread
+ *
+ * @param slot The slot
+ */
+void Logger::publish(Slot* slot) {
+    std::size_t position = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Run on the background thread until the logger is destroyed
+ *
+ * Messages are formatted into one buffer, which is written once it is large
+ * or the queue runs dry. A count of dropped messages is logged as a
+ * warning in their place.
+ */
+void Logger::flushLoop() {
+    std::string text;
+    while (true) {
+        // Read before draining, so nothing logged before the destructor is missed
+        bool stop = stopping.load(std::memory_order_acquire);
+        std::size_t drained = 0;
+        while (true) {
+            Slot& slot = slots[head & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                break;
+            }
+            format(slot, text);
+            slot.sequence.store(head + mask + 1, std::memory_order_release);
+            ++head;
+            ++drained;
+            if (text.size() >= kFlushBytes) {
+                writeOut(text);
+            }
+        }
+        std::uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost != 0 && LogLevel::WARNING <= level) {
+            text += "WARNING: Dropped " + std::to_string(lost) + " log messages\n";
+        }
+        writeOut(text);
+        if (drained == 0) {
+            if (stop) {
+                return;
+            }
+            std::this_thread::sleep_for(kIdleSleep);
+        }
+    }
+}
+
+/**
+ * @brief Format a queued message as a line
+ *
+ * @param slot The slot
+ * @param text Receives the line
+ */
+void Logger::format(const Slot& slot, std::string& text) {
+    text += toString(slot.level);
+    text += ": ";
+    const unsigned char* data = slot.data;
+    std::size_t offset = 0;
+    while (offset < slot.size) {
+        auto tag = static_cast<Tag>(data[offset++]);
+        switch (tag) {
+            case Tag::TEXT: {
+                std::uint16_t length = 0;
+                std::memcpy(&length, data + offset, sizeof(length));
+                offset += sizeof(length);
+                text.append(reinterpret_cast<const char*>(data + offset), length);
+                offset += length;
+                break;
+            }
+            case Tag::CHARACTER:
+                text += static_cast<char>(data[offset++]);
+                break;
+            case Tag::SIGNED: {
+                std::int64_t value = 0;
+                std::memcpy(&value, data + offset, sizeof(value));
+                offset += sizeof(value);
+                text += std::to_string(value);
+                break;
+            }
+            case Tag::UNSIGNED: {
+                std::uint64_t value = 0;
+                std::memcpy(&value, data + offset, sizeof(value));
+                offset += sizeof(value);
+                text += std::to_string(value);
+                break;
+            }
+            case Tag::REAL: {
+                double value = 0;
+                std::memcpy(&value, data + offset, sizeof(value));
+                offset += sizeof(value);
+                char number[32];
+                std::snprintf(number, sizeof(number), "%g", value);
+                text += number;
+                break;
+            }
+            case Tag::CUT:
+                text += "...";
+                break;
+        }
+    }
+    text += '\n';
+}
+
+/**
+ * @brief Write text to the log file
+ *
+ * @param text The text, cleared once written
+ */
+void Logger::writeOut(std::string& text) {
+    std::size_t written = 0;
+    while (written < text.size()) {
+        ssize_t result = ::write(fd, text.data() + written, text.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nowhere to report it; the text is lost
+            break;
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    text.clear();
+}
+
+/**
+ * @brief Convert a log level to a string
+ *
+ * @param logLevel The log level
+ * @return The log level as a string
+ */
+const char* Logger::toString(LogLevel logLevel) {
+    switch (logLevel) {
+        case LogLevel::ERROR: return "ERROR";
+        case LogLevel::WARNING: return "WARNING";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::DEBUG: return "DEBUG";
+        default: return "UNKNOWN";
+    }
+}
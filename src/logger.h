@@ -1,7 +1,14 @@
 #ifndef LOGGER_H
 #define LOGGER_H
-#include <fstream>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 
 /**
  * @enum LogLevel
@@ -14,54 +21,253 @@ enum class LogLevel {
     DEBUG
 };
 
+#ifndef DNA_LOG_LEVEL
+#define DNA_LOG_LEVEL 3 ///< The most detailed level compiled in: 0 error, 1 warning, 2 info, 3 debug.
+#endif
+
+/// Messages more detailed than this are removed at compile time, whatever the logger's level.
+constexpr LogLevel kCompiledLogLevel = static_cast<LogLevel>(DNA_LOG_LEVEL);
+
+/**
+ * @enum LogOverflow
+ * @brief What logging does when the queue is full.
+*/
+enum class LogOverflow {
+    DROP,  ///< Drop the message and count it; the count is logged once there is room.
+    BLOCK  ///< Wait for the background thread to make room.
+};
+
 /**
  * @class Logger
  * @brief Class for logging messages.
+ *
+ * A message is not formatted by the thread logging it: its arguments are
+ * copied into a slot of a lock-free ring shared by every thread, and a
+ * background thread turns them into lines and writes them out in large
+ * blocks. A message of a disabled level costs one comparison, and none at
+ * all when the level is above kCompiledLogLevel.
 */
 class Logger {
 public:
+    static constexpr std::size_t kRecordBytes = 240; ///< The encoded arguments a message may take; longer text is cut.
+
 /**
  * @brief Constructs a new Logger object.
  * @param level The log level.
- * @param filename The name of the log file.
+ * @param filename The name of the log file, appended to.
+ * @param overflow What logging does when the queue is full.
+ * @param capacity The number of messages the queue holds, rounded up to a power of two.
 */
-    Logger(LogLevel level, const std::string& filename) 
-        : level(level), logFile(filename, std::ios_base::app) {
-        if (!logFile) {
-            throw std::runtime_error("Failed to open log file");
-        }
-    }
+    Logger(LogLevel level, const std::string& filename, LogOverflow overflow = LogOverflow::DROP,
+           std::size_t capacity = 4096);
+
+    /**
+     * @brief Writes out every queued message and closes the log file.
+    */
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
 
     /**
      * @brief Logs a message.
      * @param logLevel The log level.
-     * @param message The message to log.
+     * @param args The parts of the message, written one after another: text, characters and numbers.
     */
-    void log(LogLevel logLevel, const std::string& message) {
-        if (logLevel <= level) {
-            logFile << toString(logLevel) << ": " << message << std::endl;
+    template <typename... Args>
+    void log(LogLevel logLevel, const Args&... args) {
+        if (!isEnabled(logLevel)) {
+            return;
+        }
+        Slot* slot = acquire();
+        if (!slot) {
+            return;
         }
+        Encoder encoder{slot->data, 0};
+        (encoder.put(args), ...);
+        slot->level = logLevel;
+        slot->size = static_cast<std::uint16_t>(encoder.size);
+        publish(slot);
     }
 
+    /**
+     * @brief Checks whether messages of a level are logged, so callers can skip preparing them.
+     * @param logLevel The log level.
+     * @return True if they are logged.
+    */
+    bool isEnabled(LogLevel logLevel) const {
+        return logLevel <= kCompiledLogLevel && logLevel <= level;
+    }
+
+    /**
+     * @brief Getter for the number of messages dropped because the queue was full.
+     * @return The count.
+    */
+    std::uint64_t getDropped() const {
+        return droppedTotal.load(std::memory_order_relaxed);
+    }
 
 private:
+    /**
+     * @enum Tag
+     * @brief The type of an encoded argument.
+    */
+    enum class Tag : unsigned char {
+        TEXT,      ///< A 16-bit length and the characters.
+        CHARACTER, ///< One character.
+        SIGNED,    ///< A 64-bit signed integer.
+        UNSIGNED,  ///< A 64-bit unsigned integer.
+        REAL,      ///< A double.
+        CUT        ///< Marks that later arguments did not fit.
+    };
+
+    /**
+     * @struct Slot
+     * @brief One queued message.
+    */
+    struct Slot {
+        std::atomic<std::size_t> sequence{0}; ///< Which turn of the ring may use the slot next.
+        LogLevel level = LogLevel::INFO; ///< The message's level.
+        std::uint16_t size = 0; ///< The bytes of data in use.
+        unsigned char data[kRecordBytes]; ///< The encoded arguments.
+    };
+
+    /**
+     * @struct Encoder
+     * @brief Copies arguments into a slot, tagged with their types.
+    */
+    struct Encoder {
+        unsigned char* data; ///< The slot's data.
+        std::size_t size; ///< The bytes written.
+        bool cut = false; ///< Set once an argument did not fit; the rest are skipped.
+
+        /**
+         * @brief Encodes text, cutting it to the room left.
+         * @param text The text.
+        */
+        void put(std::string_view text) {
+            if (!reserve(1 + sizeof(std::uint16_t) + (text.empty() ? 0 : 1))) {
+                return;
+            }
+            // A byte stays free for the cut mark
+            std::size_t room = kRecordBytes - size - 2 - sizeof(std::uint16_t);
+            if (text.size() > room) {
+                text = text.substr(0, room);
+                cut = true;
+            }
+            auto length = static_cast<std::uint16_t>(text.size());
+            data[size++] = static_cast<unsigned char>(Tag::TEXT);
+            std::memcpy(data + size, &length, sizeof(length));
+            std::memcpy(data + size + sizeof(length), text.data(), text.size());
+            size += sizeof(length) + text.size();
+            if (cut) {
+                data[size++] = static_cast<unsigned char>(Tag::CUT);
+            }
+        }
+
+        /**
+         * @brief Encodes a character, integer or floating point number.
+         * @param value The value.
+        */
+        template <typename T>
+        std::enable_if_t<std::is_arithmetic_v<T>> put(T value) {
+            if constexpr (std::is_same_v<T, char>) {
+                if (reserve(2)) {
+                    data[size++] = static_cast<unsigned char>(Tag::CHARACTER);
+                    data[size++] = static_cast<unsigned char>(value);
+                }
+            } else if constexpr (std::is_floating_point_v<T>) {
+                putWord(Tag::REAL, static_cast<double>(value));
+            } else if constexpr (std::is_signed_v<T>) {
+                putWord(Tag::SIGNED, static_cast<std::int64_t>(value));
+            } else {
+                putWord(Tag::UNSIGNED, static_cast<std::uint64_t>(value));
+            }
+        }
+
+        /**
+         * @brief Encodes a tag and an 8-byte value.
+         * @param tag The tag.
+         * @param value The value.
+        */
+        template <typename Word>
+        void putWord(Tag tag, Word value) {
+            if (reserve(1 + sizeof(Word))) {
+                data[size++] = static_cast<unsigned char>(tag);
+                std::memcpy(data + size, &value, sizeof(Word));
+                size += sizeof(Word);
+            }
+        }
+
+        /**
+         * @brief Checks for room, marking the message cut if there is none.
+         *
+         * One byte always stays free for the cut mark.
+         *
+         * @param bytes The bytes needed.
+         * @return True if they fit.
+        */
+        bool reserve(std::size_t bytes) {
+            if (cut) {
+                return false;
+            }
+            if (size + bytes + 1 <= kRecordBytes) {
+                return true;
+            }
+            cut = true;
+            data[size++] = static_cast<unsigned char>(Tag::CUT);
+            return false;
+        }
+    };
+
     LogLevel level; ///<The log level.
-    std::ofstream logFile; ///<The log file.
+    LogOverflow overflow; ///< What logging does when the queue is full.
+    int fd; ///< The log file.
+    std::size_t mask; ///< The capacity less one.
+    std::unique_ptr<Slot[]> slots; ///< The ring of messages.
+    alignas(64) std::atomic<std::size_t> tail{0}; ///< The next slot a logging thread claims.
+    alignas(64) std::size_t head = 0; ///< The next slot the background thread reads.
+    std::atomic<std::uint64_t> dropped{0}; ///< Messages dropped and not yet reported.
+    std::atomic<std::uint64_t> droppedTotal{0}; ///< Messages dropped since construction.
+    std::atomic<bool> stopping{false}; ///< Set to drain the queue and end the background thread.
+    std::thread flusher; ///< Formats and writes queued messages.
+
+    /**
+     * @brief Claims the next free slot.
+     * @return The slot, or null if the queue is full and the policy is to drop.
+    */
+    Slot* acquire();
+
+    /**
+     * @brief Hands a filled slot to the background thread.
+     * @param slot The slot.
+    */
+    void publish(Slot* slot);
+
+    /**
+     * @brief Runs on the background thread until the logger is destroyed.
+    */
+    void flushLoop();
+
+    /**
+     * @brief Formats a queued message as a line.
+     * @param slot The slot.
+     * @param text Receives the line.
+    */
+    static void format(const Slot& slot, std::string& text);
+
+    /**
+     * @brief Writes text to the log file.
+     * @param text The text, cleared once written.
+    */
+    void writeOut(std::string& text);
 
     /**
      * @brief Converts a log level to a string.
      * @param logLevel The log level.
      * @return The log level as a string.
     */
-    std::string toString(LogLevel logLevel) {
-        switch (logLevel) {
-            case LogLevel::ERROR: return "ERROR";
-            case LogLevel::WARNING: return "WARNING";
-            case LogLevel::INFO: return "INFO";
-            case LogLevel::DEBUG: return "DEBUG";
-            default: return "UNKNOWN";
-        }
-    }
+    static const char* toString(LogLevel logLevel);
 };
 
-#endif // LOGGER_H
\ No newline at end of file
+#endif // LOGGER_H
@@ -1,12 +1,95 @@
 #include "command_processor.h"
+#include "command_output.h"
+#include "command_metrics.h"
+#include "command_server.h"
 #include "fragment_list.h"
+#include "journal.h"
+#include "mapped_file.h"
+#include "memory_pool.h"
 #include <fstream>  
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <memory>
+#include <stdexcept>
 #include <unordered_map>
+#include <sys/stat.h>
 #include <unistd.h>
 
+namespace {
+
+/**
+ * @brief Lets the teardown after the last command drop pooled memory slab by slab.
+ *
+ * Fragments and sequences freed from here on are not threaded back onto the
+ * free lists; their slabs are returned to the system together at exit.
+ */
+void beginTeardown() {
+    fragmentPool().setBulkRelease(true);
+    sequenceArena().setBulkRelease(true);
+}
+
+/**
+ * @brief Reads a log level name.
+ * @param name "error", "warning", "info" or "debug".
+ * @param level Receives the level.
+ * @return False if the name is unknown.
+ */
+bool parseLogLevel(const std::string& name, LogLevel& level) {
+    static const std::unordered_map<std::string, LogLevel> levels = {
+        {"error", LogLevel::ERROR},
+        {"warning", LogLevel::WARNING},
+        {"info", LogLevel::INFO},
+        {"debug", LogLevel::DEBUG}
+    };
+    auto found = levels.find(name);
+    if (found == levels.end()) {
+        return false;
+    }
+    level = found->second;
+    return true;
+}
+
+/**
+ * @brief Reports the command metrics at the end of a run, if they are enabled.
+ *
+ * Each line is logged at the info level, or written to standard error when
+ * there is no log file.
+ *
+ * @param logger The logger, or null.
+ */
+void reportMetrics(Logger* logger) {
+    if (!commandMetrics().isEnabled()) {
+        return;
+    }
+    std::ostringstream summary;
+    commandMetrics().write(summary);
+    if (!logger) {
+        std::cerr << summary.str();
+        return;
+    }
+    std::istringstream lines(summary.str());
+    std::string line;
+    while (std::getline(lines, line)) {
+        logger->log(LogLevel::INFO, line);
+    }
+}
+
+/**
+ * @brief Reads the modification time of a file to the nanosecond.
+ *
+ * Whole seconds would miss a script rewritten to the same size within the
+ * second it was cached in.
+ *
+ * @param status The file's status.
+ * @return Nanoseconds since the epoch.
+ */
+std::int64_t modifiedNanoseconds(const struct stat& status) {
+    return static_cast<std::int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+}
+
+} // namespace
+
 /**
  * @brief Main function for the sequencer program.
  *
@@ -17,24 +100,65 @@
 int main(int argc, char* argv[]) {
     int opt;
     int fragmentsCount = 8; ///< The default number of fragments
-    std::string log_level = "info"; ///< The default log level
+    int threadCount = 1; ///< The default number of threads
+    int shardCount = 1; ///< The default number of shards, 1 for none
+    LogLevel log_level = LogLevel::INFO; ///< The default log level
+    std::string log_name; ///< The log file, if any
+    LogOverflow logOverflow = LogOverflow::DROP; ///< What logging does when its queue is full
+    bool metrics = false; ///< Record per-command metrics
     std::string file_name;
+    std::string cache_name; ///< The compiled program cache, if any
+    std::string snapshot_name; ///< The snapshot restored before running, if any
+    std::string socket_name; ///< The socket served on, or "-" for standard input; empty to run a file
+    std::string journal_name; ///< The journal the list is recovered from and changes are written to, if any
+    bool backgroundOutput = false; ///< Write output on a background thread
+    FlushPolicy errorPolicy = FlushPolicy::BATCHED; ///< When diagnostics are written
 
     // Process command line arguments
-    while ((opt = getopt(argc, argv, "h:m:l:f:")) != -1) { 
+    while ((opt = getopt(argc, argv, "h:m:t:p:l:L:P:Mf:c:s:S:J:o:e:")) != -1) { 
         switch (opt) {
             case 'h': {
                 /// Display help message
-                std::string helpMessage = "Usage: sequencer [-h] [-m #] [-l log_level] -f <file name>\n"
+                std::string helpMessage = "Usage: sequencer [-h] [-m #] [-t #] [-p #] [-l log_level] [-L <log file>] [-P policy] [-M] [-o mode] [-e policy] [-c <cache file>] [-s <snapshot file>] [-S <socket>] [-J <journal>] [-f <file name>]\n"
                                           "Options:\n"
                                           "  -h       Show this text and exit. \n"
-                                          "  -m   Max amount of space allocated for sequence fragments.\n"
+                                          "  -m   Number of positions for sequence fragments; only the\n"
+                                          "       positions in use take memory.\n"
                                           "       The default is 8\n"
-                                          "  -l   Set the log detail level.\n"
-                                          "       The default is 'info'\n"
+                                          "  -t   Number of threads running commands on different positions\n"
+                                          "       in parallel. Output keeps the command order. The default is 1\n"
+                                          "  -p   Number of shards: positions are dealt out to this many\n"
+                                          "       threads, each running the commands on its own positions in\n"
+                                          "       order, in place of -t's scheduler. The default is 1, no shards\n"
+                                          "  -l   Set the log detail level: 'error', 'warning', 'info' or\n"
+                                          "       'debug'. The default is 'info'\n"
+                                          "  -L   File the log is appended to. Without it nothing is logged\n"
+                                          "  -P   Full log queue: 'drop' drops and counts messages, 'block'\n"
+                                          "       waits for room. The default is 'drop'\n"
+                                          "  -M   Record the calls, errors, bytes and latency of each command.\n"
+                                          "       The METRICS command prints them, and a summary is logged\n"
+                                          "       at the end, or written to standard error without -L\n"
+                                          "  -o   Output writing: 'sync' writes full buffers as they fill,\n"
+                                          "       'async' writes them on a background thread. The default is 'sync'\n"
+                                          "  -e   Diagnostics flushing: 'batched' writes them with the output,\n"
+                                          "       'immediate' writes each one straight away. The default is 'batched'\n"
                                           "  -f   File name containing commands for the sequencer\n"
                                           "       The file should be plain text, 1 command per line\n"
-                                          "       If no file is specified, the program will exit.\n";
+                                          "       Required unless -S is given or -c names a cache to replay.\n"
+                                          "  -c   File caching the compiled commands\n"
+                                          "       Replayed without parsing while it matches the -f file,\n"
+                                          "       rewritten otherwise. Without -f it is replayed as is.\n"
+                                          "  -s   Snapshot file restored before the commands run,\n"
+                                          "       as written by the SAVE command.\n"
+                                          "  -S   Serve commands instead of running a file: the list stays\n"
+                                          "       in memory and commands are read from clients of this Unix\n"
+                                          "       socket and from standard input, one per line. Each response\n"
+                                          "       ends with an OK or ERROR line. '-' serves standard input only\n"
+                                          "       and exits when it ends; otherwise SIGINT or SIGTERM stops it.\n"
+                                          "  -J   Journal every command that changes a position to files named\n"
+                                          "       after this path. Changes are synced every 1024 commands\n"
+                                          "       and at the end, so a crash loses at most the last 1024. An\n"
+                                          "       existing journal is recovered first, in place of -s\n";
                 std::cout << helpMessage;
                 break;
             }
@@ -51,9 +175,86 @@ int main(int argc, char* argv[]) {
                 }
                 break;
             }
+            case 't': {
+                /// Set the number of threads
+                try {
+                    threadCount = std::stoi(optarg);
+                } catch (std::invalid_argument const &e) {
+                    std::cerr << "std::invalid_argument thrown. Please add the number of threads after -t." << '\n';
+                    return 1;
+                } catch (std::out_of_range const &e) {
+                    std::cerr << "Integer overflow for -t option: std::out_of_range thrown" << '\n';
+                    return 1;
+                }
+                if (threadCount < 1) {
+                    std::cerr << "The number of threads must be at least 1." << '\n';
+                    return 1;
+                }
+                break;
+            }
+            case 'p': {
+                /// Set the number of shards
+                try {
+                    shardCount = std::stoi(optarg);
+                } catch (std::invalid_argument const &e) {
+                    std::cerr << "std::invalid_argument thrown. Please add the number of shards after -p." << '\n';
+                    return 1;
+                } catch (std::out_of_range const &e) {
+                    std::cerr << "Integer overflow for -p option: std::out_of_range thrown" << '\n';
+                    return 1;
+                }
+                if (shardCount < 1) {
+                    std::cerr << "The number of shards must be at least 1." << '\n';
+                    return 1;
+                }
+                break;
+            }
             case 'l': {
                 /// Set the log detail level
-                log_level = optarg;
+                if (!parseLogLevel(optarg, log_level)) {
+                    std::cerr << "Unknown log level: " << optarg << '\n';
+                    return 1;
+                }
+                break;
+            }
+            case 'L': {
+                /// Set the log file
+                log_name = optarg;
+                break;
+            }
+            case 'P': {
+                /// Set what logging does when its queue is full
+                std::string policy = optarg;
+                if (policy != "drop" && policy != "block") {
+                    std::cerr << "Unknown log overflow policy: " << policy << '\n';
+                    return 1;
+                }
+                logOverflow = policy == "block" ? LogOverflow::BLOCK : LogOverflow::DROP;
+                break;
+            }
+            case 'M': {
+                /// Record per-command metrics
+                metrics = true;
+                break;
+            }
+            case 'o': {
+                /// Set how output is written
+                std::string mode = optarg;
+                if (mode != "sync" && mode != "async") {
+                    std::cerr << "Unknown output mode: " << mode << '\n';
+                    return 1;
+                }
+                backgroundOutput = mode == "async";
+                break;
+            }
+            case 'e': {
+                /// Set when diagnostics are written
+                std::string policy = optarg;
+                if (policy != "batched" && policy != "immediate") {
+                    std::cerr << "Unknown flush policy: " << policy << '\n';
+                    return 1;
+                }
+                errorPolicy = policy == "immediate" ? FlushPolicy::IMMEDIATE : FlushPolicy::BATCHED;
                 break;
             }
             case 'f': {
@@ -61,6 +262,26 @@ int main(int argc, char* argv[]) {
                 file_name = optarg;
                 break;
             }
+            case 'c': {
+                /// Set the compiled program cache
+                cache_name = optarg;
+                break;
+            }
+            case 's': {
+                /// Set the snapshot to start from
+                snapshot_name = optarg;
+                break;
+            }
+            case 'S': {
+                /// Serve commands over a socket
+                socket_name = optarg;
+                break;
+            }
+            case 'J': {
+                /// Journal changes for crash recovery
+                journal_name = optarg;
+                break;
+            }
             default: {
                 std::cerr << "Invalid option\n";
                 return 1;
@@ -68,24 +289,91 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    std::unique_ptr<Logger> logger;
+    if (!log_name.empty()) {
+        try {
+            logger = std::make_unique<Logger>(log_level, log_name, logOverflow);
+        } catch (const std::runtime_error&) {
+            std::cerr << "Failed to open log file\n";
+            return 1;
+        }
+    }
+    commandMetrics().setEnabled(metrics);
+
     FragmentList fragmentList(fragmentsCount);
+    configureOutput(backgroundOutput, errorPolicy);
+
+    // Start from the snapshot; its bases are read only when commands use them
+    if (!snapshot_name.empty() && !fragmentList.restore(snapshot_name)) {
+        flushOutput();
+        return 1;
+    }
+
     CommandProcessor processor(fragmentsCount, fragmentList);
+    processor.setThreadCount(threadCount);
+    processor.setShardCount(shardCount);
+    processor.setLogger(logger.get());
+
+    // Recover the journal's positions, or start one from the list as it is
+    std::unique_ptr<Journal> journal;
+    if (!journal_name.empty()) {
+        journal = std::make_unique<Journal>(journal_name, fragmentList, logger.get());
+        if (!processor.openJournal(*journal)) {
+            flushOutput();
+            return 1;
+        }
+    }
+
+    // Serve clients until stopped, keeping the list in memory between commands
+    if (!socket_name.empty()) {
+        flushOutput();
+        bool served = CommandServer(processor, socket_name, logger.get()).run();
+        flushOutput();
+        reportMetrics(logger.get());
+        beginTeardown();
+        return served ? 0 : 1;
+    }
+
+    // Replay the cached program while it is still current for the script
+    struct stat status{};
+    bool haveScript = !file_name.empty() && stat(file_name.c_str(), &status) == 0;
+    if (!cache_name.empty()) {
+        CommandProgram cached;
+        if (cached.load(cache_name) &&
+            (file_name.empty() ||
+             (haveScript && cached.matchesSource(status.st_size, modifiedNanoseconds(status), status.st_ino)))) {
+            processor.run(cached);
+            flushOutput();
+            reportMetrics(logger.get());
+            beginTeardown();
+            return 0;
+        }
+    }
 
     if (file_name.empty()) {
         std::cerr << "File name is required\n";
         return 1;
     }
 
-    std::ifstream file(file_name);
-    if (!file) {
+    MappedFile file(file_name);
+    if (!file.isOpen()) {
         std::cerr << "Failed to open file\n";
         return 1;
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        processor.processCommand(line);
+    // Compile every line as a view into the mapped file, then execute
+    CommandProgram program;
+    processor.compile(file.data(), program);
+    if (!cache_name.empty()) {
+        program.setSourceStamp(status.st_size, modifiedNanoseconds(status), status.st_ino);
+        if (!program.save(cache_name)) {
+            std::cerr << "Failed to write cache file\n";
+        }
     }
+    processor.run(program);
+    flushOutput();
+    reportMetrics(logger.get());
+    beginTeardown();
 
     return 0;
 }
@@ -0,0 +1,77 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Maps a file for sequential reading.
+ * @param path The path of the file.
+ */
+MappedFile::MappedFile(const std::string& path)
+    : contents(nullptr), size(0), open(false) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return;
+    }
+    if (S_ISREG(info.st_mode)) {
+        size = static_cast<std::size_t>(info.st_size);
+        if (size == 0) {
+            // mmap rejects empty mappings; an empty file is simply empty
+            open = true;
+        } else {
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                contents = static_cast<const char*>(mapping);
+                open = true;
+            } else {
+                size = 0;
+            }
+        }
+    }
+    if (!open) {
+        char chunk[1 << 16];
+        ssize_t count;
+        while ((count = read(fd, chunk, sizeof(chunk))) > 0) {
+            buffer.append(chunk, static_cast<std::size_t>(count));
+        }
+        open = count == 0;
+        size = 0;
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+/**
+ * @brief Unmaps the file.
+ */
+MappedFile::~MappedFile() {
+    if (contents != nullptr) {
+        munmap(const_cast<char*>(contents), size);
+    }
+}
+
+/**
+ * @brief Checks whether the file was opened and mapped.
+ * @return True if the contents are available.
+ */
+bool MappedFile::isOpen() const {
+    return open;
+}
+
+/**
+ * @brief Getter for the contents of the file.
+ * @return A view of the mapped bytes, valid while the object lives.
+ */
+std::string_view MappedFile::data() const {
+    if (contents == nullptr) {
+        return buffer;
+    }
+    return std::string_view(contents, size);
+}
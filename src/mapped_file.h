@@ -0,0 +1,49 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @class MappedFile
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * Files that cannot be mapped, such as pipes, are read into memory instead.
+ */
+class MappedFile {
+public:
+    /**
+     * @brief Maps a file for sequential reading.
+     * @param path The path of the file.
+     */
+    explicit MappedFile(const std::string& path);
+
+    /**
+     * @brief Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Checks whether the file was opened and mapped.
+     * @return True if the contents are available.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Getter for the contents of the file.
+     * @return A view of the mapped bytes, valid while the object lives.
+     */
+    std::string_view data() const;
+
+private:
+    const char* contents; ///< The mapped bytes, null for an empty or unopened file.
+    std::size_t size; ///< The number of mapped bytes.
+    bool open; ///< True if the file was opened.
+    std::string buffer; ///< The contents of a file that could not be mapped.
+};
+
+#endif // MAPPED_FILE_H
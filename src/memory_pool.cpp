@@ -0,0 +1,261 @@
+#include "memory_pool.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+/// The block sizes, each a multiple of 16 and at most half as big again as the one before.
+constexpr std::size_t kClassSizes[MemoryPool::kClassCount] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+    768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384
+};
+static_assert(kClassSizes[MemoryPool::kClassCount - 1] == MemoryPool::kMaxBlockSize,
+              "The last class must hold the largest slab block");
+
+constexpr std::size_t kRefillBlocks = 32; ///< The most blocks a thread takes from the pool at once.
+constexpr std::size_t kCacheBytes = 256 << 10; ///< The bytes of one class a thread keeps before giving some back.
+
+std::atomic<int> nextPoolId{0}; ///< The id of the next pool constructed.
+
+/**
+ * @brief Table from a size in 16-byte units to its size class.
+ * @return The table.
+ */
+const std::array<std::uint8_t, MemoryPool::kMaxBlockSize / 16 + 1>& classTable() {
+    static const std::array<std::uint8_t, MemoryPool::kMaxBlockSize / 16 + 1> table = [] {
+        std::array<std::uint8_t, MemoryPool::kMaxBlockSize / 16 + 1> classes{};
+        std::size_t index = 0;
+        for (std::size_t units = 0; units < classes.size(); ++units) {
+            while (kClassSizes[index] < units * 16) {
+                ++index;
+            }
+            classes[units] = static_cast<std::uint8_t>(index);
+        }
+        return classes;
+    }();
+    return table;
+}
+
+/**
+ * @brief Getter for the size class of a request.
+ * @param size The number of bytes, at most kMaxBlockSize.
+ * @return The index of the smallest class holding it.
+ */
+std::size_t classOf(std::size_t size) {
+    return classTable()[(size + 15) / 16];
+}
+
+/**
+ * @brief Getter for how many blocks of a class a thread keeps.
+ * @param index The size class.
+ * @return The number of blocks.
+ */
+std::size_t cacheLimit(std::size_t index) {
+    return std::max<std::size_t>(2, kCacheBytes / kClassSizes[index]);
+}
+
+} // namespace
+
+/**
+ * @brief Getter for the share of reserved memory not holding live data.
+ * @return The fragmentation in percent, 0 when nothing is reserved.
+ */
+double MemoryStatistics::getFragmentation() const {
+    if (reservedBytes == 0 || liveBytes >= reservedBytes) {
+        return 0.0;
+    }
+    return 100.0 * static_cast<double>(reservedBytes - liveBytes) / static_cast<double>(reservedBytes);
+}
+
+/**
+ * @brief Hands the lists back to the pool.
+ */
+MemoryPool::LocalCache::~LocalCache() {
+    if (pool != nullptr) {
+        for (std::size_t index = 0; index < kClassCount; ++index) {
+            pool->drain(*this, index, 0);
+        }
+    }
+}
+
+/**
+ * @brief Constructs an empty pool.
+ */
+MemoryPool::MemoryPool()
+    : id(nextPoolId++), liveBytes(0), peakBytes(0), reservedBytes(0), bulk(false) {
+    if (id >= kMaxPools) {
+        throw std::length_error("Too many memory pools");
+    }
+}
+
+/**
+ * @brief Returns every slab to the system.
+ */
+MemoryPool::~MemoryPool() {
+    for (char* slab : slabs) {
+        ::operator delete(slab);
+    }
+}
+
+/**
+ * @brief Allocates a block.
+ * @param size The number of bytes.
+ * @return The block, aligned for any type of up to 16 bytes.
+ */
+void* MemoryPool::allocate(std::size_t size) {
+    track(size);
+    if (size > kMaxBlockSize) {
+        reservedBytes.fetch_add(size, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+    std::size_t index = classOf(size);
+    LocalCache& cache = localCache();
+    if (cache.free[index] == nullptr) {
+        refill(cache, index);
+    }
+    Block* block = cache.free[index];
+    cache.free[index] = block->next;
+    --cache.count[index];
+    return block;
+}
+
+/**
+ * @brief Frees a block.
+ * @param block The block.
+ * @param size The number of bytes it was allocated with.
+ */
+void MemoryPool::deallocate(void* block, std::size_t size) {
+    liveBytes.fetch_sub(size, std::memory_order_relaxed);
+    if (size > kMaxBlockSize) {
+        reservedBytes.fetch_sub(size, std::memory_order_relaxed);
+        ::operator delete(block);
+        return;
+    }
+    if (bulk.load(std::memory_order_relaxed)) {
+        // The slab goes back to the system with all the others
+        return;
+    }
+    std::size_t index = classOf(size);
+    LocalCache& cache = localCache();
+    Block* freed = static_cast<Block*>(block);
+    freed->next = cache.free[index];
+    cache.free[index] = freed;
+    if (++cache.count[index] > cacheLimit(index)) {
+        drain(cache, index, cacheLimit(index) / 2);
+    }
+}
+
+/**
+ * @brief Switches frees of slab blocks to only update the statistics.
+ * @param bulk True to leave freed blocks in their slabs until the pool is destroyed.
+ */
+void MemoryPool::setBulkRelease(bool bulk) {
+    this->bulk.store(bulk, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Getter for what the pool holds.
+ * @return The statistics.
+ */
+MemoryStatistics MemoryPool::getStatistics() const {
+    MemoryStatistics statistics;
+    statistics.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    statistics.peakBytes = peakBytes.load(std::memory_order_relaxed);
+    statistics.reservedBytes = reservedBytes.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+/**
+ * @brief Getter for the calling thread's cache for this pool.
+ * @return The cache.
+ */
+MemoryPool::LocalCache& MemoryPool::localCache() {
+    thread_local LocalCache caches[kMaxPools];
+    LocalCache& cache = caches[id];
+    cache.pool = this;
+    return cache;
+}
+
+/**
+ * @brief Fills a thread's free list of a class from the shared state.
+ * @param cache The thread's cache.
+ * @param index The size class.
+ */
+void MemoryPool::refill(LocalCache& cache, std::size_t index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    SizeClass& shared = classes[index];
+    std::size_t size = kClassSizes[index];
+    for (std::size_t taken = 0; taken < kRefillBlocks; ++taken) {
+        Block* block = shared.free;
+        if (block != nullptr) {
+            shared.free = block->next;
+        } else {
+            if (shared.cursor == shared.end) {
+                if (taken != 0) {
+                    break;
+                }
+                char* slab = static_cast<char*>(::operator new(kSlabSize));
+                slabs.push_back(slab);
+                reservedBytes.fetch_add(kSlabSize, std::memory_order_relaxed);
+                shared.cursor = slab;
+                shared.end = slab + kSlabSize / size * size;
+            }
+            block = reinterpret_cast<Block*>(shared.cursor);
+            shared.cursor += size;
+        }
+        block->next = cache.free[index];
+        cache.free[index] = block;
+        ++cache.count[index];
+    }
+}
+
+/**
+ * @brief Moves blocks of a thread's free list of a class to the shared list.
+ * @param cache The thread's cache.
+ * @param index The size class.
+ * @param keep The number of blocks the thread keeps.
+ */
+void MemoryPool::drain(LocalCache& cache, std::size_t index, std::size_t keep) {
+    if (cache.count[index] <= keep) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    SizeClass& shared = classes[index];
+    while (cache.count[index] > keep) {
+        Block* block = cache.free[index];
+        cache.free[index] = block->next;
+        --cache.count[index];
+        block->next = shared.free;
+        shared.free = block;
+    }
+}
+
+/**
+ * @brief Adds to the live bytes and raises the peak if needed.
+ * @param size The number of bytes allocated.
+ */
+void MemoryPool::track(std::size_t size) {
+    std::size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    std::size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief Getter for the pool of fragments, rope nodes and chunk headers.
+ * @return The pool.
+ */
+MemoryPool& fragmentPool() {
+    static MemoryPool pool;
+    return pool;
+}
+
+/**
+ * @brief Getter for the arena of packed sequence words.
+ * @return The pool.
+ */
+MemoryPool& sequenceArena() {
+    static MemoryPool pool;
+    return pool;
+}
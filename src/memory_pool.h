@@ -0,0 +1,233 @@
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/**
+ * @struct MemoryStatistics
+ * @brief A snapshot of what a pool holds.
+ */
+struct MemoryStatistics {
+    std::size_t liveBytes = 0; ///< Bytes requested by allocations not yet freed.
+    std::size_t peakBytes = 0; ///< The highest liveBytes so far.
+    std::size_t reservedBytes = 0; ///< Bytes taken from the system, in slabs or large blocks.
+
+    /**
+     * @brief Getter for the share of reserved memory not holding live data.
+     * @return The fragmentation in percent, 0 when nothing is reserved.
+     */
+    double getFragmentation() const;
+};
+
+/**
+ * @class MemoryPool
+ * @brief Size-classed slab allocator with per-thread free lists.
+ *
+ * Requests up to kMaxBlockSize bytes are rounded up to one of a few size
+ * classes, each carved from 64 KiB slabs. Freed blocks go onto a free list
+ * of the freeing thread and are reused by its next allocation of the same
+ * class, so steady churn takes no lock; a thread only locks the pool to move
+ * a batch of blocks to or from the shared lists. Larger requests go to the
+ * system allocator but are still counted.
+ *
+ * In bulk release mode frees only update the statistics, and every slab is
+ * returned to the system at once when the pool is destroyed.
+ */
+class MemoryPool {
+public:
+    static constexpr std::size_t kSlabSize = 64 << 10; ///< The bytes carved into blocks at a time.
+    static constexpr std::size_t kMaxBlockSize = 16 << 10; ///< The largest request served from slabs.
+    static constexpr std::size_t kClassCount = 20; ///< The number of size classes.
+    static constexpr int kMaxPools = 4; ///< The number of pools that can exist at once.
+
+    /**
+     * @brief Constructs an empty pool.
+     */
+    MemoryPool();
+
+    /**
+     * @brief Returns every slab to the system.
+     */
+    ~MemoryPool();
+
+    MemoryPool(const MemoryPool&) = delete;
+    MemoryPool& operator=(const MemoryPool&) = delete;
+
+    /**
+     * @brief Allocates a block.
+     * @param size The number of bytes.
+     * @return The block, aligned for any type of up to 16 bytes.
+     */
+    void* allocate(std::size_t size);
+
+    /**
+     * @brief Frees a block.
+     * @param block The block.
+     * @param size The number of bytes it was allocated with.
+     */
+    void deallocate(void* block, std::size_t size);
+
+    /**
+     * @brief Switches frees of slab blocks to only update the statistics.
+     * @param bulk True to leave freed blocks in their slabs until the pool is destroyed.
+     */
+    void setBulkRelease(bool bulk);
+
+    /**
+     * @brief Getter for what the pool holds.
+     * @return The statistics.
+     */
+    MemoryStatistics getStatistics() const;
+
+private:
+    /**
+     * @struct Block
+     * @brief A free block, linked through its first bytes.
+     */
+    struct Block {
+        Block* next; ///< The next free block.
+    };
+
+    /**
+     * @struct SizeClass
+     * @brief The blocks of one size shared by every thread.
+     */
+    struct SizeClass {
+        Block* free = nullptr; ///< Blocks returned by threads.
+        char* cursor = nullptr; ///< The next uncarved byte of the current slab.
+        char* end = nullptr; ///< The end of the current slab.
+    };
+
+    /**
+     * @struct LocalCache
+     * @brief One thread's free lists for one pool; handed back to the pool when the thread exits.
+     */
+    struct LocalCache {
+        MemoryPool* pool = nullptr; ///< The pool the lists belong to.
+        Block* free[kClassCount] = {}; ///< Free blocks of each class.
+        std::size_t count[kClassCount] = {}; ///< The length of each list.
+
+        /**
+         * @brief Hands the lists back to the pool.
+         */
+        ~LocalCache();
+    };
+
+    int id; ///< Which of a thread's caches belongs to this pool.
+    SizeClass classes[kClassCount]; ///< The shared state of each class.
+    std::vector<char*> slabs; ///< Every slab taken from the system.
+    mutable std::mutex mutex; ///< Guards classes and slabs.
+    std::atomic<std::size_t> liveBytes; ///< Bytes requested and not yet freed.
+    std::atomic<std::size_t> peakBytes; ///< The highest liveBytes so far.
+    std::atomic<std::size_t> reservedBytes; ///< Bytes taken from the system.
+    std::atomic<bool> bulk; ///< True in bulk release mode.
+
+    /**
+     * @brief Getter for the calling thread's cache for this pool.
+     * @return The cache.
+     */
+    LocalCache& localCache();
+
+    /**
+     * @brief Fills a thread's free list of a class from the shared state.
+     * @param cache The thread's cache.
+     * @param index The size class.
+     */
+    void refill(LocalCache& cache, std::size_t index);
+
+    /**
+     * @brief Moves blocks of a thread's free list of a class to the shared list.
+     * @param cache The thread's cache.
+     * @param index The size class.
+     * @param keep The number of blocks the thread keeps.
+     */
+    void drain(LocalCache& cache, std::size_t index, std::size_t keep);
+
+    /**
+     * @brief Adds to the live bytes and raises the peak if needed.
+     * @param size The number of bytes allocated.
+     */
+    void track(std::size_t size);
+};
+
+/**
+ * @brief Getter for the pool of fragments, rope nodes and chunk headers.
+ * @return The pool.
+ */
+MemoryPool& fragmentPool();
+
+/**
+ * @brief Getter for the arena of packed sequence words.
+ * @return The pool.
+ */
+MemoryPool& sequenceArena();
+
+/**
+ * @class PoolAllocator
+ * @brief Standard allocator drawing from one of the shared pools.
+ * @tparam T The type allocated.
+ * @tparam Pool Returns the pool.
+ */
+template <typename T, MemoryPool& (*Pool)()>
+class PoolAllocator {
+public:
+    using value_type = T; ///< The type allocated.
+
+    /**
+     * @struct rebind
+     * @brief The same allocator for another type.
+     */
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U, Pool>; ///< The allocator for U.
+    };
+
+    PoolAllocator() = default;
+
+    /**
+     * @brief Converts from the allocator of another type.
+     */
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, Pool>&) {}
+
+    /**
+     * @brief Allocates storage.
+     * @param count The number of objects.
+     * @return The storage.
+     */
+    T* allocate(std::size_t count) {
+        return static_cast<T*>(Pool().allocate(count * sizeof(T)));
+    }
+
+    /**
+     * @brief Frees storage.
+     * @param pointer The storage.
+     * @param count The number of objects it was allocated for.
+     */
+    void deallocate(T* pointer, std::size_t count) {
+        Pool().deallocate(pointer, count * sizeof(T));
+    }
+
+    /**
+     * @brief Allocators of the same pool are interchangeable.
+     */
+    template <typename U>
+    bool operator==(const PoolAllocator<U, Pool>&) const {
+        return true;
+    }
+
+    /**
+     * @brief Allocators of the same pool are interchangeable.
+     */
+    template <typename U>
+    bool operator!=(const PoolAllocator<U, Pool>&) const {
+        return false;
+    }
+};
+
+#endif // MEMORY_POOL_H
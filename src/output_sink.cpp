@@ -0,0 +1,271 @@
+#include "output_sink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+#ifdef IOV_MAX
+constexpr std::size_t kMaxVectors = IOV_MAX; ///< The most iovecs one writev() accepts.
+#else
+constexpr std::size_t kMaxVectors = 1024; ///< The most iovecs one writev() accepts.
+#endif
+
+/**
+ * @brief Writes a list of blocks to a descriptor, retrying partial writes.
+ * @param fd The file descriptor.
+ * @param vectors The blocks; consumed as they are written.
+ */
+void writeAll(int fd, std::vector<iovec>& vectors) {
+    std::size_t first = 0;
+    while (first < vectors.size()) {
+        int count = static_cast<int>(std::min(vectors.size() - first, kMaxVectors));
+        ssize_t written = ::writev(fd, &vectors[first], count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The reader went away or the disk is full; drop the output
+            return;
+        }
+        std::size_t left = static_cast<std::size_t>(written);
+        while (first < vectors.size() && left >= vectors[first].iov_len) {
+            left -= vectors[first].iov_len;
+            ++first;
+        }
+        if (left != 0) {
+            vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + left;
+            vectors[first].iov_len -= left;
+        }
+    }
+    vectors.clear();
+}
+
+} // namespace
+
+/**
+ * @class OutputSink::WriteBatch
+ * @brief Gathers blocks in order and writes each run for the same descriptor with one writev().
+ */
+class OutputSink::WriteBatch {
+public:
+    /**
+     * @brief Adds a block.
+     * @param fd The file descriptor.
+     * @param data The bytes, which must stay valid until finish().
+     * @param size The number of bytes.
+     */
+    void add(int fd, const char* data, std::size_t size) {
+        if (fd != this->fd && !vectors.empty()) {
+            writeAll(this->fd, vectors);
+        }
+        this->fd = fd;
+        vectors.push_back(iovec{const_cast<char*>(data), size});
+    }
+
+    /**
+     * @brief Adds every run of a buffer.
+     * @param buffer The buffer.
+     */
+    void add(const Buffer& buffer) {
+        for (const Run& run : buffer.runs) {
+            add(run.fd, buffer.bytes.get() + run.begin, run.end - run.begin);
+        }
+    }
+
+    /**
+     * @brief Writes what is left.
+     */
+    void finish() {
+        if (!vectors.empty()) {
+            writeAll(fd, vectors);
+        }
+    }
+
+private:
+    std::vector<iovec> vectors; ///< The blocks of the current run.
+    int fd = -1; ///< The descriptor of the current run.
+};
+
+/**
+ * @brief Constructs a sink that writes from the calling thread.
+ */
+OutputSink::OutputSink()
+    : allocated(0), writing(0), errorPolicy(FlushPolicy::BATCHED), stopping(false) {
+    current = takeSpare();
+}
+
+/**
+ * @brief Flushes the sink and stops the background writer.
+ */
+OutputSink::~OutputSink() {
+    flush();
+    setBackground(false);
+}
+
+/**
+ * @brief Starts or stops the background writer thread.
+ * @param background True to write full buffers on a background thread.
+ */
+void OutputSink::setBackground(bool background) {
+    if (background == writer.joinable()) {
+        return;
+    }
+    if (background) {
+        stopping = false;
+        writer = std::thread(&OutputSink::run, this);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work.notify_one();
+    writer.join();
+}
+
+/**
+ * @brief Sets when diagnostics reach their file.
+ * @param policy The flush policy for writes to the diagnostics descriptor.
+ */
+void OutputSink::setErrorPolicy(FlushPolicy policy) {
+    errorPolicy = policy;
+}
+
+/**
+ * @brief Queues bytes for a file descriptor.
+ * @param fd The file descriptor.
+ * @param data The bytes.
+ * @param size The number of bytes.
+ */
+void OutputSink::write(int fd, const char* data, std::size_t size) {
+    if (size >= kDirectSize && !writer.joinable()) {
+        // Send the block in the same writes as what is queued, without copying it
+        WriteBatch batch;
+        batch.add(*current);
+        batch.add(fd, data, size);
+        batch.finish();
+        current->used = 0;
+        current->runs.clear();
+        size = 0;
+    }
+    while (size != 0) {
+        if (current->used == kBufferSize) {
+            submit();
+        }
+        std::size_t count = std::min(size, kBufferSize - current->used);
+        std::memcpy(current->bytes.get() + current->used, data, count);
+        if (!current->runs.empty() && current->runs.back().fd == fd) {
+            current->runs.back().end += count;
+        } else {
+            current->runs.push_back(Run{fd, current->used, current->used + count});
+        }
+        current->used += count;
+        data += count;
+        size -= count;
+    }
+    if (fd == STDERR_FILENO && errorPolicy == FlushPolicy::IMMEDIATE) {
+        flush();
+    }
+}
+
+/**
+ * @brief Writes everything queued and waits until it is written.
+ */
+void OutputSink::flush() {
+    if (current->used != 0) {
+        submit();
+    }
+    if (writer.joinable()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending.empty() && writing == 0; });
+    }
+}
+
+/**
+ * @brief Hands the current buffer over for writing and takes an empty one.
+ */
+void OutputSink::submit() {
+    if (!writer.joinable()) {
+        std::vector<std::unique_ptr<Buffer>> buffers;
+        buffers.push_back(std::move(current));
+        writeBuffers(buffers);
+        current = std::move(buffers.front());
+        current->used = 0;
+        current->runs.clear();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(current));
+    }
+    work.notify_one();
+    current = takeSpare();
+}
+
+/**
+ * @brief Writes buffers in order, one writev() per run of the same descriptor.
+ * @param buffers The buffers.
+ */
+void OutputSink::writeBuffers(const std::vector<std::unique_ptr<Buffer>>& buffers) {
+    WriteBatch batch;
+    for (const std::unique_ptr<Buffer>& buffer : buffers) {
+        batch.add(*buffer);
+    }
+    batch.finish();
+}
+
+/**
+ * @brief Runs the background writer until stopped.
+ */
+void OutputSink::run() {
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            return;
+        }
+        // Take every pending buffer so they go out in as few writes as possible
+        while (!pending.empty()) {
+            buffers.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+        writing = buffers.size();
+        lock.unlock();
+        writeBuffers(buffers);
+        lock.lock();
+        for (std::unique_ptr<Buffer>& buffer : buffers) {
+            buffer->used = 0;
+            buffer->runs.clear();
+            spare.push_back(std::move(buffer));
+        }
+        buffers.clear();
+        writing = 0;
+        done.notify_all();
+    }
+}
+
+/**
+ * @brief Takes a spare buffer, or allocates one.
+ * @return An empty buffer.
+ */
+std::unique_ptr<OutputSink::Buffer> OutputSink::takeSpare() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (spare.empty() && allocated >= kMaxBuffers) {
+        // The writer is behind; wait for it rather than queue without bound
+        done.wait(lock, [this] { return !spare.empty(); });
+    }
+    if (spare.empty()) {
+        std::unique_ptr<Buffer> buffer = std::make_unique<Buffer>();
+        buffer->bytes.reset(new char[kBufferSize]);
+        ++allocated;
+        return buffer;
+    }
+    std::unique_ptr<Buffer> buffer = std::move(spare.back());
+    spare.pop_back();
+    return buffer;
+}
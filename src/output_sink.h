@@ -0,0 +1,135 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @enum FlushPolicy
+ * @brief When diagnostics written to the sink reach their file.
+ */
+enum class FlushPolicy {
+    BATCHED,    ///< With the rest of the output, when a buffer fills or the sink is flushed.
+    IMMEDIATE   ///< Straight away, together with any output written before them.
+};
+
+/**
+ * @class OutputSink
+ * @brief Buffered writer for several file descriptors that keeps their writes in order.
+ *
+ * Writes are copied into large buffers that record which descriptor each run
+ * of bytes is for. Full buffers are written with one writev() per run of the
+ * same descriptor, either by the caller or by a background writer thread,
+ * and are then reused. Large writes made without the background writer go
+ * out in the same writev() as the buffer before them instead of being
+ * copied. Because runs keep their order, output and diagnostics
+ * sent to the same file interleave exactly as they were written.
+ */
+class OutputSink {
+public:
+    static constexpr std::size_t kBufferSize = 1 << 20; ///< The size of each buffer in bytes.
+    static constexpr std::size_t kMaxBuffers = 8; ///< The most buffers in use before writes wait.
+    static constexpr std::size_t kDirectSize = 64 << 10; ///< Writes this large skip the copy when writing from the caller.
+
+    /**
+     * @brief Constructs a sink that writes from the calling thread.
+     */
+    OutputSink();
+
+    /**
+     * @brief Flushes the sink and stops the background writer.
+     */
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /**
+     * @brief Starts or stops the background writer thread.
+     * @param background True to write full buffers on a background thread.
+     */
+    void setBackground(bool background);
+
+    /**
+     * @brief Sets when diagnostics reach their file.
+     * @param policy The flush policy for writes to the diagnostics descriptor.
+     */
+    void setErrorPolicy(FlushPolicy policy);
+
+    /**
+     * @brief Queues bytes for a file descriptor.
+     * @param fd The file descriptor.
+     * @param data The bytes.
+     * @param size The number of bytes.
+     */
+    void write(int fd, const char* data, std::size_t size);
+
+    /**
+     * @brief Writes everything queued and waits until it is written.
+     */
+    void flush();
+
+private:
+    /**
+     * @struct Run
+     * @brief Consecutive bytes of a buffer bound for one file descriptor.
+     */
+    struct Run {
+        int fd; ///< The file descriptor.
+        std::size_t begin; ///< The offset of the first byte.
+        std::size_t end; ///< The offset past the last byte.
+    };
+
+    /**
+     * @struct Buffer
+     * @brief A block of queued bytes and the descriptors they are for.
+     */
+    struct Buffer {
+        std::unique_ptr<char[]> bytes; ///< kBufferSize bytes.
+        std::size_t used = 0; ///< The number of bytes queued.
+        std::vector<Run> runs; ///< The runs, in write order.
+    };
+
+    class WriteBatch; ///< Gathers blocks into writev() calls, defined in output_sink.cpp.
+
+    std::unique_ptr<Buffer> current; ///< The buffer being filled.
+    std::vector<std::unique_ptr<Buffer>> spare; ///< Written buffers ready for reuse.
+    std::deque<std::unique_ptr<Buffer>> pending; ///< Full buffers waiting for the writer.
+    std::size_t allocated; ///< The number of buffers in existence.
+    std::size_t writing; ///< The number of buffers the writer is writing.
+    FlushPolicy errorPolicy; ///< When diagnostics are written.
+    std::mutex mutex; ///< Guards spare, pending, allocated, writing and stopping.
+    std::condition_variable work; ///< Signalled when buffers are pending or the writer should stop.
+    std::condition_variable done; ///< Signalled when the writer finishes buffers.
+    std::thread writer; ///< The background writer, if running.
+    bool stopping; ///< Set to stop the background writer.
+
+    /**
+     * @brief Hands the current buffer over for writing and takes an empty one.
+     */
+    void submit();
+
+    /**
+     * @brief Writes buffers in order, one writev() per run of the same descriptor.
+     * @param buffers The buffers.
+     */
+    static void writeBuffers(const std::vector<std::unique_ptr<Buffer>>& buffers);
+
+    /**
+     * @brief Runs the background writer until stopped.
+     */
+    void run();
+
+    /**
+     * @brief Takes a spare buffer, or allocates one.
+     * @return An empty buffer.
+     */
+    std::unique_ptr<Buffer> takeSpare();
+};
+
+#endif // OUTPUT_SINK_H
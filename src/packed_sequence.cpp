@@ -0,0 +1,649 @@
+#include "packed_sequence.h"
+#include "reverse_complement.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr std::size_t kBasesPerWord = 32; ///< Two bit codes held by one word.
+constexpr std::uint64_t kEvenBits = 0x5555555555555555ULL; ///< Low bit of every base code.
+
+/**
+ * @brief Number of words needed to hold a bit count.
+ * @param bits The number of bits.
+ * @return The number of 64-bit words.
+ */
+std::size_t wordsFor(std::size_t bits) {
+    return (bits + 63) / 64;
+}
+
+/**
+ * @brief Reads 64 bits starting at any bit offset; bits past the end read as zero.
+ * @param bits The bit array.
+ * @param size The number of words in the bit array.
+ * @param offset The offset of the first bit.
+ * @return The bits, first bit in the lowest position.
+ */
+std::uint64_t readBits(const std::uint64_t* bits, std::size_t size, std::size_t offset) {
+    std::size_t index = offset / 64;
+    std::size_t shift = offset % 64;
+    std::uint64_t low = index < size ? bits[index] : 0;
+    if (shift == 0) {
+        return low;
+    }
+    std::uint64_t high = index + 1 < size ? bits[index + 1] : 0;
+    return (low >> shift) | (high << (64 - shift));
+}
+
+/**
+ * @brief Reads 64 bits starting at any bit offset; bits past the end read as zero.
+ * @param bits The bit array.
+ * @param offset The offset of the first bit.
+ * @return The bits, first bit in the lowest position.
+ */
+std::uint64_t readBits(const PackedSequence::Words& bits, std::size_t offset) {
+    return readBits(bits.data(), bits.size(), offset);
+}
+
+/**
+ * @brief Shrinks a bit array to a bit count and clears the padding bits.
+ * @param bits The bit array.
+ * @param count The number of bits to keep.
+ */
+void truncateBits(PackedSequence::Words& bits, std::size_t count) {
+    bits.resize(wordsFor(count));
+    if (count % 64 != 0) {
+        bits.back() &= (1ULL << (count % 64)) - 1;
+    }
+}
+
+/**
+ * @brief Appends a run of bits to a bit array whose padding bits are clear.
+ * @param dst The destination bit array.
+ * @param dstCount The number of valid bits in the destination.
+ * @param src The source bit array.
+ * @param srcSize The number of words in the source bit array.
+ * @param srcOffset The offset of the first source bit.
+ * @param count The number of bits to append.
+ */
+void appendBits(PackedSequence::Words& dst, std::size_t dstCount, const std::uint64_t* src,
+                std::size_t srcSize, std::size_t srcOffset, std::size_t count) {
+    if (count == 0) {
+        return;
+    }
+    dst.resize(wordsFor(dstCount + count), 0);
+    std::size_t index = dstCount / 64;
+    std::size_t shift = dstCount % 64;
+    for (std::size_t done = 0; done < count; done += 64, ++index) {
+        std::uint64_t chunk = readBits(src, srcSize, srcOffset + done);
+        if (count - done < 64) {
+            chunk &= (1ULL << (count - done)) - 1;
+        }
+        dst[index] |= chunk << shift;
+        if (shift != 0 && index + 1 < dst.size()) {
+            dst[index + 1] |= chunk >> (64 - shift);
+        }
+    }
+}
+
+/**
+ * @brief Drops bits from the front of a bit array, moving the rest down in place.
+ * @param bits The bit array.
+ * @param count The number of valid bits.
+ * @param shift The number of bits to drop.
+ */
+void shiftDown(PackedSequence::Words& bits, std::size_t count, std::size_t shift) {
+    std::size_t remaining = count - shift;
+    for (std::size_t i = 0; i < wordsFor(remaining); ++i) {
+        // Reads only from words at or after i, so writing word i is safe.
+        bits[i] = readBits(bits, shift + 64 * i);
+    }
+    truncateBits(bits, remaining);
+}
+
+/**
+ * @brief Gathers the even bits of a word into its low 32 bits.
+ * @param x A word with bits only in even positions.
+ * @return The gathered bits.
+ */
+std::uint64_t compressEven(std::uint64_t x) {
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+    return x;
+}
+
+/**
+ * @brief Table from a character to its code; bit 2 flags a 'U' spelling.
+ * @return The table, invalid characters mapping to A.
+ */
+const std::array<std::uint8_t, 256>& baseCodes() {
+    static const std::array<std::uint8_t, 256> codes = [] {
+        std::array<std::uint8_t, 256> table{};
+        table['C'] = table['c'] = 1;
+        table['G'] = table['g'] = 2;
+        table['T'] = table['t'] = 3;
+        table['U'] = table['u'] = 3 | 4;
+        return table;
+    }();
+    return codes;
+}
+
+/**
+ * @struct LetterTable
+ * @brief Letters of the four bases packed into every byte value.
+ */
+struct LetterTable {
+    char thymine[256][4]; ///< Letters when code 3 reads as 'T'.
+    char uracil[256][4];  ///< Letters when code 3 reads as 'U'.
+};
+
+/**
+ * @brief Getter for the shared byte to letters table.
+ * @return The table.
+ */
+const LetterTable& letterTable() {
+    static const LetterTable table = [] {
+        LetterTable letters{};
+        for (int byte = 0; byte < 256; ++byte) {
+            for (int k = 0; k < 4; ++k) {
+                int code = (byte >> (2 * k)) & 3;
+                letters.thymine[byte][k] = "ACGT"[code];
+                letters.uracil[byte][k] = "ACGU"[code];
+            }
+        }
+        return letters;
+    }();
+    return table;
+}
+
+/**
+ * @brief Getter for the table spreading eight alternate flags over eight letters.
+ *
+ * 'T' and 'U' differ only in their lowest bit, so XORing a flagged letter
+ * with 1 respells it; entry f holds a 1 in byte j for each set bit j of f.
+ *
+ * @return The table.
+ */
+const std::array<std::uint64_t, 256>& flagBytes() {
+    static const std::array<std::uint64_t, 256> table = [] {
+        std::array<std::uint64_t, 256> spread{};
+        for (int flags = 0; flags < 256; ++flags) {
+            char bytes[8];
+            for (int j = 0; j < 8; ++j) {
+                bytes[j] = static_cast<char>((flags >> j) & 1);
+            }
+            std::memcpy(&spread[flags], bytes, sizeof(bytes));
+        }
+        return spread;
+    }();
+    return table;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs an empty sequence whose code 3 reads as 'T'.
+ */
+PackedSequence::PackedSequence()
+    : length(0), uracil(false), borrowedWords(nullptr), borrowedAlternate(nullptr) {}
+
+/**
+ * @brief Packs a string of bases.
+ * @param bases The bases, any case, drawn from A, C, G, T and U.
+ * @param uracil True if code 3 should read as 'U' rather than 'T'.
+ */
+PackedSequence::PackedSequence(std::string_view bases, bool uracil)
+    : words(wordsFor(2 * bases.size()), 0), length(bases.size()), uracil(uracil),
+      borrowedWords(nullptr), borrowedAlternate(nullptr) {
+    const std::array<std::uint8_t, 256>& codes = baseCodes();
+    const unsigned other = uracil ? 0 : 4;
+    for (std::size_t i = 0; i < length; i += kBasesPerWord) {
+        std::size_t end = std::min(length, i + kBasesPerWord);
+        std::uint64_t word = 0;
+        std::uint64_t flagged = 0;
+        for (std::size_t j = i; j < end; ++j) {
+            // Branch free: code 3 spelled with the other letter sets a flag bit
+            unsigned code = codes[static_cast<unsigned char>(bases[j])];
+            word |= static_cast<std::uint64_t>(code & 3) << (2 * (j - i));
+            flagged |= static_cast<std::uint64_t>(code == (3 | other)) << (j - i);
+        }
+        words[i / kBasesPerWord] = word;
+        if (flagged != 0) {
+            if (alternate.empty()) {
+                alternate.assign(wordsFor(length), 0);
+            }
+            alternate[i / 64] |= flagged << (i % 64);
+        }
+    }
+}
+
+/**
+ * @brief Constructs a sequence over packed words held elsewhere, such as a mapped file.
+ * @param words The two bit codes, one word per 32 bases.
+ * @param alternate The alternate plane, one word per 64 bases, or null if no base is flagged.
+ * @param length The number of bases.
+ * @param uracil True if code 3 reads as 'U' rather than 'T'.
+ * @param owner Keeps the words alive while the sequence or its copies reference them.
+ */
+PackedSequence::PackedSequence(const std::uint64_t* words, const std::uint64_t* alternate, std::size_t length,
+                               bool uracil, std::shared_ptr<const void> owner)
+    : length(length), uracil(uracil), borrowedWords(words), borrowedAlternate(alternate), owner(std::move(owner)) {}
+
+/**
+ * @brief Getter for the number of bases.
+ * @return The number of bases.
+ */
+std::size_t PackedSequence::size() const {
+    return length;
+}
+
+/**
+ * @brief Checks whether the sequence holds no bases.
+ * @return True if the sequence is empty.
+ */
+bool PackedSequence::empty() const {
+    return length == 0;
+}
+
+/**
+ * @brief Getter for the letter of a single base.
+ * @param index The index of the base.
+ * @return The base letter in uppercase.
+ */
+char PackedSequence::at(std::size_t index) const {
+    int code = static_cast<int>((wordData()[index / kBasesPerWord] >> (2 * (index % kBasesPerWord))) & 3);
+    if (code != 3) {
+        return "ACG"[code];
+    }
+    const std::uint64_t* plane = alternateData();
+    bool flipped = plane != nullptr && ((plane[index / 64] >> (index % 64)) & 1) != 0;
+    return uracil != flipped ? 'U' : 'T';
+}
+
+/**
+ * @brief Unpacks the sequence into one character per base.
+ * @return The sequence string.
+ */
+std::string PackedSequence::str() const {
+    std::string result(length, 'A');
+    unpack(0, length, &result[0]);
+    return result;
+}
+
+/**
+ * @brief Unpacks a range of bases into a character buffer.
+ * @param pos The index of the first base.
+ * @param count The number of bases.
+ * @param out The buffer, at least count characters long.
+ */
+void PackedSequence::unpack(std::size_t pos, std::size_t count, char* out) const {
+    // Letters in the canonical spelling, a byte of codes at a time. Flagged
+    // bases are all code 3, and 'T' and 'U' differ only in their lowest bit,
+    // so the alternate plane is XORed in eight letters at a time
+    const std::uint64_t* words = wordData();
+    const std::uint64_t* plane = alternateData();
+    std::size_t end = pos + count;
+    std::size_t flaggedEnd = std::min(end, 64 * alternateCount());
+    std::size_t i = pos;
+    const char* canonical = uracil ? "ACGU" : "ACGT";
+    auto letter = [&](std::size_t at) {
+        char spelled = canonical[(words[at / kBasesPerWord] >> (2 * (at % kBasesPerWord))) & 3];
+        return at < flaggedEnd ? static_cast<char>(spelled ^ ((plane[at / 64] >> (at % 64)) & 1)) : spelled;
+    };
+    for (; i < end && i % 8 != 0; ++i) {
+        *out++ = letter(i);
+    }
+    const LetterTable& table = letterTable();
+    const char (*letters)[4] = uracil ? table.uracil : table.thymine;
+    const std::array<std::uint64_t, 256>& spread = flagBytes();
+    for (; i + 8 <= flaggedEnd; i += 8, out += 8) {
+        std::uint64_t codes = (words[i / kBasesPerWord] >> (2 * (i % kBasesPerWord))) & 0xffff;
+        char spelled[8];
+        std::memcpy(spelled, letters[codes & 0xff], 4);
+        std::memcpy(spelled + 4, letters[codes >> 8], 4);
+        std::uint64_t eight;
+        std::memcpy(&eight, spelled, sizeof(eight));
+        eight ^= spread[(plane[i / 64] >> (i % 64)) & 0xff];
+        std::memcpy(out, &eight, sizeof(eight));
+    }
+    for (; i < flaggedEnd; ++i) {
+        *out++ = letter(i);
+    }
+    for (; i + 4 <= end; i += 4, out += 4) {
+        std::uint64_t byte = (words[i / kBasesPerWord] >> (2 * (i % kBasesPerWord))) & 0xff;
+        std::memcpy(out, letters[byte], 4);
+    }
+    for (; i < end; ++i) {
+        *out++ = letter(i);
+    }
+}
+
+/**
+ * @brief Counts the bases of each letter in a range, a word at a time.
+ *
+ * Each word's low and high code bits are split into two masks, so every
+ * code is counted with a popcount over 32 bases. Only code 3 needs the
+ * alternate plane, whose flags mark the bases spelled with the other letter.
+ *
+ * @param pos The index of the first base.
+ * @param count The number of bases, clamped to the end of the sequence.
+ * @return The counts.
+ */
+BaseCounts PackedSequence::countBases(std::size_t pos, std::size_t count) const {
+    BaseCounts counts;
+    pos = std::min(pos, length);
+    std::size_t end = pos + std::min(count, length - pos);
+    if (pos == end) {
+        return counts;
+    }
+
+    const std::uint64_t* words = wordData();
+    std::size_t codes[4] = {0, 0, 0, 0};
+    for (std::size_t w = pos / kBasesPerWord; kBasesPerWord * w < end; ++w) {
+        std::size_t first = kBasesPerWord * w;
+        std::uint64_t valid = kEvenBits;
+        if (first < pos) {
+            valid &= ~0ULL << (2 * (pos - first));
+        }
+        if (end - first < kBasesPerWord) {
+            valid &= (1ULL << (2 * (end - first))) - 1;
+        }
+        std::uint64_t low = words[w] & valid;
+        std::uint64_t high = (words[w] >> 1) & valid;
+        codes[1] += static_cast<std::size_t>(__builtin_popcountll(low & ~high));
+        codes[2] += static_cast<std::size_t>(__builtin_popcountll(high & ~low));
+        codes[3] += static_cast<std::size_t>(__builtin_popcountll(low & high));
+    }
+    codes[0] = end - pos - codes[1] - codes[2] - codes[3];
+
+    std::size_t flagged = 0;
+    const std::uint64_t* plane = alternateData();
+    for (std::size_t w = pos / 64; w < alternateCount() && 64 * w < end; ++w) {
+        std::uint64_t valid = ~0ULL;
+        if (64 * w < pos) {
+            valid &= ~0ULL << (pos - 64 * w);
+        }
+        if (end - 64 * w < 64) {
+            valid &= (1ULL << (end - 64 * w)) - 1;
+        }
+        flagged += static_cast<std::size_t>(__builtin_popcountll(plane[w] & valid));
+    }
+
+    counts.a = codes[0];
+    counts.c = codes[1];
+    counts.g = codes[2];
+    counts.t = uracil ? flagged : codes[3] - flagged;
+    counts.u = uracil ? codes[3] - flagged : flagged;
+    return counts;
+}
+
+/**
+ * @brief Copies a range of bases into a new sequence.
+ * @param pos The index of the first base.
+ * @param count The number of bases, clamped to the end of the sequence.
+ * @return The packed range.
+ */
+PackedSequence PackedSequence::substr(std::size_t pos, std::size_t count) const {
+    PackedSequence result;
+    result.uracil = uracil;
+    if (pos >= length) {
+        return result;
+    }
+    count = std::min(count, length - pos);
+    appendBits(result.words, 0, wordData(), wordCount(), 2 * pos, 2 * count);
+    if (alternateCount() != 0) {
+        appendBits(result.alternate, 0, alternateData(), alternateCount(), pos, count);
+    }
+    result.length = count;
+    result.compactAlternate();
+    return result;
+}
+
+/**
+ * @brief Appends a range of another sequence to the end of this one.
+ * @param other The sequence to append from.
+ * @param pos The index of the first base to append.
+ * @param count The number of bases, clamped to the end of the other sequence.
+ */
+void PackedSequence::append(const PackedSequence& other, std::size_t pos, std::size_t count) {
+    if (pos >= other.length) {
+        return;
+    }
+    count = std::min(count, other.length - pos);
+    own();
+    std::size_t total = length + count;
+    bool created = alternate.empty();
+    if (!alternate.empty() || other.alternateCount() != 0 || other.uracil != uracil) {
+        alternate.resize(wordsFor(length), 0);
+        if (other.uracil == uracil && other.alternateCount() == 0) {
+            alternate.resize(wordsFor(total), 0);
+        } else if (other.uracil == uracil) {
+            appendBits(alternate, length, other.alternateData(), other.alternateCount(), pos, count);
+        } else {
+            // The other sequence spells code 3 the other way round, so its
+            // canonical bases become alternates here and vice versa.
+            PackedSequence::Words flipped = other.code3Mask(pos, count);
+            for (std::size_t i = 0; i < flipped.size() && other.alternateCount() != 0; ++i) {
+                flipped[i] ^= readBits(other.alternateData(), other.alternateCount(), pos + 64 * i);
+            }
+            truncateBits(flipped, count);
+            appendBits(alternate, length, flipped.data(), flipped.size(), 0, count);
+        }
+    }
+    appendBits(words, 2 * length, other.wordData(), other.wordCount(), 2 * pos, 2 * count);
+    length = total;
+    if (created) {
+        compactAlternate();
+    }
+}
+
+/**
+ * @brief Drops every base from a given index onwards.
+ * @param count The number of bases to keep.
+ */
+void PackedSequence::truncate(std::size_t count) {
+    if (count >= length) {
+        return;
+    }
+    own();
+    truncateBits(words, 2 * count);
+    if (!alternate.empty()) {
+        truncateBits(alternate, count);
+    }
+    length = count;
+    compactAlternate();
+}
+
+/**
+ * @brief Drops bases from the front of the sequence, shifting in place.
+ * @param count The number of bases to drop.
+ */
+void PackedSequence::erasePrefix(std::size_t count) {
+    count = std::min(count, length);
+    own();
+    shiftDown(words, 2 * length, 2 * count);
+    if (!alternate.empty()) {
+        shiftDown(alternate, length, count);
+    }
+    length -= count;
+    compactAlternate();
+}
+
+/**
+ * @brief Complements and reverses the sequence in place.
+ */
+void PackedSequence::transcribe() {
+    // Every A turns into a 'T' inside the resulting RNA, so those positions
+    // form the new alternate plane; the old plane no longer matters because
+    // both T and U turn into U.
+    own();
+    std::size_t count = words.size();
+    std::vector<std::uint32_t> adenine(count);
+    transcribeWords(words.data(), count, adenine.data());
+    PackedSequence::Words plane(wordsFor(kBasesPerWord * count), 0);
+    for (std::size_t i = 0; i < count; ++i) {
+        plane[i / 2] |= static_cast<std::uint64_t>(adenine[i]) << (32 * (i % 2));
+    }
+
+    // The padding codes of the last word now lead the run, so shift them out
+    std::size_t padding = kBasesPerWord * count - length;
+    shiftDown(words, 2 * kBasesPerWord * count, 2 * padding);
+    shiftDown(plane, kBasesPerWord * count, padding);
+    alternate = std::move(plane);
+    uracil = true;
+    compactAlternate();
+}
+
+/**
+ * @brief Getter for the packed words, for writing the sequence out.
+ * @return The two bit codes, wordCount() words.
+ */
+const std::uint64_t* PackedSequence::wordData() const {
+    return owner ? borrowedWords : words.data();
+}
+
+/**
+ * @brief Getter for the number of packed words.
+ * @return One word per 32 bases.
+ */
+std::size_t PackedSequence::wordCount() const {
+    return owner ? wordsFor(2 * length) : words.size();
+}
+
+/**
+ * @brief Getter for the alternate plane.
+ * @return One bit per base, alternateCount() words, or null if no base is flagged.
+ */
+const std::uint64_t* PackedSequence::alternateData() const {
+    if (owner) {
+        return borrowedAlternate;
+    }
+    return alternate.empty() ? nullptr : alternate.data();
+}
+
+/**
+ * @brief Getter for the number of words in the alternate plane.
+ * @return One word per 64 bases, or 0 if no base is flagged.
+ */
+std::size_t PackedSequence::alternateCount() const {
+    if (owner) {
+        return borrowedAlternate != nullptr ? wordsFor(length) : 0;
+    }
+    return alternate.size();
+}
+
+/**
+ * @brief Checks how code 3 reads.
+ * @return True if code 3 reads as 'U' by default.
+ */
+bool PackedSequence::isUracil() const {
+    return uracil;
+}
+
+/**
+ * @brief Getter for the heap memory held by the sequence.
+ * @return The number of bytes allocated for packed storage; borrowed words are not counted.
+ */
+std::size_t PackedSequence::memoryUsage() const {
+    return (words.capacity() + alternate.capacity()) * sizeof(std::uint64_t);
+}
+
+/**
+ * @brief Copies borrowed words into owned storage before an edit.
+ */
+void PackedSequence::own() {
+    if (!owner) {
+        return;
+    }
+    // Edits expect the padding bits past the last base to be clear
+    words.assign(borrowedWords, borrowedWords + wordsFor(2 * length));
+    truncateBits(words, 2 * length);
+    if (borrowedAlternate != nullptr) {
+        alternate.assign(borrowedAlternate, borrowedAlternate + wordsFor(length));
+        truncateBits(alternate, length);
+    }
+    borrowedWords = nullptr;
+    borrowedAlternate = nullptr;
+    owner.reset();
+    compactAlternate();
+}
+
+/**
+ * @brief Frees the alternate plane if no base uses it.
+ */
+void PackedSequence::compactAlternate() {
+    if (std::all_of(alternate.begin(), alternate.end(), [](std::uint64_t w) { return w == 0; })) {
+        PackedSequence::Words().swap(alternate);
+    }
+}
+
+/**
+ * @brief Builds a one bit per base mask of the bases coded 3 in a range.
+ * @param pos The index of the first base.
+ * @param count The number of bases.
+ * @return The mask, one bit per base of the range.
+ */
+PackedSequence::Words PackedSequence::code3Mask(std::size_t pos, std::size_t count) const {
+    PackedSequence::Words mask(wordsFor(count), 0);
+    for (std::size_t i = 0; i < mask.size(); ++i) {
+        std::uint64_t low = readBits(wordData(), wordCount(), 2 * (pos + 64 * i));
+        std::uint64_t high = readBits(wordData(), wordCount(), 2 * (pos + 64 * i) + 64);
+        mask[i] = compressEven(low & (low >> 1) & kEvenBits) |
+                  (compressEven(high & (high >> 1) & kEvenBits) << 32);
+    }
+    truncateBits(mask, count);
+    return mask;
+}
+
+/**
+ * @brief Adds the counts of another range.
+ * @param other The counts to add.
+ * @return This.
+ */
+BaseCounts& BaseCounts::operator+=(const BaseCounts& other) {
+    a += other.a;
+    c += other.c;
+    g += other.g;
+    t += other.t;
+    u += other.u;
+    return *this;
+}
+
+/**
+ * @brief Subtracts the counts of a range within this one.
+ * @param other The counts to subtract.
+ * @return This.
+ */
+BaseCounts& BaseCounts::operator-=(const BaseCounts& other) {
+    a -= other.a;
+    c -= other.c;
+    g -= other.g;
+    t -= other.t;
+    u -= other.u;
+    return *this;
+}
+
+/**
+ * @brief Getter for the number of bases.
+ * @return The sum of the counts.
+ */
+std::size_t BaseCounts::total() const {
+    return a + c + g + t + u;
+}
+
+/**
+ * @brief Getter for the counts after PackedSequence::transcribe(), without reading the bases.
+ * @return The counts with A turned into T, C and G swapped, and T and U turned into U.
+ */
+BaseCounts BaseCounts::transcribed() const {
+    BaseCounts result;
+    result.c = g;
+    result.g = c;
+    result.t = a;
+    result.u = t + u;
+    return result;
+}
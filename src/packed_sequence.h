@@ -0,0 +1,233 @@
+#ifndef PACKED_SEQUENCE_H
+#define PACKED_SEQUENCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "memory_pool.h"
+
+/**
+ * @struct BaseCounts
+ * @brief The number of bases of each letter in a sequence, as they print.
+ */
+struct BaseCounts {
+    std::size_t a = 0; ///< The number of 'A's.
+    std::size_t c = 0; ///< The number of 'C's.
+    std::size_t g = 0; ///< The number of 'G's.
+    std::size_t t = 0; ///< The number of 'T's.
+    std::size_t u = 0; ///< The number of 'U's.
+
+    /**
+     * @brief Adds the counts of another range.
+     * @param other The counts to add.
+     * @return This.
+     */
+    BaseCounts& operator+=(const BaseCounts& other);
+
+    /**
+     * @brief Subtracts the counts of a range within this one.
+     * @param other The counts to subtract.
+     * @return This.
+     */
+    BaseCounts& operator-=(const BaseCounts& other);
+
+    /**
+     * @brief Getter for the number of bases.
+     * @return The sum of the counts.
+     */
+    std::size_t total() const;
+
+    /**
+     * @brief Getter for the counts after PackedSequence::transcribe(), without reading the bases.
+     * @return The counts with A turned into T, C and G swapped, and T and U turned into U.
+     */
+    BaseCounts transcribed() const;
+};
+
+/**
+ * @class PackedSequence
+ * @brief Nucleotide string stored at two bits per base.
+ *
+ * Bases are coded A=0, C=1, G=2 and T/U=3, 32 bases to a 64-bit word with
+ * base 0 in the low bits. Whether code 3 reads as 'T' or 'U' is decided by
+ * the canonical letter of the sequence; bases spelled with the other letter
+ * (transcription leaves 'T's inside RNA) are flagged in an optional one bit
+ * per base plane that is only allocated when such a base exists.
+ *
+ * A sequence may also borrow its words from memory it does not own, such as
+ * a mapped snapshot; it copies them into its own storage before any edit.
+ */
+class PackedSequence {
+public:
+    using Words = std::vector<std::uint64_t, PoolAllocator<std::uint64_t, sequenceArena>>; ///< Packed storage, drawn from the sequence arena.
+
+    /**
+     * @brief Constructs an empty sequence whose code 3 reads as 'T'.
+     */
+    PackedSequence();
+
+    /**
+     * @brief Packs a string of bases.
+     * @param bases The bases, any case, drawn from A, C, G, T and U.
+     * @param uracil True if code 3 should read as 'U' rather than 'T'.
+     */
+    PackedSequence(std::string_view bases, bool uracil);
+
+    /**
+     * @brief Constructs a sequence over packed words held elsewhere, such as a mapped file.
+     * @param words The two bit codes, one word per 32 bases.
+     * @param alternate The alternate plane, one word per 64 bases, or null if no base is flagged.
+     * @param length The number of bases.
+     * @param uracil True if code 3 reads as 'U' rather than 'T'.
+     * @param owner Keeps the words alive while the sequence or its copies reference them.
+     */
+    PackedSequence(const std::uint64_t* words, const std::uint64_t* alternate, std::size_t length,
+                   bool uracil, std::shared_ptr<const void> owner);
+
+    /**
+     * @brief Getter for the number of bases.
+     * @return The number of bases.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Checks whether the sequence holds no bases.
+     * @return True if the sequence is empty.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Getter for the letter of a single base.
+     * @param index The index of the base.
+     * @return The base letter in uppercase.
+     */
+    char at(std::size_t index) const;
+
+    /**
+     * @brief Unpacks the sequence into one character per base.
+     * @return The sequence string.
+     */
+    std::string str() const;
+
+    /**
+     * @brief Unpacks a range of bases into a character buffer.
+     * @param pos The index of the first base.
+     * @param count The number of bases.
+     * @param out The buffer, at least count characters long.
+     */
+    void unpack(std::size_t pos, std::size_t count, char* out) const;
+
+    /**
+     * @brief Counts the bases of each letter in a range, a word at a time.
+     * @param pos The index of the first base.
+     * @param count The number of bases, clamped to the end of the sequence.
+     * @return The counts.
+     */
+    BaseCounts countBases(std::size_t pos = 0, std::size_t count = npos) const;
+
+    /**
+     * @brief Copies a range of bases into a new sequence.
+     * @param pos The index of the first base.
+     * @param count The number of bases, clamped to the end of the sequence.
+     * @return The packed range.
+     */
+    PackedSequence substr(std::size_t pos, std::size_t count = npos) const;
+
+    /**
+     * @brief Appends a range of another sequence to the end of this one.
+     * @param other The sequence to append from.
+     * @param pos The index of the first base to append.
+     * @param count The number of bases, clamped to the end of the other sequence.
+     */
+    void append(const PackedSequence& other, std::size_t pos = 0, std::size_t count = npos);
+
+    /**
+     * @brief Drops every base from a given index onwards.
+     * @param count The number of bases to keep.
+     */
+    void truncate(std::size_t count);
+
+    /**
+     * @brief Drops bases from the front of the sequence, shifting in place.
+     * @param count The number of bases to drop.
+     */
+    void erasePrefix(std::size_t count);
+
+    /**
+     * @brief Complements and reverses the sequence in place.
+     *
+     * Follows the transcription table of FragmentList: A becomes T, C and G
+     * swap, and T or U become U. The result reads code 3 as 'U'.
+     */
+    void transcribe();
+
+    /**
+     * @brief Getter for the packed words, for writing the sequence out.
+     * @return The two bit codes, wordCount() words.
+     */
+    const std::uint64_t* wordData() const;
+
+    /**
+     * @brief Getter for the number of packed words.
+     * @return One word per 32 bases.
+     */
+    std::size_t wordCount() const;
+
+    /**
+     * @brief Getter for the alternate plane.
+     * @return One bit per base, alternateCount() words, or null if no base is flagged.
+     */
+    const std::uint64_t* alternateData() const;
+
+    /**
+     * @brief Getter for the number of words in the alternate plane.
+     * @return One word per 64 bases, or 0 if no base is flagged.
+     */
+    std::size_t alternateCount() const;
+
+    /**
+     * @brief Checks how code 3 reads.
+     * @return True if code 3 reads as 'U' by default.
+     */
+    bool isUracil() const;
+
+    /**
+     * @brief Getter for the heap memory held by the sequence.
+     * @return The number of bytes allocated for packed storage; borrowed words are not counted.
+     */
+    std::size_t memoryUsage() const;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1); ///< Marks "until the end".
+
+private:
+    Words words; ///< Two bit base codes, 32 per word.
+    Words alternate; ///< One bit per base: code 3 reads as the non-canonical letter.
+    std::size_t length; ///< The number of bases.
+    bool uracil; ///< True if code 3 reads as 'U' by default.
+    const std::uint64_t* borrowedWords; ///< The words when borrowed, in place of words.
+    const std::uint64_t* borrowedAlternate; ///< The alternate plane when borrowed, null if none.
+    std::shared_ptr<const void> owner; ///< Keeps borrowed words alive, null when the words are owned.
+
+    /**
+     * @brief Copies borrowed words into owned storage before an edit.
+     */
+    void own();
+
+    /**
+     * @brief Frees the alternate plane if no base uses it.
+     */
+    void compactAlternate();
+
+    /**
+     * @brief Builds a one bit per base mask of the bases coded 3 in a range.
+     * @param pos The index of the first base.
+     * @param count The number of bases.
+     * @return The mask, one bit per base of the range.
+     */
+    Words code3Mask(std::size_t pos, std::size_t count) const;
+};
+
+#endif // PACKED_SEQUENCE_H
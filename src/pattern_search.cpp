@@ -0,0 +1,422 @@
+#include "pattern_search.h"
+#include <algorithm>
+#include <cctype>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::size_t kLanes = 4; ///< The 64-bit lanes of an AVX2 register.
+constexpr std::size_t kMinLaneSteps = 256; ///< Shorter texts are not worth splitting into lanes.
+
+/**
+ * @struct Pattern
+ * @brief What a scan kernel needs to know about the pattern.
+ */
+struct Pattern {
+    const std::uint64_t* matches; ///< Per letter, the pattern positions holding it.
+    unsigned top; ///< The bit of the last pattern position.
+    std::size_t context; ///< The bases before a hit's end a scan needs to see.
+    int maxErrors; ///< The largest edit distance reported.
+};
+
+/**
+ * @brief Shift-Or over a range of the text.
+ * @param pattern The pattern.
+ * @param text The text.
+ * @param begin The first base scanned.
+ * @param end One past the last base scanned.
+ * @param from The first base a hit may end at.
+ * @param hits Receives the hits.
+ */
+void shiftOrScalar(const Pattern& pattern, const char* text, std::size_t begin, std::size_t end,
+                   std::size_t from, std::vector<PatternHit>& hits) {
+    std::uint64_t state = ~std::uint64_t{0};
+    for (std::size_t i = begin; i < end; ++i) {
+        state = (state << 1) | ~pattern.matches[static_cast<unsigned char>(text[i])];
+        if (((state >> pattern.top) & 1) == 0 && i >= from) {
+            hits.push_back(PatternHit{i, 0});
+        }
+    }
+}
+
+/**
+ * @brief Myers' bit-vector edit distance over a range of the text; a match may start anywhere.
+ * @param pattern The pattern.
+ * @param text The text.
+ * @param begin The first base scanned.
+ * @param end One past the last base scanned.
+ * @param from The first base a hit may end at.
+ * @param hits Receives the hits.
+ */
+void myersScalar(const Pattern& pattern, const char* text, std::size_t begin, std::size_t end,
+                 std::size_t from, std::vector<PatternHit>& hits) {
+    std::uint64_t positive = ~std::uint64_t{0};
+    std::uint64_t negative = 0;
+    int score = static_cast<int>(pattern.top) + 1;
+    for (std::size_t i = begin; i < end; ++i) {
+        std::uint64_t equal = pattern.matches[static_cast<unsigned char>(text[i])];
+        std::uint64_t vertical = equal | negative;
+        std::uint64_t horizontal = (((equal & positive) + positive) ^ positive) | equal;
+        std::uint64_t up = negative | ~(horizontal | positive);
+        std::uint64_t down = positive & horizontal;
+        score += static_cast<int>((up >> pattern.top) & 1) - static_cast<int>((down >> pattern.top) & 1);
+        up <<= 1;
+        down <<= 1;
+        positive = down | ~(vertical | up);
+        negative = up & vertical;
+        if (score <= pattern.maxErrors && i >= from) {
+            hits.push_back(PatternHit{i, score});
+        }
+    }
+}
+
+/**
+ * @brief Shift-Or kernel without SIMD.
+ * @param pattern The pattern.
+ * @param text The text.
+ * @param size The number of bases.
+ * @param skip The leading bases no hit ends in.
+ * @param hits Receives the hits.
+ */
+void shiftOrPlain(const Pattern& pattern, const char* text, std::size_t size, std::size_t skip,
+                  std::vector<PatternHit>& hits) {
+    shiftOrScalar(pattern, text, skip - std::min(skip, pattern.context), size, skip, hits);
+}
+
+/**
+ * @brief Myers kernel without SIMD.
+ * @param pattern The pattern.
+ * @param text The text.
+ * @param size The number of bases.
+ * @param skip The leading bases no hit ends in.
+ * @param hits Receives the hits.
+ */
+void myersPlain(const Pattern& pattern, const char* text, std::size_t size, std::size_t skip,
+                std::vector<PatternHit>& hits) {
+    myersScalar(pattern, text, skip - std::min(skip, pattern.context), size, skip, hits);
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @struct LaneLayout
+ * @brief How a text is split between the lanes of a vector kernel.
+ *
+ * Every lane runs the same number of steps. Each starts far enough before
+ * the first base it reports to have seen a whole match, except the first,
+ * which may start at the text's start; it reports correspondingly more.
+ */
+struct LaneLayout {
+    std::size_t start[kLanes]; ///< The first base each lane reads.
+    std::size_t warmup[kLanes]; ///< The steps each lane takes before it reports.
+    std::size_t steps; ///< The bases each lane reads.
+    std::size_t rest; ///< The first base no lane reports, left to the scalar code.
+};
+
+/**
+ * @brief Splits a text between the lanes.
+ * @param size The number of bases.
+ * @param skip The leading bases no hit ends in.
+ * @param context The bases before a hit's end a scan needs to see.
+ * @param layout Receives the split.
+ * @return False if the text is too short to be worth splitting.
+ */
+bool layoutLanes(std::size_t size, std::size_t skip, std::size_t context, LaneLayout& layout) {
+    std::size_t reported = size - skip;
+    std::size_t first = std::min(skip, context);
+    layout.steps = (reported + first + (kLanes - 1) * context) / kLanes;
+    if (layout.steps < context + kMinLaneSteps) {
+        return false;
+    }
+    layout.start[0] = skip - first;
+    layout.warmup[0] = first;
+    std::size_t next = skip + layout.steps - first;
+    for (std::size_t lane = 1; lane < kLanes; ++lane) {
+        layout.start[lane] = next - context;
+        layout.warmup[lane] = context;
+        next += layout.steps - context;
+    }
+    layout.rest = next;
+    return true;
+}
+
+/**
+ * @brief Gathers the masks of the next base of each lane.
+ * @param matches The masks per letter.
+ * @param text The text.
+ * @param layout The split.
+ * @param step The step.
+ * @return The four masks.
+ */
+__attribute__((target("avx2")))
+inline __m256i gatherMasks(const std::uint64_t* matches, const char* text, const LaneLayout& layout, std::size_t step) {
+    return _mm256_set_epi64x(
+        static_cast<long long>(matches[static_cast<unsigned char>(text[layout.start[3] + step])]),
+        static_cast<long long>(matches[static_cast<unsigned char>(text[layout.start[2] + step])]),
+        static_cast<long long>(matches[static_cast<unsigned char>(text[layout.start[1] + step])]),
+        static_cast<long long>(matches[static_cast<unsigned char>(text[layout.start[0] + step])]));
+}
+
+/**
+ * @brief Appends the lanes' hits in text order.
+ * @param lanes The hits of each lane.
+ * @param hits Receives them.
+ */
+void mergeLanes(std::vector<PatternHit> (&lanes)[kLanes], std::vector<PatternHit>& hits) {
+    for (std::vector<PatternHit>& lane : lanes) {
+        hits.insert(hits.end(), lane.begin(), lane.end());
+    }
+}
+
+/**
+ * @brief AVX2 Shift-Or kernel: four stretches of the text per step.
+ * @param pattern The pattern.
+ * @param text The text.
+ * @param size The number of bases.
+ * @param skip The leading bases no hit ends in.
+ * @param hits Receives the hits.
+ */
+__attribute__((target("avx2")))
+void shiftOrAvx2(const Pattern& pattern, const char* text, std::size_t size, std::size_t skip,
+                 std::vector<PatternHit>& hits) {
+    LaneLayout layout;
+    if (!layoutLanes(size, skip, pattern.context, layout)) {
+        shiftOrPlain(pattern, text, size, skip, hits);
+        return;
+    }
+
+    // Shifting the last pattern bit into the sign bit lets movemask read all four lanes
+    const __m128i signShift = _mm_cvtsi32_si128(static_cast<int>(63 - pattern.top));
+    std::vector<PatternHit> lanes[kLanes];
+    __m256i state = _mm256_set1_epi64x(-1);
+    for (std::size_t step = 0; step < layout.steps; ++step) {
+        __m256i masks = gatherMasks(pattern.matches, text, layout, step);
+        state = _mm256_or_si256(_mm256_slli_epi64(state, 1), _mm256_xor_si256(masks, _mm256_set1_epi64x(-1)));
+        unsigned found = ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_sll_epi64(state, signShift)))) & 0xfu;
+        while (found != 0) {
+            unsigned lane = static_cast<unsigned>(__builtin_ctz(found));
+            found &= found - 1;
+            if (step >= layout.warmup[lane]) {
+                lanes[lane].push_back(PatternHit{layout.start[lane] + step, 0});
+            }
+        }
+    }
+    mergeLanes(lanes, hits);
+    shiftOrScalar(pattern, text, layout.rest - pattern.context, size, layout.rest, hits);
+}
+
+/**
+ * @brief AVX2 Myers kernel: four stretches of the text per step.
+ * @param pattern The pattern.
+ * @param text The text.
+ * @param size The number of bases.
+ * @param skip The leading bases no hit ends in.
+ * @param hits Receives the hits.
+ */
+__attribute__((target("avx2")))
+void myersAvx2(const Pattern& pattern, const char* text, std::size_t size, std::size_t skip,
+               std::vector<PatternHit>& hits) {
+    LaneLayout layout;
+    if (!layoutLanes(size, skip, pattern.context, layout)) {
+        myersPlain(pattern, text, size, skip, hits);
+        return;
+    }
+
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i limit = _mm256_set1_epi64x(pattern.maxErrors);
+    const __m128i topShift = _mm_cvtsi32_si128(static_cast<int>(pattern.top));
+    std::vector<PatternHit> lanes[kLanes];
+    __m256i positive = ones;
+    __m256i negative = _mm256_setzero_si256();
+    __m256i score = _mm256_set1_epi64x(static_cast<long long>(pattern.top) + 1);
+    alignas(32) long long scores[kLanes];
+    for (std::size_t step = 0; step < layout.steps; ++step) {
+        __m256i equal = gatherMasks(pattern.matches, text, layout, step);
+        __m256i vertical = _mm256_or_si256(equal, negative);
+        __m256i sum = _mm256_add_epi64(_mm256_and_si256(equal, positive), positive);
+        __m256i horizontal = _mm256_or_si256(_mm256_xor_si256(sum, positive), equal);
+        __m256i up = _mm256_or_si256(negative, _mm256_xor_si256(_mm256_or_si256(horizontal, positive), ones));
+        __m256i down = _mm256_and_si256(positive, horizontal);
+        score = _mm256_add_epi64(score, _mm256_and_si256(_mm256_srl_epi64(up, topShift), one));
+        score = _mm256_sub_epi64(score, _mm256_and_si256(_mm256_srl_epi64(down, topShift), one));
+        up = _mm256_slli_epi64(up, 1);
+        down = _mm256_slli_epi64(down, 1);
+        positive = _mm256_or_si256(down, _mm256_xor_si256(_mm256_or_si256(vertical, up), ones));
+        negative = _mm256_and_si256(up, vertical);
+
+        unsigned found = ~static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(score, limit)))) & 0xfu;
+        if (found != 0) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(scores), score);
+            while (found != 0) {
+                unsigned lane = static_cast<unsigned>(__builtin_ctz(found));
+                found &= found - 1;
+                if (step >= layout.warmup[lane]) {
+                    lanes[lane].push_back(PatternHit{layout.start[lane] + step, static_cast<int>(scores[lane])});
+                }
+            }
+        }
+    }
+    mergeLanes(lanes, hits);
+    myersScalar(pattern, text, layout.rest - pattern.context, size, layout.rest, hits);
+}
+
+#endif
+
+/**
+ * @struct Kernel
+ * @brief The scan kernels and their name.
+ */
+struct Kernel {
+    void (*shiftOr)(const Pattern&, const char*, std::size_t, std::size_t, std::vector<PatternHit>&); ///< Exact search.
+    void (*myers)(const Pattern&, const char*, std::size_t, std::size_t, std::vector<PatternHit>&); ///< Search with errors.
+    const char* name; ///< The name reported by searchKernel().
+};
+
+/**
+ * @brief Picks the widest kernels the CPU supports, once.
+ * @return The kernels.
+ */
+const Kernel& selectKernel() {
+    static const Kernel kernel = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel{shiftOrAvx2, myersAvx2, "avx2"};
+        }
+#endif
+        return Kernel{shiftOrPlain, myersPlain, "scalar"};
+    }();
+    return kernel;
+}
+
+} // namespace
+
+/**
+ * @brief Prepares the bit masks of a pattern.
+ * @param pattern The pattern, 1 to kMaxLength bases in any case.
+ * @param maxErrors The largest edit distance reported, below the pattern length.
+ */
+PatternMatcher::PatternMatcher(std::string_view pattern, int maxErrors)
+    : matches{}, reversed{}, length(pattern.size()), maxErrors(maxErrors) {
+    for (std::size_t i = 0; i < length; ++i) {
+        unsigned char letter = static_cast<unsigned char>(std::toupper(static_cast<unsigned char>(pattern[i])));
+        matches[letter] |= std::uint64_t{1} << i;
+        reversed[letter] |= std::uint64_t{1} << (length - 1 - i);
+    }
+}
+
+/**
+ * @brief Getter for the pattern length.
+ * @return The number of bases.
+ */
+std::size_t PatternMatcher::getLength() const {
+    return length;
+}
+
+/**
+ * @brief Getter for the largest edit distance reported.
+ * @return The number of errors.
+ */
+int PatternMatcher::getMaxErrors() const {
+    return maxErrors;
+}
+
+/**
+ * @brief Getter for the bases before a match's end a scan needs to see.
+ * @return The pattern length plus the errors, less one.
+ */
+std::size_t PatternMatcher::getContext() const {
+    return length + static_cast<std::size_t>(maxErrors) - 1;
+}
+
+/**
+ * @brief Finds every base of a text where a match ends.
+ * @param text The text, in uppercase.
+ * @param size The number of bases.
+ * @param skip The number of leading bases only read as context; no hit ends in them.
+ * @param hits Receives the hits in increasing order.
+ */
+void PatternMatcher::scan(const char* text, std::size_t size, std::size_t skip, std::vector<PatternHit>& hits) const {
+    if (skip >= size) {
+        return;
+    }
+    Pattern pattern{matches, static_cast<unsigned>(length - 1), getContext(), maxErrors};
+    if (maxErrors == 0) {
+        selectKernel().shiftOr(pattern, text, size, skip, hits);
+    } else {
+        selectKernel().myers(pattern, text, size, skip, hits);
+    }
+}
+
+/**
+ * @brief Finds where the shortest best match ending at a base starts.
+ *
+ * Runs Myers' algorithm backwards from the last base with the reversed
+ * pattern, anchored so every alignment ends at that base.
+ *
+ * @param text The text, in uppercase.
+ * @param last The index of the last base of the match.
+ * @return The index of the first base of the match.
+ */
+std::size_t PatternMatcher::findStart(const char* text, std::size_t last) const {
+    if (maxErrors == 0) {
+        return last + 1 - length;
+    }
+    std::size_t lowest = last - std::min(last, getContext());
+    unsigned top = static_cast<unsigned>(length - 1);
+    std::uint64_t positive = ~std::uint64_t{0};
+    std::uint64_t negative = 0;
+    int score = static_cast<int>(length);
+    int best = score;
+    std::size_t start = last + 1;
+    for (std::size_t i = last + 1; i-- > lowest;) {
+        std::uint64_t equal = reversed[static_cast<unsigned char>(text[i])];
+        std::uint64_t vertical = equal | negative;
+        std::uint64_t horizontal = (((equal & positive) + positive) ^ positive) | equal;
+        std::uint64_t up = negative | ~(horizontal | positive);
+        std::uint64_t down = positive & horizontal;
+        score += static_cast<int>((up >> top) & 1) - static_cast<int>((down >> top) & 1);
+        // Skipping text before the match costs an error, so the top row grows by one per base
+        up = (up << 1) | 1;
+        down <<= 1;
+        positive = down | ~(vertical | up);
+        negative = up & vertical;
+        if (score < best) {
+            best = score;
+            start = i;
+        }
+    }
+    return start;
+}
+
+/**
+ * @brief Checks whether a string is a valid pattern.
+ * @param pattern The string.
+ * @return True if it has 1 to kMaxLength letters drawn from A, C, G, T and U.
+ */
+bool PatternMatcher::isValid(std::string_view pattern) {
+    if (pattern.empty() || pattern.size() > kMaxLength) {
+        return false;
+    }
+    for (char c : pattern) {
+        switch (std::toupper(static_cast<unsigned char>(c))) {
+            case 'A': case 'C': case 'G': case 'T': case 'U':
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Getter for the name of the search kernel picked for this CPU.
+ * @return "avx2" or "scalar".
+ */
+const char* searchKernel() {
+    return selectKernel().name;
+}
@@ -0,0 +1,95 @@
+#ifndef PATTERN_SEARCH_H
+#define PATTERN_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct PatternHit
+ * @brief A text position where a match of the pattern ends.
+ */
+struct PatternHit {
+    std::size_t last; ///< The index of the last base of the match.
+    int errors; ///< The edit distance of the best match ending there.
+};
+
+/**
+ * @class PatternMatcher
+ * @brief Bit-parallel search for a pattern of up to 64 bases.
+ *
+ * Each pattern position is one bit of a 64-bit word. With no errors allowed
+ * the text is scanned with Shift-Or; otherwise Myers' bit-vector algorithm
+ * tracks the edit distance of the best match ending at every base. Both use
+ * an AVX2 kernel when the CPU supports one, which runs four stretches of the
+ * text side by side in the four 64-bit lanes, and fall back to scalar code
+ * otherwise. Letters are matched as they print, so 'T' and 'U' differ.
+ */
+class PatternMatcher {
+public:
+    static constexpr std::size_t kMaxLength = 64; ///< The longest pattern a word holds.
+
+    /**
+     * @brief Prepares the bit masks of a pattern.
+     * @param pattern The pattern, 1 to kMaxLength bases in any case.
+     * @param maxErrors The largest edit distance reported, below the pattern length.
+     */
+    PatternMatcher(std::string_view pattern, int maxErrors);
+
+    /**
+     * @brief Getter for the pattern length.
+     * @return The number of bases.
+     */
+    std::size_t getLength() const;
+
+    /**
+     * @brief Getter for the largest edit distance reported.
+     * @return The number of errors.
+     */
+    int getMaxErrors() const;
+
+    /**
+     * @brief Getter for the bases before a match's end a scan needs to see.
+     * @return The pattern length plus the errors, less one.
+     */
+    std::size_t getContext() const;
+
+    /**
+     * @brief Finds every base of a text where a match ends.
+     * @param text The text, in uppercase.
+     * @param size The number of bases.
+     * @param skip The number of leading bases only read as context; no hit ends in them.
+     * @param hits Receives the hits in increasing order.
+     */
+    void scan(const char* text, std::size_t size, std::size_t skip, std::vector<PatternHit>& hits) const;
+
+    /**
+     * @brief Finds where the shortest best match ending at a base starts.
+     * @param text The text, in uppercase.
+     * @param last The index of the last base of the match; getContext() bases before it must be readable if they exist.
+     * @return The index of the first base of the match.
+     */
+    std::size_t findStart(const char* text, std::size_t last) const;
+
+    /**
+     * @brief Checks whether a string is a valid pattern.
+     * @param pattern The string.
+     * @return True if it has 1 to kMaxLength letters drawn from A, C, G, T and U.
+     */
+    static bool isValid(std::string_view pattern);
+
+private:
+    std::uint64_t matches[256]; ///< Per letter, the pattern positions holding it.
+    std::uint64_t reversed[256]; ///< The same for the reversed pattern.
+    std::size_t length; ///< The number of bases.
+    int maxErrors; ///< The largest edit distance reported.
+};
+
+/**
+ * @brief Getter for the name of the search kernel picked for this CPU.
+ * @return "avx2" or "scalar".
+ */
+const char* searchKernel();
+
+#endif // PATTERN_SEARCH_H
@@ -0,0 +1,278 @@
+#include "reverse_complement.h"
+#include <array>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::uint64_t kEvenBits = 0x5555555555555555ULL; ///< Low bit of every base code.
+
+/**
+ * @brief Transcription of a single two-bit code.
+ * @param code The code of the original base.
+ * @return The code of the transcribed base.
+ */
+constexpr int transcribeCode(int code) {
+    return code == 3 ? 3 : 3 - code;
+}
+
+/**
+ * @brief Builds the table that transcribes and swaps the two codes of a nibble.
+ * @param shift Where to place the result in the byte, 0 or 4.
+ * @return The 16 entry table.
+ */
+constexpr std::array<std::uint8_t, 16> flipTable(int shift) {
+    std::array<std::uint8_t, 16> table{};
+    for (int x = 0; x < 16; ++x) {
+        table[x] = static_cast<std::uint8_t>((transcribeCode(x >> 2) | transcribeCode(x & 3) << 2) << shift);
+    }
+    return table;
+}
+
+/**
+ * @brief Builds the table flagging, in swapped order, the A codes of a nibble.
+ * @param shift Where to place the result in the nibble mask, 0 or 2.
+ * @return The 16 entry table.
+ */
+constexpr std::array<std::uint8_t, 16> adenineTable(int shift) {
+    std::array<std::uint8_t, 16> table{};
+    for (int x = 0; x < 16; ++x) {
+        table[x] = static_cast<std::uint8_t>((((x >> 2) == 0 ? 1 : 0) | ((x & 3) == 0 ? 2 : 0)) << shift);
+    }
+    return table;
+}
+
+alignas(16) constexpr std::array<std::uint8_t, 16> kFlipLow = flipTable(0);
+alignas(16) constexpr std::array<std::uint8_t, 16> kFlipHigh = flipTable(4);
+alignas(16) constexpr std::array<std::uint8_t, 16> kAdenineLow = adenineTable(0);
+alignas(16) constexpr std::array<std::uint8_t, 16> kAdenineHigh = adenineTable(2);
+
+/**
+ * @brief Gathers the even bits of a word into its low 32 bits.
+ * @param x A word with bits only in even positions.
+ * @return The gathered bits.
+ */
+std::uint64_t compressEven(std::uint64_t x) {
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+    return x;
+}
+
+/**
+ * @brief Reverses the order of the 2-bit groups of a word.
+ * @param x The word.
+ * @return The reversed word.
+ */
+std::uint64_t reverseCodes(std::uint64_t x) {
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+/**
+ * @brief Transcribes and reverses one word.
+ * @param word The original word.
+ * @param adenine Receives the reversed mask of the codes that were A.
+ * @return The transcribed word.
+ */
+std::uint64_t transcribeWord(std::uint64_t word, std::uint32_t& adenine) {
+    std::uint64_t zero = ~word & ~(word >> 1) & kEvenBits;
+    adenine = static_cast<std::uint32_t>(compressEven(reverseCodes(zero)));
+    std::uint64_t code3 = word & (word >> 1) & kEvenBits;
+    return reverseCodes(~word | code3 | (code3 << 1));
+}
+
+/**
+ * @brief Scalar kernel for the words between front and back, meeting in the middle.
+ * @param words The packed words.
+ * @param front The first word still to process.
+ * @param back One past the last word still to process.
+ * @param adenine The output masks.
+ */
+void transcribeRange(std::uint64_t* words, std::size_t front, std::size_t back, std::uint32_t* adenine) {
+    while (front < back) {
+        --back;
+        std::uint64_t first = words[front];
+        std::uint64_t last = words[back];
+        words[front] = transcribeWord(last, adenine[front]);
+        words[back] = transcribeWord(first, adenine[back]);
+        ++front;
+    }
+}
+
+/**
+ * @brief Scalar kernel.
+ * @param words The packed words.
+ * @param count The number of words.
+ * @param adenine The output masks.
+ */
+void transcribeScalar(std::uint64_t* words, std::size_t count, std::uint32_t* adenine) {
+    transcribeRange(words, 0, count, adenine);
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @brief Transcribes and reverses a 16 byte block of codes.
+ *
+ * Swapping each byte's nibbles through the tables reverses the four codes of
+ * the byte; the byte shuffle then reverses the block.
+ *
+ * @param v The block.
+ * @param mask Receives the masks of the two output words.
+ * @return The transcribed block.
+ */
+__attribute__((target("sse4.1")))
+inline __m128i transcribeBlock(__m128i v, std::uint32_t* mask) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i low = _mm_and_si128(v, nibble);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i codes = _mm_or_si128(
+        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(kFlipLow.data())), high),
+        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(kFlipHigh.data())), low));
+    __m128i zero = _mm_or_si128(
+        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(kAdenineLow.data())), high),
+        _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(kAdenineHigh.data())), low));
+
+    // Merge the 4-bit masks of neighbouring bytes, then narrow to 64 bits
+    __m128i pairs = _mm_maddubs_epi16(_mm_shuffle_epi8(zero, reverse), _mm_set1_epi16(0x1001));
+    std::uint64_t bits = static_cast<std::uint64_t>(_mm_extract_epi64(_mm_packus_epi16(pairs, pairs), 0));
+    mask[0] = static_cast<std::uint32_t>(bits);
+    mask[1] = static_cast<std::uint32_t>(bits >> 32);
+    return _mm_shuffle_epi8(codes, reverse);
+}
+
+/**
+ * @brief SSE4.1 kernel: 64 bases per shuffle from each end of the run.
+ * @param words The packed words.
+ * @param count The number of words.
+ * @param adenine The output masks.
+ */
+__attribute__((target("sse4.1")))
+void transcribeSse41(std::uint64_t* words, std::size_t count, std::uint32_t* adenine) {
+    std::size_t front = 0;
+    std::size_t back = count;
+    while (back - front >= 4) {
+        back -= 2;
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + front));
+        __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + back));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words + front), transcribeBlock(last, adenine + front));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words + back), transcribeBlock(first, adenine + back));
+        front += 2;
+    }
+    transcribeRange(words, front, back, adenine);
+}
+
+/**
+ * @brief Transcribes and reverses a 32 byte block of codes.
+ *
+ * Shuffles only work within 128-bit lanes, so the lanes are swapped after
+ * reversing each one.
+ *
+ * @param v The block.
+ * @param mask Receives the masks of the four output words.
+ * @return The transcribed block.
+ */
+__attribute__((target("avx2")))
+inline __m256i transcribeBlock(__m256i v, std::uint32_t* mask) {
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m256i low = _mm256_and_si256(v, nibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i codes = _mm256_or_si256(
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kFlipLow.data()))), high),
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kFlipHigh.data()))), low));
+    __m256i zero = _mm256_or_si256(
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kAdenineLow.data()))), high),
+        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kAdenineHigh.data()))), low));
+
+    zero = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(zero, reverse), 0x4e);
+    __m256i pairs = _mm256_maddubs_epi16(zero, _mm256_set1_epi16(0x1001));
+    __m256i packed = _mm256_packus_epi16(pairs, pairs);
+    std::uint64_t bits = static_cast<std::uint64_t>(_mm256_extract_epi64(packed, 0));
+    mask[0] = static_cast<std::uint32_t>(bits);
+    mask[1] = static_cast<std::uint32_t>(bits >> 32);
+    bits = static_cast<std::uint64_t>(_mm256_extract_epi64(packed, 2));
+    mask[2] = static_cast<std::uint32_t>(bits);
+    mask[3] = static_cast<std::uint32_t>(bits >> 32);
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(codes, reverse), 0x4e);
+}
+
+/**
+ * @brief AVX2 kernel: 128 bases per shuffle from each end of the run.
+ * @param words The packed words.
+ * @param count The number of words.
+ * @param adenine The output masks.
+ */
+__attribute__((target("avx2")))
+void transcribeAvx2(std::uint64_t* words, std::size_t count, std::uint32_t* adenine) {
+    std::size_t front = 0;
+    std::size_t back = count;
+    while (back - front >= 8) {
+        back -= 4;
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + front));
+        __m256i last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + back));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(words + front), transcribeBlock(last, adenine + front));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(words + back), transcribeBlock(first, adenine + back));
+        front += 4;
+    }
+    transcribeRange(words, front, back, adenine);
+}
+
+#endif
+
+/**
+ * @struct Kernel
+ * @brief A transcription kernel and its name.
+ */
+struct Kernel {
+    void (*run)(std::uint64_t*, std::size_t, std::uint32_t*); ///< The kernel.
+    const char* name; ///< The name reported by transcribeKernel().
+};
+
+/**
+ * @brief Picks the widest kernel the CPU supports, once.
+ * @return The kernel.
+ */
+const Kernel& selectKernel() {
+    static const Kernel kernel = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel{transcribeAvx2, "avx2"};
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return Kernel{transcribeSse41, "sse4.1"};
+        }
+#endif
+        return Kernel{transcribeScalar, "scalar"};
+    }();
+    return kernel;
+}
+
+} // namespace
+
+/**
+ * @brief Transcribes a run of packed words in place in a single pass.
+ * @param words The packed words.
+ * @param count The number of words.
+ * @param adenine Receives one mask per output word flagging the codes that were A.
+ */
+void transcribeWords(std::uint64_t* words, std::size_t count, std::uint32_t* adenine) {
+    selectKernel().run(words, count, adenine);
+}
+
+/**
+ * @brief Getter for the name of the kernel picked for this CPU.
+ * @return "avx2", "sse4.1" or "scalar".
+ */
+const char* transcribeKernel() {
+    return selectKernel().name;
+}
@@ -0,0 +1,28 @@
+#ifndef REVERSE_COMPLEMENT_H
+#define REVERSE_COMPLEMENT_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Transcribes a run of packed words in place in a single pass.
+ *
+ * Reverses the order of all 32 * count two-bit codes and maps them with the
+ * transcription table of FragmentList (A to T, C to G, G to C, T or U to U).
+ * Uses an AVX2 or SSE4.1 shuffle kernel when the CPU supports one and falls
+ * back to scalar code otherwise.
+ *
+ * @param words The packed words.
+ * @param count The number of words.
+ * @param adenine Receives one mask per output word flagging the codes that
+ *                were A, which now read as 'T' rather than 'U'.
+ */
+void transcribeWords(std::uint64_t* words, std::size_t count, std::uint32_t* adenine);
+
+/**
+ * @brief Getter for the name of the kernel picked for this CPU.
+ * @return "avx2", "sse4.1" or "scalar".
+ */
+const char* transcribeKernel();
+
+#endif // REVERSE_COMPLEMENT_H
@@ -5,18 +5,44 @@
  * ID: 0005623258
  */ 
 #include "sequence_fragment.h"
+#include <algorithm>
 #include <iostream>
+#include <utility>
 
 /**
  * @brief Constructs a new Sequence Fragment object.
  * @param type The type of sequence.
  * @param sequence The sequence string.
 */
-SequenceFragment::SequenceFragment(SequenceType type, const std::string& sequence)
-    : type(type), sequence(sequence) {}
+SequenceFragment::SequenceFragment(SequenceType type, std::string_view sequence)
+    : type(type), sequence(PackedSequence(sequence, type == SequenceType::RNA)), counts(this->sequence.countBases()) {}
 
 /**
- * @brief Getter for the sequence type (DNA, RNA, or EMPTY).
+ * @brief Constructs a new Sequence Fragment object from packed bases.
+ * @param type The type of sequence.
+ * @param sequence The packed sequence.
+*/
+SequenceFragment::SequenceFragment(SequenceType type, SequenceRope sequence)
+    : type(type), sequence(std::move(sequence)), counts(this->sequence.countBases()) {}
+
+/**
+ * @brief Constructs a new Sequence Fragment object from packed bases with known counts.
+ * @param type The type of sequence.
+ * @param sequence The packed sequence.
+ * @param counts The bases of each letter in the sequence.
+*/
+SequenceFragment::SequenceFragment(SequenceType type, SequenceRope sequence, const BaseCounts& counts)
+    : type(type), sequence(std::move(sequence)), counts(counts) {}
+
+/**
+ * @brief Constructs a new Sequence Fragment object holding a protein.
+ * @param residues The amino acids, one letter each.
+*/
+SequenceFragment::SequenceFragment(std::string residues)
+    : type(SequenceType::PROTEIN), residues(std::move(residues)) {}
+
+/**
+ * @brief Getter for the sequence type (DNA, RNA, PROTEIN, or EMPTY).
  * @return The type of sequence.
 */
 SequenceType SequenceFragment::getType() const {
@@ -24,7 +50,7 @@ SequenceType SequenceFragment::getType() const {
 }
 
 /**
- * @brief Setter for sequence type (DNA, RNA, or EMPTY).
+ * @brief Setter for sequence type (DNA, RNA, PROTEIN, or EMPTY).
  * @param newType The new type of sequence.
 */
 void SequenceFragment::setType(SequenceType newType) {
@@ -32,17 +58,197 @@ void SequenceFragment::setType(SequenceType newType) {
 }
 
 /**
- * @brief Getter for the sequence string.
+ * @brief Getter for the sequence string, unpacked from its 2-bit chunks.
  * @return The sequence string.
 */
-const std::string& SequenceFragment::getSequence() const {
-    return sequence;
+std::string SequenceFragment::getSequence() const {
+    if (type == SequenceType::PROTEIN) {
+        return residues;
+    }
+    std::string bases(sequence.size(), 'A');
+    unpack(0, bases.size(), &bases[0]);
+    return bases;
+}
+
+/**
+ * @brief Getter for the amino acids of a protein.
+ * @return The amino acids, empty unless the type is PROTEIN.
+*/
+const std::string& SequenceFragment::getResidues() const {
+    return residues;
 }
 
 /**
  * @brief Setter for the sequence string.
 */
-void SequenceFragment::setSequence(const std::string& newSequence) {
-    sequence = newSequence;
+void SequenceFragment::setSequence(std::string_view newSequence) {
+    sequence = SequenceRope(PackedSequence(newSequence, type == SequenceType::RNA));
+    counts = sequence.countBases();
+    transcribed = false;
+}
+
+/**
+ * @brief Getter for the rope holding the packed sequence.
+ * @return The rope.
+*/
+const SequenceRope& SequenceFragment::getRope() const {
+    return sequence;
+}
+
+/**
+ * @brief Checks whether the rope holds the DNA the sequence was transcribed from.
+ * @return True if the bases read back reversed and complemented.
+*/
+bool SequenceFragment::isTranscribed() const {
+    return transcribed;
+}
+
+/**
+ * @brief Transcribes DNA to RNA in O(1) by reading the same bases back reversed and complemented.
+ *
+ * No base is touched: readers map positions onto the stored bases, and
+ * clip and swap split the rope at the mirrored indices.
+*/
+void SequenceFragment::transcribe() {
+    type = SequenceType::RNA;
+    counts = counts.transcribed();
+    transcribed = true;
+}
+
+/**
+ * @brief Rewrites the bases as they read, so the rope holds the RNA itself.
+ *
+ * Needed before a tail moves between a transcribed fragment and one that is not.
+*/
+void SequenceFragment::materialize() {
+    if (!transcribed) {
+        return;
+    }
+    sequence.transcribe();
+    transcribed = false;
+}
+
+/**
+ * @brief Unpacks a range of the sequence as it prints.
+ * @param pos The index of the first base.
+ * @param count The number of bases, within the sequence.
+ * @param out Receives count letters.
+*/
+void SequenceFragment::unpack(std::size_t pos, std::size_t count, char* out) const {
+    if (!transcribed) {
+        sequence.substr(pos, count).unpack(out);
+        return;
+    }
+    // Reverse and complement the packed words with the transcription kernel,
+    // which also flags the A's that read as 'T', then unpack them as usual
+    PackedSequence packed = sequence.substr(stored(pos, count), count).flatten();
+    packed.transcribe();
+    packed.unpack(0, count, out);
+}
+
+/**
+ * @brief Counts the bases of each letter in a range of the sequence as it prints.
+ * @param pos The index of the first base.
+ * @param count The number of bases, within the sequence.
+ * @return The counts.
+*/
+BaseCounts SequenceFragment::countBases(std::size_t pos, std::size_t count) const {
+    if (!transcribed) {
+        return sequence.substr(pos, count).countBases();
+    }
+    return sequence.substr(stored(pos, count), count).countBases().transcribed();
+}
+
+/**
+ * @brief Gathers the sequence as it prints into a single packed sequence.
+ * @return The packed bases.
+*/
+PackedSequence SequenceFragment::flatten() const {
+    PackedSequence packed = sequence.flatten();
+    if (transcribed) {
+        packed.transcribe();
+    }
+    return packed;
+}
+
+/**
+ * @brief Shares the bases from an index to the end, as stored.
+ * @param start The index of the first base.
+ * @return The rope of the tail.
+*/
+SequenceRope SequenceFragment::tail(std::size_t start) const {
+    return transcribed ? sequence.substr(0, sequence.size() - std::min(start, sequence.size())) : sequence.substr(start);
+}
+
+/**
+ * @brief Drops every base from a given index onwards in O(log n).
+ * @param count The number of bases to keep.
+*/
+void SequenceFragment::truncate(std::size_t count) {
+    if (transcribed) {
+        sequence.erasePrefix(sequence.size() - std::min(count, sequence.size()));
+    } else {
+        sequence.truncate(count);
+    }
+}
+
+/**
+ * @brief Drops bases from the front of the sequence in O(log n).
+ * @param count The number of bases to drop.
+*/
+void SequenceFragment::erasePrefix(std::size_t count) {
+    if (transcribed) {
+        sequence.truncate(sequence.size() - count);
+    } else {
+        sequence.erasePrefix(count);
+    }
 }
 
+/**
+ * @brief Appends a tail taken from a fragment of the same orientation in O(log n).
+ * @param other The tail, as stored.
+*/
+void SequenceFragment::append(const SequenceRope& other) {
+    if (!transcribed) {
+        sequence.append(other);
+        return;
+    }
+    // The end of the sequence as it reads is the front of the stored bases
+    SequenceRope joined = other;
+    joined.append(sequence);
+    sequence = std::move(joined);
+}
+
+/**
+ * @brief Getter for the number of bases, or of amino acids for a protein.
+ * @return The length of the sequence.
+*/
+std::size_t SequenceFragment::getLength() const {
+    return type == SequenceType::PROTEIN ? residues.size() : sequence.size();
+}
+
+/**
+ * @brief Getter for the bases of each letter.
+ * @return The counts, kept up to date by whoever edits the rope.
+*/
+const BaseCounts& SequenceFragment::getCounts() const {
+    return counts;
+}
+
+/**
+ * @brief Setter for the bases of each letter, after an edit of the rope.
+ * @param newCounts The counts of the edited sequence.
+*/
+void SequenceFragment::setCounts(const BaseCounts& newCounts) {
+    counts = newCounts;
+}
+
+/**
+ * @brief Maps a range of the sequence as it prints to the same bases as stored.
+ * @param pos The index of the first base.
+ * @param count The number of bases.
+ * @return The index of the first stored base.
+*/
+std::size_t SequenceFragment::stored(std::size_t pos, std::size_t count) const {
+    return sequence.size() - pos - count;
+}
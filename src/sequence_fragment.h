@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include "sequence_rope.h"
 
 /**
  * @enum SequenceType
@@ -11,12 +13,19 @@
 enum class SequenceType {
     DNA,   ///< Represents a DNA sequence.
     RNA,   ///< Represents an RNA sequence.
+    PROTEIN, ///< Represents a protein, one letter per amino acid.
     EMPTY  ///< Represents an empty sequence.
 };
 
 /**
  * @class SequenceFragment
  * @brief Class representing a sequence fragment.
+ *
+ * Transcription is lazy: the rope keeps the DNA the RNA was transcribed
+ * from, and the bases are read back reversed and complemented. Positions
+ * given to the view accessors are positions of the sequence as it prints;
+ * ropes they take or return hold bases as stored, so they only move
+ * between fragments that are both transcribed or both not.
  */
 class SequenceFragment {
 public:
@@ -25,7 +34,28 @@ public:
      * @param type The type of the sequence.
      * @param sequence The sequence string.
      */
-    SequenceFragment(SequenceType type, const std::string& sequence);
+    SequenceFragment(SequenceType type, std::string_view sequence);
+
+    /**
+     * @brief Constructor that takes over already packed bases.
+     * @param type The type of the sequence.
+     * @param sequence The packed sequence.
+     */
+    SequenceFragment(SequenceType type, SequenceRope sequence);
+
+    /**
+     * @brief Constructor that takes over packed bases whose counts are already known.
+     * @param type The type of the sequence.
+     * @param sequence The packed sequence.
+     * @param counts The bases of each letter in the sequence.
+     */
+    SequenceFragment(SequenceType type, SequenceRope sequence, const BaseCounts& counts);
+
+    /**
+     * @brief Constructor that initializes a protein.
+     * @param residues The amino acids, one letter each.
+     */
+    explicit SequenceFragment(std::string residues);
 
     /**
      * @brief Getter for the sequence type.
@@ -40,20 +70,124 @@ public:
     void setType(SequenceType newType);
 
     /**
-     * @brief Getter for the sequence string.
-     * @return The sequence string.
+     * @brief Getter for the amino acids of a protein.
+     * @return The amino acids, empty unless the type is PROTEIN.
      */
-    const std::string& getSequence() const;
+    const std::string& getResidues() const;
+
+    /**
+     * @brief Getter for the sequence string, unpacked from its 2-bit chunks.
+     * @return The sequence string, as it prints.
+     */
+    std::string getSequence() const;
 
     /**
      * @brief Setter for the sequence string.
      * @param newSequence The new sequence string.
      */
-    void setSequence(const std::string& newSequence);
+    void setSequence(std::string_view newSequence);
+
+    /**
+     * @brief Getter for the rope holding the packed sequence.
+     * @return The rope, as stored: reversed and uncomplemented while isTranscribed().
+     */
+    const SequenceRope& getRope() const;
+
+    /**
+     * @brief Checks whether the rope holds the DNA the sequence was transcribed from.
+     * @return True if the bases read back reversed and complemented.
+     */
+    bool isTranscribed() const;
+
+    /**
+     * @brief Transcribes DNA to RNA in O(1) by reading the same bases back reversed and complemented.
+     */
+    void transcribe();
+
+    /**
+     * @brief Rewrites the bases as they read, so the rope holds the RNA itself.
+     */
+    void materialize();
+
+    /**
+     * @brief Unpacks a range of the sequence as it prints.
+     * @param pos The index of the first base.
+     * @param count The number of bases, within the sequence.
+     * @param out Receives count letters.
+     */
+    void unpack(std::size_t pos, std::size_t count, char* out) const;
+
+    /**
+     * @brief Counts the bases of each letter in a range of the sequence as it prints.
+     * @param pos The index of the first base.
+     * @param count The number of bases, within the sequence.
+     * @return The counts.
+     */
+    BaseCounts countBases(std::size_t pos, std::size_t count) const;
+
+    /**
+     * @brief Gathers the sequence as it prints into a single packed sequence.
+     * @return The packed bases.
+     */
+    PackedSequence flatten() const;
+
+    /**
+     * @brief Shares the bases from an index to the end, as stored.
+     * @param start The index of the first base.
+     * @return The rope of the tail.
+     */
+    SequenceRope tail(std::size_t start) const;
+
+    /**
+     * @brief Drops every base from a given index onwards in O(log n).
+     * @param count The number of bases to keep.
+     */
+    void truncate(std::size_t count);
+
+    /**
+     * @brief Drops bases from the front of the sequence in O(log n).
+     * @param count The number of bases to drop.
+     */
+    void erasePrefix(std::size_t count);
+
+    /**
+     * @brief Appends a tail taken from a fragment of the same orientation in O(log n).
+     * @param other The tail, as stored.
+     */
+    void append(const SequenceRope& other);
+
+    /**
+     * @brief Getter for the number of bases, or of amino acids for a protein.
+     * @return The length of the sequence.
+     */
+    std::size_t getLength() const;
+
+    /**
+     * @brief Getter for the bases of each letter.
+     * @return The counts, kept up to date by whoever edits the rope.
+     */
+    const BaseCounts& getCounts() const;
+
+    /**
+     * @brief Setter for the bases of each letter, after an edit of the rope.
+     * @param newCounts The counts of the edited sequence.
+     */
+    void setCounts(const BaseCounts& newCounts);
 
 private:
     SequenceType type; ///< The type of the sequence.
-    std::string sequence; ///< The sequence string.
+    SequenceRope sequence; ///< The sequence as slices of shared 2-bit chunks, empty for a protein.
+    std::string residues; ///< The amino acids of a protein; they do not fit in 2-bit codes.
+    BaseCounts counts; ///< The bases of each letter, so statistics never scan the sequence.
+    bool transcribed = false; ///< True if the rope holds the DNA the sequence was transcribed from.
+
+    /**
+     * @brief Maps a range of the sequence as it prints to the same bases as stored.
+     * @param pos The index of the first base.
+     * @param count The number of bases.
+     * @return The index of the first stored base.
+     */
+    std::size_t stored(std::size_t pos, std::size_t count) const;
 };
 
 
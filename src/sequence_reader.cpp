@@ -0,0 +1,256 @@
+#include "sequence_reader.h"
+#include "sequence_validator.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::size_t kStageSize = 64 << 10; ///< The number of bases packed at a time.
+
+} // namespace
+
+/**
+ * @brief Opens a file for reading.
+ * @param path The path of the file.
+ */
+SequenceReader::SequenceReader(const std::string& path)
+    : fd(::open(path.c_str(), O_RDONLY)), buffer(new char[kChunkSize]), begin(0), end(0), marker(0),
+      length(0), valid(true), invalidCharacter(0), invalidOffset(0) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+}
+
+/**
+ * @brief Closes the file.
+ */
+SequenceReader::~SequenceReader() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+/**
+ * @brief Checks whether the file was opened.
+ * @return True if records can be read.
+ */
+bool SequenceReader::isOpen() const {
+    return fd >= 0;
+}
+
+/**
+ * @brief Reads the next record.
+ * @param type The type the bases are validated and packed as.
+ * @param sequence Receives the packed bases of a valid record.
+ * @return The outcome.
+ */
+SequenceReader::Status SequenceReader::next(SequenceType type, PackedSequence& sequence) {
+    // Skip blank lines between records
+    int c = peek();
+    while (c == '\n' || c == '\r') {
+        ++begin;
+        c = peek();
+    }
+    if (c < 0) {
+        return Status::END;
+    }
+    if (marker == 0 && (c == '>' || c == '@')) {
+        marker = static_cast<char>(c);
+    }
+    if (c != marker) {
+        return Status::MALFORMED;
+    }
+
+    // The name is the first word of the header line
+    ++begin;
+    readLine(&name);
+    name.erase(std::min(name.size(), name.find_first_of(" \t")));
+
+    sequence = PackedSequence(std::string_view(), type == SequenceType::RNA);
+    staging.clear();
+    length = 0;
+    valid = true;
+    while (true) {
+        c = peek();
+        if (marker == '>' && (c < 0 || c == '>')) {
+            break;
+        }
+        if (marker == '@') {
+            if (c < 0) {
+                return Status::MALFORMED;
+            }
+            if (c == '+') {
+                readLine(nullptr);
+                if (!skipQuality()) {
+                    return Status::MALFORMED;
+                }
+                break;
+            }
+        }
+        readBases(type, sequence);
+    }
+    if (valid && !staging.empty()) {
+        packStage(type, sequence);
+    }
+    return valid ? Status::RECORD : Status::INVALID;
+}
+
+/**
+ * @brief Getter for the name of the last record read.
+ * @return The first word of its header line.
+ */
+std::string_view SequenceReader::getName() const {
+    return name;
+}
+
+/**
+ * @brief Getter for the character that made the last record invalid.
+ * @return The character.
+ */
+char SequenceReader::getInvalidCharacter() const {
+    return invalidCharacter;
+}
+
+/**
+ * @brief Getter for where the last record became invalid.
+ * @return The offset of the character among the record's bases.
+ */
+std::size_t SequenceReader::getInvalidOffset() const {
+    return invalidOffset;
+}
+
+/**
+ * @brief Reads the next chunk once the current one is parsed.
+ * @return The next byte, or -1 at the end of the file.
+ */
+int SequenceReader::peek() {
+    if (begin == end) {
+        ssize_t count;
+        do {
+            count = ::read(fd, buffer.get(), kChunkSize);
+        } while (count < 0 && errno == EINTR);
+        begin = 0;
+        end = count > 0 ? static_cast<std::size_t>(count) : 0;
+        if (end == 0) {
+            return -1;
+        }
+    }
+    return static_cast<unsigned char>(buffer[begin]);
+}
+
+/**
+ * @brief Reads the rest of a line.
+ * @param line Receives the line without its line break, unless null.
+ * @return False if the file ended before any character.
+ */
+bool SequenceReader::readLine(std::string* line) {
+    if (line) {
+        line->clear();
+    }
+    if (peek() < 0) {
+        return false;
+    }
+    while (peek() >= 0) {
+        const char* start = buffer.get() + begin;
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', end - begin));
+        std::size_t count = newline ? static_cast<std::size_t>(newline - start) : end - begin;
+        if (line) {
+            line->append(start, count);
+        }
+        begin += count;
+        if (newline) {
+            ++begin;
+            break;
+        }
+    }
+    if (line && !line->empty() && line->back() == '\r') {
+        line->pop_back();
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a line of bases into the record.
+ * @param type The type the bases are validated as.
+ * @param sequence The record's packed bases.
+ */
+void SequenceReader::readBases(SequenceType type, PackedSequence& sequence) {
+    // Lines may be longer than a chunk, so bases are taken a chunk at a time
+    while (peek() >= 0) {
+        const char* start = buffer.get() + begin;
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', end - begin));
+        std::size_t count = newline ? static_cast<std::size_t>(newline - start) : end - begin;
+        std::size_t bases = count;
+        while (bases != 0 && start[bases - 1] == '\r') {
+            --bases;
+        }
+        addBases(start, bases, type, sequence);
+        begin += count;
+        if (newline) {
+            ++begin;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Stages bases of the record.
+ * @param data The bases.
+ * @param size The number of bases.
+ * @param type The type the bases are validated as.
+ * @param sequence The record's packed bases, appended to when the stage fills.
+ */
+void SequenceReader::addBases(const char* data, std::size_t size, SequenceType type, PackedSequence& sequence) {
+    length += size;
+    if (!valid) {
+        return;
+    }
+    staging.append(data, size);
+    if (staging.size() >= kStageSize) {
+        packStage(type, sequence);
+    }
+}
+
+/**
+ * @brief Validates the staged bases and appends them to the record.
+ * @param type The type the bases are validated as.
+ * @param sequence The record's packed bases.
+ */
+void SequenceReader::packStage(SequenceType type, PackedSequence& sequence) {
+    // Validating whole stages rather than lines keeps the SIMD check on long runs
+    std::size_t offset = findInvalidBase(staging.data(), staging.size(), type);
+    if (offset != staging.size()) {
+        valid = false;
+        invalidCharacter = staging[offset];
+        invalidOffset = length - staging.size() + offset;
+    } else {
+        sequence.append(PackedSequence(staging, type == SequenceType::RNA));
+    }
+    staging.clear();
+}
+
+/**
+ * @brief Skips a FASTQ record's quality letters.
+ * @return False if the file ended first.
+ */
+bool SequenceReader::skipQuality() {
+    // There is one quality letter per base, possibly over several lines
+    std::size_t left = length;
+    while (left != 0) {
+        int c = peek();
+        if (c < 0) {
+            return false;
+        }
+        ++begin;
+        if (c != '\n' && c != '\r') {
+            --left;
+        }
+    }
+    readLine(nullptr);
+    return true;
+}
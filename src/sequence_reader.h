@@ -0,0 +1,136 @@
+#ifndef SEQUENCE_READER_H
+#define SEQUENCE_READER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "packed_sequence.h"
+#include "sequence_fragment.h"
+
+/**
+ * @class SequenceReader
+ * @brief Streams FASTA or FASTQ records from a file, validating and packing bases as they are read.
+ *
+ * The file is read in fixed-size chunks, so records and lines of any length
+ * are handled without holding more than one chunk and the packed record.
+ * The format is taken from the first record: '>' for FASTA, '@' for FASTQ.
+ */
+class SequenceReader {
+public:
+    /**
+     * @enum Status
+     * @brief The outcome of reading a record.
+     */
+    enum class Status {
+        RECORD,     ///< A record was read.
+        INVALID,    ///< A record was read but holds a character that is not a base.
+        END,        ///< There are no more records.
+        MALFORMED   ///< The file is not FASTA or FASTQ, or a record is cut short.
+    };
+
+    static constexpr std::size_t kChunkSize = 1 << 20; ///< The number of bytes read at a time.
+
+    /**
+     * @brief Opens a file for reading.
+     * @param path The path of the file.
+     */
+    explicit SequenceReader(const std::string& path);
+
+    /**
+     * @brief Closes the file.
+     */
+    ~SequenceReader();
+
+    SequenceReader(const SequenceReader&) = delete;
+    SequenceReader& operator=(const SequenceReader&) = delete;
+
+    /**
+     * @brief Checks whether the file was opened.
+     * @return True if records can be read.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Reads the next record.
+     * @param type The type the bases are validated and packed as.
+     * @param sequence Receives the packed bases of a valid record.
+     * @return The outcome.
+     */
+    Status next(SequenceType type, PackedSequence& sequence);
+
+    /**
+     * @brief Getter for the name of the last record read.
+     * @return The first word of its header line.
+     */
+    std::string_view getName() const;
+
+    /**
+     * @brief Getter for the character that made the last record invalid.
+     * @return The character.
+     */
+    char getInvalidCharacter() const;
+
+    /**
+     * @brief Getter for where the last record became invalid.
+     * @return The offset of the character among the record's bases.
+     */
+    std::size_t getInvalidOffset() const;
+
+private:
+    int fd; ///< The file, -1 if it could not be opened.
+    std::unique_ptr<char[]> buffer; ///< The chunk being parsed.
+    std::size_t begin; ///< The next unparsed byte of the chunk.
+    std::size_t end; ///< The end of the chunk.
+    char marker; ///< The first character of a header line, 0 until the format is known.
+    std::string name; ///< The header of the last record.
+    std::string staging; ///< Bases waiting to be validated and packed.
+    std::size_t length; ///< The number of bases of the record so far.
+    bool valid; ///< False once the record holds an invalid character.
+    char invalidCharacter; ///< The invalid character.
+    std::size_t invalidOffset; ///< The offset of the invalid character.
+
+    /**
+     * @brief Reads the next chunk once the current one is parsed.
+     * @return The next byte, or -1 at the end of the file.
+     */
+    int peek();
+
+    /**
+     * @brief Reads the rest of a line.
+     * @param line Receives the line without its line break, unless null.
+     * @return False if the file ended before any character.
+     */
+    bool readLine(std::string* line);
+
+    /**
+     * @brief Reads a line of bases into the record.
+     * @param type The type the bases are validated as.
+     * @param sequence The record's packed bases.
+     */
+    void readBases(SequenceType type, PackedSequence& sequence);
+
+    /**
+     * @brief Stages bases of the record.
+     * @param data The bases.
+     * @param size The number of bases.
+     * @param type The type the bases are validated as.
+     * @param sequence The record's packed bases, appended to when the stage fills.
+     */
+    void addBases(const char* data, std::size_t size, SequenceType type, PackedSequence& sequence);
+
+    /**
+     * @brief Validates the staged bases and appends them to the record.
+     * @param type The type the bases are validated as.
+     * @param sequence The record's packed bases.
+     */
+    void packStage(SequenceType type, PackedSequence& sequence);
+
+    /**
+     * @brief Skips a FASTQ record's quality letters.
+     * @return False if the file ended first.
+     */
+    bool skipQuality();
+};
+
+#endif // SEQUENCE_READER_H
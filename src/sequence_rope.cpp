@@ -0,0 +1,341 @@
+#include "sequence_rope.h"
+#include "memory_pool.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/**
+ * @struct SequenceRope::Node
+ * @brief A leaf slice of a chunk, or the join of two subtrees.
+ */
+struct SequenceRope::Node {
+    NodePtr left; ///< The left subtree, null for a leaf.
+    NodePtr right; ///< The right subtree, null for a leaf.
+    std::shared_ptr<const PackedSequence> chunk; ///< The chunk a leaf slices, null for an inner node.
+    std::size_t offset; ///< The first base of a leaf's slice in its chunk.
+    std::size_t length; ///< The number of bases under the node.
+    int height; ///< 1 for a leaf, one more than the taller child otherwise.
+};
+
+namespace {
+
+using Node = SequenceRope::Node;
+using NodePtr = std::shared_ptr<const Node>;
+
+/// Neighbouring leaves shorter than this together are merged into one chunk,
+/// so repeated edits do not leave a trail of tiny slices.
+constexpr std::size_t kMergeLength = 256;
+
+/**
+ * @brief Builds a shared object in the fragment pool, which nodes and chunks churn through on every edit.
+ * @param args The constructor arguments.
+ * @return The object.
+ */
+template <typename T, typename... Args>
+std::shared_ptr<const T> makePooled(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T, fragmentPool>(), std::forward<Args>(args)...);
+}
+
+/**
+ * @brief Height of a possibly empty tree.
+ * @param node The tree.
+ * @return The height, 0 when empty.
+ */
+int height(const NodePtr& node) {
+    return node ? node->height : 0;
+}
+
+/**
+ * @brief Builds a leaf over a slice of a chunk.
+ * @param chunk The chunk.
+ * @param offset The first base of the slice.
+ * @param length The number of bases.
+ * @return The leaf.
+ */
+NodePtr makeLeaf(std::shared_ptr<const PackedSequence> chunk, std::size_t offset, std::size_t length) {
+    return makePooled<Node>(Node{nullptr, nullptr, std::move(chunk), offset, length, 1});
+}
+
+/**
+ * @brief Builds an inner node over two non-empty subtrees.
+ * @param left The left subtree.
+ * @param right The right subtree.
+ * @return The node.
+ */
+NodePtr makeNode(NodePtr left, NodePtr right) {
+    std::size_t length = left->length + right->length;
+    int h = std::max(left->height, right->height) + 1;
+    return makePooled<Node>(Node{std::move(left), std::move(right), nullptr, 0, length, h});
+}
+
+/**
+ * @brief Joins two subtrees whose heights differ by at most two, rotating if needed.
+ * @param left The left subtree.
+ * @param right The right subtree.
+ * @return The balanced tree.
+ */
+NodePtr balance(NodePtr left, NodePtr right) {
+    if (left->height > right->height + 1) {
+        if (height(left->left) >= height(left->right)) {
+            return makeNode(left->left, makeNode(left->right, std::move(right)));
+        }
+        const NodePtr& pivot = left->right;
+        return makeNode(makeNode(left->left, pivot->left), makeNode(pivot->right, std::move(right)));
+    }
+    if (right->height > left->height + 1) {
+        if (height(right->right) >= height(right->left)) {
+            return makeNode(makeNode(std::move(left), right->left), right->right);
+        }
+        const NodePtr& pivot = right->left;
+        return makeNode(makeNode(std::move(left), pivot->left), makeNode(pivot->right, right->right));
+    }
+    return makeNode(std::move(left), std::move(right));
+}
+
+/**
+ * @brief Concatenates two trees in O(height difference).
+ * @param left The left tree, possibly empty.
+ * @param right The right tree, possibly empty.
+ * @return The joined tree.
+ */
+NodePtr join(NodePtr left, NodePtr right) {
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+    if (left->height == 1 && right->height == 1 && left->length + right->length < kMergeLength) {
+        PackedSequence merged = left->chunk->substr(left->offset, left->length);
+        merged.append(*right->chunk, right->offset, right->length);
+        std::size_t length = merged.size();
+        return makeLeaf(makePooled<PackedSequence>(std::move(merged)), 0, length);
+    }
+    if (left->height > right->height + 1) {
+        return balance(left->left, join(left->right, std::move(right)));
+    }
+    if (right->height > left->height + 1) {
+        return balance(join(std::move(left), right->left), right->right);
+    }
+    return makeNode(std::move(left), std::move(right));
+}
+
+/**
+ * @brief Splits a tree in O(log n) into the first index bases and the rest.
+ * @param node The tree.
+ * @param index The number of bases that go left.
+ * @return The two trees, either possibly empty.
+ */
+std::pair<NodePtr, NodePtr> split(const NodePtr& node, std::size_t index) {
+    if (!node || index == 0) {
+        return {nullptr, node};
+    }
+    if (index >= node->length) {
+        return {node, nullptr};
+    }
+    if (node->height == 1) {
+        return {makeLeaf(node->chunk, node->offset, index),
+                makeLeaf(node->chunk, node->offset + index, node->length - index)};
+    }
+    std::size_t leftLength = node->left->length;
+    if (index < leftLength) {
+        std::pair<NodePtr, NodePtr> parts = split(node->left, index);
+        return {std::move(parts.first), join(std::move(parts.second), node->right)};
+    }
+    if (index == leftLength) {
+        return {node->left, node->right};
+    }
+    std::pair<NodePtr, NodePtr> parts = split(node->right, index - leftLength);
+    return {join(node->left, std::move(parts.first)), std::move(parts.second)};
+}
+
+/**
+ * @brief Visits the leaves of a tree from left to right.
+ * @param node The tree.
+ * @param visit Called with each leaf.
+ */
+template <typename Visitor>
+void forEachLeaf(const NodePtr& node, Visitor visit) {
+    std::vector<const Node*> stack;
+    if (node) {
+        stack.push_back(node.get());
+    }
+    while (!stack.empty()) {
+        const Node* current = stack.back();
+        stack.pop_back();
+        if (current->height == 1) {
+            visit(*current);
+        } else {
+            stack.push_back(current->right.get());
+            stack.push_back(current->left.get());
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Constructs an empty rope.
+ */
+SequenceRope::SequenceRope() = default;
+
+/**
+ * @brief Constructs a rope holding a single chunk.
+ * @param sequence The packed bases.
+ */
+SequenceRope::SequenceRope(PackedSequence sequence) {
+    if (!sequence.empty()) {
+        std::size_t length = sequence.size();
+        root = makeLeaf(makePooled<PackedSequence>(std::move(sequence)), 0, length);
+    }
+}
+
+/**
+ * @brief Constructs a rope from a tree.
+ * @param root The root of the tree.
+ */
+SequenceRope::SequenceRope(NodePtr root)
+    : root(std::move(root)) {}
+
+/**
+ * @brief Getter for the number of bases.
+ * @return The number of bases.
+ */
+std::size_t SequenceRope::size() const {
+    return root ? root->length : 0;
+}
+
+/**
+ * @brief Checks whether the rope holds no bases.
+ * @return True if the rope is empty.
+ */
+bool SequenceRope::empty() const {
+    return !root;
+}
+
+/**
+ * @brief Getter for the letter of a single base.
+ * @param index The index of the base.
+ * @return The base letter.
+ */
+char SequenceRope::at(std::size_t index) const {
+    const Node* node = root.get();
+    while (node->height > 1) {
+        if (index < node->left->length) {
+            node = node->left.get();
+        } else {
+            index -= node->left->length;
+            node = node->right.get();
+        }
+    }
+    return node->chunk->at(node->offset + index);
+}
+
+/**
+ * @brief Unpacks the rope into one character per base.
+ * @return The sequence string.
+ */
+std::string SequenceRope::str() const {
+    std::string result(size(), 'A');
+    unpack(&result[0]);
+    return result;
+}
+
+/**
+ * @brief Unpacks the rope into a caller's buffer.
+ * @param out Receives size() letters.
+ */
+void SequenceRope::unpack(char* out) const {
+    forEachLeaf(root, [&](const Node& leaf) {
+        leaf.chunk->unpack(leaf.offset, leaf.length, out);
+        out += leaf.length;
+    });
+}
+
+/**
+ * @brief Counts the bases of each letter, a chunk slice at a time.
+ * @return The counts.
+ */
+BaseCounts SequenceRope::countBases() const {
+    BaseCounts counts;
+    forEachLeaf(root, [&](const Node& leaf) {
+        counts += leaf.chunk->countBases(leaf.offset, leaf.length);
+    });
+    return counts;
+}
+
+/**
+ * @brief Gathers the rope into a single packed sequence.
+ * @return The packed bases.
+ */
+PackedSequence SequenceRope::flatten() const {
+    if (root && root->height == 1) {
+        return root->chunk->substr(root->offset, root->length);
+    }
+    PackedSequence result;
+    bool first = true;
+    forEachLeaf(root, [&](const Node& leaf) {
+        if (first) {
+            // Take the spelling of code 3 from the first chunk
+            result = leaf.chunk->substr(leaf.offset, leaf.length);
+            first = false;
+        } else {
+            result.append(*leaf.chunk, leaf.offset, leaf.length);
+        }
+    });
+    return result;
+}
+
+/**
+ * @brief Shares a range of bases as a new rope in O(log n).
+ * @param pos The index of the first base.
+ * @param count The number of bases, clamped to the end of the rope.
+ * @return The rope of the range.
+ */
+SequenceRope SequenceRope::substr(std::size_t pos, std::size_t count) const {
+    NodePtr tail = split(root, pos).second;
+    return SequenceRope(split(tail, count).first);
+}
+
+/**
+ * @brief Appends another rope in O(log n), sharing its chunks.
+ * @param other The rope to append.
+ */
+void SequenceRope::append(const SequenceRope& other) {
+    root = join(std::move(root), other.root);
+}
+
+/**
+ * @brief Drops every base from a given index onwards in O(log n).
+ * @param count The number of bases to keep.
+ */
+void SequenceRope::truncate(std::size_t count) {
+    root = split(root, count).first;
+}
+
+/**
+ * @brief Drops bases from the front of the rope in O(log n).
+ * @param count The number of bases to drop.
+ */
+void SequenceRope::erasePrefix(std::size_t count) {
+    root = split(root, count).second;
+}
+
+/**
+ * @brief Complements and reverses the rope into a single new chunk.
+ */
+void SequenceRope::transcribe() {
+    PackedSequence sequence = flatten();
+    sequence.transcribe();
+    *this = SequenceRope(std::move(sequence));
+}
+
+/**
+ * @brief Getter for the number of chunk slices in the rope.
+ * @return The number of leaves.
+ */
+std::size_t SequenceRope::leafCount() const {
+    std::size_t count = 0;
+    forEachLeaf(root, [&](const Node&) { ++count; });
+    return count;
+}
@@ -0,0 +1,125 @@
+#ifndef SEQUENCE_ROPE_H
+#define SEQUENCE_ROPE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "packed_sequence.h"
+
+/**
+ * @class SequenceRope
+ * @brief Sequence built from slices of shared, immutable packed chunks.
+ *
+ * The slices are the leaves of a persistent height balanced tree, so
+ * splitting and joining touch O(log n) nodes and never copy bases. Nodes and
+ * chunks are never modified once built, which lets any number of ropes share
+ * them. Bases are only gathered into one buffer when flattened.
+ */
+class SequenceRope {
+public:
+    /**
+     * @brief Constructs an empty rope.
+     */
+    SequenceRope();
+
+    /**
+     * @brief Constructs a rope holding a single chunk.
+     * @param sequence The packed bases.
+     */
+    explicit SequenceRope(PackedSequence sequence);
+
+    /**
+     * @brief Getter for the number of bases.
+     * @return The number of bases.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Checks whether the rope holds no bases.
+     * @return True if the rope is empty.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Getter for the letter of a single base.
+     * @param index The index of the base.
+     * @return The base letter.
+     */
+    char at(std::size_t index) const;
+
+    /**
+     * @brief Unpacks the rope into one character per base.
+     * @return The sequence string.
+     */
+    std::string str() const;
+
+    /**
+     * @brief Unpacks the rope into a caller's buffer.
+     * @param out Receives size() letters.
+     */
+    void unpack(char* out) const;
+
+    /**
+     * @brief Counts the bases of each letter, a chunk slice at a time.
+     * @return The counts.
+     */
+    BaseCounts countBases() const;
+
+    /**
+     * @brief Gathers the rope into a single packed sequence.
+     * @return The packed bases.
+     */
+    PackedSequence flatten() const;
+
+    /**
+     * @brief Shares a range of bases as a new rope in O(log n).
+     * @param pos The index of the first base.
+     * @param count The number of bases, clamped to the end of the rope.
+     * @return The rope of the range.
+     */
+    SequenceRope substr(std::size_t pos, std::size_t count = PackedSequence::npos) const;
+
+    /**
+     * @brief Appends another rope in O(log n), sharing its chunks.
+     * @param other The rope to append.
+     */
+    void append(const SequenceRope& other);
+
+    /**
+     * @brief Drops every base from a given index onwards in O(log n).
+     * @param count The number of bases to keep.
+     */
+    void truncate(std::size_t count);
+
+    /**
+     * @brief Drops bases from the front of the rope in O(log n).
+     * @param count The number of bases to drop.
+     */
+    void erasePrefix(std::size_t count);
+
+    /**
+     * @brief Complements and reverses the rope into a single new chunk.
+     */
+    void transcribe();
+
+    /**
+     * @brief Getter for the number of chunk slices in the rope.
+     * @return The number of leaves.
+     */
+    std::size_t leafCount() const;
+
+    struct Node; ///< A tree node, defined in sequence_rope.cpp.
+
+private:
+    using NodePtr = std::shared_ptr<const Node>; ///< Nodes are shared and never modified.
+
+    NodePtr root; ///< The root of the tree, null when empty.
+
+    /**
+     * @brief Constructs a rope from a tree.
+     * @param root The root of the tree.
+     */
+    explicit SequenceRope(NodePtr root);
+};
+
+#endif // SEQUENCE_ROPE_H
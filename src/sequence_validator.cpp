@@ -0,0 +1,148 @@
+#include "sequence_validator.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Scalar check of a range, folding case by setting bit 5.
+ * @param data The characters to check.
+ * @param offset The offset to start from.
+ * @param size The number of characters.
+ * @param fourth The fourth base in lowercase, 't' or 'u'.
+ * @return The offset of the first invalid character, or size.
+ */
+std::size_t findInvalidScalar(const char* data, std::size_t offset, std::size_t size, char fourth) {
+    for (; offset < size; ++offset) {
+        char c = static_cast<char>(data[offset] | 0x20);
+        if (c != 'a' && c != 'c' && c != 'g' && c != fourth) {
+            return offset;
+        }
+    }
+    return size;
+}
+
+#if !defined(__x86_64__)
+
+/**
+ * @brief Scalar kernel.
+ * @param data The characters to check.
+ * @param size The number of characters.
+ * @param fourth The fourth base in lowercase.
+ * @return The offset of the first invalid character, or size.
+ */
+std::size_t validateScalar(const char* data, std::size_t size, char fourth) {
+    return findInvalidScalar(data, 0, size, fourth);
+}
+
+#else
+
+/**
+ * @brief SSE2 kernel: 16 characters per compare.
+ * @param data The characters to check.
+ * @param size The number of characters.
+ * @param fourth The fourth base in lowercase.
+ * @return The offset of the first invalid character, or size.
+ */
+std::size_t validateSse2(const char* data, std::size_t size, char fourth) {
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i a = _mm_set1_epi8('a');
+    const __m128i c = _mm_set1_epi8('c');
+    const __m128i g = _mm_set1_epi8('g');
+    const __m128i t = _mm_set1_epi8(fourth);
+    std::size_t offset = 0;
+    for (; offset + 16 <= size; offset += 16) {
+        // Only 'X' and 'x' fold onto 'x', so the compares stay exact
+        __m128i v = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)), caseBit);
+        __m128i valid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, c)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, g), _mm_cmpeq_epi8(v, t)));
+        unsigned invalid = ~static_cast<unsigned>(_mm_movemask_epi8(valid)) & 0xffffu;
+        if (invalid != 0) {
+            return offset + __builtin_ctz(invalid);
+        }
+    }
+    return findInvalidScalar(data, offset, size, fourth);
+}
+
+/**
+ * @brief AVX2 kernel: 32 characters per compare.
+ * @param data The characters to check.
+ * @param size The number of characters.
+ * @param fourth The fourth base in lowercase.
+ * @return The offset of the first invalid character, or size.
+ */
+__attribute__((target("avx2")))
+std::size_t validateAvx2(const char* data, std::size_t size, char fourth) {
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i a = _mm256_set1_epi8('a');
+    const __m256i c = _mm256_set1_epi8('c');
+    const __m256i g = _mm256_set1_epi8('g');
+    const __m256i t = _mm256_set1_epi8(fourth);
+    std::size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32) {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset)), caseBit);
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, c)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(v, g), _mm256_cmpeq_epi8(v, t)));
+        unsigned invalid = ~static_cast<unsigned>(_mm256_movemask_epi8(valid));
+        if (invalid != 0) {
+            return offset + __builtin_ctz(invalid);
+        }
+    }
+    return findInvalidScalar(data, offset, size, fourth);
+}
+
+#endif
+
+/**
+ * @struct Kernel
+ * @brief A validation kernel and its name.
+ */
+struct Kernel {
+    std::size_t (*run)(const char*, std::size_t, char); ///< The kernel.
+    const char* name; ///< The name reported by validationKernel().
+};
+
+/**
+ * @brief Picks the widest kernel the CPU supports, once.
+ * @return The kernel.
+ */
+const Kernel& selectKernel() {
+    static const Kernel kernel = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel{validateAvx2, "avx2"};
+        }
+        return Kernel{validateSse2, "sse2"};
+#else
+        return Kernel{validateScalar, "scalar"};
+#endif
+    }();
+    return kernel;
+}
+
+} // namespace
+
+/**
+ * @brief Finds the first character that is not a base of a sequence type.
+ * @param data The characters to check.
+ * @param size The number of characters.
+ * @param type The type of the sequence.
+ * @return The offset of the first invalid character, or size if all are valid.
+ */
+std::size_t findInvalidBase(const char* data, std::size_t size, SequenceType type) {
+    if (type != SequenceType::DNA && type != SequenceType::RNA) {
+        return size;
+    }
+    return selectKernel().run(data, size, type == SequenceType::DNA ? 't' : 'u');
+}
+
+/**
+ * @brief Getter for the name of the validation kernel picked for this CPU.
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char* validationKernel() {
+    return selectKernel().name;
+}
@@ -0,0 +1,27 @@
+#ifndef SEQUENCE_VALIDATOR_H
+#define SEQUENCE_VALIDATOR_H
+
+#include <cstddef>
+#include "sequence_fragment.h"
+
+/**
+ * @brief Finds the first character that is not a base of a sequence type.
+ *
+ * DNA allows A, C, G and T, RNA allows A, C, G and U, in either case. Checks
+ * 32 bytes per compare with AVX2 or 16 with SSE2 when available; other types
+ * are not checked.
+ *
+ * @param data The characters to check.
+ * @param size The number of characters.
+ * @param type The type of the sequence.
+ * @return The offset of the first invalid character, or size if all are valid.
+ */
+std::size_t findInvalidBase(const char* data, std::size_t size, SequenceType type);
+
+/**
+ * @brief Getter for the name of the validation kernel picked for this CPU.
+ * @return "avx2", "sse2" or "scalar".
+ */
+const char* validationKernel();
+
+#endif // SEQUENCE_VALIDATOR_H
@@ -0,0 +1,97 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free queue with one producer thread and one consumer thread.
+ *
+ * The producer only writes the tail and the consumer only writes the head,
+ * each on a cache line of its own, so pushing and popping cost one release
+ * store and no read-modify-write. Each side also caches the other's index
+ * and rereads it only when the queue looks full or empty.
+ * @tparam T The element type, trivially copyable.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * @brief Constructs an empty queue.
+     * @param capacity The most elements held at once, rounded up to a power of two.
+     */
+    explicit SpscQueue(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        elements.reset(new T[size]);
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * @brief Appends an element; called by the producer only.
+     * @param element The element.
+     * @return False if the queue is full.
+     */
+    bool tryPush(const T& element) {
+        std::size_t position = producer.index.load(std::memory_order_relaxed);
+        if (position - producer.cached > mask) {
+            producer.cached = consumer.index.load(std::memory_order_acquire);
+            if (position - producer.cached > mask) {
+                return false;
+            }
+        }
+        elements[position & mask] = element;
+        producer.index.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element; called by the consumer only.
+     * @param element Receives the element.
+     * @return False if the queue is empty.
+     */
+    bool tryPop(T& element) {
+        std::size_t position = consumer.index.load(std::memory_order_relaxed);
+        if (position == consumer.cached) {
+            consumer.cached = producer.index.load(std::memory_order_acquire);
+            if (position == consumer.cached) {
+                return false;
+            }
+        }
+        element = elements[position & mask];
+        consumer.index.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Checks for elements; safe from either side.
+     * @return True if nothing is queued.
+     */
+    bool empty() const {
+        return consumer.index.load(std::memory_order_acquire) == producer.index.load(std::memory_order_acquire);
+    }
+
+private:
+    /**
+     * @struct End
+     * @brief One side's index and its copy of the other side's.
+     */
+    struct alignas(64) End {
+        std::atomic<std::size_t> index{0}; ///< The next element this side pushes or pops.
+        std::size_t cached = 0; ///< The other side's index when last read.
+    };
+
+    End producer; ///< Written by the producer.
+    End consumer; ///< Written by the consumer.
+    std::size_t mask = 0; ///< The capacity minus one.
+    std::unique_ptr<T[]> elements; ///< The ring.
+};
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,172 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace {
+
+thread_local std::size_t workerIndex = static_cast<std::size_t>(-1); ///< The index of the calling worker, if it is one.
+thread_local const void* workerPool = nullptr; ///< The pool the calling worker belongs to.
+
+} // namespace
+
+/**
+ * @brief Starts the workers.
+ * @param threadCount The number of workers, at least one.
+ */
+ThreadPool::ThreadPool(int threadCount)
+    : queued(0), outstanding(0), nextQueue(0), stopping(false) {
+    std::size_t count = static_cast<std::size_t>(std::max(threadCount, 1));
+    for (std::size_t i = 0; i < count; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+/**
+ * @brief Lets the workers finish their queues and joins them.
+ */
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Queues a task.
+ * @param task The task; it may submit further tasks.
+ */
+void ThreadPool::submit(std::function<void()> task) {
+    std::size_t index = workerPool == this ? workerIndex : nextQueue++ % queues.size();
+    outstanding++;
+    {
+        // Count the task under the sleep lock so a worker about to sleep sees it
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+/**
+ * @brief Blocks until every submitted task, and every task they submitted, has run.
+ */
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    idle.wait(lock, [this] { return outstanding == 0; });
+}
+
+/**
+ * @brief Runs a body on the calling thread and on up to helpers idle workers, returning once every run has.
+ *
+ * Safe to call from a worker: helpers still queued when the caller
+ * finishes are skipped, so the caller never waits on its own queue.
+ *
+ * @param helpers The most workers asked to join in.
+ * @param body Run by each participant; it claims its share of the work itself, as from an atomic cursor.
+ */
+void ThreadPool::parallel(std::size_t helpers, const std::function<void()>& body) {
+    struct Group {
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::size_t running = 0;
+        bool closed = false;
+    };
+    auto group = std::make_shared<Group>();
+    for (std::size_t i = 0; i < helpers; ++i) {
+        submit([group, &body] {
+            {
+                std::lock_guard<std::mutex> lock(group->mutex);
+                if (group->closed) {
+                    return;
+                }
+                ++group->running;
+            }
+            body();
+            std::lock_guard<std::mutex> lock(group->mutex);
+            if (--group->running == 0) {
+                group->finished.notify_one();
+            }
+        });
+    }
+    body();
+    // Helpers that have not started by now would find nothing left to do
+    std::unique_lock<std::mutex> lock(group->mutex);
+    group->closed = true;
+    group->finished.wait(lock, [&] { return group->running == 0; });
+}
+
+/**
+ * @brief Getter for the number of workers.
+ * @return The number of workers.
+ */
+int ThreadPool::size() const {
+    return static_cast<int>(workers.size());
+}
+
+/**
+ * @brief Runs tasks until the pool stops.
+ * @param index The index of the worker.
+ */
+void ThreadPool::work(std::size_t index) {
+    workerIndex = index;
+    workerPool = this;
+    std::function<void()> task;
+    while (true) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            if (--outstanding == 0) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued != 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Takes a task from a worker's own queue, or steals one.
+ * @param index The index of the worker.
+ * @param task Receives the task.
+ * @return True if a task was taken.
+ */
+bool ThreadPool::take(std::size_t index, std::function<void()>& task) {
+    {
+        // Newest first from our own queue
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+        // Oldest first from the others
+        Queue& other = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,100 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed set of worker threads that steal work from each other.
+ *
+ * Each worker has its own queue. Tasks submitted from a worker go to the back
+ * of its queue and are run from the back, so follow-up work stays on the warm
+ * thread; an idle worker steals from the front of another worker's queue.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Starts the workers.
+     * @param threadCount The number of workers, at least one.
+     */
+    explicit ThreadPool(int threadCount);
+
+    /**
+     * @brief Lets the workers finish their queues and joins them.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a task.
+     * @param task The task; it may submit further tasks.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Blocks until every submitted task, and every task they submitted, has run.
+     */
+    void wait();
+
+    /**
+     * @brief Runs a body on the calling thread and on up to helpers idle workers, returning once every run has.
+     *
+     * Safe to call from a worker: helpers still queued when the caller
+     * finishes are skipped, so the caller never waits on its own queue.
+     * @param helpers The most workers asked to join in.
+     * @param body Run by each participant; it claims its share of the work itself, as from an atomic cursor.
+     */
+    void parallel(std::size_t helpers, const std::function<void()>& body);
+
+    /**
+     * @brief Getter for the number of workers.
+     * @return The number of workers.
+     */
+    int size() const;
+
+private:
+    /**
+     * @struct Queue
+     * @brief The tasks of one worker.
+     */
+    struct Queue {
+        std::mutex mutex; ///< Guards tasks.
+        std::deque<std::function<void()>> tasks; ///< The queued tasks.
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; ///< One queue per worker.
+    std::vector<std::thread> workers; ///< The worker threads.
+    std::mutex sleepMutex; ///< Guards sleeping and waking.
+    std::condition_variable wake; ///< Signalled when a task is queued or the pool stops.
+    std::condition_variable idle; ///< Signalled when the last outstanding task finishes.
+    std::atomic<std::size_t> queued; ///< The number of tasks waiting in queues.
+    std::atomic<std::size_t> outstanding; ///< The number of tasks submitted but not finished.
+    std::atomic<std::size_t> nextQueue; ///< Round robin cursor for tasks submitted from outside.
+    bool stopping; ///< Set when the pool is destroyed.
+
+    /**
+     * @brief Runs tasks until the pool stops.
+     * @param index The index of the worker.
+     */
+    void work(std::size_t index);
+
+    /**
+     * @brief Takes a task from a worker's own queue, or steals one.
+     * @param index The index of the worker.
+     * @param task Receives the task.
+     * @return True if a task was taken.
+     */
+    bool take(std::size_t index, std::function<void()>& task);
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,182 @@
+#include "translation.h"
+#include <array>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/// The standard genetic code, codons in the usual U, C, A, G order.
+constexpr char kStandardCode[] = "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG";
+
+/**
+ * @brief Where a two-bit code sits in the U, C, A, G order of kStandardCode.
+ * @param code The code: A=0, C=1, G=2, U=3.
+ * @return The index.
+ */
+constexpr int standardIndex(int code) {
+    return code == 0 ? 2 : code == 1 ? 1 : code == 2 ? 3 : 0;
+}
+
+/**
+ * @brief Builds the table from a codon's three two-bit codes, first base in the high bits, to its amino acid.
+ * @return The 64 entry table.
+ */
+constexpr std::array<char, 64> codonTable() {
+    std::array<char, 64> table{};
+    for (int codon = 0; codon < 64; ++codon) {
+        table[codon] = kStandardCode[16 * standardIndex(codon >> 4) + 4 * standardIndex((codon >> 2) & 3) +
+                                     standardIndex(codon & 3)];
+    }
+    return table;
+}
+
+constexpr std::array<char, 64> kCodons = codonTable(); ///< Amino acid of every codon.
+static_assert(kCodons[0x0e] == 'M' && kCodons[0x38] == '*' && kCodons[0x00] == 'K', "AUG, UGA and AAA");
+
+/**
+ * @brief Builds the table from a character to its two-bit code.
+ * @return The table: A=0, C=1, G=2, T and U=3.
+ */
+constexpr std::array<std::uint8_t, 256> letterTable() {
+    std::array<std::uint8_t, 256> table{};
+    table['C'] = 1;
+    table['G'] = 2;
+    table['T'] = 3;
+    table['U'] = 3;
+    return table;
+}
+
+constexpr std::array<std::uint8_t, 256> kLetters = letterTable(); ///< Two-bit code of every letter.
+
+/**
+ * @brief Scalar kernel: one codon at a time through the tables.
+ * @param bases The bases, count + 2 of them.
+ * @param count The number of codons.
+ * @param forward Receives count amino acids.
+ * @param reverse Receives count amino acids.
+ */
+void translateScalar(const char* bases, std::size_t count, char* forward, char* reverse) {
+    for (std::size_t i = 0; i < count; ++i) {
+        unsigned first = kLetters[static_cast<unsigned char>(bases[i])];
+        unsigned second = kLetters[static_cast<unsigned char>(bases[i + 1])];
+        unsigned third = kLetters[static_cast<unsigned char>(bases[i + 2])];
+        forward[i] = kCodons[first << 4 | second << 2 | third];
+        reverse[i] = kCodons[(3 - third) << 4 | (3 - second) << 2 | (3 - first)];
+    }
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @brief Maps 32 letters to their two-bit codes; A, C, G, T and U differ in their low nibble.
+ * @param letters The letters.
+ * @return The codes.
+ */
+__attribute__((target("avx2")))
+inline __m256i letterCodes(__m256i letters) {
+    const __m256i table = _mm256_setr_epi8(0, 0, 0, 1, 3, 3, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 0, 0, 1, 3, 3, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0);
+    return _mm256_shuffle_epi8(table, _mm256_and_si256(letters, _mm256_set1_epi8(0x0f)));
+}
+
+/**
+ * @brief Looks up 32 codons in the 64 entry table, a quarter at a time.
+ * @param codons The codons, 0 to 63.
+ * @param quarters The four 16 entry quarters of the table, each in both lanes.
+ * @return The amino acids.
+ */
+__attribute__((target("avx2")))
+inline __m256i lookupCodons(__m256i codons, const __m256i (&quarters)[4]) {
+    __m256i low = _mm256_and_si256(codons, _mm256_set1_epi8(0x0f));
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(codons, 4), _mm256_set1_epi8(0x03));
+    __m256i result = _mm256_shuffle_epi8(quarters[0], low);
+    for (int quarter = 1; quarter < 4; ++quarter) {
+        __m256i selected = _mm256_cmpeq_epi8(high, _mm256_set1_epi8(static_cast<char>(quarter)));
+        result = _mm256_blendv_epi8(result, _mm256_shuffle_epi8(quarters[quarter], low), selected);
+    }
+    return result;
+}
+
+/**
+ * @brief AVX2 kernel: codes and translates 32 codons of both strands per step.
+ * @param bases The bases, count + 2 of them.
+ * @param count The number of codons.
+ * @param forward Receives count amino acids.
+ * @param reverse Receives count amino acids.
+ */
+__attribute__((target("avx2")))
+void translateAvx2(const char* bases, std::size_t count, char* forward, char* reverse) {
+    __m256i quarters[4];
+    for (int quarter = 0; quarter < 4; ++quarter) {
+        quarters[quarter] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(kCodons.data() + 16 * quarter)));
+    }
+    const __m256i three = _mm256_set1_epi8(3);
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i first = letterCodes(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bases + i)));
+        __m256i second = letterCodes(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bases + i + 1)));
+        __m256i third = letterCodes(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bases + i + 2)));
+        // Codes are at most 3, so 16-bit shifts never carry into the next byte
+        __m256i codons = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(first, 4), _mm256_slli_epi16(second, 2)), third);
+        // The reverse complement reads the bases backwards with each code c turned into 3 - c
+        __m256i complements = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(_mm256_xor_si256(third, three), 4),
+                                                              _mm256_slli_epi16(_mm256_xor_si256(second, three), 2)),
+                                              _mm256_xor_si256(first, three));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(forward + i), lookupCodons(codons, quarters));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(reverse + i), lookupCodons(complements, quarters));
+    }
+    translateScalar(bases + i, count - i, forward + i, reverse + i);
+}
+
+#endif
+
+/**
+ * @struct Kernel
+ * @brief A translation kernel and its name.
+ */
+struct Kernel {
+    void (*run)(const char*, std::size_t, char*, char*); ///< The kernel.
+    const char* name; ///< The name reported by translationKernel().
+};
+
+/**
+ * @brief Picks the widest kernel the CPU supports, once.
+ * @return The kernel.
+ */
+const Kernel& selectKernel() {
+    static const Kernel kernel = [] {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel{translateAvx2, "avx2"};
+        }
+#endif
+        return Kernel{translateScalar, "scalar"};
+    }();
+    return kernel;
+}
+
+} // namespace
+
+/**
+ * @brief Translates every codon of a run of bases, on both strands, in a single pass.
+ * @param bases The bases in uppercase, count + 2 of them.
+ * @param count The number of codons.
+ * @param forward Receives count amino acids.
+ * @param reverse Receives count amino acids.
+ */
+void translateCodons(const char* bases, std::size_t count, char* forward, char* reverse) {
+    selectKernel().run(bases, count, forward, reverse);
+}
+
+/**
+ * @brief Getter for the name of the translation kernel picked for this CPU.
+ * @return "avx2" or "scalar".
+ */
+const char* translationKernel() {
+    return selectKernel().name;
+}
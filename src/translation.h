@@ -0,0 +1,28 @@
+#ifndef TRANSLATION_H
+#define TRANSLATION_H
+
+#include <cstddef>
+
+/**
+ * @brief Translates every codon of a run of bases, on both strands, in a single pass.
+ *
+ * Codon i is bases i to i + 2. Its amino acid goes to forward[i], and that of
+ * its reverse complement to reverse[i], so each reading frame of either
+ * strand is every third entry. Uses the standard genetic code with '*' for
+ * stop codons and reads 'T' as 'U'. Uses an AVX2 shuffle kernel when the CPU
+ * supports one and falls back to scalar code otherwise.
+ *
+ * @param bases The bases in uppercase, count + 2 of them.
+ * @param count The number of codons.
+ * @param forward Receives count amino acids.
+ * @param reverse Receives count amino acids.
+ */
+void translateCodons(const char* bases, std::size_t count, char* forward, char* reverse);
+
+/**
+ * @brief Getter for the name of the translation kernel picked for this CPU.
+ * @return "avx2" or "scalar".
+ */
+const char* translationKernel();
+
+#endif // TRANSLATION_H
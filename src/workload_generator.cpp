@@ -0,0 +1,332 @@
+#include "workload_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+/// The command names, in WorkloadOperation order.
+constexpr const char* kOperationNames[] = {"insert", "remove", "print", "clip", "copy", "swap",
+                                           "transcribe", "stats", "find", "translate", "align"};
+static_assert(sizeof(kOperationNames) / sizeof(kOperationNames[0]) == static_cast<std::size_t>(WorkloadOperation::COUNT),
+              "Every operation needs a name");
+
+constexpr const char* kFrames[] = {"1", "2", "3", "-1", "-2", "-3", "all"}; ///< The frames translate is given.
+
+} // namespace
+
+/**
+ * @brief Constructor for the WorkloadGenerator class
+ * 
+ * @param options What the scripts look like
+ */
+WorkloadGenerator::WorkloadGenerator(const WorkloadOptions& options)
+    : options(options), random(options.seed), slots(static_cast<std::size_t>(std::max(options.slotCount, 1))) {}
+
+/**
+ * @brief Write a script
+ * 
+ * A comment naming the seed comes first. Each command's operation is drawn
+ * by weight from the mix; the slots start empty, so a script usually opens
+ * with inserts. Every draw is made from the raw 64-bit engine output, so a
+ * seed gives the same script with any standard library.
+ * 
+ * @return The commands, one per line
+ */
+std::string WorkloadGenerator::generate() {
+    script = "# Seed " + std::to_string(options.seed) + ", " + std::to_string(options.commandCount) +
+             " commands on positions 0 to " + std::to_string(slots.size() - 1) + "\n";
+    int total = std::accumulate(options.mix.begin(), options.mix.end(), 0);
+    for (int i = 0; i < options.commandCount; ++i) {
+        if (total == 0) {
+            writeInsert();
+            continue;
+        }
+        int chosen = static_cast<int>(draw(0, static_cast<std::size_t>(total - 1)));
+        std::size_t operation = 0;
+        while (chosen >= options.mix[operation]) {
+            chosen -= options.mix[operation++];
+        }
+        writeCommand(static_cast<WorkloadOperation>(operation));
+    }
+    return script;
+}
+
+/**
+ * @brief Read operation weights written as name=weight pairs separated by commas
+ * 
+ * @param text The weights, such as "insert=5,find=1"
+ * @param mix Receives the weights
+ * @return False if a name is unknown or a weight is not a non-negative integer
+ */
+bool WorkloadGenerator::parseMix(std::string_view text,
+                                 std::array<int, static_cast<std::size_t>(WorkloadOperation::COUNT)>& mix) {
+    while (!text.empty()) {
+        std::size_t comma = text.find(',');
+        std::string_view pair = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        std::size_t equals = pair.find('=');
+        if (equals == std::string_view::npos || equals + 1 == pair.size()) {
+            return false;
+        }
+        std::string_view name = pair.substr(0, equals);
+        int weight = 0;
+        for (char c : pair.substr(equals + 1)) {
+            if (c < '0' || c > '9' || weight > 100000) {
+                return false;
+            }
+            weight = weight * 10 + (c - '0');
+        }
+        std::size_t operation = 0;
+        while (operation < mix.size() && name != kOperationNames[operation]) {
+            ++operation;
+        }
+        if (operation == mix.size()) {
+            return false;
+        }
+        mix[operation] = weight;
+    }
+    return true;
+}
+
+/**
+ * @brief Read a length distribution name
+ * 
+ * @param text "fixed", "uniform" or "log"
+ * @param distribution Receives the distribution
+ * @return False if the name is unknown
+ */
+bool WorkloadGenerator::parseDistribution(std::string_view text, LengthDistribution& distribution) {
+    if (text == "fixed") {
+        distribution = LengthDistribution::FIXED;
+    } else if (text == "uniform") {
+        distribution = LengthDistribution::UNIFORM;
+    } else if (text == "log") {
+        distribution = LengthDistribution::LOG;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Getter for the name of an operation
+ * 
+ * @param operation The operation
+ * @return The lowercase command name
+ */
+const char* WorkloadGenerator::operationName(WorkloadOperation operation) {
+    return kOperationNames[static_cast<std::size_t>(operation)];
+}
+
+/**
+ * @brief Write one command of an operation, or an insert if no slot suits it
+ * 
+ * @param operation The operation
+ */
+void WorkloadGenerator::writeCommand(WorkloadOperation operation) {
+    auto occupied = [](const Slot& slot) { return slot.type != 0; };
+    switch (operation) {
+        case WorkloadOperation::REMOVE: {
+            int pos = pickSlot(occupied);
+            if (pos < 0) {
+                break;
+            }
+            slots[pos] = Slot();
+            script += "remove " + std::to_string(pos) + "\n";
+            return;
+        }
+        case WorkloadOperation::PRINT: {
+            int pos = pickSlot(occupied);
+            if (pos < 0) {
+                break;
+            }
+            script += "print " + std::to_string(pos) + "\n";
+            return;
+        }
+        case WorkloadOperation::CLIP: {
+            int pos = pickSlot([](const Slot& slot) { return slot.type != 0 && slot.length > 1; });
+            if (pos < 0) {
+                break;
+            }
+            std::size_t start = draw(1, slots[pos].length - 1);
+            slots[pos].length -= start;
+            script += "clip " + std::to_string(pos) + " " + std::to_string(start) + "\n";
+            return;
+        }
+        case WorkloadOperation::COPY: {
+            int from = pickSlot(occupied);
+            if (from < 0) {
+                break;
+            }
+            int to = static_cast<int>(draw(0, slots.size() - 1));
+            slots[to] = slots[from];
+            script += "copy " + std::to_string(from) + " " + std::to_string(to) + "\n";
+            return;
+        }
+        case WorkloadOperation::SWAP: {
+            int pos1 = pickSlot(occupied);
+            if (pos1 < 0) {
+                break;
+            }
+            char type = slots[pos1].type;
+            int pos2 = pickSlot([&](const Slot& slot) { return slot.type == type && &slot != &slots[pos1]; });
+            if (pos2 < 0) {
+                break;
+            }
+            // Starting past base 0 leaves neither sequence empty
+            std::size_t start1 = draw(1, slots[pos1].length);
+            std::size_t start2 = draw(1, slots[pos2].length);
+            std::size_t length1 = slots[pos1].length;
+            slots[pos1].length = start1 + slots[pos2].length - start2;
+            slots[pos2].length = start2 + length1 - start1;
+            script += "swap " + std::to_string(pos1) + " " + std::to_string(start1) + " " + std::to_string(pos2) + " " +
+                      std::to_string(start2) + "\n";
+            return;
+        }
+        case WorkloadOperation::TRANSCRIBE: {
+            int pos = pickSlot([](const Slot& slot) { return slot.type == 'D'; });
+            if (pos < 0) {
+                break;
+            }
+            slots[pos].type = 'R';
+            script += "transcribe " + std::to_string(pos) + "\n";
+            return;
+        }
+        case WorkloadOperation::STATS: {
+            int pos = pickSlot(occupied);
+            if (pos < 0 || draw(0, 1) == 0) {
+                script += "stats\n";
+            } else {
+                script += "stats " + std::to_string(pos) + "\n";
+            }
+            return;
+        }
+        case WorkloadOperation::FIND: {
+            int pos = pickSlot(occupied);
+            if (pos < 0) {
+                break;
+            }
+            const char* letters = slots[pos].type == 'R' ? "ACGU" : "ACGT";
+            std::size_t length = draw(8, 16);
+            std::string pattern;
+            for (std::size_t i = 0; i < length; ++i) {
+                pattern.push_back(letters[draw(0, 3)]);
+            }
+            std::string where = draw(0, 3) == 0 ? "all" : std::to_string(pos);
+            script += "find " + where + " " + pattern + " " + std::to_string(draw(0, 2)) + "\n";
+            return;
+        }
+        case WorkloadOperation::TRANSLATE: {
+            int pos = pickSlot([](const Slot& slot) { return slot.type == 'R'; });
+            if (pos < 0) {
+                break;
+            }
+            script += "translate " + std::to_string(pos) + " " + kFrames[draw(0, 6)] + "\n";
+            return;
+        }
+        case WorkloadOperation::ALIGN: {
+            std::size_t cells = options.maxAlignCells;
+            int pos1 = pickSlot([&](const Slot& slot) { return slot.type != 0 && slot.length <= cells; });
+            if (pos1 < 0) {
+                break;
+            }
+            std::size_t length1 = slots[pos1].length;
+            int pos2 = pickSlot([&](const Slot& slot) { return slot.type != 0 && slot.length * length1 <= cells; });
+            if (pos2 < 0) {
+                break;
+            }
+            script += "align " + std::to_string(pos1) + " " + std::to_string(pos2) +
+                      (draw(0, 1) == 0 ? " local\n" : " global\n");
+            return;
+        }
+        default:
+            break;
+    }
+    writeInsert();
+}
+
+/**
+ * @brief Write an insert of a random sequence at a random position
+ * 
+ * Four in five inserts are DNA; the rest are RNA, spelled with 'U'.
+ */
+void WorkloadGenerator::writeInsert() {
+    int pos = static_cast<int>(draw(0, slots.size() - 1));
+    bool rna = draw(0, 4) == 0;
+    const char* letters = rna ? "ACGU" : "ACGT";
+    std::size_t length = drawLength();
+    script += "insert " + std::to_string(pos) + (rna ? " RNA " : " DNA ");
+    std::size_t start = script.size();
+    script.resize(start + length);
+    for (std::size_t i = 0; i < length; i += 32) {
+        // One draw gives 32 bases
+        std::uint64_t bits = random();
+        for (std::size_t j = i; j < std::min(length, i + 32); ++j, bits >>= 2) {
+            script[start + j] = letters[bits & 3];
+        }
+    }
+    script += "\n";
+    slots[pos] = Slot{rna ? 'R' : 'D', length};
+}
+
+/**
+ * @brief Pick a random position whose slot passes a test
+ * 
+ * @param test The test
+ * @return The position, or -1 if none passes
+ */
+template <typename Test>
+int WorkloadGenerator::pickSlot(Test test) {
+    std::size_t count = 0;
+    for (const Slot& slot : slots) {
+        count += test(slot) ? 1 : 0;
+    }
+    if (count == 0) {
+        return -1;
+    }
+    std::size_t chosen = draw(0, count - 1);
+    for (std::size_t pos = 0; pos < slots.size(); ++pos) {
+        if (test(slots[pos]) && chosen-- == 0) {
+            return static_cast<int>(pos);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Draw an inserted sequence length
+ * 
+ * @return The length, between the minimum and the maximum
+ */
+std::size_t WorkloadGenerator::drawLength() {
+    std::size_t low = std::max<std::size_t>(options.minLength, 1);
+    std::size_t high = std::max(options.maxLength, low);
+    switch (options.distribution) {
+        case LengthDistribution::FIXED:
+            return high;
+        case LengthDistribution::UNIFORM:
+            return draw(low, high);
+        case LengthDistribution::LOG: {
+            double fraction = static_cast<double>(random() >> 11) / static_cast<double>(std::uint64_t(1) << 53);
+            double lowest = std::log10(static_cast<double>(low));
+            double exponent = lowest + fraction * (std::log10(static_cast<double>(high)) - lowest);
+            auto length = static_cast<std::size_t>(std::pow(10.0, exponent));
+            return std::min(std::max(length, low), high);
+        }
+    }
+    return high;
+}
+
+/**
+ * @brief Draw an integer
+ * 
+ * @param low The smallest value
+ * @param high The largest value
+ * @return The value
+ */
+std::size_t WorkloadGenerator::draw(std::size_t low, std::size_t high) {
+    std::uint64_t span = static_cast<std::uint64_t>(high - low) + 1;
+    return low + static_cast<std::size_t>(span == 0 ? random() : random() % span);
+}
@@ -0,0 +1,152 @@
+#ifndef WORKLOAD_GENERATOR_H
+#define WORKLOAD_GENERATOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum WorkloadOperation
+ * @brief The commands a generated script is drawn from.
+ */
+enum class WorkloadOperation : std::uint8_t {
+    INSERT,
+    REMOVE,
+    PRINT,
+    CLIP,
+    COPY,
+    SWAP,
+    TRANSCRIBE,
+    STATS,
+    FIND,
+    TRANSLATE,
+    ALIGN,
+    COUNT ///< The number of operations.
+};
+
+/**
+ * @enum LengthDistribution
+ * @brief How the lengths of inserted sequences are drawn between the minimum and the maximum.
+ */
+enum class LengthDistribution : std::uint8_t {
+    FIXED,   ///< Always the maximum.
+    UNIFORM, ///< Every length equally likely.
+    LOG      ///< Every power of ten equally likely, as with many short reads and a few long references.
+};
+
+/**
+ * @struct WorkloadOptions
+ * @brief What a generated script looks like.
+ */
+struct WorkloadOptions {
+    std::uint64_t seed = 1; ///< The seed; equal options give equal scripts.
+    int commandCount = 1000; ///< The number of commands.
+    int slotCount = 8; ///< The positions used, from 0; run the script with at least this -m.
+    LengthDistribution distribution = LengthDistribution::LOG; ///< How inserted lengths are drawn.
+    std::size_t minLength = 10; ///< The shortest inserted sequence.
+    std::size_t maxLength = 100000; ///< The longest inserted sequence.
+    std::size_t maxAlignCells = 10000000; ///< The largest product of lengths an align may have.
+    /// The relative weight of each operation, in WorkloadOperation order.
+    std::array<int, static_cast<std::size_t>(WorkloadOperation::COUNT)> mix{{20, 5, 5, 10, 10, 10, 5, 10, 10, 5, 10}};
+};
+
+/**
+ * @class WorkloadGenerator
+ * @brief Writes seeded command scripts with a tunable mix of operations, slot count and sequence lengths.
+ *
+ * The generator follows what each slot holds, so every command it writes is
+ * valid when it runs: clips and swaps stay within the sequences, transcribe
+ * gets DNA and translate RNA. An operation with no slot it can use is
+ * written as an insert instead.
+ */
+class WorkloadGenerator {
+public:
+    /**
+     * @brief Constructor for the WorkloadGenerator class.
+     * @param options What the scripts look like.
+     */
+    explicit WorkloadGenerator(const WorkloadOptions& options);
+
+    /**
+     * @brief Writes a script.
+     * @return The commands, one per line.
+     */
+    std::string generate();
+
+    /**
+     * @brief Reads operation weights written as name=weight pairs separated by commas, such as "insert=5,find=1".
+     * @param text The weights; operations not named keep their weight.
+     * @param mix Receives the weights.
+     * @return False if a name is unknown or a weight is not a non-negative integer.
+     */
+    static bool parseMix(std::string_view text, std::array<int, static_cast<std::size_t>(WorkloadOperation::COUNT)>& mix);
+
+    /**
+     * @brief Reads a length distribution name.
+     * @param text "fixed", "uniform" or "log".
+     * @param distribution Receives the distribution.
+     * @return False if the name is unknown.
+     */
+    static bool parseDistribution(std::string_view text, LengthDistribution& distribution);
+
+    /**
+     * @brief Getter for the name of an operation.
+     * @param operation The operation.
+     * @return The lowercase command name.
+     */
+    static const char* operationName(WorkloadOperation operation);
+
+private:
+    /**
+     * @struct Slot
+     * @brief What the script has placed at a position.
+     */
+    struct Slot {
+        char type = 0; ///< 'D' for DNA, 'R' for RNA, 0 when empty.
+        std::size_t length = 0; ///< The number of bases.
+    };
+
+    WorkloadOptions options; ///< What the scripts look like.
+    std::mt19937_64 random; ///< The seeded source of every choice.
+    std::vector<Slot> slots; ///< What each position holds.
+    std::string script; ///< The script being written.
+
+    /**
+     * @brief Writes one command of an operation, or an insert if no slot suits it.
+     * @param operation The operation.
+     */
+    void writeCommand(WorkloadOperation operation);
+
+    /**
+     * @brief Writes an insert of a random sequence at a random position.
+     */
+    void writeInsert();
+
+    /**
+     * @brief Picks a random position whose slot passes a test.
+     * @param test The test.
+     * @return The position, or -1 if none passes.
+     */
+    template <typename Test>
+    int pickSlot(Test test);
+
+    /**
+     * @brief Draws an inserted sequence length.
+     * @return The length.
+     */
+    std::size_t drawLength();
+
+    /**
+     * @brief Draws an integer.
+     * @param low The smallest value.
+     * @param high The largest value.
+     * @return The value.
+     */
+    std::size_t draw(std::size_t low, std::size_t high);
+};
+
+#endif // WORKLOAD_GENERATOR_H